@@ -0,0 +1,77 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <SDL2/SDL.h>
+#include "chip8.h"
+
+// Output stream parameters.
+#define AUDIO_SAMPLE_RATE 44100
+#define AUDIO_BUFFER_SAMPLES 512
+#define AUDIO_SAMPLES_PER_FRAME (AUDIO_SAMPLE_RATE / TIMER_FREQUENCY)
+
+// Buzzer tone parameters.
+#define AUDIO_TONE_FREQUENCY 440.0f
+#define AUDIO_TONE_VOLUME 0.15f
+#define AUDIO_DECLICK_STEP (1.0f / 64.0f)  // Gain change per sample when toggling the tone
+
+// Number of per-frame tone states the ring can hold (must be a power of two).
+#define AUDIO_RING_SIZE 64
+
+// Most frames queued ahead of the one playing; older ones are skipped so tone changes are heard on time.
+#define AUDIO_MAX_LAG_FRAMES 2
+
+/**
+ * Single-producer/single-consumer ring of per-frame tone states.
+ *
+ * The emulation thread is the only writer of `head`, the audio callback is the
+ * only writer of `tail`, so neither side ever takes a lock. When the emulation
+ * runs ahead of the callback, the callback skips all but the last
+ * AUDIO_MAX_LAG_FRAMES states.
+ */
+typedef struct {
+    uint8_t states[AUDIO_RING_SIZE];  // Tone on/off for each emulated frame
+    SDL_atomic_t head;                // Next slot to write (producer)
+    SDL_atomic_t tail;                // Next slot to read (consumer)
+} AudioRing;
+
+typedef struct {
+    SDL_AudioDeviceID device;  // 0 when no device could be opened
+    AudioRing ring;            // Tone states pushed by the emulator
+    float phase;               // Oscillator phase in [0, 1), callback only
+    float gain;                // Current declick gain, callback only
+    uint8_t tone;              // Tone state of the frame being played, callback only
+    int samples_left;          // Samples left in the frame being played, callback only
+} Audio;
+
+/**
+ * @brief Opens the default SDL audio device and starts playback.
+ *
+ * Failure to open a device is not fatal: the emulator simply runs silent.
+ *
+ * @param audio Pointer to the Audio struct to initialize. Must stay at a fixed
+ *              address until audio_close() is called.
+ * @return 1 if an audio device was opened, 0 otherwise.
+ */
+int audio_init(Audio *audio);
+
+/**
+ * @brief Queues the tone state for one emulated frame.
+ *
+ * Never blocks: if the audio callback has fallen behind and the ring is full,
+ * the state is dropped. States queued faster than they are played are skipped
+ * by the callback, so the tone lags the emulation by at most
+ * AUDIO_MAX_LAG_FRAMES frames.
+ *
+ * @param audio Pointer to the Audio struct.
+ * @param tone 1 if the buzzer sounds during this frame, 0 otherwise.
+ */
+void audio_push_frame(Audio *audio, uint8_t tone);
+
+/**
+ * @brief Stops playback and closes the audio device.
+ *
+ * @param audio Pointer to the Audio struct.
+ */
+void audio_close(Audio *audio);
+
+#endif // AUDIO_H
@@ -7,6 +7,10 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "display_row.h"
+#include "chip8_quirks.h"
+#include "chip8_ram.h"
+
 #ifdef _WIN32
     #include <windows.h>
     #define sleep_ms(ms) Sleep(ms)  // Sleep function for Windows
@@ -16,51 +20,130 @@
 #endif
 
 // Define constants for CHIP-8 emulator
-#define RAM_SIZE 4096
+#define RAM_SIZE 65536  // Largest address space (XO-CHIP)
+#define CHIP8_RAM_SIZE 4096
+#define XOCHIP_RAM_SIZE 65536
 #define REGISTERS_SIZE 16
+#define FLAG_REGISTERS_SIZE 16
 #define STACK_SIZE 16
 #define MEMORY_READ_START 512
 #define PROGRAM_MEMORY_SIZE (RAM_SIZE - MEMORY_READ_START)
 #define FONT_SET_START 0
 #define FONT_SET_SIZE 80 // 16 characters * 5 bytes each
+#define BIG_FONT_SET_START (FONT_SET_START + FONT_SET_SIZE)
+#define BIG_FONT_SET_SIZE 160 // 16 characters * 10 bytes each
 #define KEYBOARD_SIZE 16
 #define DISPLAY_WIDTH 64
 #define DISPLAY_HEIGHT 32
-#define OPCODE_AMOUNT 34
+#define DISPLAY_HIRES_WIDTH 128
+#define DISPLAY_HIRES_HEIGHT 64
+#define DISPLAY_PLANES 2
+#define AUDIO_PATTERN_SIZE 16
+#define OPCODE_AMOUNT 50
 #define CPU_FREQUENCY 500  // 500 Hz for the main loop
 #define TIMER_FREQUENCY 60  // 60 Hz for timer updates
 #define TIME_PER_TICK_MS (1000 / CPU_FREQUENCY)  // Time per tick in milliseconds
 #define TIME_PER_TIMER_TICK_MS (1000 / TIMER_FREQUENCY)  // Timer update interval in milliseconds
+#define CYCLES_PER_FRAME (CPU_FREQUENCY / TIMER_FREQUENCY)  // Instructions per timer update
 
 /**
- * Structure representing the state of the CHIP-8 emulator.
+ * Platforms the emulator can run programs for. Values are bit flags so the
+ * opcode table can list every platform an instruction exists on.
+ */
+typedef enum {
+    PLATFORM_CHIP8 = 1 << 0,    // Original CHIP-8, 64x32, 4 KB RAM
+    PLATFORM_SCHIP = 1 << 1,    // SUPER-CHIP 1.1, adds 128x64 mode and scrolling
+    PLATFORM_XOCHIP = 1 << 2,   // XO-CHIP, adds 64 KB RAM and a second bitplane
+} Chip8Platform;
+
+#define PLATFORM_ALL (PLATFORM_CHIP8 | PLATFORM_SCHIP | PLATFORM_XOCHIP)
+#define PLATFORM_SUPER (PLATFORM_SCHIP | PLATFORM_XOCHIP)
+
+/**
+ * Idle states reported by chip8_idle_state().
+ */
+typedef enum {
+    CHIP8_RUNNING,          // The next instructions may change the machine state
+    CHIP8_IDLE_TIMER,       // Side-effect-free loop, nothing changes before the next timer update
+    CHIP8_IDLE_HALTED,      // Jump to itself with both timers expired, nothing will ever change
+    CHIP8_IDLE_KEY,         // Fx0A is waiting and the keyboard did not change since it last looked
+} Chip8IdleState;
+
+/**
+ * Structure representing an opcode.
  */
 typedef struct {
+    uint16_t instruction;  // Full opcode instruction
+    uint16_t nnn;          // Address
+    uint8_t n;             // 4-bit nibble
+    uint8_t x;             // 4-bit x register
+    uint8_t y;             // 4-bit y register
+    uint8_t kk;            // 8-bit immediate value
+} Opcode;
+
+typedef struct Chip8 Chip8;
+typedef struct Chip8Watch Chip8Watch;
+typedef struct Chip8Snapshot Chip8Snapshot;
+typedef struct Chip8ForkTracker Chip8ForkTracker;
+typedef struct Chip8StateHash Chip8StateHash;
+
+/* Opcode handler function */
+typedef void (*Chip8Handler)(Chip8 *chip8, Opcode *opcode);
+
+/**
+ * Structure representing the state of the CHIP-8 emulator.
+ */
+struct Chip8 {
     uint8_t stack_pointer;              // Stack pointer
     uint8_t sound_timer;                // Sound timer
     uint8_t delay_timer;                // Delay timer
     uint16_t i_register;                // Index register
     uint16_t program_counter;           // Program counter
-    uint8_t ram[RAM_SIZE];              // RAM memory
+    uint16_t address_mask;              // Highest valid RAM address for the platform
+    uint8_t platform;                   // Chip8Platform being emulated
+    uint8_t quirks;                     // Chip8QuirkProfile the handlers were taken from
+    Chip8Handler handlers[OPCODE_AMOUNT + 1]; // Handler per opcode id, NULL if unavailable
+    uint8_t *ram;                       // RAM memory, index it with chip8_ram_index()
+    Chip8Ram memory;                    // Backing of ram
     uint8_t v[REGISTERS_SIZE];          // V registers
+    uint8_t flags[FLAG_REGISTERS_SIZE]; // SUPER-CHIP flag registers (Fx75/Fx85)
     uint16_t stack[STACK_SIZE];         // Stack
     uint16_t keys;                      // Keyboard state (bitfield)
-    uint64_t display[DISPLAY_HEIGHT];   // Display
-    clock_t timer;                      // Timer
+    uint8_t key_wait;                   // Set while Fx0A waits for a key press and release
+    uint16_t key_wait_held;             // Keys held when Fx0A last looked at the keyboard
+    uint16_t key_wait_pressed;          // Keys pressed since Fx0A started waiting
+    DisplayRow display[DISPLAY_PLANES][DISPLAY_HIRES_HEIGHT]; // Display bitplanes
+    uint8_t hires;                      // 1 in 128x64 mode, 0 in 64x32 mode
+    uint8_t planes;                     // Bitplanes selected for drawing (bitfield)
+    uint8_t audio_pattern[AUDIO_PATTERN_SIZE]; // XO-CHIP audio pattern buffer
+    uint8_t pitch;                      // XO-CHIP audio pitch register
+    uint32_t random_state;              // Cxkk random number generator state (xorshift32), never 0
+    uint8_t exited;                     // Set once the program executed 00FD
+    uint8_t trapped;                    // Set by a debugger callback to stop the program after the current instruction
+    Chip8Watch *watch;                  // Write watchpoints, NULL when none are attached
+    Chip8Snapshot *snapshot;            // Snapshot recording dirty RAM pages, NULL when none is attached
+    Chip8ForkTracker *fork_tracker;     // RAM pages shared with forks, NULL when not tracked
+    Chip8StateHash *state_hash;         // Rolling hash following RAM and display writes, NULL when none is attached
+    clock_t timer;                      // Instructions executed since the last timer update
     uint8_t display_changed;            // Flag for redrawing display only if needed
-} Chip8;
+};
 
 /**
- * Structure representing an opcode.
+ * @brief Index into Chip8.ram of the byte `offset` bytes past a guest address, wrapping around RAM.
+ *
+ * Where RAM is mirrored only the address is masked and the mirror absorbs the
+ * offset, in a heap buffer the sum is masked.
+ *
+ * @param chip8 Pointer to the Chip8 structure.
+ * @param address Guest address of the first byte of the access, any 16-bit value.
+ * @param offset Bytes past the first one, below CHIP8_RAM_OVERRUN.
  */
-typedef struct {
-    uint16_t instruction;  // Full opcode instruction
-    uint16_t nnn;          // Address
-    uint8_t n;             // 4-bit nibble
-    uint8_t x;             // 4-bit x register
-    uint8_t y;             // 4-bit y register
-    uint8_t kk;            // 8-bit immediate value
-} Opcode;
+static inline uint32_t chip8_ram_index(const Chip8 *chip8, uint16_t address, uint32_t offset) {
+    if (chip8->memory.reserved != 0) {
+        return (uint32_t)(address & chip8->address_mask) + offset;
+    }
+    return (address + offset) & chip8->address_mask;
+}
 
 /**
  * Structure for opcode handling.
@@ -68,28 +151,106 @@ typedef struct {
 typedef struct {
     uint16_t opcode_prefix;                       // The prefix to match
     uint16_t mask;                                // Mask to isolate relevant bits
-    void (*handler)(Chip8 *chip8, Opcode *opcode);  // Handler function
+    Chip8Handler handler;                         // Handler function
+    uint8_t platforms;                            // Chip8Platform flags the opcode exists on
 } OpcodeEntry;
 
 /* Font set used by CHIP-8 */
 extern const uint8_t chip8_font_set[FONT_SET_SIZE];
 
-/* Opcode table for CHIP-8 */
+/* Large 8x10 font set used by SUPER-CHIP and XO-CHIP */
+extern const uint8_t chip8_big_font_set[BIG_FONT_SET_SIZE];
+
+/* Opcode table for CHIP-8, indexed by opcode id, using the chip8 quirk profile */
 extern const OpcodeEntry opcode_table[OPCODE_AMOUNT];
 
+/* Opcode table of every quirk profile, indexed by Chip8QuirkProfile */
+extern const OpcodeEntry *const quirk_profile_tables[QUIRK_PROFILE_AMOUNT];
+
 /**
- * Initialize a CHIP-8 structure with default values.
+ * Initialize a CHIP-8 structure with default values, exiting if its RAM cannot be allocated.
  * 
  * @param chip8 Pointer to the Chip8 structure to initialize.
  */
 void chip8_init(Chip8 *chip8);
 
+/**
+ * Initialize a CHIP-8 structure with default values for a platform.
+ * The RAM is mapped once, for the address space of that platform.
+ * 
+ * @param chip8 Pointer to the Chip8 structure to initialize.
+ * @param platform One of the Chip8Platform values.
+ * @return 1 on success, 0 with errno set if the RAM could not be allocated.
+ */
+int chip8_init_platform(Chip8 *chip8, uint8_t platform);
+
+/**
+ * Release the memory held by a CHIP-8 structure.
+ * 
+ * @param chip8 Pointer to the Chip8 structure to release.
+ */
+void chip8_destroy(Chip8 *chip8);
+
+/**
+ * Select the quirk profile whose specialized handlers execute the program.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @param quirks One of the Chip8QuirkProfile values.
+ */
+void chip8_set_quirks(Chip8 *chip8, uint8_t quirks);
+
+/**
+ * Put back the handler a layer swapped for its wrapper, e.g. when a snapshot
+ * is released. If another layer wrapped the wrapper since, the wrapper is
+ * spliced out of that layer's originals instead, so layers can be detached in
+ * any order.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @param opcode Opcode id whose handler the layer wrapped.
+ * @param wrapper Handler of the layer.
+ * @param original Handler the wrapper calls.
+ */
+void chip8_unwrap_handler(Chip8 *chip8, uint8_t opcode, Chip8Handler wrapper, Chip8Handler original);
+
+/**
+ * Seed the random number generator of Cxkk. Every instance has its own, so a
+ * seeded run draws the same numbers in any thread.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @param seed Any value; nearby seeds give unrelated sequences.
+ */
+void chip8_seed_random(Chip8 *chip8, uint32_t seed);
+
+/**
+ * Get the width of the display in the current resolution.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @return 128 in high resolution, 64 otherwise.
+ */
+uint8_t chip8_display_width(Chip8 *chip8);
+
+/**
+ * Get the height of the display in the current resolution.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @return 64 in high resolution, 32 otherwise.
+ */
+uint8_t chip8_display_height(Chip8 *chip8);
+
+/**
+ * Number of program bytes that fit in the RAM of a platform.
+ * 
+ * @param platform One of the Chip8Platform values.
+ * @return Bytes from MEMORY_READ_START to the end of RAM.
+ */
+size_t chip8_program_capacity(uint8_t platform);
+
 /**
  * Load a program into CHIP-8's RAM.
  * 
  * @param chip8 Pointer to the Chip8 structure.
  * @param program Pointer to the program data.
- * @param program_size Size of the program data.
+ * @param program_size Size of the program data, cut to chip8_program_capacity() of the platform.
  */
 void chip8_load_ram(Chip8 *chip8, const uint8_t *program, size_t program_size);
 
@@ -139,7 +300,7 @@ void chip8_set_keyboard_state(Chip8 *chip8, uint8_t key_index, uint8_t state);
  * @param chip8 Pointer to the Chip8 structure.
  * @param x_pos X position of the pixel.
  * @param y_pos Y position of the pixel.
- * @return 1 if the pixel is set, 0 otherwise.
+ * @return Bitplane bits of the pixel (bit 0 for plane 1, bit 1 for plane 2), 0 if unset.
  */
 uint8_t chip8_get_display_state(Chip8 *chip8, uint8_t x_pos, uint8_t y_pos);
 
@@ -149,7 +310,7 @@ uint8_t chip8_get_display_state(Chip8 *chip8, uint8_t x_pos, uint8_t y_pos);
  * @param chip8 Pointer to the Chip8 structure.
  * @param x_pos X position of the pixel.
  * @param y_pos Y position of the pixel.
- * @param state State to set (1 for on, 0 for off).
+ * @param state Bitplane bits to set (bit 0 for plane 1, bit 1 for plane 2).
  */
 void chip8_set_display_state(Chip8 *chip8, uint8_t x_pos, uint8_t y_pos, uint8_t state);
 
@@ -170,6 +331,36 @@ Opcode chip8_fetch_opcode(Chip8 *chip8);
  */
 int chip8_execute_opcode(Chip8 *chip8, Opcode *opcode);
 
+/**
+ * Fetch and execute the next instruction without waiting for the next tick.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @return 0 if the opcode was handled, 1 otherwise.
+ */
+int chip8_step(Chip8 *chip8);
+
+/**
+ * Detect whether the program is spinning in a loop that only the timers can end:
+ * a jump to itself, or the delay timer polling loop Fx07; 3x00; 1nnn. A waiting
+ * Fx0A is idle until the keyboard state changes.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @return One of the Chip8IdleState values.
+ */
+uint8_t chip8_idle_state(Chip8 *chip8);
+
+/**
+ * Skip whole iterations of an idle loop instead of executing them. Timer updates
+ * falling inside the skipped instructions are applied, the final instructions
+ * that may leave the loop are left to be executed normally. A waiting Fx0A is
+ * skipped for up to max_cycles, only a keyboard change can end it.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @param max_cycles Maximum number of instructions to skip.
+ * @return Number of instructions skipped, 0 if the program is not idle.
+ */
+uint32_t chip8_fast_forward(Chip8 *chip8, uint32_t max_cycles);
+
 /**
  * Wait to maintain a constant CPU frequency.
  */
@@ -0,0 +1,110 @@
+#ifndef CHIP8_BATCH_H
+#define CHIP8_BATCH_H
+
+#include "chip8.h"
+#include "chip8_fork.h"
+
+#define BATCH_MAGIC 0x43384254  // Identifies a step buffer
+#define BATCH_OBSERVATION_WIDTH 64
+#define BATCH_OBSERVATION_HEIGHT 32
+#define BATCH_OBSERVATION_SIZE (BATCH_OBSERVATION_WIDTH * BATCH_OBSERVATION_HEIGHT / 8)
+
+/**
+ * Start of the step buffer, followed by one Chip8BatchRecord per instance.
+ */
+typedef struct {
+    uint32_t magic;             // BATCH_MAGIC
+    uint32_t count;             // Number of instances
+    uint32_t record_size;       // sizeof(Chip8BatchRecord)
+    uint32_t observation_size;  // BATCH_OBSERVATION_SIZE
+    uint64_t steps;             // Completed steps, updated after the records
+} Chip8BatchHeader;
+
+/**
+ * Result of the last step of one instance.
+ */
+typedef struct {
+    uint8_t observation[BATCH_OBSERVATION_SIZE]; // 32 rows of 8 bytes, pixel 0 in the top bit of the first byte
+    int32_t reward;                              // Change of the score during the step
+    uint8_t done;                                // 1 if the episode ended, the next step starts a new one
+    uint8_t padding[3];
+} Chip8BatchRecord;
+
+/**
+ * Where rewards and episode ends are read from.
+ */
+typedef struct {
+    uint16_t reward_address;  // First byte of the score in RAM
+    uint8_t reward_size;      // Bytes of the big-endian score (1, 2 or 4), 0 for no rewards
+    int32_t done_address;     // RAM byte that ends an episode when it equals done_value, -1 for none
+    uint8_t done_value;       // Value of done_address that ends an episode
+} Chip8BatchConfig;
+
+/**
+ * Instances stepped together for reinforcement learning.
+ *
+ * Every instance starts from the same initial fork, so a reset only copies
+ * the RAM pages the episode wrote. Results are written into a buffer laid out
+ * as a Chip8BatchHeader followed by the records; when the batch creates the
+ * buffer itself it is a memfd that a trainer process can map, and `event_fd`
+ * is signalled after every step.
+ */
+typedef struct {
+    int count;                    // Number of instances
+    Chip8 *instances;             // The instances
+    Chip8ForkTracker *trackers;   // RAM pages each instance shares with initial
+    Chip8Fork *initial;           // State every episode starts from
+    uint32_t *scores;             // Score of each instance after its last step
+    Chip8BatchConfig config;      // Reward and episode end addresses
+    Chip8BatchHeader *header;     // Start of the step buffer
+    Chip8BatchRecord *records;    // Records in the step buffer
+    size_t buffer_size;           // Size of the step buffer
+    uint8_t owns_buffer;          // 1 if the batch created the step buffer
+    int shm_fd;                   // memfd holding the step buffer, -1 if the caller provided it
+    int event_fd;                 // eventfd signalled after every step, -1 without a memfd
+} Chip8Batch;
+
+/**
+ * @brief Returns the size of the step buffer of a batch.
+ *
+ * @param count Number of instances.
+ * @return Size in bytes.
+ */
+size_t chip8_batch_buffer_size(int count);
+
+/**
+ * @brief Creates the instances of a batch, all running the same program.
+ *
+ * @param batch Pointer to the Chip8Batch to initialize.
+ * @param count Number of instances.
+ * @param platform Chip8Platform of the instances.
+ * @param quirks Chip8QuirkProfile of the instances.
+ * @param program Program bytes, loaded at MEMORY_READ_START.
+ * @param program_size Number of program bytes.
+ * @param config Where rewards and episode ends are read from.
+ * @param buffer Step buffer of chip8_batch_buffer_size() bytes, NULL to create a shared memfd.
+ * @return 1 on success, 0 if out of memory or the RAM of an instance could not be mapped.
+ */
+int chip8_batch_init(Chip8Batch *batch, int count, uint8_t platform, uint8_t quirks,
+                     const uint8_t *program, size_t program_size, const Chip8BatchConfig *config, void *buffer);
+
+/**
+ * @brief Advances every instance and writes the observations, rewards and done flags.
+ *
+ * Instances whose episode ended in the previous step are reset first. The keys
+ * of each action are held for the whole step.
+ *
+ * @param batch Pointer to the Chip8Batch.
+ * @param actions Keyboard bitfield per instance, bit n for key n.
+ * @param frames_per_step Number of 60 Hz frames each instance runs.
+ */
+void chip8_batch_step(Chip8Batch *batch, const uint16_t *actions, uint32_t frames_per_step);
+
+/**
+ * @brief Releases the instances and the step buffer if the batch created it.
+ *
+ * @param batch Pointer to the Chip8Batch.
+ */
+void chip8_batch_free(Chip8Batch *batch);
+
+#endif // CHIP8_BATCH_H
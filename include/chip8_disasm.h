@@ -0,0 +1,128 @@
+#ifndef CHIP8_DISASM_H
+#define CHIP8_DISASM_H
+
+#include "chip8.h"
+
+// Classification of each address in Chip8Disasm.map.
+#define DISASM_CODE        0x01  // Byte of a reachable instruction
+#define DISASM_INSTRUCTION 0x02  // First byte of a reachable instruction
+#define DISASM_LEADER      0x04  // Jumped, called or skipped to: starts a basic block
+#define DISASM_FUNCTION    0x08  // Program start or 2nnn target
+#define DISASM_DATA_REF    0x10  // Loaded into I by Annn or F000 nnnn
+
+// Findings about the instruction at an address, in Chip8Disasm.flags.
+#define DISASM_FLAG_INDIRECT  0x01  // Bnnn: the successor depends on V0 (or Vx)
+#define DISASM_FLAG_SMC       0x02  // Writes RAM that holds reachable code
+#define DISASM_FLAG_MAYBE_SMC 0x04  // Writes RAM through an I the analysis could not follow
+#define DISASM_FLAG_INVALID   0x08  // Reached, but not an instruction of the platform
+
+/**
+ * How control leaves a basic block.
+ */
+typedef enum {
+    DISASM_EXIT_FALLTHROUGH,  // Runs into the next block
+    DISASM_EXIT_JUMP,         // 1nnn
+    DISASM_EXIT_CALL,         // 2nnn, continues after the call
+    DISASM_EXIT_SKIP,         // Conditional skip, two successors
+    DISASM_EXIT_RETURN,       // 00EE
+    DISASM_EXIT_INDIRECT,     // Bnnn
+    DISASM_EXIT_HALT,         // 00FD or an invalid instruction
+    DISASM_EXIT_AMOUNT
+} Chip8DisasmExit;
+
+/**
+ * Straight-line run of reachable instructions.
+ */
+typedef struct {
+    uint16_t start;           // Address of the first instruction
+    uint16_t end;             // Address after the last instruction
+    uint16_t instructions;    // Number of instructions
+    uint16_t function;        // Entry of the subroutine the block was first reached from
+    uint16_t call;            // Callee of a DISASM_EXIT_CALL block
+    uint16_t successors[2];   // Blocks control continues with
+    uint8_t successor_count;  // Number of successors
+    uint8_t exit;             // Chip8DisasmExit
+    uint8_t flags;            // DISASM_FLAG_* of all instructions in the block
+} Chip8DisasmBlock;
+
+/**
+ * Static analysis of a program image.
+ *
+ * Code is found by recursive descent from MEMORY_READ_START: jumps, calls and
+ * both sides of every skip are followed, Bnnn is not. Whatever the descent
+ * never reaches is treated as data.
+ */
+typedef struct {
+    uint8_t memory[RAM_SIZE];    // Program image at MEMORY_READ_START
+    uint8_t map[RAM_SIZE];       // DISASM_* classification of each address
+    uint8_t flags[RAM_SIZE];     // DISASM_FLAG_* of the instruction at each address
+    uint32_t size;               // Address space of the platform
+    uint32_t program_end;        // Address after the last program byte
+    uint8_t platform;            // Chip8Platform the program was decoded for
+    Chip8DisasmBlock *blocks;    // Basic blocks in address order
+    int block_count;             // Number of basic blocks
+} Chip8Disasm;
+
+/**
+ * @brief Decodes an instruction through the masks of the opcode table.
+ *
+ * @param instruction The 16-bit instruction.
+ * @param platform Chip8Platform the instruction has to exist on.
+ * @return The Chip8OpcodeId, OPCODE_UNKNOWN if the platform has no such instruction.
+ */
+uint8_t chip8_disasm_decode(uint16_t instruction, uint8_t platform);
+
+/**
+ * @brief Writes the mnemonic of an instruction.
+ *
+ * @param buffer Destination of the text.
+ * @param size Size of buffer.
+ * @param instruction The 16-bit instruction.
+ * @param next The 16 bits after it, the operand of F000 nnnn.
+ * @param platform Chip8Platform to decode for.
+ */
+void chip8_disasm_format(char *buffer, size_t size, uint16_t instruction, uint16_t next, uint8_t platform);
+
+/**
+ * @brief Finds the reachable code of a program and splits it into basic blocks.
+ *
+ * @param disasm Pointer to the Chip8Disasm to fill.
+ * @param program Program bytes, loaded at MEMORY_READ_START.
+ * @param program_size Number of program bytes.
+ * @param platform Chip8Platform to decode for.
+ * @return 1 on success, 0 if out of memory.
+ */
+int chip8_disasm_analyze(Chip8Disasm *disasm, const uint8_t *program, size_t program_size, uint8_t platform);
+
+/**
+ * @brief Releases the blocks of an analysis.
+ *
+ * @param disasm Pointer to the analyzed Chip8Disasm.
+ */
+void chip8_disasm_free(Chip8Disasm *disasm);
+
+/**
+ * @brief Prints an assembly listing with block labels, data regions and the call graph.
+ *
+ * @param disasm Pointer to the analyzed Chip8Disasm.
+ * @param out Stream to print to.
+ */
+void chip8_disasm_print_text(const Chip8Disasm *disasm, FILE *out);
+
+/**
+ * @brief Prints the control flow graph in Graphviz DOT, one cluster per subroutine.
+ *
+ * @param disasm Pointer to the analyzed Chip8Disasm.
+ * @param out Stream to print to.
+ */
+void chip8_disasm_print_dot(const Chip8Disasm *disasm, FILE *out);
+
+/**
+ * @brief Prints one line per block, data region and call site for other tools to load.
+ *
+ * @param disasm Pointer to the analyzed Chip8Disasm.
+ * @param out Stream to print to.
+ */
+void chip8_disasm_print_table(const Chip8Disasm *disasm, FILE *out);
+
+#endif // CHIP8_DISASM_H
@@ -0,0 +1,98 @@
+#ifndef CHIP8_FORK_H
+#define CHIP8_FORK_H
+
+#include "chip8.h"
+
+#define FORK_PAGE_SIZE 256
+#define FORK_MAX_PAGES (RAM_SIZE / FORK_PAGE_SIZE)
+
+/**
+ * 256 bytes of RAM shared between forks.
+ */
+typedef struct {
+    uint32_t refs;                  // Forks and trackers holding the page
+    uint8_t data[FORK_PAGE_SIZE];   // Page contents, never modified once shared
+} Chip8Page;
+
+/**
+ * Saved instance that shares the RAM pages it has in common with other forks.
+ *
+ * Registers, timers, the stack and the display are copied into `state`
+ * eagerly; RAM is a list of shared pages, so a fork only costs memory for the
+ * pages the program wrote since the fork it was resumed from.
+ */
+typedef struct {
+    Chip8 state;                    // Instance as forked, its ram pointer unused
+    uint32_t page_count;            // Pages in the address space of the platform
+    Chip8Page *pages[];             // RAM, one shared page per 256 bytes
+} Chip8Fork;
+
+/**
+ * Pages an instance shares with forks.
+ *
+ * While attached, the handlers of the RAM-writing instructions (Fx33, Fx55,
+ * 5xy2) are swapped for wrappers that unshare the pages they write; every other
+ * page still equals the shared page listed for it and needs no copy when forking.
+ */
+struct Chip8ForkTracker {
+    Chip8Page *resident[FORK_MAX_PAGES];  // Shared page each RAM page equals, NULL once written
+    Chip8Handler originals[3];            // Handlers replaced by the wrappers
+};
+
+/**
+ * @brief Starts tracking the RAM pages an instance writes, so that it can be forked.
+ *
+ * RAM written other than by Fx33, Fx55 and 5xy2 (loading a program, a debugger)
+ * has to be written before attaching, or reported with chip8_fork_touch().
+ *
+ * @param chip8 Pointer to the Chip8 instance.
+ * @param tracker Pointer to the Chip8ForkTracker to initialize, must outlive the attachment.
+ */
+void chip8_fork_attach(Chip8 *chip8, Chip8ForkTracker *tracker);
+
+/**
+ * @brief Stops tracking and puts the original handlers back.
+ *
+ * @param chip8 Pointer to the Chip8 instance with an attached tracker.
+ */
+void chip8_fork_detach(Chip8 *chip8);
+
+/**
+ * @brief Unshares the pages of a RAM write made outside of the opcode handlers, e.g. by restoring a snapshot.
+ *
+ * @param chip8 Pointer to the Chip8 instance with an attached tracker.
+ * @param address First written guest address, wrapping around RAM like the handlers.
+ * @param length Number of written bytes.
+ */
+void chip8_fork_touch(Chip8 *chip8, uint32_t address, uint32_t length);
+
+/**
+ * @brief Saves the instance, copying only the RAM pages written since it last forked or resumed.
+ *
+ * @param chip8 Pointer to the Chip8 instance with an attached tracker.
+ * @return The new fork, NULL if out of memory.
+ */
+Chip8Fork *chip8_fork(Chip8 *chip8);
+
+/**
+ * @brief Continues an instance from a fork.
+ *
+ * Only the RAM pages that differ from the fork are copied in. The fork may come
+ * from another instance of the same platform and stays valid. The watchpoints,
+ * snapshot and state hash of the instance stay attached: the pages copied in
+ * are recorded as dirty in the snapshot and the hash is rehashed.
+ *
+ * @param chip8 Pointer to the Chip8 instance with an attached tracker.
+ * @param fork Pointer to the fork to continue from.
+ * @return 1 on success, 0 if the fork is of a platform with another address space.
+ */
+int chip8_fork_resume(Chip8 *chip8, const Chip8Fork *fork);
+
+/**
+ * @brief Releases a fork and the pages no other fork or instance shares.
+ *
+ * @param fork Pointer to the fork, may be NULL.
+ */
+void chip8_fork_free(Chip8Fork *fork);
+
+#endif // CHIP8_FORK_H
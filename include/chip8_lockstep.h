@@ -0,0 +1,162 @@
+#ifndef CHIP8_LOCKSTEP_H
+#define CHIP8_LOCKSTEP_H
+
+#include "chip8.h"
+
+#include <stdio.h>
+
+#define STATE_HASH_WORDS 13         // Registers, timers, stack and keyboard packed into 64-bit words
+#define STATE_HASH_HANDLERS 11      // Handlers of the instructions writing RAM or the display
+
+#define LOCKSTEP_REFERENCE 0        // Index of the reference engine in Chip8Lockstep
+#define LOCKSTEP_CANDIDATE 1        // Index of the engine checked against it
+
+/**
+ * Rolling hash of everything a program can observe or change.
+ *
+ * The hash is a sum of one term per RAM byte, per display row and per word of
+ * registers, so a write replaces the terms it changes instead of rehashing the
+ * state. While attached, the handlers of the RAM-writing instructions (Fx33,
+ * Fx55, 5xy2) and of the display-writing ones (Dxyn, 00E0, scrolls, 00FE,
+ * 00FF) are swapped for wrappers that update the terms of the bytes and rows
+ * they write; chip8_state_hash_update() then folds in the registers that
+ * changed. Hashes are only comparable within one process.
+ */
+struct Chip8StateHash {
+    uint64_t value;                                 // Hash of the whole state
+    uint64_t words[STATE_HASH_WORDS];               // Registers as last folded into value
+    Chip8Handler originals[STATE_HASH_HANDLERS];    // Handlers replaced by the wrappers
+};
+
+/**
+ * Advances an instance by at least one instruction.
+ *
+ * @param chip8 Pointer to the Chip8 instance.
+ * @param max_cycles Most instructions to run, at least 1.
+ * @param stopped Set to 1 if the program exited or hit an unknown opcode.
+ * @return Number of instructions run, the one that stopped the program included.
+ */
+typedef uint32_t (*Chip8Engine)(Chip8 *chip8, uint32_t max_cycles, uint8_t *stopped);
+
+/**
+ * Two engines running the same program with the same input, compared every
+ * `interval` instructions by their state hashes.
+ *
+ * The engine that ran fewer instructions is always advanced, never past the
+ * other one, so both are compared at the same instruction count. An engine
+ * running several instructions at once, such as the idle loop fast-forward, is
+ * compared at the end of every run.
+ */
+typedef struct {
+    Chip8 *instances[2];                // Reference and candidate instances
+    Chip8Engine engines[2];             // How each instance is advanced
+    Chip8StateHash hashes[2];           // Rolling hash of each instance
+    uint32_t interval;                  // Instructions between comparisons
+    uint64_t executed;                  // Instructions both engines ran in earlier calls
+    uint64_t next_check;                // Instruction count of the next comparison
+    uint64_t matched;                   // Instruction count of the last comparison that matched
+    uint8_t stopped[2];                 // Set once the program of an instance stopped
+    uint8_t diverged;                   // Set once the engines differ
+    uint64_t diverged_at;               // Instruction count where they were found to differ
+    uint16_t last_pc[2];                // Program counter before the last advance of each engine
+    uint16_t last_instruction[2];       // Instruction at last_pc when it ran
+    uint32_t last_cycles[2];            // Instructions run by the last advance of each engine
+} Chip8Lockstep;
+
+/**
+ * @brief Computes the state hash of an instance from scratch.
+ *
+ * @param chip8 Pointer to the Chip8 instance.
+ * @return The hash an attached Chip8StateHash holds for the same state.
+ */
+uint64_t chip8_state_hash_compute(const Chip8 *chip8);
+
+/**
+ * @brief Hashes an instance and starts following its writes.
+ *
+ * RAM written other than by Fx33, Fx55 and 5xy2 (loading a program) has to be
+ * written before attaching, and the platform and quirks set before.
+ *
+ * @param chip8 Pointer to the Chip8 instance, without an attached hash.
+ * @param hash Pointer to the Chip8StateHash to initialize, must outlive the attachment.
+ */
+void chip8_state_hash_attach(Chip8 *chip8, Chip8StateHash *hash);
+
+/**
+ * @brief Folds the registers that changed since the last update into the hash.
+ *
+ * Called after every advance of the instance; RAM and display writes are
+ * already accounted for by the handlers.
+ *
+ * @param chip8 Pointer to the Chip8 instance with an attached hash.
+ * @return The hash of the current state.
+ */
+uint64_t chip8_state_hash_update(Chip8 *chip8);
+
+/**
+ * @brief Rehashes an attached hash after the whole state was replaced, e.g. by resuming a fork.
+ *
+ * @param chip8 Pointer to the Chip8 instance with an attached hash.
+ */
+void chip8_state_hash_reset(Chip8 *chip8);
+
+/**
+ * @brief Stops following writes and puts the original handlers back.
+ *
+ * @param chip8 Pointer to the Chip8 instance with an attached hash.
+ */
+void chip8_state_hash_detach(Chip8 *chip8);
+
+/**
+ * @brief Reference engine: one instruction with chip8_step().
+ */
+uint32_t chip8_engine_step(Chip8 *chip8, uint32_t max_cycles, uint8_t *stopped);
+
+/**
+ * @brief Skips idle loops with chip8_fast_forward(), otherwise one instruction with chip8_step().
+ */
+uint32_t chip8_engine_fast_forward(Chip8 *chip8, uint32_t max_cycles, uint8_t *stopped);
+
+/**
+ * @brief Attaches state hashes to two instances in the same state.
+ *
+ * @param lockstep Pointer to the Chip8Lockstep to initialize.
+ * @param reference Instance run by the reference engine.
+ * @param reference_engine Engine whose results are taken as correct.
+ * @param candidate Instance run by the engine under test.
+ * @param candidate_engine Engine under test.
+ * @param interval Instructions between comparisons, 1 to compare after every advance.
+ */
+void chip8_lockstep_start(Chip8Lockstep *lockstep, Chip8 *reference, Chip8Engine reference_engine,
+                          Chip8 *candidate, Chip8Engine candidate_engine, uint32_t interval);
+
+/**
+ * @brief Runs both engines for a number of instructions, comparing them on the way.
+ *
+ * Input such as the keyboard has to be set on both instances before the call.
+ *
+ * @param lockstep Pointer to the Chip8Lockstep.
+ * @param cycles Instructions to run, fewer once the program stops.
+ * @return 1 if the engines agree, 0 once they differ; both instances are left where the difference was seen.
+ */
+int chip8_lockstep_run(Chip8Lockstep *lockstep, uint32_t cycles);
+
+/**
+ * @brief Prints where the engines differ and the fields of both states that differ.
+ *
+ * Each rolling hash is also checked against a full rehash, which exposes a
+ * write that escaped the wrappers.
+ *
+ * @param lockstep Pointer to the Chip8Lockstep.
+ * @param out Stream to print to.
+ */
+void chip8_lockstep_dump(Chip8Lockstep *lockstep, FILE *out);
+
+/**
+ * @brief Detaches the state hashes of both instances.
+ *
+ * @param lockstep Pointer to the Chip8Lockstep.
+ */
+void chip8_lockstep_stop(Chip8Lockstep *lockstep);
+
+#endif // CHIP8_LOCKSTEP_H
@@ -3,6 +3,84 @@
 
 #include "chip8.h"
 
+/**
+ * Opcode ids, the index of each opcode in the opcode tables and Chip8.handlers.
+ */
+typedef enum {
+    OPCODE_SCROLL_DOWN,           // 00Cn
+    OPCODE_SCROLL_UP,             // 00Dn
+    OPCODE_CLS,                   // 00E0
+    OPCODE_RET,                   // 00EE
+    OPCODE_SCROLL_RIGHT,          // 00FB
+    OPCODE_SCROLL_LEFT,           // 00FC
+    OPCODE_EXIT,                  // 00FD
+    OPCODE_LORES,                 // 00FE
+    OPCODE_HIRES,                 // 00FF
+    OPCODE_JP,                    // 1nnn
+    OPCODE_CALL,                  // 2nnn
+    OPCODE_SKIP_EQUAL_BYTE,       // 3xkk
+    OPCODE_SKIP_NOT_EQUAL_BYTE,   // 4xkk
+    OPCODE_SKIP_EQUAL,            // 5xy0
+    OPCODE_SAVE_RANGE,            // 5xy2
+    OPCODE_LOAD_RANGE,            // 5xy3
+    OPCODE_LOAD_BYTE,             // 6xkk
+    OPCODE_ADD_BYTE,              // 7xkk
+    OPCODE_LOAD,                  // 8xy0
+    OPCODE_OR,                    // 8xy1
+    OPCODE_AND,                   // 8xy2
+    OPCODE_XOR,                   // 8xy3
+    OPCODE_ADD,                   // 8xy4
+    OPCODE_SUBTRACT_X,            // 8xy5
+    OPCODE_DIVIDE,                // 8xy6
+    OPCODE_SUBTRACT_Y,            // 8xy7
+    OPCODE_MULTIPLY,              // 8xyE
+    OPCODE_SKIP_NOT_EQUAL,        // 9xy0
+    OPCODE_SET_I,                 // Annn
+    OPCODE_JUMP,                  // Bnnn
+    OPCODE_RANDOM,                // Cxkk
+    OPCODE_DRAW,                  // Dxyn
+    OPCODE_SKIP_KEY,              // Ex9E
+    OPCODE_SKIP_NOT_KEY,          // ExA1
+    OPCODE_LOAD_LONG_I,           // F000 nnnn
+    OPCODE_SELECT_PLANES,         // Fn01
+    OPCODE_LOAD_AUDIO,            // F002
+    OPCODE_LOAD_DELAY_TIMER,      // Fx07
+    OPCODE_WAIT_KEY,              // Fx0A
+    OPCODE_SET_DELAY_TIMER,       // Fx15
+    OPCODE_SET_SOUND_TIMER,       // Fx18
+    OPCODE_ADD_I,                 // Fx1E
+    OPCODE_LOAD_FONT,             // Fx29
+    OPCODE_LOAD_BIG_FONT,         // Fx30
+    OPCODE_LOAD_BCD,              // Fx33
+    OPCODE_SET_PITCH,             // Fx3A
+    OPCODE_LOAD_REGISTERS,        // Fx55
+    OPCODE_LOAD_MEMORY,           // Fx65
+    OPCODE_SAVE_FLAGS,            // Fx75
+    OPCODE_LOAD_FLAGS,            // Fx85
+    OPCODE_UNKNOWN                // Not a valid instruction, equals OPCODE_AMOUNT
+} Chip8OpcodeId;
+
+/**
+ * @brief Decode an instruction to its opcode id without scanning the opcode table.
+ *
+ * @param instruction The 16-bit instruction.
+ * @return The Chip8OpcodeId matching the instruction, OPCODE_UNKNOWN if none does.
+ */
+uint8_t chip8_decode_opcode(uint16_t instruction);
+
+/*
+ * Handlers of the opcodes below depend on the quirk profile. A specialized copy of
+ * each is generated per CHIP8_QUIRK_PROFILES entry inside chip8_opcodes.c and only
+ * reachable through quirk_profile_tables:
+ *
+ *   3xkk, 4xkk, 5xy0, 9xy0, Ex9E, ExA1  skip instructions (long_skip)
+ *   8xy1, 8xy2, 8xy3                    logical operations (vf_reset)
+ *   8xy6, 8xyE                          shifts (shift_vy)
+ *   Bnnn                                jump with offset (jump_vx)
+ *   Dxyn                                draw (clip_sprites)
+ *   Fx55, Fx65                          register store/load (memory_increment_i)
+ */
+
 /**
  * @brief Clear the display.
  *
@@ -36,243 +114,254 @@ void chip8_execute_opcode_jp(Chip8 *chip8, Opcode *opcode);
 void chip8_execute_opcode_call(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Skip the next instruction if Vx equals kk.
+ * @brief Set Vx to kk.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_skip_equal_byte(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_load_byte(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Skip the next instruction if Vx does not equal kk.
+ * @brief Add kk to Vx.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_skip_not_equal_byte(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_add_byte(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Skip the next instruction if Vx equals Vy.
+ * @brief Set Vx to Vy.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_skip_equal(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_load(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Set Vx to kk.
+ * @brief Add Vy to Vx, set VF to carry.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_load_byte(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_add(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Add kk to Vx.
+ * @brief Subtract Vy from Vx, set VF to NOT borrow.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_add_byte(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_subtract_x(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Set Vx to Vy.
+ * @brief Subtract Vx from Vy, set VF to NOT borrow.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_load(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_subtract_y(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Set Vx to Vx OR Vy.
+ * @brief Set I to nnn.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_or(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_set_i(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Set Vx to Vx AND Vy.
+ * @brief Set Vx to a random byte AND kk.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_and(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_random(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Set Vx to Vx XOR Vy.
+ * @brief Set Vx to the delay timer value.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_xor(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_load_delay_timer(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Add Vy to Vx, set VF to carry.
+ * @brief Wait for a key press and release, store the value of the key in Vx.
+ *
+ * The first execution only puts the instance into the waiting state; the
+ * instruction completes once a key pressed during the wait is released.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_add(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_wait_key(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Subtract Vy from Vx, set VF to NOT borrow.
+ * @brief Set the delay timer to Vx.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_subtract_x(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_set_delay_timer(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Shift Vx right by 1 bit.
+ * @brief Set the sound timer to Vx.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_divide(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_set_sound_timer(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Subtract Vx from Vy, set VF to NOT borrow.
+ * @brief Add Vx to I.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_subtract_y(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_add_i(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Multiply Vx and Vy (interpret as a right shift operation).
+ * @brief Set I to the location of the sprite for digit Vx.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_multiply(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_load_font(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Skip the next instruction if Vx does not equal Vy.
+ * @brief Store the BCD representation of Vx in memory locations I, I+1, and I+2.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_skip_not_equal(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_load_bcd(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Set I to nnn.
+ * @brief Scroll the display down by n pixels.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_set_i(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_scroll_down(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Jump to location nnn + V0.
+ * @brief Scroll the display up by n pixels (XO-CHIP).
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_jump(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_scroll_up(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Set Vx to a random byte AND kk.
+ * @brief Scroll the display right by 4 pixels.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_random(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_scroll_right(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Display an n-byte sprite starting at memory location I at (Vx, Vy), set VF to collision.
+ * @brief Scroll the display left by 4 pixels.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_draw(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_scroll_left(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Skip the next instruction if the key with the value of Vx is pressed.
+ * @brief Exit the interpreter.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_skip_key(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_exit(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Skip the next instruction if the key with the value of Vx is not pressed.
+ * @brief Switch to 64x32 low resolution mode.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_skip_not_key(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_lores(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Set Vx to the delay timer value.
+ * @brief Switch to 128x64 high resolution mode.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_load_delay_timer(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_hires(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Wait for a key press, store the value of the key in Vx.
+ * @brief Store registers Vx through Vy in memory starting at location I (XO-CHIP).
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_wait_key(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_save_range(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Set the delay timer to Vx.
+ * @brief Read registers Vx through Vy from memory starting at location I (XO-CHIP).
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_set_delay_timer(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_load_range(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Set the sound timer to Vx.
+ * @brief Set I to the 16-bit address following the instruction (XO-CHIP).
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_set_sound_timer(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_load_long_i(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Add Vx to I.
+ * @brief Select the bitplanes used by drawing, clearing and scrolling (XO-CHIP).
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_add_i(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_select_planes(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Set I to the location of the sprite for digit Vx.
+ * @brief Load the 16-byte audio pattern starting at location I (XO-CHIP).
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_load_font(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_load_audio(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Store the BCD representation of Vx in memory locations I, I+1, and I+2.
+ * @brief Set I to the location of the large sprite for digit Vx.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_load_bcd(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_load_big_font(Chip8 *chip8, Opcode *opcode);
+
+/**
+ * @brief Set the audio pitch to Vx (XO-CHIP).
+ *
+ * @param chip8 Pointer to the Chip8 state structure.
+ * @param opcode Pointer to the Opcode structure containing the instruction.
+ */
+void chip8_execute_opcode_set_pitch(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Store registers V0 through Vx in memory starting at location I.
+ * @brief Store registers V0 through Vx in the flag registers.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_load_registers(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_save_flags(Chip8 *chip8, Opcode *opcode);
 
 /**
- * @brief Read registers V0 through Vx from memory starting at location I.
+ * @brief Read registers V0 through Vx from the flag registers.
  *
  * @param chip8 Pointer to the Chip8 state structure.
  * @param opcode Pointer to the Opcode structure containing the instruction.
  */
-void chip8_execute_opcode_load_memory(Chip8 *chip8, Opcode *opcode);
+void chip8_execute_opcode_load_flags(Chip8 *chip8, Opcode *opcode);
 
 #endif /* CHIP8_OPCODES_H */
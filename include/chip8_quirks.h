@@ -0,0 +1,37 @@
+#ifndef CHIP8_QUIRKS_H
+#define CHIP8_QUIRKS_H
+
+/**
+ * Quirk profiles. Each X(...) entry instantiates a complete set of opcode
+ * handlers with its quirks as compile-time constants, so handlers never
+ * branch on a quirk at runtime.
+ *
+ * X(ID, name, shift_vy, memory_increment_i, jump_vx, vf_reset, clip_sprites, long_skip)
+ *
+ * shift_vy            8xy6/8xyE shift Vy into Vx instead of shifting Vx in place.
+ * memory_increment_i  Fx55/Fx65 leave I pointing past the last register.
+ * jump_vx             Bxnn jumps to xnn + Vx instead of nnn + V0.
+ * vf_reset            8xy1/8xy2/8xy3 clear VF.
+ * clip_sprites        Sprites are clipped at the display edges instead of wrapping.
+ * long_skip           Skips step over the four-byte XO-CHIP F000 nnnn instruction.
+ */
+#define CHIP8_QUIRK_PROFILES(X) \
+    X(CHIP8,  chip8,  0, 0, 0, 0, 0, 0) \
+    X(VIP,    vip,    1, 1, 0, 1, 1, 0) \
+    X(SCHIP,  schip,  0, 0, 1, 0, 1, 0) \
+    X(XOCHIP, xochip, 1, 1, 0, 0, 0, 1)
+
+/**
+ * Identifiers of the quirk profiles, in CHIP8_QUIRK_PROFILES order.
+ */
+typedef enum {
+#define QUIRK_PROFILE_ID(ID, name, ...) QUIRKS_##ID,
+    CHIP8_QUIRK_PROFILES(QUIRK_PROFILE_ID)
+#undef QUIRK_PROFILE_ID
+    QUIRK_PROFILE_AMOUNT
+} Chip8QuirkProfile;
+
+/* Names of the quirk profiles as accepted on the command line */
+extern const char *const quirk_profile_names[QUIRK_PROFILE_AMOUNT];
+
+#endif /* CHIP8_QUIRKS_H */
@@ -0,0 +1,43 @@
+#ifndef CHIP8_RAM_H
+#define CHIP8_RAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CHIP8_RAM_ADDRESS_SPACE 65536  // Guest addresses are 16 bits wide
+#define CHIP8_RAM_OVERRUN 64            // Furthest an instruction reads past its first address (Dxyn on two planes)
+
+/**
+ * Guest RAM backing.
+ *
+ * On Linux the RAM lives in a memfd that is mapped twice back to back,
+ * followed by a guard page. Address `a` and `a + size` then hit the same
+ * physical byte, so an access only masks its first address and the bytes after
+ * it wrap in hardware (see chip8_ram_index()). Each instance costs three
+ * mappings. Where the RAM cannot be mirrored (other systems, hosts whose pages
+ * are larger than the RAM, no mappings left) it is a heap buffer instead, and
+ * every byte of an access is masked.
+ */
+typedef struct {
+    uint8_t *data;    // Guest address 0
+    uint32_t size;    // Guest RAM size in bytes (a power of two)
+    size_t reserved;  // Length of the mirrored mapping, 0 for a heap buffer
+} Chip8Ram;
+
+/**
+ * @brief Allocates zeroed guest RAM of the given size.
+ *
+ * @param ram Pointer to the Chip8Ram to fill in.
+ * @param size Guest RAM size in bytes, a power of two up to CHIP8_RAM_ADDRESS_SPACE.
+ * @return 1 on success, 0 with errno set if the RAM could not be allocated.
+ */
+int chip8_ram_alloc(Chip8Ram *ram, uint32_t size);
+
+/**
+ * @brief Releases guest RAM allocated by chip8_ram_alloc().
+ *
+ * @param ram Pointer to the Chip8Ram to release.
+ */
+void chip8_ram_free(Chip8Ram *ram);
+
+#endif // CHIP8_RAM_H
@@ -0,0 +1,65 @@
+#ifndef CHIP8_SNAPSHOT_H
+#define CHIP8_SNAPSHOT_H
+
+#include "chip8.h"
+
+#define SNAPSHOT_PAGE_SIZE 256
+#define SNAPSHOT_RAM_SIZE CHIP8_RAM_ADDRESS_SPACE
+#define SNAPSHOT_PAGES (SNAPSHOT_RAM_SIZE / SNAPSHOT_PAGE_SIZE)
+
+/**
+ * Saved state of an instance that can be restored any number of times.
+ *
+ * While a snapshot is attached, the handlers of the RAM-writing instructions
+ * (Fx33, Fx55, 5xy2) are swapped for wrappers that record the 256-byte pages
+ * they write. Restoring copies back only those pages, so its cost follows what
+ * the program wrote instead of the size of RAM.
+ */
+struct Chip8Snapshot {
+    Chip8 state;                            // Instance as captured, its ram pointer, handlers and attachments unused
+    uint8_t ram[SNAPSHOT_RAM_SIZE];         // RAM as captured, indexed like Chip8.ram
+    uint8_t dirty[SNAPSHOT_PAGES];          // Set for pages written since the last restore
+    uint16_t dirty_pages[SNAPSHOT_PAGES];   // Pages set in dirty, in the order they were written
+    int dirty_count;                        // Number of pages in dirty_pages
+    Chip8Handler originals[3];              // Handlers replaced by the wrappers
+};
+
+/**
+ * @brief Captures an instance and starts recording the RAM pages it writes.
+ *
+ * @param chip8 Pointer to the Chip8 instance, without an attached snapshot.
+ * @param snapshot Pointer to the Chip8Snapshot to fill, must outlive the attachment.
+ */
+void chip8_snapshot_capture(Chip8 *chip8, Chip8Snapshot *snapshot);
+
+/**
+ * @brief Brings an instance back to the captured state.
+ *
+ * The instance must not change platform while the snapshot is attached. The
+ * watchpoints, fork tracker and state hash attached since the capture stay
+ * attached: the pages copied back are unshared from forks and the hash is
+ * rehashed.
+ *
+ * @param chip8 Pointer to the Chip8 instance the snapshot is attached to.
+ * @param snapshot Pointer to the attached Chip8Snapshot.
+ */
+void chip8_snapshot_restore(Chip8 *chip8, Chip8Snapshot *snapshot);
+
+/**
+ * @brief Records a RAM write made outside of the opcode handlers, e.g. by loading a program.
+ *
+ * @param snapshot Pointer to the attached Chip8Snapshot.
+ * @param address First written guest address, wrapping around RAM like the handlers.
+ * @param length Number of written bytes.
+ */
+void chip8_snapshot_touch(Chip8Snapshot *snapshot, uint32_t address, uint32_t length);
+
+/**
+ * @brief Stops recording and puts the original handlers back.
+ *
+ * @param chip8 Pointer to the Chip8 instance the snapshot is attached to.
+ * @param snapshot Pointer to the attached Chip8Snapshot.
+ */
+void chip8_snapshot_release(Chip8 *chip8, Chip8Snapshot *snapshot);
+
+#endif // CHIP8_SNAPSHOT_H
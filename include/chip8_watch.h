@@ -0,0 +1,78 @@
+#ifndef CHIP8_WATCH_H
+#define CHIP8_WATCH_H
+
+#include "chip8.h"
+
+#define WATCH_PAGE_SIZE 256
+#define WATCH_PAGES (RAM_SIZE / WATCH_PAGE_SIZE)
+#define WATCH_MAX_POINTS 16
+
+/**
+ * Called once per watched byte an instruction wrote.
+ *
+ * @param chip8 Pointer to the Chip8 instance.
+ * @param pc Address of the writing instruction.
+ * @param address Address of the written byte.
+ * @param old_value Byte before the write.
+ * @param new_value Byte after the write.
+ * @param user Pointer given to chip8_watch_init().
+ */
+typedef void (*Chip8WatchCallback)(Chip8 *chip8, uint16_t pc, uint16_t address, uint8_t old_value, uint8_t new_value, void *user);
+
+/**
+ * Watched address range.
+ */
+typedef struct {
+    uint16_t start;   // First watched address
+    uint16_t length;  // Number of watched bytes
+} Chip8Watchpoint;
+
+/**
+ * Write watchpoints of one instance.
+ *
+ * While at least one watchpoint is set, the handlers of the RAM-writing
+ * instructions (Fx33, Fx55, 5xy2) are swapped for wrappers that look up the
+ * 256-byte guest pages they write in `pages`, and only compare addresses
+ * against the watchpoints when one of them is flagged. Without watchpoints the
+ * original handlers run untouched.
+ */
+struct Chip8Watch {
+    uint8_t pages[WATCH_PAGES];                  // Watchpoints overlapping each guest page
+    Chip8Watchpoint points[WATCH_MAX_POINTS];    // Set watchpoints
+    int count;                                   // Number of set watchpoints
+    Chip8Handler originals[3];                   // Handlers replaced by the wrappers
+    Chip8WatchCallback callback;                 // Hit notification
+    void *user;                                  // Passed to callback
+};
+
+/**
+ * @brief Attaches an empty watchpoint set to an instance.
+ *
+ * @param chip8 Pointer to the Chip8 instance.
+ * @param watch Pointer to the Chip8Watch to initialize, must outlive the attachment.
+ * @param callback Function called for every watched byte written.
+ * @param user Pointer passed to callback.
+ */
+void chip8_watch_init(Chip8 *chip8, Chip8Watch *watch, Chip8WatchCallback callback, void *user);
+
+/**
+ * @brief Watches writes to an address range.
+ *
+ * @param chip8 Pointer to the Chip8 instance with an attached Chip8Watch.
+ * @param start First address of the range.
+ * @param length Number of bytes in the range, at least 1.
+ * @return 1 if the watchpoint was set, 0 if the set is full.
+ */
+int chip8_watch_add(Chip8 *chip8, uint16_t start, uint16_t length);
+
+/**
+ * @brief Removes a watchpoint set with the same range.
+ *
+ * @param chip8 Pointer to the Chip8 instance with an attached Chip8Watch.
+ * @param start First address of the range.
+ * @param length Number of bytes in the range.
+ * @return 1 if a watchpoint was removed, 0 if none matched.
+ */
+int chip8_watch_remove(Chip8 *chip8, uint16_t start, uint16_t length);
+
+#endif // CHIP8_WATCH_H
@@ -0,0 +1,92 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+// Size of the composited image: twice the high resolution display, so that
+// scale2x output of either resolution fits without further scaling.
+#define COMPOSITOR_WIDTH (2 * DISPLAY_HIRES_WIDTH)
+#define COMPOSITOR_HEIGHT (2 * DISPLAY_HIRES_HEIGHT)
+
+// Brightness a pixel keeps per frame after it goes dark, out of 256.
+#define COMPOSITOR_PHOSPHOR_DECAY 144
+
+// Frames a dark pixel fades for at most, after which it is fully dark.
+#define COMPOSITOR_PHOSPHOR_FRAMES 8
+
+/**
+ * Scaling filter applied to the display.
+ */
+typedef enum {
+    COMPOSITOR_NEAREST,                 // Every pixel becomes a square
+    COMPOSITOR_SCALE2X,                 // Scale2x (EPX) smoothing of diagonal edges, then squares
+    COMPOSITOR_FILTER_AMOUNT
+} CompositorFilter;
+
+/** Names of the filters, indexed by CompositorFilter. */
+extern const char *const compositor_filter_names[COMPOSITOR_FILTER_AMOUNT];
+
+/**
+ * Turns the bitplanes of the display into a COMPOSITOR_WIDTH x COMPOSITOR_HEIGHT
+ * ARGB8888 image on the CPU.
+ *
+ * Only the rows of the display that changed since the last composition are
+ * processed. With phosphor decay, a pixel that goes dark fades out over a few
+ * frames instead of disappearing at once, which hides the flicker of sprites
+ * that are erased and redrawn with XOR.
+ */
+typedef struct {
+    uint32_t pixels[COMPOSITOR_HEIGHT][COMPOSITOR_WIDTH];      // Composited image
+    uint32_t palette[1 << DISPLAY_PLANES];                      // ARGB color of each pixel state
+    DisplayRow source[DISPLAY_PLANES][DISPLAY_HIRES_HEIGHT];    // Display of the last composition
+    uint8_t fading[DISPLAY_HIRES_HEIGHT];                       // Display rows whose image is still fading
+    uint8_t hires;                                              // Resolution of the last composition
+    uint8_t valid;                                              // 0 until the first composition
+    uint8_t filter;                                             // CompositorFilter
+    uint8_t phosphor;                                           // 1 with phosphor decay
+    int dirty_top;                                              // First image row the last composition changed
+    int dirty_bottom;                                           // Row after the last one it changed
+} Compositor;
+
+/**
+ * @brief Initializes a compositor.
+ *
+ * @param compositor Pointer to the Compositor to initialize.
+ * @param colors RGB color of each pixel state.
+ * @param filter CompositorFilter to scale with.
+ * @param phosphor 1 to fade out dark pixels, 0 to turn them dark at once.
+ */
+void compositor_init(Compositor *compositor, const uint8_t colors[1 << DISPLAY_PLANES][3], CompositorFilter filter,
+                     uint8_t phosphor);
+
+/**
+ * @brief Composites the rows of the display that changed or are still fading.
+ *
+ * Sets dirty_top and dirty_bottom to the image rows that changed.
+ *
+ * @param compositor Pointer to the Compositor.
+ * @param chip8 Pointer to the Chip8 whose display is composited.
+ * @param frames Frames since the last composition, by which fading pixels darken.
+ * @return 1 if the image changed, 0 otherwise.
+ */
+int compositor_update(Compositor *compositor, const Chip8 *chip8, uint32_t frames);
+
+/**
+ * @brief Tells whether pixels are still fading, so that later frames change the image.
+ *
+ * @param compositor Pointer to the Compositor.
+ * @return 1 while some pixel is fading, 0 otherwise.
+ */
+int compositor_is_fading(const Compositor *compositor);
+
+/**
+ * @brief Converts a filter name to its CompositorFilter value.
+ *
+ * @param name Name of the filter.
+ * @return The CompositorFilter, -1 for an unknown name.
+ */
+int parse_filter(const char *name);
+
+#endif // COMPOSITOR_H
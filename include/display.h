@@ -3,6 +3,7 @@
 
 #include <SDL2/SDL.h>
 #include "chip8.h"
+#include "compositor.h"
 
 // Defines the size of each pixel in the SDL window.
 #define PIXEL_SIZE 20
@@ -14,10 +15,19 @@
 #define ONE_R 200
 #define ONE_G 172
 #define ONE_B 214
+#define TWO_R 112
+#define TWO_G 84
+#define TWO_B 140
+#define THREE_R 246
+#define THREE_G 236
+#define THREE_B 250
 
 typedef struct {
     SDL_Window *window;
     SDL_Renderer *renderer;
+    SDL_Texture *texture;       // Composited image, stretched over the window
+    Compositor *compositor;     // Turns the display into the texture
+    uint64_t composed;          // Performance counter at the start of the frame last composited
 } Display;
 
 /**
@@ -32,6 +42,15 @@ void initSDL();
  */
 Display createDisplay();
 
+/**
+ * @brief Selects how the display is scaled to the window.
+ *
+ * @param display Pointer to the Display struct.
+ * @param filter CompositorFilter to scale with.
+ * @param phosphor 1 to fade out pixels that go dark over a few frames, 0 otherwise.
+ */
+void setDisplayFilter(Display *display, CompositorFilter filter, uint8_t phosphor);
+
 /**
  * @brief Cleans up SDL resources.
  * 
@@ -47,7 +66,7 @@ void removeDisplay(Display *display);
 void show_terminal_display(Chip8 *chip8);
 
 /**
- * @brief Renders the display using SDL if it has changed.
+ * @brief Renders the display using SDL if it has changed or is still fading.
  * 
  * @param display Pointer to the Display struct.
  * @param chip8 Pointer to the Chip8 emulator instance.
@@ -55,13 +74,20 @@ void show_terminal_display(Chip8 *chip8);
 void show_sdl_display(Display *display, Chip8 *chip8);
 
 /**
- * @brief Clears the terminal screen based on the operating system.
+ * @brief Renders the display using SDL with lines of text over its top left corner.
+ *
+ * Unlike show_sdl_display(), always renders, so that the text can change while
+ * the display does not. Letters are drawn in upper case.
+ *
+ * @param display Pointer to the Display struct.
+ * @param chip8 Pointer to the Chip8 emulator instance.
+ * @param text Lines separated by '\n'.
  */
-void clear_terminal();
+void show_sdl_display_overlay(Display *display, Chip8 *chip8, const char *text);
 
 /**
- * @brief beeps the buzzer
+ * @brief Clears the terminal screen based on the operating system.
  */
-void sound_buzzer();
+void clear_terminal();
 
 #endif // DISPLAY_H
@@ -0,0 +1,145 @@
+#ifndef DISPLAY_ROW_H
+#define DISPLAY_ROW_H
+
+#include <stdint.h>
+
+/**
+ * One 128-pixel display row stored as two 64-bit words.
+ *
+ * Pixel 0 is the most significant bit of `hi` and pixel 127 the least
+ * significant bit of `lo`. In low resolution only the first 64 pixels
+ * (`hi`) are used, which keeps the classic 64x32 layout unchanged.
+ */
+typedef struct {
+    uint64_t hi;  // Pixels 0-63
+    uint64_t lo;  // Pixels 64-127
+} DisplayRow;
+
+/**
+ * Bitwise AND of two rows.
+ */
+static inline DisplayRow display_row_and(DisplayRow a, DisplayRow b) {
+    DisplayRow r = { a.hi & b.hi, a.lo & b.lo };
+    return r;
+}
+
+/**
+ * Bitwise OR of two rows.
+ */
+static inline DisplayRow display_row_or(DisplayRow a, DisplayRow b) {
+    DisplayRow r = { a.hi | b.hi, a.lo | b.lo };
+    return r;
+}
+
+/**
+ * Bitwise XOR of two rows.
+ */
+static inline DisplayRow display_row_xor(DisplayRow a, DisplayRow b) {
+    DisplayRow r = { a.hi ^ b.hi, a.lo ^ b.lo };
+    return r;
+}
+
+/**
+ * Check whether no pixel of the row is set.
+ */
+static inline int display_row_is_zero(DisplayRow a) {
+    return (a.hi | a.lo) == 0;
+}
+
+/**
+ * Mask selecting the pixels that exist in a row of the given width (64 or 128).
+ */
+static inline DisplayRow display_row_mask(uint8_t width) {
+    DisplayRow r = { UINT64_MAX, (width > 64) ? UINT64_MAX : 0 };
+    return r;
+}
+
+/**
+ * Move every pixel n positions to the right (towards pixel 127), 0 <= n < 128.
+ */
+static inline DisplayRow display_row_shift_right(DisplayRow a, uint8_t n) {
+    DisplayRow r;
+    if (n == 0) {
+        return a;
+    }
+    if (n < 64) {
+        r.lo = (a.lo >> n) | (a.hi << (64 - n));
+        r.hi = a.hi >> n;
+    } else {
+        r.lo = a.hi >> (n - 64);
+        r.hi = 0;
+    }
+    return r;
+}
+
+/**
+ * Move every pixel n positions to the left (towards pixel 0), 0 <= n < 128.
+ */
+static inline DisplayRow display_row_shift_left(DisplayRow a, uint8_t n) {
+    DisplayRow r;
+    if (n == 0) {
+        return a;
+    }
+    if (n < 64) {
+        r.hi = (a.hi << n) | (a.lo >> (64 - n));
+        r.lo = a.lo << n;
+    } else {
+        r.hi = a.lo << (n - 64);
+        r.lo = 0;
+    }
+    return r;
+}
+
+/**
+ * Rotate the first `width` pixels (64 or 128) of the row right by n, 0 <= n < width.
+ */
+static inline DisplayRow display_row_rotate_right(DisplayRow a, uint8_t n, uint8_t width) {
+    if (n == 0) {
+        return a;
+    }
+    if (width <= 64) {
+        DisplayRow r = { (a.hi >> n) | (a.hi << (64 - n)), 0 };
+        return r;
+    }
+    return display_row_or(display_row_shift_right(a, n), display_row_shift_left(a, 128 - n));
+}
+
+/**
+ * Build a row holding a sprite line of `bits_width` bits (8 or 16) whose
+ * leftmost pixel lands at x, wrapping around a row of `width` pixels.
+ */
+static inline DisplayRow display_row_place_sprite(uint16_t bits, uint8_t bits_width, uint8_t x, uint8_t width) {
+    DisplayRow r = { (uint64_t)bits << (64 - bits_width), 0 };
+    return display_row_rotate_right(r, x, width);
+}
+
+/**
+ * Build a row holding a sprite line of `bits_width` bits (8 or 16) whose
+ * leftmost pixel lands at x, dropping the pixels past a row of `width` pixels.
+ */
+static inline DisplayRow display_row_place_sprite_clipped(uint16_t bits, uint8_t bits_width, uint8_t x, uint8_t width) {
+    DisplayRow r = { (uint64_t)bits << (64 - bits_width), 0 };
+    return display_row_and(display_row_shift_right(r, x), display_row_mask(width));
+}
+
+/**
+ * Read the pixel at x from the row.
+ */
+static inline uint8_t display_row_get(DisplayRow a, uint8_t x) {
+    return (x < 64) ? (uint8_t)((a.hi >> (63 - x)) & 1) : (uint8_t)((a.lo >> (127 - x)) & 1);
+}
+
+/**
+ * Set or clear the pixel at x in the row.
+ */
+static inline void display_row_set(DisplayRow *a, uint8_t x, uint8_t state) {
+    uint64_t *word = (x < 64) ? &a->hi : &a->lo;
+    uint64_t mask = (uint64_t)1 << (63 - (x & 63));
+    if (state) {
+        *word |= mask;
+    } else {
+        *word &= ~mask;
+    }
+}
+
+#endif // DISPLAY_ROW_H
@@ -0,0 +1,115 @@
+#ifndef GDB_STUB_H
+#define GDB_STUB_H
+
+#include "chip8.h"
+
+#define GDB_PACKET_SIZE 4096
+
+// Signals reported to GDB in stop replies.
+#define GDB_SIGINT 2
+#define GDB_SIGILL 4
+#define GDB_SIGTRAP 5
+
+/**
+ * GDB remote serial protocol server.
+ *
+ * Breakpoints are kept as one bit per guest address, which the emulation loop
+ * tests before each instruction with gdb_stub_breakpoint_at(). Guest RAM and
+ * the dispatch table are never modified, so the program cannot see or
+ * overwrite a breakpoint, and rebuilding the handlers does not lose them.
+ * Unknown opcodes and watchpoint hits are reported through gdb_stub_trap().
+ */
+typedef struct {
+    int listen_fd;                                  // Listening socket, -1 when closed
+    int fd;                                         // Connection to GDB, -1 when detached
+    uint8_t breakpoints[CHIP8_RAM_ADDRESS_SPACE / 8]; // Bit set for each address with a breakpoint
+    int breakpoint_count;                           // Number of set breakpoints
+    char packet[GDB_PACKET_SIZE];                   // Last received packet payload
+    char input[GDB_PACKET_SIZE];                    // Bytes received but not parsed yet
+    int input_start;                                // First unparsed byte of input
+    int input_end;                                  // End of the received bytes in input
+    uint8_t watch_hit;                              // Set until a watchpoint hit is reported
+    uint16_t watch_address;                         // Address written by the watchpoint hit
+} GdbStub;
+
+/**
+ * @brief Listens for GDB and waits until it connects.
+ *
+ * @param stub Pointer to the GdbStub to initialize.
+ * @param address Address to listen on, in any form net_listen() accepts.
+ * @return 1 once GDB is connected, 0 on failure.
+ */
+int gdb_stub_open(GdbStub *stub, const char *address);
+
+/**
+ * @brief Hands control to GDB before the program starts.
+ *
+ * Blocks while GDB inspects the stopped program, until it continues.
+ *
+ * @param stub Pointer to the connected GdbStub.
+ * @param chip8 Pointer to the Chip8 instance to debug.
+ * @return 1 if GDB killed the program, 0 otherwise.
+ */
+int gdb_stub_attach(GdbStub *stub, Chip8 *chip8);
+
+/**
+ * @brief Tells whether a breakpoint is set at an address.
+ *
+ * Meant to be called with the program counter before every instruction.
+ *
+ * @param stub Pointer to the GdbStub.
+ * @param address Guest address.
+ * @return 1 if the program has to stop before the instruction at the address, 0 otherwise.
+ */
+static inline int gdb_stub_breakpoint_at(const GdbStub *stub, uint16_t address) {
+    return (stub->breakpoints[address >> 3] >> (address & 7)) & 1;
+}
+
+/**
+ * @brief Reports a stop to GDB and serves it until it continues.
+ *
+ * Called with the program counter on a breakpoint before executing it, which
+ * is reported as SIGTRAP, after a watchpoint hit set `trapped`, also SIGTRAP,
+ * or on an opcode the platform does not know, reported as SIGILL. Without a
+ * connected GDB it ends the program, like an unknown opcode does without a
+ * debugger.
+ *
+ * @param stub Pointer to the GdbStub.
+ * @param chip8 Pointer to the stopped Chip8 instance.
+ * @return 1 if the program has to stop, 0 to keep running.
+ */
+int gdb_stub_trap(GdbStub *stub, Chip8 *chip8);
+
+/**
+ * @brief Checks, without blocking, whether GDB asked to interrupt the program.
+ *
+ * Meant to be called once per frame rather than once per instruction.
+ *
+ * @param stub Pointer to the GdbStub.
+ * @param chip8 Pointer to the Chip8 instance.
+ * @return 1 if the program has to stop, 0 to keep running.
+ */
+int gdb_stub_poll(GdbStub *stub, Chip8 *chip8);
+
+/**
+ * @brief Stops the program after the instruction that wrote a watched address.
+ *
+ * Meant to be called from a Chip8WatchCallback; the stop is reported to GDB
+ * as a write watchpoint hit. Watchpoints are set through Z2 packets once a
+ * Chip8Watch is attached to the instance.
+ *
+ * @param stub Pointer to the GdbStub.
+ * @param chip8 Pointer to the Chip8 instance.
+ * @param address Address that was written.
+ */
+void gdb_stub_watch_hit(GdbStub *stub, Chip8 *chip8, uint16_t address);
+
+/**
+ * @brief Reports the end of the program to GDB and closes the sockets.
+ *
+ * @param stub Pointer to the GdbStub.
+ * @param chip8 Pointer to the Chip8 instance.
+ */
+void gdb_stub_close(GdbStub *stub, Chip8 *chip8);
+
+#endif // GDB_STUB_H
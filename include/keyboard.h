@@ -2,6 +2,7 @@
 #define KEYBOARD_H
 
 #include "chip8.h"
+#include "latency.h"
 #include <SDL2/SDL.h>
 #include <stdint.h>
 
@@ -9,17 +10,35 @@
  * Reads the keyboard state and updates the CHIP-8 keyboard state.
  * 
  * @param chip8 Pointer to the Chip8 structure.
+ * @param latency Pointer to the Latency timing key presses, NULL to not time them.
  * @return 1 if the ESC key was pressed, 0 otherwise.
  */
-int read_keyboard(Chip8 *chip8);
+int read_keyboard(Chip8 *chip8, Latency *latency);
 
 /**
  * Reads the keyboard state using SDL and updates the CHIP-8 keyboard state.
  * 
  * @param chip8 Pointer to the Chip8 structure.
+ * @param latency Pointer to the Latency timing key presses, NULL to not time them.
  * @return 1 if the ESC key was pressed, 0 otherwise.
  */
-int read_keyboard_sdl(Chip8 *chip8);
+int read_keyboard_sdl(Chip8 *chip8, Latency *latency);
+
+/**
+ * Binds host keys to the CHIP-8 keys.
+ * 
+ * @param keys Digit or lowercase letter bound to each CHIP-8 key, in key order.
+ * @return 1 if the keys were bound, 0 if one is not a digit or letter or appears twice.
+ */
+int set_keymap(const char keys[KEYBOARD_SIZE]);
+
+/**
+ * Notes when a CHIP-8 key was pressed according to an SDL event.
+ * 
+ * @param e SDL event, ignored unless it presses a CHIP-8 key.
+ * @param latency Pointer to the Latency timing key presses.
+ */
+void time_key_event_sdl(const SDL_Event *e, Latency *latency);
 
 /**
  * Waits for a key press and returns the corresponding CHIP-8 key index.
@@ -35,4 +54,19 @@ uint8_t wait_for_key_sdl();
  */
 uint8_t wait_for_key();
 
+/**
+ * Blocks until an SDL event arrives or the timeout expires.
+ * The event stays queued for the next SDL_PollEvent().
+ * 
+ * @param timeout_ms Maximum time to wait in milliseconds, -1 to wait forever.
+ */
+void wait_for_input_sdl(int timeout_ms);
+
+/**
+ * Blocks until a key is available on the terminal or the timeout expires.
+ * 
+ * @param timeout_ms Maximum time to wait in milliseconds, -1 to wait forever.
+ */
+void wait_for_input(int timeout_ms);
+
 #endif // KEYBOARD_H
@@ -0,0 +1,122 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Values below 2^(LATENCY_SUB_BUCKET_BITS + 1) microseconds get a bucket each,
+// larger ones share buckets with a relative width of 1 / 2^LATENCY_SUB_BUCKET_BITS
+#define LATENCY_SUB_BUCKET_BITS 5
+#define LATENCY_MAX_BITS 36             // Largest value recorded, about 19 hours in microseconds
+#define LATENCY_BUCKETS (((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS - 1) << LATENCY_SUB_BUCKET_BITS) + \
+                         (2 << LATENCY_SUB_BUCKET_BITS))
+
+/**
+ * Segments of the path from a key press to the display showing its effect.
+ */
+typedef enum {
+    LATENCY_INPUT,                      // Key event to the change of Chip8.keys
+    LATENCY_EMULATION,                  // Change of Chip8.keys to the first Dxyn after it
+    LATENCY_RENDER,                     // That Dxyn to the frame presenting it
+    LATENCY_TOTAL,                      // Key event to the frame presenting its effect
+    LATENCY_SEGMENTS
+} LatencySegment;
+
+/**
+ * Log-linear histogram of durations in microseconds, in the style of
+ * HdrHistogram: every bucket is at most about 3% wide, so percentiles keep
+ * that precision over the whole range with a fixed amount of memory.
+ */
+typedef struct {
+    uint64_t count;                     // Values recorded
+    uint64_t sum;                       // Sum of the values
+    uint64_t max;                       // Largest value
+    uint32_t counts[LATENCY_BUCKETS];   // Values per bucket
+} LatencyHistogram;
+
+/**
+ * Measurement of the latency of key presses.
+ *
+ * One press is followed at a time: presses while it is in flight are not
+ * measured. Its effect is taken to be the first Dxyn after Chip8.keys
+ * changed, so programs that keep drawing regardless of input make the figures
+ * a lower bound. Times are in SDL performance counter ticks.
+ */
+typedef struct {
+    LatencyHistogram segments[LATENCY_SEGMENTS];
+    uint64_t frequency;                 // Performance counter ticks per second
+    uint64_t event_time;                // Earliest key event not yet seen in Chip8.keys, 0 for none
+    uint64_t start_time;                // Key event of the press in flight
+    uint64_t keys_time;                 // Change of Chip8.keys of the press in flight
+    uint64_t draw_time;                 // Dxyn of the press in flight
+    uint64_t abandoned;                 // Presses that drew nothing within a second
+    uint8_t stage;                      // Last stage the press in flight reached
+} Latency;
+
+/**
+ * @brief Resets the histograms.
+ *
+ * @param latency Pointer to the Latency to initialize.
+ * @param frequency Performance counter ticks per second.
+ */
+void latency_init(Latency *latency, uint64_t frequency);
+
+/**
+ * @brief Notes a key event, before the key reaches Chip8.keys.
+ *
+ * @param latency Pointer to the Latency, NULL to do nothing.
+ * @param time Performance counter when the event happened.
+ */
+void latency_key_event(Latency *latency, uint64_t time);
+
+/**
+ * @brief Notes that a key was pressed in Chip8.keys, starting a measurement if none is in flight.
+ *
+ * @param latency Pointer to the Latency, NULL to do nothing.
+ * @param time Performance counter when Chip8.keys changed.
+ */
+void latency_keys_changed(Latency *latency, uint64_t time);
+
+/**
+ * @brief Notes that a Dxyn instruction was executed.
+ *
+ * @param latency Pointer to the Latency.
+ * @param time Performance counter after the instruction.
+ */
+void latency_draw(Latency *latency, uint64_t time);
+
+/**
+ * @brief Notes that a frame was presented, completing the measurement in flight if it drew.
+ *
+ * @param latency Pointer to the Latency.
+ * @param time Performance counter after the frame was presented.
+ */
+void latency_present(Latency *latency, uint64_t time);
+
+/**
+ * @brief Returns the value below which a fraction of the recorded values fall.
+ *
+ * @param histogram Pointer to the LatencyHistogram.
+ * @param quantile Fraction between 0 and 1.
+ * @return Upper end of the bucket holding the quantile in microseconds, 0 without values.
+ */
+uint64_t latency_quantile(const LatencyHistogram *histogram, double quantile);
+
+/**
+ * @brief Writes the histograms as Prometheus summaries.
+ *
+ * @param latency Pointer to the Latency.
+ * @param buffer Buffer receiving the text.
+ * @param size Size of the buffer.
+ * @return Length of the text, truncated to fit the buffer.
+ */
+size_t latency_format(const Latency *latency, char *buffer, size_t size);
+
+/**
+ * @brief Prints the percentiles of every segment, if any press was measured.
+ *
+ * @param latency Pointer to the Latency.
+ */
+void latency_report(const Latency *latency);
+
+#endif // LATENCY_H
@@ -0,0 +1,31 @@
+#ifndef NET_H
+#define NET_H
+
+/**
+ * Socket addresses accepted by the servers and clients:
+ *
+ *   <port>          TCP on 127.0.0.1
+ *   <host>:<port>   TCP on the given IPv4 address, e.g. 0.0.0.0:9000 to listen on every interface
+ *   <path>          Unix socket, any address containing a '/'
+ */
+
+/**
+ * @brief Creates a socket listening on an address.
+ *
+ * A stale Unix socket file at the path is replaced.
+ *
+ * @param address Address to listen on.
+ * @param backlog Connections that may wait to be accepted.
+ * @return The listening socket, -1 on failure (reported on stderr).
+ */
+int net_listen(const char *address, int backlog);
+
+/**
+ * @brief Connects to a listening socket.
+ *
+ * @param address Address to connect to.
+ * @return The connected socket, -1 on failure (reported on stderr).
+ */
+int net_connect(const char *address);
+
+#endif // NET_H
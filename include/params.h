@@ -2,6 +2,9 @@
 #define PARAMS_H
 
 #include "chip8.h"
+#include "chip8_watch.h"
+#include "rom.h"
+#include "rom_pack.h"
 
 #include <stdint.h>
 #include <ctype.h>
@@ -11,34 +14,45 @@
 /** Error message printed on failure to start the CHIP-8 emulator. */
 #define ERROR_MSG "CHIP 8 EMULATOR FAILED TO START\n"
 
+/** Returned by hex_decode() for text that is not hexadecimal. */
+#define HEX_INVALID (-1)
+
+/** Returned by hex_decode() for text with more bytes than fit. */
+#define HEX_TOO_LARGE (-2)
+
+/** Largest raw data text read from a stream, enough for a full program with 0x prefixes and line breaks. */
+#define RAW_TEXT_MAX (8 * PROGRAM_MEMORY_SIZE)
+
 /** Structure to hold command-line arguments. */
 typedef struct {
     char *ui;       /**< User interface type (e.g., terminal, window). */
-    char *type;     /**< Type of program data (e.g., file, raw). */
-    char *data;     /**< Path to file or raw data bytes. */
+    char *type;     /**< Type of program data (e.g., file, raw, pack). */
+    char *data;     /**< Path to file, raw data bytes or <archive>:<name>. */
+    char *platform; /**< Platform to emulate (e.g., chip8, schip, xochip), NULL for the program's own. */
+    char *quirks;   /**< Quirk profile (e.g., chip8, vip, schip, xochip), NULL for the program's own. */
+    unsigned long frames; /**< Number of 60 Hz frames to run headless, 0 for no limit. */
+    char *gdb;      /**< GDB stub address (TCP port or Unix socket path), NULL to run without it. */
+    char *watch;    /**< Watched RAM ranges (e.g., 300:3,3f0), NULL for none. */
+    char *record;   /**< Recording path (.y4m, .gif or .c8r), NULL to run without it. */
+    char *stream;   /**< Spectator stream address (TCP port, host:port or Unix socket path), NULL for none. */
+    char *stats;    /**< Stats endpoint address (Unix socket path, TCP port or host:port), NULL for none. */
+    char *trace;    /**< Chrome trace event JSON path, NULL to run without tracing. */
+    char *filter;   /**< Window scaling filter (e.g., nearest, scale2x). */
+    int phosphor;   /**< 1 to fade out pixels that go dark in the window, 0 otherwise. */
+    char *isa;      /**< Instruction set of the vector kernels (e.g., sse2, avx2), NULL for the best the host runs. */
     int result;     /**< Result status of argument parsing. */
 } Arguments;
 
 /** Structure to hold program data and its size. */
 typedef struct {
     size_t program_size; /**< Size of the loaded program. */
-    uint8_t program[PROGRAM_MEMORY_SIZE]; /**< Memory buffer to hold the program. */
+    const uint8_t *program; /**< Program bytes, in buffer or in the mapping of rom. */
+    Rom rom; /**< Mapped program file, loaded into RAM without an intermediate copy. */
+    RomPack pack; /**< Mapped ROM pack the program was read from, unmapped when it is not one. */
+    RomPackEntry entry; /**< How the ROM pack runs the program, all 0 for other programs. */
+    uint8_t buffer[PROGRAM_MEMORY_SIZE]; /**< Memory buffer to hold a raw program. */
 } Data;
 
-/** Check if a file exists and is readable.
- * 
- * @param path Path to the file.
- * @return 1 if the file exists and is readable, 0 otherwise.
- */
-int file_exists_and_readable(const char *path);
-
-/** Validate the format of raw data.
- * 
- * @param str Raw data string to validate.
- * @return 1 if the raw data is valid, 0 otherwise.
- */
-int is_raw_data_valid(const char *str);
-
 /** Read a binary file into a program buffer.
  * 
  * @param file_path Path to the binary file.
@@ -47,28 +61,78 @@ int is_raw_data_valid(const char *str);
  */
 void read_file_to_program(const char* file_path, uint8_t *program, size_t *program_size);
 
-/** Convert raw hexadecimal string to program byte array.
+/** Validate and decode hexadecimal text in a single pass.
  * 
- * @param hex_string Raw hexadecimal data as a string.
- * @param byte_array Pointer to the buffer where bytes will be stored.
- * @param program_size Pointer to a variable that will receive the program size.
+ * Bytes are pairs of digits in words separated by any whitespace, each word
+ * optionally prefixed with 0x, e.g. "00E0 0x6000\n1200".
+ * 
+ * @param text Hexadecimal text, not necessarily NUL terminated.
+ * @param length Length of the text.
+ * @param bytes Buffer receiving the bytes, NULL to only validate.
+ * @param capacity Number of bytes the program may have.
+ * @return Number of bytes, HEX_INVALID if the text is malformed, HEX_TOO_LARGE if it exceeds the capacity.
+ */
+long hex_decode(const char *text, size_t length, uint8_t *bytes, size_t capacity);
+
+/** Read a whole stream of text, such as a pipe, into memory.
+ * 
+ * @param stream Stream to read until its end.
+ * @param length Pointer to a variable that will receive the length of the text.
+ * @return The NUL terminated text, to be freed by the caller, NULL on failure or if it exceeds RAW_TEXT_MAX.
  */
-void raw_data_to_program(const char *hex_string, uint8_t *byte_array, size_t *program_size);
+char *read_text_stream(FILE *stream, size_t *length);
 
 /** Handle raw program data and load it into the program buffer.
  * 
- * @param data Raw hexadecimal data as a string.
+ * @param data Raw hexadecimal data as a string, "-" to read it from stdin.
  * @param program_data Pointer to the Data structure to store the loaded program.
  */
 void handle_raw_program_data(const char *data, Data *program_data);
 
-/** Handle file-based program data and load it into the program buffer.
+/** Handle file-based program data by mapping the file.
  * 
  * @param data Path to the program file.
  * @param program_data Pointer to the Data structure to store the loaded program.
  */
 void handle_file_program_data(const char *data, Data *program_data);
 
+/** Handle program data from a ROM pack by mapping the archive.
+ * 
+ * @param data Path to the archive and name or content hash of the program, <archive>:<name>.
+ * @param program_data Pointer to the Data structure to store the loaded program.
+ */
+void handle_pack_program_data(const char *data, Data *program_data);
+
+/** Convert a platform name to its Chip8Platform value.
+ * 
+ * @param name Platform name (chip8, schip or xochip).
+ * @return The Chip8Platform value, 0 if the name is unknown.
+ */
+uint8_t parse_platform(const char *name);
+
+/** Convert a quirk profile name to its Chip8QuirkProfile value.
+ * 
+ * @param name Quirk profile name (chip8, vip, schip or xochip).
+ * @return The Chip8QuirkProfile value, -1 if the name is unknown.
+ */
+int parse_quirks(const char *name);
+
+/** Parse a comma separated list of hexadecimal watch ranges, each <start>[:<length>].
+ * 
+ * @param text Watch range list.
+ * @param starts Receives the first address of each range.
+ * @param lengths Receives the length of each range, 1 if omitted.
+ * @param max Capacity of starts and lengths.
+ * @return Number of ranges, -1 if the list is malformed or too long.
+ */
+int parse_watchpoints(const char *text, uint16_t *starts, uint16_t *lengths, int max);
+
+/** Release the memory of a program once it is loaded into RAM.
+ * 
+ * @param program_data Pointer to the Data structure holding the program.
+ */
+void free_program_data(Data *program_data);
+
 /** Parse command-line arguments.
  * 
  * @param args Pointer to the Arguments structure to populate.
@@ -78,10 +142,12 @@ void handle_file_program_data(const char *data, Data *program_data);
 void get_args(Arguments *args, int argc, char *argv[]);
 
 /** Handle command-line arguments and load program data accordingly.
+ * 
+ * The platform and quirk profile default to those of the program.
  * 
  * @param args Pointer to the Arguments structure containing parsed arguments.
  * @param program_data Pointer to the Data structure to store the loaded program.
  */
-void handle_args(const Arguments *args, Data *program_data);
+void handle_args(Arguments *args, Data *program_data);
 
 #endif // PARAMS_H
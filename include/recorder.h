@@ -0,0 +1,117 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include "chip8.h"
+
+// Number of frames the ring can hold (must be a power of two).
+#define RECORDER_RING_SIZE 256
+
+// Recorded image, low resolution frames are scaled up to it.
+#define RECORDER_WIDTH DISPLAY_HIRES_WIDTH
+#define RECORDER_HEIGHT DISPLAY_HIRES_HEIGHT
+
+// Shortest GIF frame delay in 1/100 s, viewers slow down shorter ones.
+#define RECORDER_GIF_MIN_DELAY 2
+
+/**
+ * Run-length encoded recording (.c8r), played back by chip8-play.
+ *
+ * The file starts with RECORDER_RLE_MAGIC, a version byte and the frame rate,
+ * followed by one record per displayed image until the end of the file:
+ *
+ *   varint  frames the image stays on screen
+ *   byte    0 for 64x32, 1 for 128x64
+ *   varint  run lengths covering every pixel row by row, alternating between
+ *           pixels equal to the previous image and pixels that toggled,
+ *           starting with equal ones
+ *
+ * A pixel is lit if any bitplane is set. After a resolution change the
+ * previous image counts as blank. Varints are LEB128: 7 bits per byte, least
+ * significant first, the top bit set on all but the last byte.
+ */
+#define RECORDER_RLE_MAGIC "C8RL"
+#define RECORDER_RLE_VERSION 1
+
+typedef enum {
+    RECORDER_Y4M,   // Uncompressed YUV 4:2:0 at a constant 60 fps, for external encoders
+    RECORDER_GIF,   // Animated GIF in the display colors
+    RECORDER_RLE    // RECORDER_RLE_MAGIC run-length encoded 1-bit frames
+} RecorderFormat;
+
+/**
+ * Display contents at the end of one emulated frame.
+ */
+typedef struct {
+    uint32_t frame;                                           // Number of the emulated frame
+    uint8_t hires;                                            // 1 in 128x64 mode, 0 in 64x32 mode
+    DisplayRow display[DISPLAY_PLANES][DISPLAY_HIRES_HEIGHT]; // Display bitplanes
+} RecorderFrame;
+
+/**
+ * Single-producer/single-consumer ring of frames.
+ *
+ * The emulation thread is the only writer of `head`, the encoder thread is the
+ * only writer of `tail`, so neither side ever takes a lock.
+ */
+typedef struct {
+    RecorderFrame frames[RECORDER_RING_SIZE];
+    SDL_atomic_t head;                // Next slot to write (producer)
+    SDL_atomic_t tail;                // Next slot to read (consumer)
+} RecorderRing;
+
+typedef struct {
+    RecorderFormat format;            // Output format, from the file extension
+    FILE *file;                       // Output file
+    RecorderRing ring;                // Frames pushed by the emulator
+    SDL_Thread *thread;               // Encoder thread
+    SDL_sem *wake;                    // Posted after every push
+    SDL_atomic_t stopping;            // Set once no more frames will be pushed
+    uint32_t end_frame;               // Frame after the last pushed one, read once stopping
+    RecorderFrame last;               // Last queued frame, producer only
+    uint8_t has_last;                 // 1 once a frame was queued, producer only
+    uint32_t pushed;                  // Frames queued, producer only
+    uint32_t dropped;                 // Frames lost to a full ring, producer only
+    uint32_t gif_start;               // Frame the next GIF image is shown from, encoder only
+    uint8_t previous[RECORDER_HEIGHT][RECORDER_WIDTH]; // Last encoded RLE image, encoder only
+    uint8_t previous_hires;           // Resolution of previous, encoder only
+} Recorder;
+
+/**
+ * @brief Creates the output file and starts the encoder thread.
+ *
+ * The format follows the extension of the path: .y4m, .gif or .c8r. A Y4M
+ * recording can be piped to an encoder by giving the path of a named pipe.
+ *
+ * @param recorder Pointer to the Recorder struct to initialize. Must stay at a
+ *                 fixed address until recorder_close() is called.
+ * @param path Path of the output file.
+ * @return 1 if the recording started, 0 otherwise.
+ */
+int recorder_open(Recorder *recorder, const char *path);
+
+/**
+ * @brief Queues the display at the end of an emulated frame.
+ *
+ * Frames identical to the previously queued one are skipped. Never blocks: if
+ * the encoder has fallen behind and the ring is full, the frame is dropped and
+ * counted.
+ *
+ * @param recorder Pointer to the Recorder struct.
+ * @param chip8 Pointer to the Chip8 instance.
+ * @param frame Number of emulated frames run so far; the frame is shown from then on.
+ */
+void recorder_push_frame(Recorder *recorder, const Chip8 *chip8, uint32_t frame);
+
+/**
+ * @brief Encodes the queued frames, finishes the file and stops the encoder thread.
+ *
+ * The last frame stays on screen until the end of the last pushed frame. Prints
+ * the number of recorded and dropped frames.
+ *
+ * @param recorder Pointer to the Recorder struct.
+ */
+void recorder_close(Recorder *recorder);
+
+#endif // RECORDER_H
@@ -0,0 +1,101 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include "chip8.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ROMs past the one just handed out whose pages are requested from the disk.
+#define ROM_PREFETCH_DISTANCE 16
+
+/**
+ * Program file mapped into memory, loaded into guest RAM without an
+ * intermediate buffer.
+ */
+typedef struct {
+    const uint8_t *data;    // Program bytes, NULL for an empty file
+    size_t size;            // Bytes of the program, at most PROGRAM_MEMORY_SIZE
+    size_t mapped;          // Length of the mapping, 0 if the bytes are not mapped by rom_map()
+    uint8_t owned;          // 1 if data is a heap buffer that rom_unmap() frees
+} Rom;
+
+/**
+ * ROM files handed out to any number of worker threads, in order.
+ *
+ * Directories are expanded into the regular files they contain, sorted by
+ * name. Handing out a ROM asks the kernel to read the ROM
+ * ROM_PREFETCH_DISTANCE places later, so that its pages are cached by the
+ * time a worker maps it.
+ */
+typedef struct {
+    char **paths;           // Every ROM file
+    int count;              // Number of ROM files
+    int next;               // Index of the next ROM to hand out, claimed atomically
+} RomQueue;
+
+/**
+ * @brief Maps a program file, opening it once.
+ *
+ * Files that cannot be mapped, such as pipes, are read into a heap buffer
+ * instead. Files longer than PROGRAM_MEMORY_SIZE are cut to it.
+ *
+ * @param rom Pointer to the Rom to fill.
+ * @param path Path to the program file.
+ * @return 1 on success, 0 if the file cannot be read (errno tells why).
+ */
+int rom_map(Rom *rom, const char *path);
+
+/**
+ * @brief Releases the memory of a Rom.
+ *
+ * @param rom Pointer to the Rom.
+ */
+void rom_unmap(Rom *rom);
+
+/**
+ * @brief Asks the kernel to start reading a file into the page cache without waiting for it.
+ *
+ * @param path Path to the file.
+ */
+void rom_prefetch(const char *path);
+
+/**
+ * @brief Loads a mapped program into guest RAM with a single copy.
+ *
+ * The write is recorded in an attached snapshot, so that restoring it
+ * before the next program clears this one.
+ *
+ * @param chip8 Pointer to the Chip8 structure.
+ * @param rom Pointer to the Rom.
+ */
+void rom_load(Chip8 *chip8, const Rom *rom);
+
+/**
+ * @brief Lists the ROM files of paths and directories and starts prefetching the first ones.
+ *
+ * @param queue Pointer to the RomQueue to initialize.
+ * @param paths ROM files and directories of ROM files.
+ * @param count Number of paths.
+ * @return 1 on success, 0 if a directory cannot be read or memory runs out (reported on stderr).
+ */
+int rom_queue_init(RomQueue *queue, char *const *paths, int count);
+
+/**
+ * @brief Claims and maps the next ROM. Safe to call from several threads.
+ *
+ * @param queue Pointer to the RomQueue.
+ * @param rom Pointer to the Rom to fill, to be released with rom_unmap().
+ * @return Index of the ROM in the queue, -1 once every ROM was handed out.
+ *         A ROM that cannot be read is reported on stderr and handed out empty.
+ */
+int rom_queue_next(RomQueue *queue, Rom *rom);
+
+/**
+ * @brief Releases the paths of a queue.
+ *
+ * @param queue Pointer to the RomQueue.
+ */
+void rom_queue_free(RomQueue *queue);
+
+#endif // ROM_H
@@ -0,0 +1,158 @@
+#ifndef ROM_PACK_H
+#define ROM_PACK_H
+
+#include "chip8.h"
+#include "rom.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ROM_PACK_MAGIC "C8PK"
+#define ROM_PACK_VERSION 1
+#define ROM_PACK_BYTE_ORDER 0x01020304u    // Reads back differently on a host of the other byte order
+#define ROM_PACK_ALIGNMENT 16              // Alignment of every program in the archive
+#define ROM_PACK_NAME_MAX 8                // Size of the platform and quirk profile fields
+
+/**
+ * A ROM pack is a single file holding many programs, read in place from a
+ * read-only mapping. All values are in the byte order of the host that wrote
+ * it, which the reader checks, and every table is naturally aligned:
+ *
+ *   RomPackHeader
+ *   RomPackEntry[entry_count]   sorted by name_hash, then name
+ *   RomPackBlob[blob_count]     sorted by hash
+ *   names                       NUL terminated
+ *   programs                    each aligned to ROM_PACK_ALIGNMENT
+ *
+ * Entries that name identical programs share one blob.
+ */
+typedef struct {
+    char magic[4];              // ROM_PACK_MAGIC
+    uint32_t version;           // ROM_PACK_VERSION
+    uint32_t byte_order;        // ROM_PACK_BYTE_ORDER
+    uint32_t entry_count;
+    uint32_t blob_count;
+    uint32_t entries;           // Offset of the entry table
+    uint32_t blobs;             // Offset of the blob table
+    uint32_t size;              // Size of the whole archive
+} RomPackHeader;
+
+/**
+ * Named program and how to run it.
+ */
+typedef struct {
+    uint64_t name_hash;                 // rom_pack_hash() of the name
+    uint32_t name;                      // Offset of the NUL terminated name
+    uint32_t blob;                      // Index of the program in the blob table
+    char platform[ROM_PACK_NAME_MAX];   // Platform name, NUL padded
+    char quirks[ROM_PACK_NAME_MAX];     // Quirk profile name, NUL padded
+    char keymap[KEYBOARD_SIZE];         // Host key bound to each CHIP-8 key, all 0 for the default layout
+    uint16_t cycles_per_frame;          // Instructions per 60 Hz frame the program expects, 0 if unknown
+    uint8_t padding[6];
+} RomPackEntry;
+
+/**
+ * Distinct program.
+ */
+typedef struct {
+    uint64_t hash;              // rom_pack_hash() of the program
+    uint32_t offset;            // Offset of the program
+    uint32_t size;              // Bytes of the program, at most PROGRAM_MEMORY_SIZE
+    uint32_t entry;             // Index of the first entry naming the program
+    uint32_t padding;
+} RomPackBlob;
+
+/**
+ * Mapped ROM pack.
+ */
+typedef struct {
+    const uint8_t *base;            // Mapping of the whole archive
+    size_t size;                    // Length of the mapping
+    const RomPackHeader *header;
+    const RomPackEntry *entries;
+    const RomPackBlob *blobs;
+} RomPack;
+
+/**
+ * @brief Hashes bytes with 64-bit FNV-1a, the hash of names and programs in a ROM pack.
+ *
+ * @param data Bytes to hash.
+ * @param size Number of bytes.
+ * @return The hash.
+ */
+uint64_t rom_pack_hash(const void *data, size_t size);
+
+/**
+ * @brief Maps a ROM pack and checks its header and tables.
+ *
+ * @param pack Pointer to the RomPack to fill.
+ * @param path Path to the archive.
+ * @return 1 on success, 0 if the file cannot be mapped or is not a valid archive (reported on stderr).
+ */
+int rom_pack_open(RomPack *pack, const char *path);
+
+/**
+ * @brief Unmaps a ROM pack. Roms borrowed from it become invalid.
+ *
+ * @param pack Pointer to the RomPack.
+ */
+void rom_pack_close(RomPack *pack);
+
+/**
+ * @brief Finds an entry by name with a binary search of the sorted hashes.
+ *
+ * @param pack Pointer to the RomPack.
+ * @param name Name of the entry.
+ * @return The entry, NULL if there is none of that name.
+ */
+const RomPackEntry *rom_pack_find(const RomPack *pack, const char *name);
+
+/**
+ * @brief Finds the first entry naming a program by the hash of its content.
+ *
+ * @param pack Pointer to the RomPack.
+ * @param hash rom_pack_hash() of the program.
+ * @return The entry, NULL if no program has that hash.
+ */
+const RomPackEntry *rom_pack_find_hash(const RomPack *pack, uint64_t hash);
+
+/**
+ * @brief Finds an entry by name or, failing that, by a 16 digit hexadecimal content hash.
+ *
+ * @param pack Pointer to the RomPack.
+ * @param key Name or content hash.
+ * @return The entry, NULL if none matches.
+ */
+const RomPackEntry *rom_pack_lookup(const RomPack *pack, const char *key);
+
+/**
+ * @brief Returns the name of an entry.
+ *
+ * @param pack Pointer to the RomPack.
+ * @param entry Entry of the pack.
+ * @return The name, NULL if the archive is corrupt.
+ */
+const char *rom_pack_name(const RomPack *pack, const RomPackEntry *entry);
+
+/**
+ * @brief Returns the blob of an entry.
+ *
+ * @param pack Pointer to the RomPack.
+ * @param entry Entry of the pack.
+ * @return The blob, NULL if the archive is corrupt.
+ */
+const RomPackBlob *rom_pack_blob(const RomPack *pack, const RomPackEntry *entry);
+
+/**
+ * @brief Points a Rom at the program of an entry, inside the mapping of the pack.
+ *
+ * The Rom borrows the bytes: rom_unmap() leaves the pack mapped.
+ *
+ * @param pack Pointer to the RomPack.
+ * @param entry Entry of the pack.
+ * @param rom Pointer to the Rom to fill.
+ * @return 1 on success, 0 if the archive is corrupt.
+ */
+int rom_pack_rom(const RomPack *pack, const RomPackEntry *entry, Rom *rom);
+
+#endif // ROM_PACK_H
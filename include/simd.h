@@ -0,0 +1,114 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "display_row.h"
+
+#include <stdint.h>
+
+/**
+ * Instruction sets the vector kernels are built for.
+ *
+ * Every kernel is compiled for each instruction set the compiler can target,
+ * whatever the flags of the build, and the best one the host supports is
+ * picked on first use. A single binary thus runs the AVX-512 kernels on hosts
+ * that have it and the SSE2 ones on the others.
+ */
+typedef enum {
+    SIMD_SCALAR,            // Portable C, always available
+    SIMD_SSE2,              // x86, 128-bit
+    SIMD_AVX2,              // x86, 256-bit
+    SIMD_AVX512,            // x86 with AVX-512 F, DQ and BW, 512-bit
+    SIMD_NEON,              // AArch64, 128-bit
+    SIMD_ISA_AMOUNT
+} SimdIsa;
+
+/** Names of the instruction sets as accepted by --force-isa, indexed by SimdIsa. */
+extern const char *const simd_isa_names[SIMD_ISA_AMOUNT];
+
+/**
+ * @brief Converts an instruction set name to its SimdIsa value.
+ *
+ * @param name Instruction set name (scalar, sse2, avx2, avx512 or neon).
+ * @return The SimdIsa value, -1 if the name is unknown.
+ */
+int parse_isa(const char *name);
+
+/**
+ * @brief Tells whether the kernels of an instruction set are built in and the host can run them.
+ *
+ * @param isa One of the SimdIsa values.
+ * @return 1 if the kernels can be used, 0 otherwise.
+ */
+int simd_supported(SimdIsa isa);
+
+/**
+ * @brief Selects the kernels of an instruction set instead of the best one, for testing.
+ *
+ * @param isa One of the SimdIsa values.
+ * @return 1 on success, 0 if the instruction set is not supported (see simd_supported()).
+ */
+int simd_force(SimdIsa isa);
+
+/**
+ * @brief Returns the instruction set whose kernels run, selecting the best supported one on first use.
+ *
+ * @return One of the SimdIsa values.
+ */
+SimdIsa simd_isa(void);
+
+/**
+ * @brief Mixes 64 bits with the splitmix64 finalizer, the scalar form of the mix simd_hash_ram() sums.
+ */
+static inline uint64_t simd_mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Expands pixels of two bitplanes into ARGB pixels, repeating each one `factor` times.
+ *
+ * @param out Receives width * factor pixels.
+ * @param plane0 First bitplane, leftmost pixel in the top bit of the first word.
+ * @param plane1 Second bitplane, laid out like plane0.
+ * @param width Pixels to expand, a multiple of 16.
+ * @param factor Times each pixel is repeated: 1, 2 or 4.
+ * @param palette ARGB color of each pixel state, bit 0 from plane0 and bit 1 from plane1.
+ */
+void simd_expand(uint32_t *out, const uint64_t *plane0, const uint64_t *plane1, int width, int factor,
+                 const uint32_t *palette);
+
+/**
+ * @brief Blends ARGB pixels into the current ones: each channel takes the brighter of its new
+ *        value and its old value scaled by keep / 256.
+ *
+ * @param row Current pixels, updated in place.
+ * @param target New pixels.
+ * @param count Number of pixels, a multiple of 16.
+ * @param keep Brightness out of 256 the old pixels keep.
+ * @return 1 if some pixel is still brighter than its new value, 0 otherwise.
+ */
+int simd_fade(uint32_t *row, const uint32_t *target, int count, uint32_t keep);
+
+/**
+ * @brief Compares two snapshots of display rows.
+ *
+ * @param a First rows.
+ * @param b Second rows.
+ * @param count Number of rows, a multiple of 4 and at most 64.
+ * @return Bit y set if row y differs.
+ */
+uint64_t simd_rows_differ(const DisplayRow *a, const DisplayRow *b, int count);
+
+/**
+ * @brief Sums simd_mix64(address << 8 | byte) over a RAM image, in any order.
+ *
+ * @param ram Bytes to hash, the first at address 0.
+ * @param size Number of bytes.
+ * @return The sum, modulo 2^64.
+ */
+uint64_t simd_hash_ram(const uint8_t *ram, uint32_t size);
+
+#endif // SIMD_H
@@ -0,0 +1,134 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "chip8.h"
+
+#define STREAM_MAX_VIEWERS 16
+
+/**
+ * Spectator stream protocol.
+ *
+ * On connecting, a viewer receives STREAM_MAGIC and STREAM_VERSION, then one
+ * message per displayed frame that differs from the previous one:
+ *
+ *   StreamHeader      little-endian
+ *   row entries       `count` times: one byte plane * 64 + y, then the row,
+ *                     8 bytes in 64x32 mode and 16 in 128x64 mode, leftmost
+ *                     pixel in the top bit of the first byte
+ *
+ * A keyframe holds every row of both bitplanes and replaces the display. A
+ * delta holds the rows that changed since the message before it and applies
+ * only on top of display version `sequence - 1`. The server never waits for a
+ * viewer: one that cannot keep up misses messages and gets a keyframe of the
+ * current display once its socket drains.
+ */
+#define STREAM_MAGIC "C8SP"
+#define STREAM_VERSION 1
+
+#define STREAM_KEYFRAME 1
+#define STREAM_DELTA 2
+
+#define STREAM_HEADER_SIZE 12
+#define STREAM_MESSAGE_MAX (STREAM_HEADER_SIZE + DISPLAY_PLANES * DISPLAY_HIRES_HEIGHT * (1 + DISPLAY_HIRES_WIDTH / 8))
+
+/** Socket buffer size on either end, bounding how far behind a viewer can lag. */
+#define STREAM_SOCKET_BUFFER (2 * STREAM_MESSAGE_MAX)
+
+/**
+ * Start of every message, STREAM_HEADER_SIZE bytes on the wire.
+ */
+typedef struct {
+    uint8_t type;        // STREAM_KEYFRAME or STREAM_DELTA
+    uint8_t hires;       // 1 in 128x64 mode, 0 in 64x32 mode
+    uint8_t count;       // Row entries following the header
+    uint8_t reserved;
+    uint32_t sequence;   // Display version, incremented by every change
+    uint32_t frame;      // Emulated frame the display was taken at
+} StreamHeader;
+
+/**
+ * Connection to one viewer.
+ */
+typedef struct {
+    int fd;                                 // Socket, -1 for a free slot
+    uint8_t pending[STREAM_MESSAGE_MAX];    // Message the socket did not take in full yet
+    int pending_start;                      // First byte of pending not sent yet
+    int pending_end;                        // End of the message in pending
+    uint8_t need_keyframe;                  // Set when the viewer missed messages
+} StreamViewer;
+
+/**
+ * Server sending the display to any number of spectators.
+ *
+ * Everything runs on the emulation thread with non-blocking sockets, once
+ * per frame: new viewers are accepted, the changed rows are encoded once and
+ * handed to every viewer whose previous message has left.
+ */
+typedef struct {
+    int listen_fd;                                            // Listening socket
+    StreamViewer viewers[STREAM_MAX_VIEWERS];                 // Connected viewers
+    DisplayRow display[DISPLAY_PLANES][DISPLAY_HIRES_HEIGHT]; // Display as last sent
+    uint8_t hires;                                            // Resolution as last sent
+    uint32_t sequence;                                        // Version of display
+    uint8_t keyframe[STREAM_MESSAGE_MAX];                     // Keyframe of the current frame
+    int keyframe_size;                                        // 0 until it is needed in a frame
+    uint8_t delta[STREAM_MESSAGE_MAX];                        // Delta of the current frame
+    int delta_size;                                           // 0 if nothing changed
+} StreamServer;
+
+/**
+ * @brief Starts listening for viewers.
+ *
+ * @param server Pointer to the StreamServer to initialize.
+ * @param address Address to listen on, in any form net_listen() accepts.
+ * @return 1 on success, 0 on failure.
+ */
+int stream_open(StreamServer *server, const char *address);
+
+/**
+ * @brief Accepts new viewers and sends them the display at the end of a frame.
+ *
+ * Never blocks.
+ *
+ * @param server Pointer to the StreamServer.
+ * @param chip8 Pointer to the Chip8 instance.
+ * @param frame Number of the emulated frame.
+ */
+void stream_push_frame(StreamServer *server, const Chip8 *chip8, uint32_t frame);
+
+/**
+ * @brief Disconnects every viewer and stops listening.
+ *
+ * @param server Pointer to the StreamServer.
+ */
+void stream_close(StreamServer *server);
+
+/**
+ * @brief Reads a message header from its wire format.
+ *
+ * @param bytes STREAM_HEADER_SIZE bytes.
+ * @param header Receives the header.
+ */
+void stream_decode_header(const uint8_t *bytes, StreamHeader *header);
+
+/**
+ * @brief Returns the number of bytes of row entries following a header.
+ *
+ * @param header Pointer to the decoded header.
+ * @return Size in bytes.
+ */
+int stream_rows_size(const StreamHeader *header);
+
+/**
+ * @brief Writes the row entries of a message into the display of an instance.
+ *
+ * A keyframe clears the display and sets the resolution first.
+ *
+ * @param chip8 Pointer to the Chip8 instance whose display is updated.
+ * @param header Pointer to the decoded header.
+ * @param rows stream_rows_size() bytes of row entries.
+ * @return 1 on success, 0 if an entry names a row outside the display.
+ */
+int stream_apply_rows(Chip8 *chip8, const StreamHeader *header, const uint8_t *rows);
+
+#endif // STREAM_H
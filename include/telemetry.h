@@ -0,0 +1,123 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "latency.h"
+#include <SDL2/SDL.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define TELEMETRY_MAX_CLIENTS 8
+#define TELEMETRY_OVERLAY_SIZE 256
+
+/**
+ * Stats client that connected and has not been answered yet.
+ */
+typedef struct {
+    int fd;               // Socket, -1 for a free slot
+    uint64_t accepted;    // Performance counter when it connected
+} TelemetryClient;
+
+/**
+ * Performance counters of one emulator instance.
+ *
+ * Every field is written by the emulation thread only, and the stats socket is
+ * served from the same thread at frame boundaries, so the counters are plain
+ * integers. Times are in SDL performance counter ticks. The rates cover the
+ * last complete second.
+ */
+typedef struct {
+    uint64_t instructions;              // Instructions executed
+    uint64_t frames;                    // 60 Hz frames completed
+    uint64_t late_frames;               // Frames that took over 1.5 frame periods of host time
+    uint64_t dropped_frames;            // Whole frame periods lost by late frames
+    uint64_t emulation_ticks;           // Time spent executing instructions
+    uint64_t render_ticks;              // Time spent drawing the display
+    uint64_t input_ticks;               // Time spent polling events and the keyboard
+
+    double instructions_per_second;
+    double frames_per_second;
+    double emulation_ms_per_frame;
+    double render_ms_per_frame;
+    double input_ms_per_frame;
+
+    uint64_t frequency;                 // Performance counter ticks per second
+    uint64_t frame_start;               // Performance counter at the start of the current frame
+    uint64_t window_start;              // Performance counter at the start of the current second
+    uint64_t window_instructions;       // Totals at the start of the current second
+    uint64_t window_frames;
+    uint64_t window_emulation_ticks;
+    uint64_t window_render_ticks;
+    uint64_t window_input_ticks;
+    uint64_t last_poll;                 // Performance counter when the stats socket was last served
+
+    int listen_fd;                      // Stats socket, -1 without one
+    TelemetryClient clients[TELEMETRY_MAX_CLIENTS];
+    Latency latency;                    // Key press to display latency
+    uint8_t overlay;                    // 1 while the window shows the overlay
+} Telemetry;
+
+/**
+ * @brief Returns the current value of the performance counter.
+ *
+ * @return Ticks of the SDL high resolution counter.
+ */
+static inline uint64_t telemetry_now(void) {
+    return SDL_GetPerformanceCounter();
+}
+
+/**
+ * @brief Resets the counters and starts the first frame.
+ *
+ * @param telemetry Pointer to the Telemetry to initialize.
+ */
+void telemetry_init(Telemetry *telemetry);
+
+/**
+ * @brief Opens the stats socket.
+ *
+ * A client connecting to it gets the counters and the key latency histograms
+ * in the Prometheus text format,
+ * wrapped in an HTTP response if it sends an HTTP request, and is disconnected.
+ *
+ * @param telemetry Pointer to the Telemetry.
+ * @param address Address to listen on, in any form net_listen() accepts.
+ * @return 1 on success, 0 on failure.
+ */
+int telemetry_listen(Telemetry *telemetry, const char *address);
+
+/**
+ * @brief Ends frames, updating the frame timing and rates and answering stats clients.
+ *
+ * @param telemetry Pointer to the Telemetry.
+ * @param frames Number of frames that ended.
+ * @param paced 1 if frames are paced to 60 Hz and late ones count, 0 for an
+ *              unthrottled run, whose whole time counts as emulation.
+ */
+void telemetry_end_frames(Telemetry *telemetry, uint32_t frames, uint8_t paced);
+
+/**
+ * @brief Writes the counters in the Prometheus text exposition format.
+ *
+ * @param telemetry Pointer to the Telemetry.
+ * @param buffer Buffer receiving the text.
+ * @param size Size of the buffer.
+ * @return Length of the text, truncated to fit the buffer.
+ */
+size_t telemetry_format(const Telemetry *telemetry, char *buffer, size_t size);
+
+/**
+ * @brief Writes the rates as short lines for the window overlay.
+ *
+ * @param telemetry Pointer to the Telemetry.
+ * @param buffer Buffer of TELEMETRY_OVERLAY_SIZE bytes receiving the lines.
+ */
+void telemetry_format_overlay(const Telemetry *telemetry, char *buffer);
+
+/**
+ * @brief Disconnects pending clients and closes the stats socket.
+ *
+ * @param telemetry Pointer to the Telemetry.
+ */
+void telemetry_close(Telemetry *telemetry);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,117 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <SDL2/SDL.h>
+#include <stdint.h>
+
+// Events one thread keeps at most, later ones are dropped.
+#define TRACE_MAX_EVENTS (1 << 22)
+
+// Spans one thread can have open at once.
+#define TRACE_MAX_DEPTH 8
+
+/**
+ * Span or instant recorded by a thread. Times are in SDL performance counter
+ * ticks, the end of a span is 0 until it ends.
+ */
+typedef struct {
+    const char *name;                   // Static string naming the phase
+    uint64_t begin;
+    uint64_t end;
+    uint8_t instant;                    // 1 for an instant, which has no end
+} TraceEvent;
+
+/**
+ * Events of one thread. Only that thread writes to it until the trace is
+ * closed, so recording takes no lock.
+ */
+typedef struct TraceBuffer {
+    TraceEvent *events;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t dropped;                   // Events lost to TRACE_MAX_EVENTS
+    int32_t open[TRACE_MAX_DEPTH];      // Index of each open span, -1 for a dropped one
+    int depth;
+    unsigned long thread_id;            // SDL_ThreadID() of the thread
+    const char *thread_name;            // Static string, NULL for an unnamed thread
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+/** 1 while a trace is being recorded. */
+extern uint8_t trace_enabled;
+
+/**
+ * @brief Starts recording a trace of the calling thread and every thread that records events.
+ *
+ * @param path Path of the Chrome trace event JSON file written by trace_close().
+ * @return 1 on success, 0 if the trace cannot be recorded.
+ */
+int trace_open(const char *path);
+
+/**
+ * @brief Names the calling thread in the trace.
+ *
+ * @param name Static string naming the thread.
+ */
+void trace_thread_name(const char *name);
+
+/**
+ * @brief Records the beginning of a span on the calling thread.
+ *
+ * @param name Static string naming the phase.
+ */
+void trace_record_begin(const char *name);
+
+/**
+ * @brief Records the end of the innermost open span of the calling thread.
+ */
+void trace_record_end(void);
+
+/**
+ * @brief Records an instant on the calling thread.
+ *
+ * @param name Static string naming the instant.
+ */
+void trace_record_instant(const char *name);
+
+/**
+ * @brief Writes the trace and stops recording.
+ *
+ * Every other thread that recorded events must have stopped doing so.
+ *
+ * @return 1 if the trace was written or none was recorded, 0 on failure.
+ */
+int trace_close(void);
+
+/**
+ * @brief Begins a span if a trace is being recorded.
+ *
+ * @param name Static string naming the phase.
+ */
+static inline void trace_begin(const char *name) {
+    if (trace_enabled) {
+        trace_record_begin(name);
+    }
+}
+
+/**
+ * @brief Ends the innermost open span if a trace is being recorded.
+ */
+static inline void trace_end(void) {
+    if (trace_enabled) {
+        trace_record_end();
+    }
+}
+
+/**
+ * @brief Records an instant if a trace is being recorded.
+ *
+ * @param name Static string naming the instant.
+ */
+static inline void trace_instant(const char *name) {
+    if (trace_enabled) {
+        trace_record_instant(name);
+    }
+}
+
+#endif // TRACE_H
@@ -0,0 +1,274 @@
+#include "../include/chip8.h"
+#include "../include/chip8_fork.h"
+#include "../include/chip8_lockstep.h"
+#include "../include/chip8_snapshot.h"
+#include "../include/chip8_watch.h"
+
+#include <stdio.h>
+
+// Fails the current test with the condition that did not hold.
+#define CHECK(condition)                                                                  \
+    do {                                                                                  \
+        if (!(condition)) {                                                               \
+            fprintf(stderr, "%s:%d: %s\n", __func__, __LINE__, #condition);               \
+            return 0;                                                                     \
+        }                                                                                 \
+    } while (0)
+
+// Writes through Fx33 twice, then loops: A300 F033 607B F033 1208.
+static const uint8_t bcdProgram[] = { 0xA3, 0x00, 0xF0, 0x33, 0x60, 0x7B, 0xF0, 0x33, 0x12, 0x08 };
+
+// Initializes an instance running a program.
+static void loadProgram(Chip8 *chip8, const uint8_t *program, size_t size) {
+    chip8_init(chip8);
+    chip8_seed_random(chip8, 1);
+    chip8_load_ram(chip8, program, size);
+}
+
+// Resuming a fork taken before the state hash was attached keeps the hash attached and exact.
+static int testForkResumeKeepsStateHash(void) {
+    Chip8 chip8;
+    Chip8ForkTracker tracker;
+    Chip8StateHash hash;
+    loadProgram(&chip8, bcdProgram, sizeof(bcdProgram));
+    chip8_fork_attach(&chip8, &tracker);
+    Chip8Fork *fork = chip8_fork(&chip8);
+    CHECK(fork != NULL);
+
+    chip8_step(&chip8);
+    chip8_state_hash_attach(&chip8, &hash);
+    CHECK(chip8_fork_resume(&chip8, fork));
+    CHECK(chip8.state_hash == &hash);
+    CHECK(chip8_state_hash_update(&chip8) == chip8_state_hash_compute(&chip8));
+
+    for (int i = 0; i < 4; i++) {
+        chip8_step(&chip8);
+        CHECK(chip8_state_hash_update(&chip8) == chip8_state_hash_compute(&chip8));
+    }
+    CHECK(chip8.ram[0x300] == 1 && chip8.ram[0x301] == 2 && chip8.ram[0x302] == 3);
+
+    chip8_state_hash_detach(&chip8);
+    chip8_fork_detach(&chip8);
+    chip8_fork_free(fork);
+    chip8_destroy(&chip8);
+    return 1;
+}
+
+// Pages a fork resume copies into RAM are restored by a snapshot captured before the resume.
+static int testForkResumeUnderSnapshot(void) {
+    static Chip8 chip8;
+    static Chip8Snapshot snapshot;
+    Chip8ForkTracker tracker;
+    loadProgram(&chip8, bcdProgram, sizeof(bcdProgram));
+    chip8_fork_attach(&chip8, &tracker);
+    Chip8Fork *fork = chip8_fork(&chip8);
+    CHECK(fork != NULL);
+
+    for (int i = 0; i < 4; i++) {
+        chip8_step(&chip8);
+    }
+    chip8_snapshot_capture(&chip8, &snapshot);
+    CHECK(chip8_fork_resume(&chip8, fork));
+    CHECK(chip8.ram[0x300] == 0 && chip8.ram[0x301] == 0 && chip8.ram[0x302] == 0);
+
+    chip8_snapshot_restore(&chip8, &snapshot);
+    CHECK(chip8.ram[0x300] == 1 && chip8.ram[0x301] == 2 && chip8.ram[0x302] == 3);
+
+    chip8_snapshot_release(&chip8, &snapshot);
+    chip8_fork_detach(&chip8);
+    chip8_fork_free(fork);
+    chip8_destroy(&chip8);
+    return 1;
+}
+
+// Restoring a snapshot captured before the state hash was attached keeps the hash attached and exact.
+static int testSnapshotRestoreKeepsStateHash(void) {
+    static Chip8 chip8;
+    static Chip8Snapshot snapshot;
+    Chip8StateHash hash;
+    loadProgram(&chip8, bcdProgram, sizeof(bcdProgram));
+    Chip8Handler handlers[OPCODE_AMOUNT + 1];
+    memcpy(handlers, chip8.handlers, sizeof(handlers));
+
+    chip8_snapshot_capture(&chip8, &snapshot);
+    chip8_step(&chip8);
+    chip8_state_hash_attach(&chip8, &hash);
+    chip8_snapshot_restore(&chip8, &snapshot);
+    CHECK(chip8.state_hash == &hash);
+    CHECK(chip8_state_hash_update(&chip8) == chip8_state_hash_compute(&chip8));
+
+    for (int i = 0; i < 4; i++) {
+        chip8_step(&chip8);
+        CHECK(chip8_state_hash_update(&chip8) == chip8_state_hash_compute(&chip8));
+    }
+
+    chip8_state_hash_detach(&chip8);
+    chip8_snapshot_release(&chip8, &snapshot);
+    CHECK(memcmp(chip8.handlers, handlers, sizeof(handlers)) == 0);
+    chip8_destroy(&chip8);
+    return 1;
+}
+
+// Pages a snapshot restore copies into RAM are not taken for the pages forks share.
+static int testSnapshotRestoreUnderFork(void) {
+    static Chip8 chip8;
+    static Chip8Snapshot snapshot;
+    Chip8ForkTracker tracker;
+    loadProgram(&chip8, bcdProgram, sizeof(bcdProgram));
+    chip8_fork_attach(&chip8, &tracker);
+    chip8_snapshot_capture(&chip8, &snapshot);
+
+    for (int i = 0; i < 4; i++) {
+        chip8_step(&chip8);
+    }
+    Chip8Fork *before = chip8_fork(&chip8);
+    CHECK(before != NULL);
+    chip8_snapshot_restore(&chip8, &snapshot);
+    Chip8Fork *after = chip8_fork(&chip8);
+    CHECK(after != NULL);
+
+    const uint8_t *page = after->pages[0x300 / FORK_PAGE_SIZE]->data;
+    CHECK(page[0] == 0 && page[1] == 0 && page[2] == 0);
+    page = before->pages[0x300 / FORK_PAGE_SIZE]->data;
+    CHECK(page[0] == 1 && page[1] == 2 && page[2] == 3);
+
+    chip8_snapshot_release(&chip8, &snapshot);
+    chip8_fork_detach(&chip8);
+    chip8_fork_free(before);
+    chip8_fork_free(after);
+    chip8_destroy(&chip8);
+    return 1;
+}
+
+// Counts watchpoint hits in the int user points to.
+static void countHit(Chip8 *chip8, uint16_t pc, uint16_t address, uint8_t before, uint8_t after, void *user) {
+    (void)chip8; (void)pc; (void)address; (void)before; (void)after;
+    (*(int *)user)++;
+}
+
+// Watchpoints removed while a snapshot wraps them leave the snapshot recording, then the original handlers.
+static int testWatchDetachUnderSnapshot(void) {
+    static Chip8 chip8;
+    static Chip8Snapshot snapshot;
+    Chip8Watch watch;
+    int hits = 0;
+    loadProgram(&chip8, bcdProgram, sizeof(bcdProgram));
+    Chip8Handler handlers[OPCODE_AMOUNT + 1];
+    memcpy(handlers, chip8.handlers, sizeof(handlers));
+
+    chip8_watch_init(&chip8, &watch, countHit, &hits);
+    CHECK(chip8_watch_add(&chip8, 0x300, 3));
+    chip8_snapshot_capture(&chip8, &snapshot);
+    CHECK(chip8_watch_remove(&chip8, 0x300, 3));
+
+    chip8_step(&chip8);
+    chip8_step(&chip8);
+    CHECK(hits == 0);
+    CHECK(snapshot.dirty_count == 1);
+
+    chip8_snapshot_release(&chip8, &snapshot);
+    CHECK(memcmp(chip8.handlers, handlers, sizeof(handlers)) == 0);
+    chip8_destroy(&chip8);
+    return 1;
+}
+
+// A snapshot released while a fork tracker wraps it leaves the tracker unsharing pages, then the original handlers.
+static int testSnapshotReleaseUnderFork(void) {
+    static Chip8 chip8;
+    static Chip8Snapshot snapshot;
+    Chip8ForkTracker tracker;
+    loadProgram(&chip8, bcdProgram, sizeof(bcdProgram));
+    Chip8Handler handlers[OPCODE_AMOUNT + 1];
+    memcpy(handlers, chip8.handlers, sizeof(handlers));
+
+    chip8_snapshot_capture(&chip8, &snapshot);
+    chip8_fork_attach(&chip8, &tracker);
+    Chip8Fork *fork = chip8_fork(&chip8);
+    CHECK(fork != NULL);
+    chip8_snapshot_release(&chip8, &snapshot);
+
+    chip8_step(&chip8);
+    chip8_step(&chip8);
+    CHECK(tracker.resident[0x300 / FORK_PAGE_SIZE] == NULL);
+    CHECK(snapshot.dirty_count == 0);
+
+    chip8_fork_detach(&chip8);
+    chip8_fork_free(fork);
+    CHECK(memcmp(chip8.handlers, handlers, sizeof(handlers)) == 0);
+    chip8_destroy(&chip8);
+    return 1;
+}
+
+// A fork tracker detached while a state hash wraps it leaves the hash exact, then the original handlers.
+static int testForkDetachUnderStateHash(void) {
+    Chip8 chip8;
+    Chip8ForkTracker tracker;
+    Chip8StateHash hash;
+    loadProgram(&chip8, bcdProgram, sizeof(bcdProgram));
+    Chip8Handler handlers[OPCODE_AMOUNT + 1];
+    memcpy(handlers, chip8.handlers, sizeof(handlers));
+
+    chip8_fork_attach(&chip8, &tracker);
+    chip8_state_hash_attach(&chip8, &hash);
+    chip8_fork_detach(&chip8);
+
+    for (int i = 0; i < 4; i++) {
+        chip8_step(&chip8);
+        CHECK(chip8_state_hash_update(&chip8) == chip8_state_hash_compute(&chip8));
+    }
+
+    chip8_state_hash_detach(&chip8);
+    CHECK(memcmp(chip8.handlers, handlers, sizeof(handlers)) == 0);
+    chip8_destroy(&chip8);
+    return 1;
+}
+
+// A state hash detached while watchpoints wrap it leaves the watchpoints reporting, then the original handlers.
+static int testStateHashDetachUnderWatch(void) {
+    Chip8 chip8;
+    Chip8StateHash hash;
+    Chip8Watch watch;
+    int hits = 0;
+    loadProgram(&chip8, bcdProgram, sizeof(bcdProgram));
+    Chip8Handler handlers[OPCODE_AMOUNT + 1];
+    memcpy(handlers, chip8.handlers, sizeof(handlers));
+
+    chip8_state_hash_attach(&chip8, &hash);
+    chip8_watch_init(&chip8, &watch, countHit, &hits);
+    CHECK(chip8_watch_add(&chip8, 0x300, 3));
+    chip8_state_hash_detach(&chip8);
+
+    for (int i = 0; i < 4; i++) {
+        chip8_step(&chip8);
+    }
+    CHECK(hits == 6);
+
+    CHECK(chip8_watch_remove(&chip8, 0x300, 3));
+    CHECK(memcmp(chip8.handlers, handlers, sizeof(handlers)) == 0);
+    chip8_destroy(&chip8);
+    return 1;
+}
+
+static const struct {
+    const char *name;
+    int (*run)(void);
+} tests[] = {
+    { "fork resume keeps state hash", testForkResumeKeepsStateHash },
+    { "fork resumed under snapshot", testForkResumeUnderSnapshot },
+    { "snapshot restore keeps state hash", testSnapshotRestoreKeepsStateHash },
+    { "snapshot restored under fork", testSnapshotRestoreUnderFork },
+    { "watch detached under snapshot", testWatchDetachUnderSnapshot },
+    { "snapshot released under fork", testSnapshotReleaseUnderFork },
+    { "fork detached under state hash", testForkDetachUnderStateHash },
+    { "state hash detached under watch", testStateHashDetachUnderWatch },
+};
+
+int main(void) {
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int passed = tests[i].run();
+        printf("%s %s\n", passed ? "ok" : "FAIL", tests[i].name);
+        failed += !passed;
+    }
+    return failed ? 1 : 0;
+}
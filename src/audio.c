@@ -0,0 +1,119 @@
+#include "../include/audio.h"
+
+// PolyBLEP residual that smooths the discontinuity of a naive square wave,
+// removing most of the aliasing a hard edge produces.
+static float poly_blep(float t, float dt) {
+    if (t < dt) {
+        t /= dt;
+        return t + t - t * t - 1.0f;
+    }
+    if (t > 1.0f - dt) {
+        t = (t - 1.0f) / dt;
+        return t * t + t + t + 1.0f;
+    }
+    return 0.0f;
+}
+
+// Pops the next frame's tone state, keeping the previous one if the ring is empty.
+static void audio_next_frame(Audio *audio) {
+    int tail = SDL_AtomicGet(&audio->ring.tail);
+    int head = SDL_AtomicGet(&audio->ring.head);
+    if (head - tail > AUDIO_MAX_LAG_FRAMES) {
+        tail = head - AUDIO_MAX_LAG_FRAMES; // Emulation ran ahead, the skipped states are stale
+    }
+    if (tail != head) {
+        audio->tone = audio->ring.states[tail & (AUDIO_RING_SIZE - 1)];
+        SDL_AtomicSet(&audio->ring.tail, tail + 1);
+    }
+    audio->samples_left = AUDIO_SAMPLES_PER_FRAME;
+}
+
+// Fills the device buffer with a band-limited square wave gated by the tone states.
+static void audio_callback(void *userdata, Uint8 *stream, int len) {
+    Audio *audio = (Audio *)userdata;
+    float *samples = (float *)stream;
+    int count = len / (int)sizeof(float);
+    const float dt = AUDIO_TONE_FREQUENCY / AUDIO_SAMPLE_RATE;
+
+    for (int i = 0; i < count; i++) {
+        if (audio->samples_left == 0) {
+            audio_next_frame(audio);
+        }
+        audio->samples_left--;
+
+        // Ramp the gain instead of switching it to avoid clicks on tone edges.
+        float target = audio->tone ? 1.0f : 0.0f;
+        if (audio->gain < target) {
+            audio->gain = (audio->gain + AUDIO_DECLICK_STEP > target) ? target : audio->gain + AUDIO_DECLICK_STEP;
+        } else if (audio->gain > target) {
+            audio->gain = (audio->gain - AUDIO_DECLICK_STEP < target) ? target : audio->gain - AUDIO_DECLICK_STEP;
+        }
+
+        float half = audio->phase + 0.5f;
+        if (half >= 1.0f) {
+            half -= 1.0f;
+        }
+        float value = (audio->phase < 0.5f) ? 1.0f : -1.0f;
+        value += poly_blep(audio->phase, dt);
+        value -= poly_blep(half, dt);
+
+        audio->phase += dt;
+        if (audio->phase >= 1.0f) {
+            audio->phase -= 1.0f;
+        }
+
+        samples[i] = value * audio->gain * AUDIO_TONE_VOLUME;
+    }
+}
+
+// Opens the default SDL audio device and starts playback.
+int audio_init(Audio *audio) {
+    memset(audio, 0, sizeof(*audio));
+
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        fprintf(stderr, "SDL audio could not initialize! SDL_Error: %s\n", SDL_GetError());
+        return 0;
+    }
+
+    SDL_AudioSpec wanted;
+    SDL_AudioSpec obtained;
+    memset(&wanted, 0, sizeof(wanted));
+    wanted.freq = AUDIO_SAMPLE_RATE;
+    wanted.format = AUDIO_F32SYS;
+    wanted.channels = 1;
+    wanted.samples = AUDIO_BUFFER_SAMPLES;
+    wanted.callback = audio_callback;
+    wanted.userdata = audio;
+
+    audio->device = SDL_OpenAudioDevice(NULL, 0, &wanted, &obtained, 0);
+    if (audio->device == 0) {
+        fprintf(stderr, "Audio device could not be opened! SDL_Error: %s\n", SDL_GetError());
+        return 0;
+    }
+
+    SDL_PauseAudioDevice(audio->device, 0);
+    return 1;
+}
+
+// Queues the tone state for one emulated frame without ever blocking.
+void audio_push_frame(Audio *audio, uint8_t tone) {
+    if (audio->device == 0) {
+        return;
+    }
+
+    int head = SDL_AtomicGet(&audio->ring.head);
+    if (head - SDL_AtomicGet(&audio->ring.tail) >= AUDIO_RING_SIZE) {
+        return; // Consumer fell behind, drop this frame
+    }
+
+    audio->ring.states[head & (AUDIO_RING_SIZE - 1)] = tone;
+    SDL_AtomicSet(&audio->ring.head, head + 1);
+}
+
+// Stops playback and closes the audio device.
+void audio_close(Audio *audio) {
+    if (audio->device != 0) {
+        SDL_CloseAudioDevice(audio->device);
+        audio->device = 0;
+    }
+}
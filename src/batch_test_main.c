@@ -0,0 +1,101 @@
+#include "../include/chip8_batch.h"
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Fails the current test with the condition that did not hold.
+#define CHECK(condition)                                                                  \
+    do {                                                                                  \
+        if (!(condition)) {                                                               \
+            fprintf(stderr, "%s:%d: %s\n", __func__, __LINE__, #condition);               \
+            return 0;                                                                     \
+        }                                                                                 \
+    } while (0)
+
+#define TEST_INSTANCES 3
+#define TEST_FRAMES_PER_STEP 4
+#define TEST_SCORE_ADDRESS 0x301
+
+// Draws the digit 5 at 0,0, then counts in RAM: 6205 F229 D335 A301 7101 8010 F055 1208.
+static const uint8_t countProgram[] = {
+    0x62, 0x05, 0xF2, 0x29, 0xD3, 0x35, 0xA3, 0x01, 0x71, 0x01, 0x80, 0x10, 0xF0, 0x55, 0x12, 0x08
+};
+
+// Score after one step: 4 setup instructions, then one count per 4-instruction loop.
+#define TEST_STEP_SCORE ((TEST_FRAMES_PER_STEP * CYCLES_PER_FRAME - 4) / 4)
+
+// A trainer mapping the step buffer sees the header, every record and the step counter.
+static int testSharedBuffer(void) {
+    Chip8Batch batch;
+    Chip8BatchConfig config = { TEST_SCORE_ADDRESS, 1, -1, 0 };
+    CHECK(chip8_batch_init(&batch, TEST_INSTANCES, PLATFORM_CHIP8, QUIRKS_CHIP8, countProgram, sizeof(countProgram),
+                           &config, NULL));
+    CHECK(batch.shm_fd >= 0 && batch.event_fd >= 0);
+
+    const uint8_t *shared = mmap(NULL, batch.buffer_size, PROT_READ, MAP_SHARED, batch.shm_fd, 0);
+    CHECK(shared != MAP_FAILED);
+    const Chip8BatchHeader *header = (const Chip8BatchHeader *)shared;
+    size_t records_offset = (size_t)((uint8_t *)batch.records - (uint8_t *)batch.header);
+    const Chip8BatchRecord *records = (const Chip8BatchRecord *)(shared + records_offset);
+    CHECK(header->magic == BATCH_MAGIC && header->count == TEST_INSTANCES);
+    CHECK(header->record_size == sizeof(Chip8BatchRecord) && header->observation_size == BATCH_OBSERVATION_SIZE);
+
+    uint16_t actions[TEST_INSTANCES] = { 0 };
+    for (uint64_t step = 1; step <= 2; step++) {
+        chip8_batch_step(&batch, actions, TEST_FRAMES_PER_STEP);
+        CHECK(__atomic_load_n(&header->steps, __ATOMIC_ACQUIRE) == step);
+
+        uint64_t signalled;
+        CHECK(read(batch.event_fd, &signalled, sizeof(signalled)) == sizeof(signalled) && signalled == 1);
+        for (int i = 0; i < TEST_INSTANCES; i++) {
+            CHECK(records[i].observation[0] == 0xF0 && records[i].observation[8] == 0x80);
+            CHECK(records[i].reward == TEST_STEP_SCORE + (step == 2));
+            CHECK(records[i].done == 0);
+        }
+    }
+
+    munmap((void *)shared, batch.buffer_size);
+    chip8_batch_free(&batch);
+    return 1;
+}
+
+// An instance whose episode ended starts the next step from the initial RAM and score.
+static int testDoneRestarts(void) {
+    Chip8Batch batch;
+    Chip8BatchConfig config = { TEST_SCORE_ADDRESS, 1, TEST_SCORE_ADDRESS, TEST_STEP_SCORE };
+    CHECK(chip8_batch_init(&batch, TEST_INSTANCES, PLATFORM_CHIP8, QUIRKS_CHIP8, countProgram, sizeof(countProgram),
+                           &config, NULL));
+
+    uint16_t actions[TEST_INSTANCES] = { 0 };
+    for (int step = 0; step < 3; step++) {
+        chip8_batch_step(&batch, actions, TEST_FRAMES_PER_STEP);
+        for (int i = 0; i < TEST_INSTANCES; i++) {
+            CHECK(batch.records[i].done == 1);
+            CHECK(batch.records[i].reward == TEST_STEP_SCORE);
+            CHECK(batch.instances[i].ram[TEST_SCORE_ADDRESS] == TEST_STEP_SCORE);
+            CHECK(batch.instances[i].program_counter == 0x208);
+        }
+    }
+
+    chip8_batch_free(&batch);
+    return 1;
+}
+
+static const struct {
+    const char *name;
+    int (*run)(void);
+} tests[] = {
+    { "shared buffer", testSharedBuffer },
+    { "done restarts", testDoneRestarts },
+};
+
+int main(void) {
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int passed = tests[i].run();
+        printf("%s %s\n", passed ? "ok" : "FAIL", tests[i].name);
+        failed += !passed;
+    }
+    return failed ? 1 : 0;
+}
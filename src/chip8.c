@@ -1,5 +1,9 @@
 #include "../include/chip8.h"
+#include "../include/chip8_fork.h"
+#include "../include/chip8_lockstep.h"
 #include "../include/chip8_opcodes.h"
+#include "../include/chip8_snapshot.h"
+#include "../include/chip8_watch.h"
 
 /* Define the font set used by CHIP-8 */
 const uint8_t chip8_font_set[FONT_SET_SIZE] = {
@@ -21,26 +25,74 @@ const uint8_t chip8_font_set[FONT_SET_SIZE] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+/* Define the large font set used by SUPER-CHIP and XO-CHIP */
+const uint8_t chip8_big_font_set[BIG_FONT_SET_SIZE] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+/**
+ * Highest valid RAM address of a platform.
+ */
+static uint16_t chip8_platform_address_mask(uint8_t platform) {
+    return (platform == PLATFORM_XOCHIP) ? XOCHIP_RAM_SIZE - 1 : CHIP8_RAM_SIZE - 1;
+}
+
 /**
- * Initialize a CHIP-8 structure with default values.
+ * Initialize a CHIP-8 structure with default values for a platform.
+ * The RAM is mapped once, for the address space of that platform.
  * 
  * @param chip8 Pointer to the Chip8 structure to initialize.
+ * @param platform One of the Chip8Platform values.
+ * @return 1 on success, 0 with errno set if the RAM could not be allocated.
  */
-void chip8_init(Chip8 *chip8) {
-    srand((unsigned int)time(NULL));
+int chip8_init_platform(Chip8 *chip8, uint8_t platform) {
+    chip8_seed_random(chip8, (uint32_t)time(NULL));
 
     chip8->stack_pointer = 0;
     chip8->sound_timer = 0;
     chip8->delay_timer = 0;
     chip8->i_register = 0;
     chip8->program_counter = MEMORY_READ_START;
+    chip8->address_mask = chip8_platform_address_mask(platform);
+    chip8->platform = platform;
+    chip8_set_quirks(chip8, QUIRKS_CHIP8);
+    chip8->hires = 0;
+    chip8->planes = 1;
+    chip8->pitch = 64;
+    chip8->exited = 0;
+    chip8->trapped = 0;
+    chip8->watch = NULL;
+    chip8->snapshot = NULL;
+    chip8->fork_tracker = NULL;
+    chip8->state_hash = NULL;
     chip8->timer = 0;
 
-    /* Initialize RAM memory to zero */
-    memset(chip8->ram, 0, RAM_SIZE);
+    /* Allocate zeroed RAM memory */
+    if (!chip8_ram_alloc(&chip8->memory, (uint32_t)chip8->address_mask + 1)) {
+        chip8->ram = NULL;
+        return 0;
+    }
+    chip8->ram = chip8->memory.data;
 
     /* Initialize V registers to zero */
     memset(chip8->v, 0, REGISTERS_SIZE);
+    memset(chip8->flags, 0, FLAG_REGISTERS_SIZE);
+    memset(chip8->audio_pattern, 0, AUDIO_PATTERN_SIZE);
 
     /* Initialize stack to zero */
     memset(chip8->stack, 0, STACK_SIZE * sizeof(uint16_t));
@@ -48,11 +100,144 @@ void chip8_init(Chip8 *chip8) {
     /* Initialize display pixels to zero */
     memset(chip8->display, 0, sizeof(chip8->display));
 
-    /* Load the font set into memory */
+    /* Load the font sets into memory */
     memcpy(chip8->ram + FONT_SET_START, chip8_font_set, FONT_SET_SIZE);
+    memcpy(chip8->ram + BIG_FONT_SET_START, chip8_big_font_set, BIG_FONT_SET_SIZE);
 
     /* Initialize keyboard state to zero */
     chip8->keys = 0;
+    chip8->key_wait = 0;
+    chip8->key_wait_held = 0;
+    chip8->key_wait_pressed = 0;
+    return 1;
+}
+
+/**
+ * Initialize a CHIP-8 structure with default values, exiting if its RAM cannot be allocated.
+ * 
+ * @param chip8 Pointer to the Chip8 structure to initialize.
+ */
+void chip8_init(Chip8 *chip8) {
+    if (!chip8_init_platform(chip8, PLATFORM_CHIP8)) {
+        perror("Failed to allocate CHIP-8 RAM");
+        exit(1);
+    }
+}
+
+/**
+ * Release the memory held by a CHIP-8 structure.
+ * 
+ * @param chip8 Pointer to the Chip8 structure to release.
+ */
+void chip8_destroy(Chip8 *chip8) {
+    chip8_ram_free(&chip8->memory);
+    chip8->ram = NULL;
+}
+
+/**
+ * Select the quirk profile whose specialized handlers execute the program.
+ * Opcodes that do not exist on the current platform get no handler.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @param quirks One of the Chip8QuirkProfile values.
+ */
+void chip8_set_quirks(Chip8 *chip8, uint8_t quirks) {
+    const OpcodeEntry *table = quirk_profile_tables[quirks];
+
+    chip8->quirks = quirks;
+    for (int i = 0; i < OPCODE_AMOUNT; ++i) {
+        chip8->handlers[i] = (table[i].platforms & chip8->platform) ? table[i].handler : NULL;
+    }
+    chip8->handlers[OPCODE_UNKNOWN] = NULL;
+}
+
+/**
+ * Replace a handler in the originals of a layer.
+ */
+static int chip8_replace_original(Chip8Handler *originals, int count, Chip8Handler wrapper, Chip8Handler original) {
+    for (int i = 0; i < count; i++) {
+        if (originals[i] == wrapper) {
+            originals[i] = original;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Put back the handler a layer swapped for its wrapper, wherever the wrapper now sits.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @param opcode Opcode id whose handler the layer wrapped.
+ * @param wrapper Handler of the layer.
+ * @param original Handler the wrapper calls.
+ */
+void chip8_unwrap_handler(Chip8 *chip8, uint8_t opcode, Chip8Handler wrapper, Chip8Handler original) {
+    if (chip8->handlers[opcode] == wrapper) {
+        chip8->handlers[opcode] = original;
+        return;
+    }
+
+    // A layer attached later wrapped the wrapper: splice it out of that layer's chain instead
+    if (chip8->watch != NULL && chip8_replace_original(chip8->watch->originals, 3, wrapper, original)) {
+        return;
+    }
+    if (chip8->snapshot != NULL && chip8_replace_original(chip8->snapshot->originals, 3, wrapper, original)) {
+        return;
+    }
+    if (chip8->fork_tracker != NULL && chip8_replace_original(chip8->fork_tracker->originals, 3, wrapper, original)) {
+        return;
+    }
+    if (chip8->state_hash != NULL) {
+        chip8_replace_original(chip8->state_hash->originals, STATE_HASH_HANDLERS, wrapper, original);
+    }
+}
+
+/**
+ * Seed the random number generator of Cxkk.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @param seed Any value; nearby seeds give unrelated sequences.
+ */
+void chip8_seed_random(Chip8 *chip8, uint32_t seed) {
+    // Murmur3 finalizer, so that consecutive seeds do not start out correlated
+    seed += 0x9E3779B9;
+    seed ^= seed >> 16;
+    seed *= 0x85EBCA6B;
+    seed ^= seed >> 13;
+    seed *= 0xC2B2AE35;
+    seed ^= seed >> 16;
+    chip8->random_state = seed ? seed : 1; // xorshift never leaves 0
+}
+
+/**
+ * Get the width of the display in the current resolution.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @return 128 in high resolution, 64 otherwise.
+ */
+uint8_t chip8_display_width(Chip8 *chip8) {
+    return chip8->hires ? DISPLAY_HIRES_WIDTH : DISPLAY_WIDTH;
+}
+
+/**
+ * Get the height of the display in the current resolution.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @return 64 in high resolution, 32 otherwise.
+ */
+uint8_t chip8_display_height(Chip8 *chip8) {
+    return chip8->hires ? DISPLAY_HIRES_HEIGHT : DISPLAY_HEIGHT;
+}
+
+/**
+ * Number of program bytes that fit in the RAM of a platform.
+ * 
+ * @param platform One of the Chip8Platform values.
+ * @return Bytes from MEMORY_READ_START to the end of RAM.
+ */
+size_t chip8_program_capacity(uint8_t platform) {
+    return (size_t)chip8_platform_address_mask(platform) + 1 - MEMORY_READ_START;
 }
 
 /**
@@ -62,9 +247,14 @@ void chip8_init(Chip8 *chip8) {
  * @param program Pointer to the program data.
  * @param program_size Size of the program data.
  */
-void chip8_load_ram(Chip8 *chip8, const uint8_t program[PROGRAM_MEMORY_SIZE], size_t program_size) {
+void chip8_load_ram(Chip8 *chip8, const uint8_t *program, size_t program_size) {
+    size_t capacity = (size_t)chip8->address_mask + 1 - MEMORY_READ_START;
+    if (program_size > capacity) {
+        program_size = capacity;
+    }
     memcpy(chip8->ram + MEMORY_READ_START, program, program_size); 
     memcpy(chip8->ram + FONT_SET_START, chip8_font_set, FONT_SET_SIZE);
+    memcpy(chip8->ram + BIG_FONT_SET_START, chip8_big_font_set, BIG_FONT_SET_SIZE);
 }
 
 /**
@@ -98,7 +288,7 @@ uint8_t chip8_should_buzz(Chip8 *chip8) {
  */
 void chip8_handle_timer_updates(Chip8 *chip8) {
     chip8->timer += 1;
-    if (chip8->timer > TIME_PER_TIMER_TICK_MS) {
+    if (chip8->timer >= CYCLES_PER_FRAME) {
         chip8_decrement_timers(chip8);
         chip8->timer = 0;
     }
@@ -145,15 +335,19 @@ void chip8_set_keyboard_state(Chip8 *chip8, uint8_t key_index, uint8_t state) {
  * @param chip8 Pointer to the Chip8 structure.
  * @param x_pos X position of the pixel.
  * @param y_pos Y position of the pixel.
- * @return 1 if the pixel is set, 0 otherwise.
+ * @return Bitplane bits of the pixel (bit 0 for plane 1, bit 1 for plane 2), 0 if unset.
  */
 uint8_t chip8_get_display_state(Chip8 *chip8, uint8_t x_pos, uint8_t y_pos) {
-    if (x_pos >= DISPLAY_WIDTH || y_pos >= DISPLAY_HEIGHT) {
+    if (x_pos >= chip8_display_width(chip8) || y_pos >= chip8_display_height(chip8)) {
         // Invalid pixel index, return 0
         return 0;
     }
-    uint64_t mask = (uint64_t)1 << (DISPLAY_WIDTH - 1 - x_pos);
-    return (chip8->display[y_pos] & mask) ? 1 : 0;
+
+    uint8_t state = 0;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        state |= display_row_get(chip8->display[plane][y_pos], x_pos) << plane;
+    }
+    return state;
 }
 
 /**
@@ -162,20 +356,16 @@ uint8_t chip8_get_display_state(Chip8 *chip8, uint8_t x_pos, uint8_t y_pos) {
  * @param chip8 Pointer to the Chip8 structure.
  * @param x_pos X position of the pixel.
  * @param y_pos Y position of the pixel.
- * @param state State to set (1 for on, 0 for off).
+ * @param state Bitplane bits to set (bit 0 for plane 1, bit 1 for plane 2).
  */
 void chip8_set_display_state(Chip8 *chip8, uint8_t x_pos, uint8_t y_pos, uint8_t state) {
-    if (x_pos >= DISPLAY_WIDTH || y_pos >= DISPLAY_HEIGHT) {
+    if (x_pos >= chip8_display_width(chip8) || y_pos >= chip8_display_height(chip8)) {
         // Invalid pixel index, return
         return;
     }
 
-    uint64_t mask = (uint64_t)1 << (DISPLAY_WIDTH - 1 - x_pos);
-
-    if (state) {
-        chip8->display[y_pos] |= mask;  // Set the bit
-    } else {
-        chip8->display[y_pos] &= ~mask; // Clear the bit
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        display_row_set(&chip8->display[plane][y_pos], x_pos, (state >> plane) & 1);
     }
 }
 
@@ -191,7 +381,7 @@ Opcode chip8_fetch_opcode(Chip8 *chip8) {
     uint16_t pc = chip8->program_counter;
 
     /* Fetch instruction */
-    opcode.instruction = (chip8->ram[pc] << 8) | chip8->ram[pc + 1];
+    opcode.instruction = (chip8->ram[chip8_ram_index(chip8, pc, 0)] << 8) | chip8->ram[chip8_ram_index(chip8, pc, 1)];
 
     /* Decode instruction */
     opcode.nnn = opcode.instruction & 0x0FFF;        // Lowest 12 bits
@@ -214,15 +404,163 @@ int chip8_execute_opcode(Chip8 *chip8, Opcode *opcode) {
     chip8_wait_for_next_tick();
     chip8_handle_timer_updates(chip8);
 
-    int handled = 1;
-    for (int i = 0; i < OPCODE_AMOUNT; ++i) {
-        if ((opcode->instruction & opcode_table[i].mask) == opcode_table[i].opcode_prefix) {
-            opcode_table[i].handler(chip8, opcode);
-            handled = 0;
-            break;
+    Chip8Handler handler = chip8->handlers[chip8_decode_opcode(opcode->instruction)];
+    if (handler == NULL) {
+        return 1;
+    }
+    handler(chip8, opcode);
+    return 0;
+}
+
+/**
+ * Fetch and execute the next instruction without waiting for the next tick.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @return 0 if the opcode was handled, 1 otherwise.
+ */
+int chip8_step(Chip8 *chip8) {
+    Opcode opcode = chip8_fetch_opcode(chip8);
+    chip8_handle_timer_updates(chip8);
+
+    Chip8Handler handler = chip8->handlers[chip8_decode_opcode(opcode.instruction)];
+    if (handler == NULL) {
+        return 1;
+    }
+    handler(chip8, &opcode);
+    return 0;
+}
+
+/**
+ * Read the instruction stored at an address.
+ */
+static uint16_t chip8_read_instruction(Chip8 *chip8, uint16_t address) {
+    return (chip8->ram[chip8_ram_index(chip8, address, 0)] << 8) | chip8->ram[chip8_ram_index(chip8, address, 1)];
+}
+
+/**
+ * Apply the timer updates that happen during a number of instructions
+ * without executing them.
+ */
+static void chip8_skip_cycles(Chip8 *chip8, uint32_t cycles) {
+    uint64_t elapsed = (uint64_t)chip8->timer + cycles;
+    uint64_t updates = elapsed / CYCLES_PER_FRAME;
+
+    chip8->delay_timer = (chip8->delay_timer > updates) ? chip8->delay_timer - updates : 0;
+    chip8->sound_timer = (chip8->sound_timer > updates) ? chip8->sound_timer - updates : 0;
+    chip8->timer = elapsed % CYCLES_PER_FRAME;
+}
+
+/**
+ * Recognize an idle loop starting at the program counter.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @param reg Receives the register of a delay timer polling loop.
+ * @return Loop length in instructions: 1 for a jump to itself, 3 for
+ *         Fx07; 3x00; 1nnn jumping back to Fx07, 0 for anything else.
+ */
+static uint8_t chip8_idle_loop_length(Chip8 *chip8, uint8_t *reg) {
+    uint16_t pc = chip8->program_counter;
+    if (pc > 0x0FFF) {
+        return 0; // 1nnn cannot address it
+    }
+
+    uint16_t jump_to_pc = 0x1000 | pc;
+    uint16_t first = chip8_read_instruction(chip8, pc);
+
+    if (first == jump_to_pc) {
+        return 1;
+    }
+    if ((first & 0xF0FF) == 0xF007 &&
+        chip8_read_instruction(chip8, pc + 2) == (0x3000 | (first & 0x0F00)) &&
+        chip8_read_instruction(chip8, pc + 4) == jump_to_pc) {
+        *reg = (first & 0x0F00) >> 8;
+        return 3;
+    }
+    return 0;
+}
+
+/**
+ * Detect whether the program is spinning in a loop that only the timers can end:
+ * a jump to itself, or the delay timer polling loop Fx07; 3x00; 1nnn. A waiting
+ * Fx0A is idle until the keyboard state changes.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @return One of the Chip8IdleState values.
+ */
+uint8_t chip8_idle_state(Chip8 *chip8) {
+    uint8_t reg;
+    if (chip8->key_wait) {
+        return (chip8->keys == chip8->key_wait_held) ? CHIP8_IDLE_KEY : CHIP8_RUNNING;
+    }
+    switch (chip8_idle_loop_length(chip8, &reg)) {
+        case 1:
+            if (chip8->delay_timer == 0 && chip8->sound_timer == 0) {
+                return CHIP8_IDLE_HALTED;
+            }
+            return CHIP8_IDLE_TIMER;
+        case 3:
+            return (chip8->delay_timer > 0) ? CHIP8_IDLE_TIMER : CHIP8_RUNNING;
+        default:
+            return CHIP8_RUNNING;
+    }
+}
+
+/**
+ * Skip whole iterations of an idle loop instead of executing them. Timer updates
+ * falling inside the skipped instructions are applied, the final instructions
+ * that may leave the loop are left to be executed normally. A waiting Fx0A is
+ * skipped for up to max_cycles, only a keyboard change can end it.
+ * 
+ * @param chip8 Pointer to the Chip8 structure.
+ * @param max_cycles Maximum number of instructions to skip.
+ * @return Number of instructions skipped, 0 if the program is not idle.
+ */
+uint32_t chip8_fast_forward(Chip8 *chip8, uint32_t max_cycles) {
+    if (chip8->key_wait) {
+        if (chip8->keys != chip8->key_wait_held) {
+            return 0; // Fx0A has to see the new keyboard state
         }
+        chip8_skip_cycles(chip8, max_cycles);
+        return max_cycles;
+    }
+
+    uint8_t reg = 0;
+    uint8_t length = chip8_idle_loop_length(chip8, &reg);
+    if (length == 0) {
+        return 0;
+    }
+
+    // Timer updates needed before the loop can end (or stop mattering)
+    uint8_t remaining = chip8->delay_timer;
+    if (length == 1 && chip8->sound_timer > remaining) {
+        remaining = chip8->sound_timer;
+    }
+    if (remaining == 0) {
+        return 0;
     }
-    return handled;
+
+    // Instruction during which the last of those timer updates happens
+    uint64_t final_update = (CYCLES_PER_FRAME - chip8->timer) + (uint64_t)(remaining - 1) * CYCLES_PER_FRAME;
+
+    // Skip only the iterations that complete before it
+    uint64_t iterations = (final_update - 1) / length;
+    if (iterations * length > max_cycles) {
+        iterations = max_cycles / length;
+    }
+    if (iterations == 0) {
+        return 0;
+    }
+
+    uint32_t cycles = (uint32_t)(iterations * length);
+
+    if (length == 3) {
+        // Value read by the Fx07 of the last skipped iteration
+        uint32_t updates_before_read = (uint32_t)((chip8->timer + cycles - 2) / CYCLES_PER_FRAME);
+        chip8->v[reg] = chip8->delay_timer - updates_before_read;
+    }
+
+    chip8_skip_cycles(chip8, cycles);
+    return cycles;
 }
 
 /**
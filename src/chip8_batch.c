@@ -0,0 +1,245 @@
+#ifdef __linux__
+#define _GNU_SOURCE  // memfd_create
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "../include/chip8_batch.h"
+
+// Size of the header rounded up so that the records stay aligned.
+#define BATCH_HEADER_SIZE ((sizeof(Chip8BatchHeader) + 63) / 64 * 64)
+
+// Returns the size of the step buffer of a batch.
+size_t chip8_batch_buffer_size(int count) {
+    return BATCH_HEADER_SIZE + (size_t)count * sizeof(Chip8BatchRecord);
+}
+
+#ifdef __linux__
+// Creates the step buffer as a memfd a trainer process can map, plus the eventfd announcing steps.
+static void *chip8_batch_map_shared(Chip8Batch *batch) {
+    // No MFD_CLOEXEC/EFD_CLOEXEC: the descriptors are meant to be handed to the trainer
+    batch->shm_fd = memfd_create("chip8-batch", 0);
+    if (batch->shm_fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(batch->shm_fd, batch->buffer_size) < 0) {
+        return NULL;
+    }
+    void *buffer = mmap(NULL, batch->buffer_size, PROT_READ | PROT_WRITE, MAP_SHARED, batch->shm_fd, 0);
+    if (buffer == MAP_FAILED) {
+        return NULL;
+    }
+    batch->event_fd = eventfd(0, 0);
+    if (batch->event_fd < 0) {
+        munmap(buffer, batch->buffer_size);
+        return NULL;
+    }
+    return buffer;
+}
+#endif
+
+// Reads the score of an instance.
+static uint32_t chip8_batch_score(const Chip8Batch *batch, const Chip8 *chip8) {
+    uint32_t score = 0;
+    for (uint8_t i = 0; i < batch->config.reward_size; i++) {
+        score = (score << 8) | chip8->ram[(batch->config.reward_address + i) & chip8->address_mask];
+    }
+    return score;
+}
+
+// Merges pairs of neighbouring pixels of a 64-pixel word into 32 pixels.
+static uint32_t chip8_batch_halve(uint64_t pixels) {
+    uint64_t pairs = (pixels | (pixels >> 1)) & 0x5555555555555555ULL;
+    pairs = (pairs | (pairs >> 1)) & 0x3333333333333333ULL;
+    pairs = (pairs | (pairs >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    pairs = (pairs | (pairs >> 4)) & 0x00FF00FF00FF00FFULL;
+    pairs = (pairs | (pairs >> 8)) & 0x0000FFFF0000FFFFULL;
+    pairs = (pairs | (pairs >> 16)) & 0x00000000FFFFFFFFULL;
+    return (uint32_t)pairs;
+}
+
+// Packs the display into a 64x32 observation, merging bitplanes and 2x2 blocks of the high resolution mode.
+static void chip8_batch_observe(const Chip8 *chip8, uint8_t *observation) {
+    for (int y = 0; y < BATCH_OBSERVATION_HEIGHT; y++) {
+        uint64_t row;
+        if (chip8->hires) {
+            DisplayRow top = display_row_or(chip8->display[0][2 * y], chip8->display[1][2 * y]);
+            DisplayRow bottom = display_row_or(chip8->display[0][2 * y + 1], chip8->display[1][2 * y + 1]);
+            DisplayRow merged = display_row_or(top, bottom);
+            row = ((uint64_t)chip8_batch_halve(merged.hi) << 32) | chip8_batch_halve(merged.lo);
+        } else {
+            row = chip8->display[0][y].hi | chip8->display[1][y].hi;
+        }
+        for (int byte = 0; byte < 8; byte++) {
+            observation[y * 8 + byte] = (uint8_t)(row >> (56 - 8 * byte));
+        }
+    }
+}
+
+// Runs an instance for a number of frames, returns 1 if the program stopped.
+static int chip8_batch_run(Chip8 *chip8, uint32_t frames) {
+    uint64_t limit = (uint64_t)frames * CYCLES_PER_FRAME;
+    uint64_t cycles = 0;
+
+    while (cycles < limit) {
+        if (chip8_idle_state(chip8) == CHIP8_IDLE_HALTED) {
+            return 1;
+        }
+        uint64_t budget = limit - cycles;
+        uint32_t skipped = chip8_fast_forward(chip8, (budget > UINT32_MAX) ? UINT32_MAX : (uint32_t)budget);
+        if (skipped) {
+            cycles += skipped;
+            continue;
+        }
+        if (chip8_step(chip8) || chip8->exited) {
+            return 1;
+        }
+        cycles++;
+    }
+    return 0;
+}
+
+// Creates the instances of a batch, all running the same program.
+int chip8_batch_init(Chip8Batch *batch, int count, uint8_t platform, uint8_t quirks,
+                     const uint8_t *program, size_t program_size, const Chip8BatchConfig *config, void *buffer) {
+    memset(batch, 0, sizeof(*batch));
+    batch->count = count;
+    batch->config = *config;
+    batch->buffer_size = chip8_batch_buffer_size(count);
+    batch->shm_fd = -1;
+    batch->event_fd = -1;
+
+    if (buffer == NULL) {
+#ifdef __linux__
+        buffer = chip8_batch_map_shared(batch);
+#else
+        buffer = malloc(batch->buffer_size);
+#endif
+        if (buffer == NULL) {
+            chip8_batch_free(batch);
+            return 0;
+        }
+        batch->owns_buffer = 1;
+    }
+    batch->header = buffer;
+    batch->records = (Chip8BatchRecord *)((uint8_t *)buffer + BATCH_HEADER_SIZE);
+
+    batch->instances = calloc(count, sizeof(Chip8));
+    batch->trackers = calloc(count, sizeof(Chip8ForkTracker));
+    batch->scores = calloc(count, sizeof(uint32_t));
+    if (batch->instances == NULL || batch->trackers == NULL || batch->scores == NULL) {
+        chip8_batch_free(batch);
+        return 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        Chip8 *chip8 = &batch->instances[i];
+        if (!chip8_init_platform(chip8, platform)) {
+            chip8_batch_free(batch);
+            return 0;
+        }
+        chip8_set_quirks(chip8, quirks);
+        if (i == 0) {
+            chip8_load_ram(chip8, program, program_size);
+        }
+        chip8_fork_attach(chip8, &batch->trackers[i]);
+
+        if (i == 0) {
+            batch->initial = chip8_fork(chip8);
+            if (batch->initial == NULL) {
+                chip8_batch_free(batch);
+                return 0;
+            }
+        } else {
+            chip8_fork_resume(chip8, batch->initial);
+            chip8_seed_random(chip8, batch->instances[0].random_state + (uint32_t)i);
+        }
+        batch->scores[i] = chip8_batch_score(batch, chip8);
+    }
+
+    memset(buffer, 0, batch->buffer_size);
+    batch->header->magic = BATCH_MAGIC;
+    batch->header->count = (uint32_t)count;
+    batch->header->record_size = sizeof(Chip8BatchRecord);
+    batch->header->observation_size = BATCH_OBSERVATION_SIZE;
+    for (int i = 0; i < count; i++) {
+        chip8_batch_observe(&batch->instances[i], batch->records[i].observation);
+    }
+    return 1;
+}
+
+// Advances every instance and writes the observations, rewards and done flags.
+void chip8_batch_step(Chip8Batch *batch, const uint16_t *actions, uint32_t frames_per_step) {
+    for (int i = 0; i < batch->count; i++) {
+        Chip8 *chip8 = &batch->instances[i];
+        Chip8BatchRecord *record = &batch->records[i];
+
+        if (record->done) {
+            // The next episode continues the random numbers of the instance instead of repeating the first
+            uint32_t random_state = chip8->random_state;
+            chip8_fork_resume(chip8, batch->initial);
+            chip8->random_state = random_state;
+            batch->scores[i] = chip8_batch_score(batch, chip8);
+        }
+
+        for (uint8_t key = 0; key < KEYBOARD_SIZE; key++) {
+            chip8_set_keyboard_state(chip8, key, (actions[i] >> key) & 1);
+        }
+
+        int done = chip8_batch_run(chip8, frames_per_step);
+        if (batch->config.done_address >= 0 &&
+            chip8->ram[batch->config.done_address & chip8->address_mask] == batch->config.done_value) {
+            done = 1;
+        }
+
+        uint32_t score = chip8_batch_score(batch, chip8);
+        record->reward = (int32_t)(score - batch->scores[i]);
+        record->done = (uint8_t)done;
+        batch->scores[i] = score;
+        chip8_batch_observe(chip8, record->observation);
+    }
+
+    __atomic_store_n(&batch->header->steps, batch->header->steps + 1, __ATOMIC_RELEASE);
+#ifdef __linux__
+    if (batch->event_fd >= 0) {
+        uint64_t one = 1;
+        if (write(batch->event_fd, &one, sizeof(one)) < 0) {
+            perror("Failed to signal the batch step");
+        }
+    }
+#endif
+}
+
+// Releases the instances and the step buffer if the batch created it.
+void chip8_batch_free(Chip8Batch *batch) {
+    if (batch->instances != NULL) {
+        for (int i = 0; i < batch->count; i++) {
+            if (batch->instances[i].fork_tracker != NULL) {
+                chip8_fork_detach(&batch->instances[i]);
+            }
+            chip8_destroy(&batch->instances[i]);
+        }
+    }
+    chip8_fork_free(batch->initial);
+    free(batch->instances);
+    free(batch->trackers);
+    free(batch->scores);
+
+#ifdef __linux__
+    if (batch->owns_buffer) {
+        munmap(batch->header, batch->buffer_size);
+    }
+    if (batch->shm_fd >= 0) {
+        close(batch->shm_fd);
+    }
+    if (batch->event_fd >= 0) {
+        close(batch->event_fd);
+    }
+#else
+    if (batch->owns_buffer) {
+        free(batch->header);
+    }
+#endif
+    memset(batch, 0, sizeof(*batch));
+}
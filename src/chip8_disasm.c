@@ -0,0 +1,661 @@
+#include "../include/chip8_disasm.h"
+#include "../include/chip8_opcodes.h"
+
+// Names of Chip8DisasmExit values in the block table.
+static const char *const exit_names[DISASM_EXIT_AMOUNT] = {
+    [DISASM_EXIT_FALLTHROUGH] = "fallthrough",
+    [DISASM_EXIT_JUMP]        = "jump",
+    [DISASM_EXIT_CALL]        = "call",
+    [DISASM_EXIT_SKIP]        = "skip",
+    [DISASM_EXIT_RETURN]      = "return",
+    [DISASM_EXIT_INDIRECT]    = "indirect",
+    [DISASM_EXIT_HALT]        = "halt",
+};
+
+// Decodes an instruction through the masks of the opcode table.
+uint8_t chip8_disasm_decode(uint16_t instruction, uint8_t platform) {
+    for (uint8_t id = 0; id < OPCODE_AMOUNT; id++) {
+        if ((instruction & opcode_table[id].mask) == opcode_table[id].opcode_prefix) {
+            return (opcode_table[id].platforms & platform) ? id : OPCODE_UNKNOWN;
+        }
+    }
+    return OPCODE_UNKNOWN;
+}
+
+// Writes the mnemonic of an instruction.
+void chip8_disasm_format(char *buffer, size_t size, uint16_t instruction, uint16_t next, uint8_t platform) {
+    uint8_t x = (instruction >> 8) & 0x0F;
+    uint8_t y = (instruction >> 4) & 0x0F;
+    uint8_t n = instruction & 0x0F;
+    uint8_t kk = instruction & 0xFF;
+    uint16_t nnn = instruction & 0x0FFF;
+
+    switch (chip8_disasm_decode(instruction, platform)) {
+        case OPCODE_SCROLL_DOWN:         snprintf(buffer, size, "SCD %u", n); break;
+        case OPCODE_SCROLL_UP:           snprintf(buffer, size, "SCU %u", n); break;
+        case OPCODE_CLS:                 snprintf(buffer, size, "CLS"); break;
+        case OPCODE_RET:                 snprintf(buffer, size, "RET"); break;
+        case OPCODE_SCROLL_RIGHT:        snprintf(buffer, size, "SCR"); break;
+        case OPCODE_SCROLL_LEFT:         snprintf(buffer, size, "SCL"); break;
+        case OPCODE_EXIT:                snprintf(buffer, size, "EXIT"); break;
+        case OPCODE_LORES:               snprintf(buffer, size, "LOW"); break;
+        case OPCODE_HIRES:               snprintf(buffer, size, "HIGH"); break;
+        case OPCODE_JP:                  snprintf(buffer, size, "JP 0x%03X", nnn); break;
+        case OPCODE_CALL:                snprintf(buffer, size, "CALL 0x%03X", nnn); break;
+        case OPCODE_SKIP_EQUAL_BYTE:     snprintf(buffer, size, "SE V%X, 0x%02X", x, kk); break;
+        case OPCODE_SKIP_NOT_EQUAL_BYTE: snprintf(buffer, size, "SNE V%X, 0x%02X", x, kk); break;
+        case OPCODE_SKIP_EQUAL:          snprintf(buffer, size, "SE V%X, V%X", x, y); break;
+        case OPCODE_SAVE_RANGE:          snprintf(buffer, size, "SAVE V%X - V%X", x, y); break;
+        case OPCODE_LOAD_RANGE:          snprintf(buffer, size, "LOAD V%X - V%X", x, y); break;
+        case OPCODE_LOAD_BYTE:           snprintf(buffer, size, "LD V%X, 0x%02X", x, kk); break;
+        case OPCODE_ADD_BYTE:            snprintf(buffer, size, "ADD V%X, 0x%02X", x, kk); break;
+        case OPCODE_LOAD:                snprintf(buffer, size, "LD V%X, V%X", x, y); break;
+        case OPCODE_OR:                  snprintf(buffer, size, "OR V%X, V%X", x, y); break;
+        case OPCODE_AND:                 snprintf(buffer, size, "AND V%X, V%X", x, y); break;
+        case OPCODE_XOR:                 snprintf(buffer, size, "XOR V%X, V%X", x, y); break;
+        case OPCODE_ADD:                 snprintf(buffer, size, "ADD V%X, V%X", x, y); break;
+        case OPCODE_SUBTRACT_X:          snprintf(buffer, size, "SUB V%X, V%X", x, y); break;
+        case OPCODE_DIVIDE:              snprintf(buffer, size, "SHR V%X, V%X", x, y); break;
+        case OPCODE_SUBTRACT_Y:          snprintf(buffer, size, "SUBN V%X, V%X", x, y); break;
+        case OPCODE_MULTIPLY:            snprintf(buffer, size, "SHL V%X, V%X", x, y); break;
+        case OPCODE_SKIP_NOT_EQUAL:      snprintf(buffer, size, "SNE V%X, V%X", x, y); break;
+        case OPCODE_SET_I:               snprintf(buffer, size, "LD I, 0x%03X", nnn); break;
+        case OPCODE_JUMP:                snprintf(buffer, size, "JP V0, 0x%03X", nnn); break;
+        case OPCODE_RANDOM:              snprintf(buffer, size, "RND V%X, 0x%02X", x, kk); break;
+        case OPCODE_DRAW:                snprintf(buffer, size, "DRW V%X, V%X, %u", x, y, n); break;
+        case OPCODE_SKIP_KEY:            snprintf(buffer, size, "SKP V%X", x); break;
+        case OPCODE_SKIP_NOT_KEY:        snprintf(buffer, size, "SKNP V%X", x); break;
+        case OPCODE_LOAD_LONG_I:         snprintf(buffer, size, "LD I, 0x%04X", next); break;
+        case OPCODE_SELECT_PLANES:       snprintf(buffer, size, "PLANE %u", x); break;
+        case OPCODE_LOAD_AUDIO:          snprintf(buffer, size, "AUDIO"); break;
+        case OPCODE_LOAD_DELAY_TIMER:    snprintf(buffer, size, "LD V%X, DT", x); break;
+        case OPCODE_WAIT_KEY:            snprintf(buffer, size, "LD V%X, K", x); break;
+        case OPCODE_SET_DELAY_TIMER:     snprintf(buffer, size, "LD DT, V%X", x); break;
+        case OPCODE_SET_SOUND_TIMER:     snprintf(buffer, size, "LD ST, V%X", x); break;
+        case OPCODE_ADD_I:               snprintf(buffer, size, "ADD I, V%X", x); break;
+        case OPCODE_LOAD_FONT:           snprintf(buffer, size, "LD F, V%X", x); break;
+        case OPCODE_LOAD_BIG_FONT:       snprintf(buffer, size, "LD HF, V%X", x); break;
+        case OPCODE_LOAD_BCD:            snprintf(buffer, size, "LD B, V%X", x); break;
+        case OPCODE_SET_PITCH:           snprintf(buffer, size, "PITCH V%X", x); break;
+        case OPCODE_LOAD_REGISTERS:      snprintf(buffer, size, "LD [I], V%X", x); break;
+        case OPCODE_LOAD_MEMORY:         snprintf(buffer, size, "LD V%X, [I]", x); break;
+        case OPCODE_SAVE_FLAGS:          snprintf(buffer, size, "LD R, V%X", x); break;
+        case OPCODE_LOAD_FLAGS:          snprintf(buffer, size, "LD V%X, R", x); break;
+        default:                         snprintf(buffer, size, "DW 0x%04X", instruction); break;
+    }
+}
+
+// Reads the instruction at an address, wrapping around the address space like the program counter.
+static uint16_t chip8_disasm_word(const Chip8Disasm *disasm, uint32_t address) {
+    uint32_t mask = disasm->size - 1;
+    return (uint16_t)((disasm->memory[address & mask] << 8) | disasm->memory[(address + 1) & mask]);
+}
+
+// Returns the number of bytes of the instruction at an address.
+static uint8_t chip8_disasm_length(const Chip8Disasm *disasm, uint32_t address) {
+    return chip8_disasm_decode(chip8_disasm_word(disasm, address), disasm->platform) == OPCODE_LOAD_LONG_I ? 4 : 2;
+}
+
+// Checks whether an opcode is one of the conditional skips.
+static int chip8_disasm_is_skip(uint8_t id) {
+    return id == OPCODE_SKIP_EQUAL_BYTE || id == OPCODE_SKIP_NOT_EQUAL_BYTE || id == OPCODE_SKIP_EQUAL ||
+           id == OPCODE_SKIP_NOT_EQUAL || id == OPCODE_SKIP_KEY || id == OPCODE_SKIP_NOT_KEY;
+}
+
+// Marks a branch target as a block leader and queues it for decoding.
+static void chip8_disasm_branch(Chip8Disasm *disasm, uint16_t *stack, int *top, uint32_t target) {
+    target &= disasm->size - 1;
+    disasm->map[target] |= DISASM_LEADER;
+    if (!(disasm->map[target] & DISASM_INSTRUCTION)) {
+        stack[(*top)++] = (uint16_t)target;
+    }
+}
+
+// Decodes everything reachable from the program start, following jumps, calls and skips.
+static void chip8_disasm_descend(Chip8Disasm *disasm, uint16_t *stack) {
+    uint32_t mask = disasm->size - 1;
+    int top = 0;
+
+    disasm->map[MEMORY_READ_START] |= DISASM_FUNCTION;
+    chip8_disasm_branch(disasm, stack, &top, MEMORY_READ_START);
+
+    while (top > 0) {
+        uint32_t address = stack[--top];
+        int follow = 1;
+
+        while (follow && !(disasm->map[address] & DISASM_INSTRUCTION)) {
+            uint16_t instruction = chip8_disasm_word(disasm, address);
+            uint8_t id = chip8_disasm_decode(instruction, disasm->platform);
+            uint8_t length = (id == OPCODE_LOAD_LONG_I) ? 4 : 2;
+            uint32_t next = (address + length) & mask;
+
+            disasm->map[address] |= DISASM_INSTRUCTION;
+            for (uint8_t i = 0; i < length; i++) {
+                disasm->map[(address + i) & mask] |= DISASM_CODE;
+            }
+
+            if (id == OPCODE_UNKNOWN) {
+                disasm->flags[address] |= DISASM_FLAG_INVALID;
+                follow = 0;
+            } else if (id == OPCODE_JP) {
+                chip8_disasm_branch(disasm, stack, &top, instruction & 0x0FFF);
+                follow = 0;
+            } else if (id == OPCODE_CALL) {
+                disasm->map[instruction & 0x0FFF & mask] |= DISASM_FUNCTION;
+                chip8_disasm_branch(disasm, stack, &top, instruction & 0x0FFF);
+            } else if (id == OPCODE_RET || id == OPCODE_EXIT) {
+                follow = 0;
+            } else if (id == OPCODE_JUMP) {
+                disasm->flags[address] |= DISASM_FLAG_INDIRECT;
+                follow = 0;
+            } else if (chip8_disasm_is_skip(id)) {
+                // Both the skipped instruction and the one after it start blocks
+                chip8_disasm_branch(disasm, stack, &top, next + chip8_disasm_length(disasm, next));
+                chip8_disasm_branch(disasm, stack, &top, next);
+                follow = 0;
+            }
+            address = next;
+        }
+    }
+}
+
+// Flags a RAM write of length bytes at I: into code if I is known, possibly into code if not.
+static void chip8_disasm_check_write(Chip8Disasm *disasm, uint32_t address, int i_known, uint32_t i, uint8_t length) {
+    if (!i_known) {
+        disasm->flags[address] |= DISASM_FLAG_MAYBE_SMC;
+        return;
+    }
+    for (uint8_t k = 0; k < length; k++) {
+        if (disasm->map[(i + k) & (disasm->size - 1)] & DISASM_CODE) {
+            disasm->flags[address] |= DISASM_FLAG_SMC;
+            return;
+        }
+    }
+}
+
+// Follows I through a block to find the RAM its writes can reach.
+static void chip8_disasm_track_i(Chip8Disasm *disasm, const Chip8DisasmBlock *block) {
+    uint32_t mask = disasm->size - 1;
+    uint32_t address = block->start;
+    int i_known = 0;
+    uint32_t i = 0;
+
+    for (uint16_t count = 0; count < block->instructions; count++) {
+        uint16_t instruction = chip8_disasm_word(disasm, address);
+        uint8_t id = chip8_disasm_decode(instruction, disasm->platform);
+        uint8_t x = (instruction >> 8) & 0x0F;
+        uint8_t y = (instruction >> 4) & 0x0F;
+
+        switch (id) {
+            case OPCODE_SET_I:
+                i = instruction & 0x0FFF;
+                i_known = 1;
+                disasm->map[i & mask] |= DISASM_DATA_REF;
+                break;
+            case OPCODE_LOAD_LONG_I:
+                i = chip8_disasm_word(disasm, address + 2);
+                i_known = 1;
+                disasm->map[i & mask] |= DISASM_DATA_REF;
+                break;
+            case OPCODE_LOAD_BCD:
+                chip8_disasm_check_write(disasm, address, i_known, i, 3);
+                break;
+            case OPCODE_SAVE_RANGE:
+                chip8_disasm_check_write(disasm, address, i_known, i, (x <= y) ? y - x + 1 : x - y + 1);
+                break;
+            case OPCODE_LOAD_REGISTERS:
+                chip8_disasm_check_write(disasm, address, i_known, i, x + 1);
+                i_known = 0; // Whether I moves depends on the quirk profile
+                break;
+            case OPCODE_LOAD_MEMORY:
+            case OPCODE_ADD_I:
+            case OPCODE_LOAD_FONT:
+            case OPCODE_LOAD_BIG_FONT:
+                i_known = 0;
+                break;
+            default:
+                break;
+        }
+        address = (address + ((id == OPCODE_LOAD_LONG_I) ? 4 : 2)) & mask;
+    }
+}
+
+// Appends an empty block starting at an address.
+static Chip8DisasmBlock *chip8_disasm_add_block(Chip8Disasm *disasm, int *capacity, uint32_t start) {
+    if (disasm->block_count == *capacity) {
+        int grown = *capacity ? *capacity * 2 : 64;
+        Chip8DisasmBlock *blocks = realloc(disasm->blocks, grown * sizeof(*blocks));
+        if (blocks == NULL) {
+            return NULL;
+        }
+        disasm->blocks = blocks;
+        *capacity = grown;
+    }
+    Chip8DisasmBlock *block = &disasm->blocks[disasm->block_count++];
+    memset(block, 0, sizeof(*block));
+    block->start = (uint16_t)start;
+    block->end = (uint16_t)start;
+    return block;
+}
+
+// Splits the decoded instructions into basic blocks, in address order.
+static int chip8_disasm_split(Chip8Disasm *disasm) {
+    Chip8DisasmBlock *block = NULL;
+    int capacity = 0;
+
+    for (uint32_t address = 0; address < disasm->size; address++) {
+        if (!(disasm->map[address] & DISASM_INSTRUCTION)) {
+            continue;
+        }
+
+        if (block != NULL && ((disasm->map[address] & DISASM_LEADER) || address != block->end)) {
+            // Runs into a jump target: the open block falls through to it
+            block->exit = DISASM_EXIT_FALLTHROUGH;
+            block->successors[0] = block->end;
+            block->successor_count = 1;
+            block = NULL;
+        }
+        if (block == NULL && (block = chip8_disasm_add_block(disasm, &capacity, address)) == NULL) {
+            return 0;
+        }
+
+        uint16_t instruction = chip8_disasm_word(disasm, address);
+        uint8_t id = chip8_disasm_decode(instruction, disasm->platform);
+        uint32_t next = (address + ((id == OPCODE_LOAD_LONG_I) ? 4 : 2)) & (disasm->size - 1);
+
+        block->instructions++;
+        block->end = (uint16_t)next;
+
+        int closed = 1;
+        if (id == OPCODE_UNKNOWN || id == OPCODE_EXIT) {
+            block->exit = DISASM_EXIT_HALT;
+        } else if (id == OPCODE_JP) {
+            block->exit = DISASM_EXIT_JUMP;
+            block->successors[block->successor_count++] = instruction & 0x0FFF;
+        } else if (id == OPCODE_CALL) {
+            block->exit = DISASM_EXIT_CALL;
+            block->call = instruction & 0x0FFF;
+            block->successors[block->successor_count++] = (uint16_t)next;
+        } else if (id == OPCODE_RET) {
+            block->exit = DISASM_EXIT_RETURN;
+        } else if (id == OPCODE_JUMP) {
+            block->exit = DISASM_EXIT_INDIRECT;
+        } else if (chip8_disasm_is_skip(id)) {
+            block->exit = DISASM_EXIT_SKIP;
+            block->successors[block->successor_count++] = (uint16_t)next;
+            block->successors[block->successor_count++] = (uint16_t)((next + chip8_disasm_length(disasm, next)) & (disasm->size - 1));
+        } else {
+            closed = 0;
+        }
+        if (closed) {
+            block = NULL;
+        }
+    }
+
+    if (block != NULL) {
+        // Only possible when code runs off the end of the address space
+        block->exit = DISASM_EXIT_FALLTHROUGH;
+        block->successors[0] = block->end;
+        block->successor_count = 1;
+    }
+    return 1;
+}
+
+// Finds the block starting at an address, -1 if there is none.
+static int chip8_disasm_find_block(const Chip8Disasm *disasm, uint16_t start) {
+    int low = 0;
+    int high = disasm->block_count - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (disasm->blocks[middle].start == start) {
+            return middle;
+        } else if (disasm->blocks[middle].start < start) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return -1;
+}
+
+// Assigns every block to the first subroutine, in address order, it is reachable from without a call.
+static int chip8_disasm_assign_functions(Chip8Disasm *disasm) {
+    uint8_t *assigned = calloc(disasm->block_count + 1, 1);
+    int *stack = malloc((disasm->block_count + 1) * sizeof(int));
+    if (assigned == NULL || stack == NULL) {
+        free(assigned);
+        free(stack);
+        return 0;
+    }
+
+    for (uint32_t entry = 0; entry < disasm->size; entry++) {
+        if (!(disasm->map[entry] & DISASM_FUNCTION)) {
+            continue;
+        }
+        int first = chip8_disasm_find_block(disasm, (uint16_t)entry);
+        if (first < 0 || assigned[first]) {
+            continue;
+        }
+
+        int top = 0;
+        assigned[first] = 1;
+        stack[top++] = first;
+        while (top > 0) {
+            Chip8DisasmBlock *block = &disasm->blocks[stack[--top]];
+            block->function = (uint16_t)entry;
+            for (uint8_t s = 0; s < block->successor_count; s++) {
+                int index = chip8_disasm_find_block(disasm, block->successors[s]);
+                if (index >= 0 && !assigned[index]) {
+                    assigned[index] = 1;
+                    stack[top++] = index;
+                }
+            }
+        }
+    }
+
+    free(assigned);
+    free(stack);
+    return 1;
+}
+
+// Finds the reachable code of a program and splits it into basic blocks.
+int chip8_disasm_analyze(Chip8Disasm *disasm, const uint8_t *program, size_t program_size, uint8_t platform) {
+    memset(disasm, 0, sizeof(*disasm));
+    disasm->platform = platform;
+    disasm->size = (platform == PLATFORM_XOCHIP) ? XOCHIP_RAM_SIZE : CHIP8_RAM_SIZE;
+
+    if (program_size > disasm->size - MEMORY_READ_START) {
+        program_size = disasm->size - MEMORY_READ_START;
+    }
+    memcpy(disasm->memory + MEMORY_READ_START, program, program_size);
+    disasm->program_end = MEMORY_READ_START + program_size;
+
+    // Every instruction is decoded once and queues at most two addresses
+    uint16_t *stack = malloc(2 * disasm->size * sizeof(uint16_t));
+    if (stack == NULL) {
+        return 0;
+    }
+    chip8_disasm_descend(disasm, stack);
+    free(stack);
+
+    if (!chip8_disasm_split(disasm) || !chip8_disasm_assign_functions(disasm)) {
+        chip8_disasm_free(disasm);
+        return 0;
+    }
+
+    // The code map is complete now, so writes can be checked against it
+    for (int b = 0; b < disasm->block_count; b++) {
+        Chip8DisasmBlock *block = &disasm->blocks[b];
+        chip8_disasm_track_i(disasm, block);
+
+        uint32_t address = block->start;
+        for (uint16_t count = 0; count < block->instructions; count++) {
+            block->flags |= disasm->flags[address];
+            address = (address + chip8_disasm_length(disasm, address)) & (disasm->size - 1);
+        }
+    }
+    return 1;
+}
+
+// Releases the blocks of an analysis.
+void chip8_disasm_free(Chip8Disasm *disasm) {
+    free(disasm->blocks);
+    disasm->blocks = NULL;
+    disasm->block_count = 0;
+}
+
+// Returns the name of a platform as accepted by --platform.
+static const char *chip8_disasm_platform_name(uint8_t platform) {
+    switch (platform) {
+        case PLATFORM_SCHIP:  return "schip";
+        case PLATFORM_XOCHIP: return "xochip";
+        default:              return "chip8";
+    }
+}
+
+// Returns the end of the data region starting at an address.
+static uint32_t chip8_disasm_data_end(const Chip8Disasm *disasm, uint32_t start) {
+    uint32_t end = start;
+    while (end < disasm->program_end && !(disasm->map[end] & DISASM_CODE)) {
+        end++;
+    }
+    return end;
+}
+
+// Checks whether I is ever pointed into a range.
+static int chip8_disasm_is_referenced(const Chip8Disasm *disasm, uint32_t start, uint32_t end) {
+    for (uint32_t address = start; address < end; address++) {
+        if (disasm->map[address] & DISASM_DATA_REF) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Prints the label of a subroutine entry.
+static void chip8_disasm_print_function(const Chip8Disasm *disasm, FILE *out, uint16_t entry) {
+    if (entry == MEMORY_READ_START) {
+        fprintf(out, "start");
+    } else {
+        fprintf(out, "sub_%0*X", disasm->size > CHIP8_RAM_SIZE ? 4 : 3, entry);
+    }
+}
+
+// Prints the subroutines a subroutine calls, each once.
+static void chip8_disasm_print_callees(const Chip8Disasm *disasm, FILE *out, uint16_t entry) {
+    int printed = 0;
+    for (int b = 0; b < disasm->block_count; b++) {
+        const Chip8DisasmBlock *block = &disasm->blocks[b];
+        if (block->function != entry || block->exit != DISASM_EXIT_CALL) {
+            continue;
+        }
+
+        int seen = 0;
+        for (int earlier = 0; earlier < b && !seen; earlier++) {
+            seen = disasm->blocks[earlier].function == entry && disasm->blocks[earlier].exit == DISASM_EXIT_CALL &&
+                   disasm->blocks[earlier].call == block->call;
+        }
+        if (!seen) {
+            fputc(' ', out);
+            chip8_disasm_print_function(disasm, out, block->call);
+            printed = 1;
+        }
+    }
+    if (!printed) {
+        fprintf(out, " -");
+    }
+}
+
+// Prints an assembly listing with block labels, data regions and the call graph.
+void chip8_disasm_print_text(const Chip8Disasm *disasm, FILE *out) {
+    int width = disasm->size > CHIP8_RAM_SIZE ? 4 : 3;
+    int functions = 0, indirect = 0, smc = 0, maybe_smc = 0, invalid = 0, data = 0;
+
+    for (uint32_t address = 0; address < disasm->size; address++) {
+        functions += (disasm->map[address] & DISASM_FUNCTION) != 0;
+        indirect += (disasm->flags[address] & DISASM_FLAG_INDIRECT) != 0;
+        smc += (disasm->flags[address] & DISASM_FLAG_SMC) != 0;
+        maybe_smc += (disasm->flags[address] & DISASM_FLAG_MAYBE_SMC) != 0;
+        invalid += (disasm->flags[address] & DISASM_FLAG_INVALID) != 0;
+    }
+    for (uint32_t address = MEMORY_READ_START; address < disasm->program_end; address++) {
+        if (!(disasm->map[address] & DISASM_CODE)) {
+            data++;
+            address = chip8_disasm_data_end(disasm, address);
+        }
+    }
+
+    fprintf(out, "; %u bytes, platform %s\n", disasm->program_end - MEMORY_READ_START, chip8_disasm_platform_name(disasm->platform));
+    fprintf(out, "; %d blocks, %d subroutines, %d data regions\n", disasm->block_count, functions, data);
+    fprintf(out, "; %d indirect jumps, %d self-modifying writes, %d possibly self-modifying writes, %d invalid instructions\n",
+            indirect, smc, maybe_smc, invalid);
+
+    uint32_t address = 0;
+    while (address < disasm->size) {
+        if (disasm->map[address] & DISASM_INSTRUCTION) {
+            uint16_t instruction = chip8_disasm_word(disasm, address);
+            uint16_t operand = chip8_disasm_word(disasm, address + 2);
+            uint8_t length = chip8_disasm_length(disasm, address);
+            uint8_t flags = disasm->flags[address];
+            char mnemonic[32];
+            char bytes[16];
+
+            if (disasm->map[address] & DISASM_FUNCTION) {
+                fputc('\n', out);
+                chip8_disasm_print_function(disasm, out, (uint16_t)address);
+                fprintf(out, ":\n");
+            } else if (chip8_disasm_find_block(disasm, (uint16_t)address) >= 0) {
+                fprintf(out, "L%0*X:\n", width, address);
+            }
+
+            chip8_disasm_format(mnemonic, sizeof(mnemonic), instruction, operand, disasm->platform);
+            if (length == 4) {
+                snprintf(bytes, sizeof(bytes), "%04X %04X", instruction, operand);
+            } else {
+                snprintf(bytes, sizeof(bytes), "%04X", instruction);
+            }
+            fprintf(out, "    %0*X: %-9s  %s", width, address, bytes, mnemonic);
+
+            const char *comment = NULL;
+            if (flags & DISASM_FLAG_INDIRECT) {
+                comment = "indirect jump";
+            } else if (flags & DISASM_FLAG_SMC) {
+                comment = "writes code";
+            } else if (flags & DISASM_FLAG_MAYBE_SMC) {
+                comment = "may write code";
+            } else if (flags & DISASM_FLAG_INVALID) {
+                comment = "invalid on this platform";
+            }
+            if (comment != NULL) {
+                fprintf(out, "%*s; %s", (int)(20 - strlen(mnemonic)), "", comment);
+            }
+            fputc('\n', out);
+            address += length;
+        } else if (address >= MEMORY_READ_START && address < disasm->program_end && !(disasm->map[address] & DISASM_CODE)) {
+            uint32_t end = chip8_disasm_data_end(disasm, address);
+            fprintf(out, "\ndata_%0*X:%s\n", width, address,
+                    chip8_disasm_is_referenced(disasm, address, end) ? "" : "  ; never loaded into I");
+            for (uint32_t row = address; row < end; row += 8) {
+                fprintf(out, "    %0*X: DB", width, row);
+                for (uint32_t byte = row; byte < end && byte < row + 8; byte++) {
+                    fprintf(out, " 0x%02X", disasm->memory[byte]);
+                }
+                fputc('\n', out);
+            }
+            address = end;
+        } else {
+            address++;
+        }
+    }
+
+    fprintf(out, "\n; Call graph\n");
+    for (uint32_t entry = 0; entry < disasm->size; entry++) {
+        if (disasm->map[entry] & DISASM_FUNCTION) {
+            fprintf(out, ";   ");
+            chip8_disasm_print_function(disasm, out, (uint16_t)entry);
+            fprintf(out, " ->");
+            chip8_disasm_print_callees(disasm, out, (uint16_t)entry);
+            fputc('\n', out);
+        }
+    }
+}
+
+// Prints the control flow graph in Graphviz DOT, one cluster per subroutine.
+void chip8_disasm_print_dot(const Chip8Disasm *disasm, FILE *out) {
+    int width = disasm->size > CHIP8_RAM_SIZE ? 4 : 3;
+
+    fprintf(out, "digraph chip8 {\n");
+    fprintf(out, "    node [shape=box, fontname=\"monospace\"];\n");
+
+    for (uint32_t entry = 0; entry < disasm->size; entry++) {
+        if (!(disasm->map[entry] & DISASM_FUNCTION)) {
+            continue;
+        }
+        fprintf(out, "    subgraph cluster_%X {\n        label=\"", entry);
+        chip8_disasm_print_function(disasm, out, (uint16_t)entry);
+        fprintf(out, "\";\n");
+
+        for (int b = 0; b < disasm->block_count; b++) {
+            const Chip8DisasmBlock *block = &disasm->blocks[b];
+            if (block->function != entry) {
+                continue;
+            }
+
+            fprintf(out, "        b%X [label=\"", block->start);
+            uint32_t address = block->start;
+            for (uint16_t count = 0; count < block->instructions; count++) {
+                char mnemonic[32];
+                chip8_disasm_format(mnemonic, sizeof(mnemonic), chip8_disasm_word(disasm, address),
+                                    chip8_disasm_word(disasm, address + 2), disasm->platform);
+                fprintf(out, "%0*X: %s\\l", width, address, mnemonic);
+                address = (address + chip8_disasm_length(disasm, address)) & (disasm->size - 1);
+            }
+            fprintf(out, "\"");
+            if (block->flags & (DISASM_FLAG_SMC | DISASM_FLAG_INVALID)) {
+                fprintf(out, ", color=red");
+            } else if (block->flags & (DISASM_FLAG_INDIRECT | DISASM_FLAG_MAYBE_SMC)) {
+                fprintf(out, ", color=orange");
+            }
+            fprintf(out, "];\n");
+        }
+        fprintf(out, "    }\n");
+    }
+
+    for (int b = 0; b < disasm->block_count; b++) {
+        const Chip8DisasmBlock *block = &disasm->blocks[b];
+        for (uint8_t s = 0; s < block->successor_count; s++) {
+            fprintf(out, "    b%X -> b%X%s;\n", block->start, block->successors[s],
+                    (block->exit == DISASM_EXIT_SKIP && s == 1) ? " [label=\"skip\"]" : "");
+        }
+        if (block->exit == DISASM_EXIT_CALL) {
+            fprintf(out, "    b%X -> b%X [style=dashed];\n", block->start, block->call);
+        }
+    }
+    fprintf(out, "}\n");
+}
+
+// Prints one line per block, data region and call site for other tools to load.
+void chip8_disasm_print_table(const Chip8Disasm *disasm, FILE *out) {
+    fprintf(out, "# platform %s\n", chip8_disasm_platform_name(disasm->platform));
+    fprintf(out, "# block <start> <end> <instructions> <subroutine> <exit> <successors> <flags>\n");
+    fprintf(out, "# data <start> <end> <referenced>\n");
+    fprintf(out, "# call <site> <caller> <callee>\n");
+
+    for (int b = 0; b < disasm->block_count; b++) {
+        const Chip8DisasmBlock *block = &disasm->blocks[b];
+        char flags[8];
+        int length = 0;
+
+        if (block->flags & DISASM_FLAG_INDIRECT) flags[length++] = 'i';
+        if (block->flags & DISASM_FLAG_SMC) flags[length++] = 'w';
+        if (block->flags & DISASM_FLAG_MAYBE_SMC) flags[length++] = 'm';
+        if (block->flags & DISASM_FLAG_INVALID) flags[length++] = 'x';
+        if (length == 0) flags[length++] = '-';
+        flags[length] = '\0';
+
+        fprintf(out, "block %x %x %u %x %s ", block->start, block->end, block->instructions, block->function,
+                exit_names[block->exit]);
+        if (block->successor_count == 0) {
+            fprintf(out, "-");
+        }
+        for (uint8_t s = 0; s < block->successor_count; s++) {
+            fprintf(out, s ? ",%x" : "%x", block->successors[s]);
+        }
+        fprintf(out, " %s\n", flags);
+    }
+
+    for (uint32_t address = MEMORY_READ_START; address < disasm->program_end; address++) {
+        if (!(disasm->map[address] & DISASM_CODE)) {
+            uint32_t end = chip8_disasm_data_end(disasm, address);
+            fprintf(out, "data %x %x %d\n", address, end, chip8_disasm_is_referenced(disasm, address, end));
+            address = end;
+        }
+    }
+
+    for (int b = 0; b < disasm->block_count; b++) {
+        const Chip8DisasmBlock *block = &disasm->blocks[b];
+        if (block->exit == DISASM_EXIT_CALL) {
+            fprintf(out, "call %x %x %x\n", (block->end - 2) & (disasm->size - 1), block->function, block->call);
+        }
+    }
+}
@@ -0,0 +1,178 @@
+#include "../include/chip8_fork.h"
+#include "../include/chip8_lockstep.h"
+#include "../include/chip8_opcodes.h"
+#include "../include/chip8_snapshot.h"
+
+// Opcodes whose handlers write RAM, in the order of Chip8ForkTracker.originals.
+static const uint8_t written_opcodes[3] = { OPCODE_LOAD_BCD, OPCODE_LOAD_REGISTERS, OPCODE_SAVE_RANGE };
+
+// Drops one reference to a shared page.
+static void chip8_page_release(Chip8Page *page) {
+    if (page != NULL && --page->refs == 0) {
+        free(page);
+    }
+}
+
+// Unshares the pages of a RAM write made outside of the opcode handlers.
+void chip8_fork_touch(Chip8 *chip8, uint32_t address, uint32_t length) {
+    if (length == 0) {
+        return;
+    }
+    Chip8ForkTracker *tracker = chip8->fork_tracker;
+    uint32_t mask = chip8->address_mask;
+    uint32_t first = address & mask;
+    uint32_t last = first + (length - 1 < mask ? length - 1 : mask);
+
+    // Pages past the end of RAM are its first ones again
+    for (uint32_t at = first & ~(uint32_t)(FORK_PAGE_SIZE - 1); at <= last; at += FORK_PAGE_SIZE) {
+        uint32_t page = (at & mask) / FORK_PAGE_SIZE;
+        chip8_page_release(tracker->resident[page]);
+        tracker->resident[page] = NULL;
+    }
+}
+
+/* Fx33 unsharing the pages it writes. */
+static void chip8_fork_load_bcd(Chip8 *chip8, Opcode *opcode)
+{
+    chip8_fork_touch(chip8, chip8->i_register, 3);
+    chip8->fork_tracker->originals[0](chip8, opcode);
+}
+
+/* Fx55 unsharing the pages it writes. */
+static void chip8_fork_load_registers(Chip8 *chip8, Opcode *opcode)
+{
+    chip8_fork_touch(chip8, chip8->i_register, opcode->x + 1);
+    chip8->fork_tracker->originals[1](chip8, opcode);
+}
+
+/* 5xy2 unsharing the pages it writes. */
+static void chip8_fork_save_range(Chip8 *chip8, Opcode *opcode)
+{
+    uint8_t length = (opcode->x <= opcode->y) ? opcode->y - opcode->x + 1 : opcode->x - opcode->y + 1;
+    chip8_fork_touch(chip8, chip8->i_register, length);
+    chip8->fork_tracker->originals[2](chip8, opcode);
+}
+
+static const Chip8Handler fork_handlers[3] = {
+    chip8_fork_load_bcd, chip8_fork_load_registers, chip8_fork_save_range
+};
+
+// Returns the number of pages in the address space of an instance.
+static uint32_t chip8_fork_page_count(const Chip8 *chip8) {
+    return ((uint32_t)chip8->address_mask + 1) / FORK_PAGE_SIZE;
+}
+
+// Starts tracking the RAM pages an instance writes.
+void chip8_fork_attach(Chip8 *chip8, Chip8ForkTracker *tracker) {
+    memset(tracker->resident, 0, sizeof(tracker->resident));
+    for (int i = 0; i < 3; i++) {
+        tracker->originals[i] = chip8->handlers[written_opcodes[i]];
+        if (tracker->originals[i] != NULL) {
+            chip8->handlers[written_opcodes[i]] = fork_handlers[i];
+        }
+    }
+    chip8->fork_tracker = tracker;
+}
+
+// Stops tracking and puts the original handlers back.
+void chip8_fork_detach(Chip8 *chip8) {
+    Chip8ForkTracker *tracker = chip8->fork_tracker;
+    for (uint32_t page = 0; page < FORK_MAX_PAGES; page++) {
+        chip8_page_release(tracker->resident[page]);
+        tracker->resident[page] = NULL;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (tracker->originals[i] != NULL) {
+            chip8_unwrap_handler(chip8, written_opcodes[i], fork_handlers[i], tracker->originals[i]);
+        }
+    }
+    chip8->fork_tracker = NULL;
+}
+
+// Saves the instance, copying only the RAM pages written since it last forked or resumed.
+Chip8Fork *chip8_fork(Chip8 *chip8) {
+    Chip8ForkTracker *tracker = chip8->fork_tracker;
+    uint32_t page_count = chip8_fork_page_count(chip8);
+
+    Chip8Fork *fork = malloc(sizeof(Chip8Fork) + page_count * sizeof(Chip8Page *));
+    if (fork == NULL) {
+        return NULL;
+    }
+    fork->state = *chip8;
+    fork->page_count = page_count;
+
+    for (uint32_t page = 0; page < page_count; page++) {
+        Chip8Page *shared = tracker->resident[page];
+        if (shared == NULL) {
+            // Written since the last fork: becomes a new shared page, held by the fork and the tracker
+            shared = malloc(sizeof(Chip8Page));
+            if (shared == NULL) {
+                fork->page_count = page;
+                chip8_fork_free(fork);
+                return NULL;
+            }
+            memcpy(shared->data, chip8->ram + page * FORK_PAGE_SIZE, FORK_PAGE_SIZE);
+            shared->refs = 1;
+            tracker->resident[page] = shared;
+        }
+        shared->refs++;
+        fork->pages[page] = shared;
+    }
+    return fork;
+}
+
+// Continues an instance from a fork.
+int chip8_fork_resume(Chip8 *chip8, const Chip8Fork *fork) {
+    Chip8ForkTracker *tracker = chip8->fork_tracker;
+    if (fork->page_count != chip8_fork_page_count(chip8)) {
+        return 0;
+    }
+
+    for (uint32_t page = 0; page < fork->page_count; page++) {
+        Chip8Page *shared = fork->pages[page];
+        if (tracker->resident[page] != shared) {
+            memcpy(chip8->ram + page * FORK_PAGE_SIZE, shared->data, FORK_PAGE_SIZE);
+            if (chip8->snapshot != NULL) {
+                chip8_snapshot_touch(chip8->snapshot, page * FORK_PAGE_SIZE, FORK_PAGE_SIZE);
+            }
+            shared->refs++;
+            chip8_page_release(tracker->resident[page]);
+            tracker->resident[page] = shared;
+        }
+    }
+
+    // Everything but the RAM mapping and the attachments of this instance comes from the fork
+    uint8_t *ram = chip8->ram;
+    Chip8Ram memory = chip8->memory;
+    Chip8Watch *watch = chip8->watch;
+    Chip8Snapshot *snapshot = chip8->snapshot;
+    Chip8StateHash *state_hash = chip8->state_hash;
+    Chip8Handler handlers[OPCODE_AMOUNT + 1];
+    memcpy(handlers, chip8->handlers, sizeof(handlers));
+
+    *chip8 = fork->state;
+    chip8->ram = ram;
+    chip8->memory = memory;
+    chip8->watch = watch;
+    chip8->snapshot = snapshot;
+    chip8->fork_tracker = tracker;
+    chip8->state_hash = state_hash;
+    memcpy(chip8->handlers, handlers, sizeof(handlers));
+
+    // The hash described the state before the resume
+    if (state_hash != NULL) {
+        chip8_state_hash_reset(chip8);
+    }
+    return 1;
+}
+
+// Releases a fork and the pages no other fork or instance shares.
+void chip8_fork_free(Chip8Fork *fork) {
+    if (fork == NULL) {
+        return;
+    }
+    for (uint32_t page = 0; page < fork->page_count; page++) {
+        chip8_page_release(fork->pages[page]);
+    }
+    free(fork);
+}
@@ -0,0 +1,388 @@
+#include "../include/chip8_lockstep.h"
+#include "../include/chip8_opcodes.h"
+#include "../include/simd.h"
+
+#include <inttypes.h>
+
+// Kinds of terms other than RAM bytes, kept apart so that equal values at equal indices hash differently.
+#define TERM_REGISTERS (1ull << 62)
+#define TERM_DISPLAY (2ull << 62)
+
+// Differing RAM bytes and display rows printed by chip8_lockstep_dump().
+#define DUMP_LIMIT 16
+
+// Opcodes whose handlers write RAM or the display, in the order of Chip8StateHash.originals.
+static const uint8_t hashed_opcodes[STATE_HASH_HANDLERS] = {
+    OPCODE_LOAD_BCD, OPCODE_LOAD_REGISTERS, OPCODE_SAVE_RANGE, OPCODE_DRAW,
+    OPCODE_CLS, OPCODE_SCROLL_DOWN, OPCODE_SCROLL_UP, OPCODE_SCROLL_RIGHT, OPCODE_SCROLL_LEFT, OPCODE_LORES, OPCODE_HIRES
+};
+
+static const char *const engine_names[2] = { "reference", "candidate" };
+
+// Terms are mixed with the splitmix64 finalizer, a bijection spreading every input bit over the whole
+// output; RAM terms are those simd_hash_ram() sums.
+static inline uint64_t state_hash_ram_term(uint32_t address, uint8_t value) {
+    return simd_mix64((uint64_t)address << 8 | value);
+}
+
+static inline uint64_t state_hash_word_term(int index, uint64_t word) {
+    return simd_mix64(simd_mix64(TERM_REGISTERS | (uint64_t)index) ^ word);
+}
+
+static inline uint64_t state_hash_row_term(int plane, int y, DisplayRow row) {
+    return simd_mix64(simd_mix64((TERM_DISPLAY | (uint64_t)plane << 8 | (uint64_t)y) ^ row.hi) ^ row.lo);
+}
+
+// Packs the registers, timers, stack and keyboard into words; byte order and padding stay within the process.
+static void state_hash_pack(const Chip8 *chip8, uint64_t words[STATE_HASH_WORDS]) {
+    memcpy(&words[0], chip8->v, sizeof(chip8->v));
+    memcpy(&words[2], chip8->flags, sizeof(chip8->flags));
+    memcpy(&words[4], chip8->stack, sizeof(chip8->stack));
+    memcpy(&words[8], chip8->audio_pattern, sizeof(chip8->audio_pattern));
+    words[10] = (uint64_t)chip8->program_counter | (uint64_t)chip8->i_register << 16 |
+                (uint64_t)chip8->stack_pointer << 32 | (uint64_t)chip8->delay_timer << 40 |
+                (uint64_t)chip8->sound_timer << 48 | (uint64_t)chip8->planes << 56;
+    words[11] = (uint64_t)chip8->random_state | (uint64_t)chip8->pitch << 32 | (uint64_t)chip8->hires << 40 |
+                (uint64_t)chip8->exited << 48 | (uint64_t)chip8->key_wait << 56;
+    words[12] = (uint64_t)chip8->key_wait_held | (uint64_t)chip8->key_wait_pressed << 16 |
+                (uint64_t)chip8->keys << 32 | (uint64_t)(uint16_t)chip8->timer << 48;
+}
+
+// Adds or removes the terms of RAM bytes, wrapping around the address space like the handlers.
+static void state_hash_ram(Chip8 *chip8, uint16_t start, uint8_t length, int add) {
+    Chip8StateHash *hash = chip8->state_hash;
+    for (uint8_t i = 0; i < length; i++) {
+        uint64_t term = state_hash_ram_term((start + i) & chip8->address_mask, chip8->ram[chip8_ram_index(chip8, start, i)]);
+        hash->value = add ? hash->value + term : hash->value - term;
+    }
+}
+
+// Adds or removes the terms of display rows on both planes, wrapping around the height.
+static void state_hash_rows(Chip8 *chip8, uint8_t first, uint8_t count, uint8_t height, int add) {
+    Chip8StateHash *hash = chip8->state_hash;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        for (uint8_t n = 0; n < count; n++) {
+            int y = (first + n) & (height - 1);
+            uint64_t term = state_hash_row_term(plane, y, chip8->display[plane][y]);
+            hash->value = add ? hash->value + term : hash->value - term;
+        }
+    }
+}
+
+// Runs a RAM-writing handler, replacing the terms of the bytes it writes.
+static void state_hash_write_ram(Chip8 *chip8, Opcode *opcode, int slot, uint8_t length) {
+    uint16_t start = chip8->i_register;
+    state_hash_ram(chip8, start, length, 0);
+    chip8->state_hash->originals[slot](chip8, opcode);
+    state_hash_ram(chip8, start, length, 1);
+}
+
+// Runs a handler rewriting the whole display, replacing the terms of every row.
+static void state_hash_write_display(Chip8 *chip8, Opcode *opcode, int slot) {
+    state_hash_rows(chip8, 0, DISPLAY_HIRES_HEIGHT, DISPLAY_HIRES_HEIGHT, 0);
+    chip8->state_hash->originals[slot](chip8, opcode);
+    state_hash_rows(chip8, 0, DISPLAY_HIRES_HEIGHT, DISPLAY_HIRES_HEIGHT, 1);
+}
+
+/* Fx33 with hashing. */
+static void state_hash_load_bcd(Chip8 *chip8, Opcode *opcode)
+{
+    state_hash_write_ram(chip8, opcode, 0, 3);
+}
+
+/* Fx55 with hashing. */
+static void state_hash_load_registers(Chip8 *chip8, Opcode *opcode)
+{
+    state_hash_write_ram(chip8, opcode, 1, opcode->x + 1);
+}
+
+/* 5xy2 with hashing. */
+static void state_hash_save_range(Chip8 *chip8, Opcode *opcode)
+{
+    uint8_t length = (opcode->x <= opcode->y) ? opcode->y - opcode->x + 1 : opcode->x - opcode->y + 1;
+    state_hash_write_ram(chip8, opcode, 2, length);
+}
+
+/* Dxyn with hashing: only the rows under the sprite change, on either plane. */
+static void state_hash_draw(Chip8 *chip8, Opcode *opcode)
+{
+    uint8_t height = chip8_display_height(chip8);
+    uint8_t first = chip8->v[opcode->y] & (height - 1);
+    uint8_t count = (opcode->n == 0 && chip8->platform != PLATFORM_CHIP8) ? 16 : opcode->n;
+
+    state_hash_rows(chip8, first, count, height, 0);
+    chip8->state_hash->originals[3](chip8, opcode);
+    state_hash_rows(chip8, first, count, height, 1);
+}
+
+/* Instantiate the wrapper of a handler that rewrites the whole display. */
+#define STATE_HASH_DISPLAY_WRAPPER(name, slot) \
+    static void state_hash_##name(Chip8 *chip8, Opcode *opcode) \
+    { \
+        state_hash_write_display(chip8, opcode, slot); \
+    }
+
+STATE_HASH_DISPLAY_WRAPPER(cls, 4)
+STATE_HASH_DISPLAY_WRAPPER(scroll_down, 5)
+STATE_HASH_DISPLAY_WRAPPER(scroll_up, 6)
+STATE_HASH_DISPLAY_WRAPPER(scroll_right, 7)
+STATE_HASH_DISPLAY_WRAPPER(scroll_left, 8)
+STATE_HASH_DISPLAY_WRAPPER(lores, 9)
+STATE_HASH_DISPLAY_WRAPPER(hires, 10)
+
+static const Chip8Handler state_hash_handlers[STATE_HASH_HANDLERS] = {
+    state_hash_load_bcd, state_hash_load_registers, state_hash_save_range, state_hash_draw,
+    state_hash_cls, state_hash_scroll_down, state_hash_scroll_up, state_hash_scroll_right, state_hash_scroll_left,
+    state_hash_lores, state_hash_hires
+};
+
+// Computes the state hash of an instance from scratch.
+uint64_t chip8_state_hash_compute(const Chip8 *chip8) {
+    uint64_t words[STATE_HASH_WORDS];
+    state_hash_pack(chip8, words);
+
+    uint64_t value = 0;
+    for (int i = 0; i < STATE_HASH_WORDS; i++) {
+        value += state_hash_word_term(i, words[i]);
+    }
+    value += simd_hash_ram(chip8->ram, (uint32_t)chip8->address_mask + 1);
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        for (int y = 0; y < DISPLAY_HIRES_HEIGHT; y++) {
+            value += state_hash_row_term(plane, y, chip8->display[plane][y]);
+        }
+    }
+    return value;
+}
+
+// Hashes an instance and starts following its writes.
+void chip8_state_hash_attach(Chip8 *chip8, Chip8StateHash *hash) {
+    for (int i = 0; i < STATE_HASH_HANDLERS; i++) {
+        hash->originals[i] = chip8->handlers[hashed_opcodes[i]];
+        if (hash->originals[i] != NULL) {
+            chip8->handlers[hashed_opcodes[i]] = state_hash_handlers[i];
+        }
+    }
+    chip8->state_hash = hash;
+    chip8_state_hash_reset(chip8);
+}
+
+// Folds the registers that changed since the last update into the hash.
+uint64_t chip8_state_hash_update(Chip8 *chip8) {
+    Chip8StateHash *hash = chip8->state_hash;
+    uint64_t words[STATE_HASH_WORDS];
+    state_hash_pack(chip8, words);
+
+    for (int i = 0; i < STATE_HASH_WORDS; i++) {
+        if (words[i] != hash->words[i]) {
+            hash->value += state_hash_word_term(i, words[i]) - state_hash_word_term(i, hash->words[i]);
+            hash->words[i] = words[i];
+        }
+    }
+    return hash->value;
+}
+
+// Rehashes an attached hash after the whole state was replaced.
+void chip8_state_hash_reset(Chip8 *chip8) {
+    state_hash_pack(chip8, chip8->state_hash->words);
+    chip8->state_hash->value = chip8_state_hash_compute(chip8);
+}
+
+// Stops following writes and puts the original handlers back.
+void chip8_state_hash_detach(Chip8 *chip8) {
+    Chip8StateHash *hash = chip8->state_hash;
+    for (int i = 0; i < STATE_HASH_HANDLERS; i++) {
+        if (hash->originals[i] != NULL) {
+            chip8_unwrap_handler(chip8, hashed_opcodes[i], state_hash_handlers[i], hash->originals[i]);
+        }
+    }
+    chip8->state_hash = NULL;
+}
+
+// Reference engine: one instruction with chip8_step().
+uint32_t chip8_engine_step(Chip8 *chip8, uint32_t max_cycles, uint8_t *stopped) {
+    (void)max_cycles;
+    *stopped = chip8_step(chip8) || chip8->exited;
+    return 1;
+}
+
+// Skips idle loops with chip8_fast_forward(), otherwise one instruction with chip8_step().
+uint32_t chip8_engine_fast_forward(Chip8 *chip8, uint32_t max_cycles, uint8_t *stopped) {
+    uint32_t skipped = chip8_fast_forward(chip8, max_cycles);
+    if (skipped) {
+        return skipped;
+    }
+    return chip8_engine_step(chip8, max_cycles, stopped);
+}
+
+// Attaches state hashes to two instances in the same state.
+void chip8_lockstep_start(Chip8Lockstep *lockstep, Chip8 *reference, Chip8Engine reference_engine,
+                          Chip8 *candidate, Chip8Engine candidate_engine, uint32_t interval) {
+    memset(lockstep, 0, sizeof(*lockstep));
+    lockstep->instances[LOCKSTEP_REFERENCE] = reference;
+    lockstep->instances[LOCKSTEP_CANDIDATE] = candidate;
+    lockstep->engines[LOCKSTEP_REFERENCE] = reference_engine;
+    lockstep->engines[LOCKSTEP_CANDIDATE] = candidate_engine;
+    lockstep->interval = interval ? interval : 1;
+    lockstep->next_check = 0; // The starting states are compared as well
+
+    for (int side = 0; side < 2; side++) {
+        chip8_state_hash_attach(lockstep->instances[side], &lockstep->hashes[side]);
+    }
+}
+
+// Runs both engines for a number of instructions, comparing them on the way.
+int chip8_lockstep_run(Chip8Lockstep *lockstep, uint32_t cycles) {
+    if (lockstep->diverged) {
+        return 0;
+    }
+
+    uint32_t done[2] = { 0, 0 };
+    for (;;) {
+        if (done[LOCKSTEP_REFERENCE] == done[LOCKSTEP_CANDIDATE]) {
+            uint64_t executed = lockstep->executed + done[LOCKSTEP_REFERENCE];
+            int stopping = lockstep->stopped[LOCKSTEP_REFERENCE] || lockstep->stopped[LOCKSTEP_CANDIDATE];
+            if (executed >= lockstep->next_check || stopping) {
+                if (lockstep->stopped[LOCKSTEP_REFERENCE] != lockstep->stopped[LOCKSTEP_CANDIDATE] ||
+                    lockstep->hashes[LOCKSTEP_REFERENCE].value != lockstep->hashes[LOCKSTEP_CANDIDATE].value) {
+                    lockstep->diverged = 1;
+                    lockstep->diverged_at = executed;
+                    return 0;
+                }
+                lockstep->matched = executed;
+                lockstep->next_check = executed + lockstep->interval;
+            }
+            if (done[LOCKSTEP_REFERENCE] == cycles || stopping) {
+                break;
+            }
+        }
+
+        // The candidate leads, so that it advances in the steps it would take running alone
+        int side = (done[LOCKSTEP_REFERENCE] < done[LOCKSTEP_CANDIDATE]) ? LOCKSTEP_REFERENCE : LOCKSTEP_CANDIDATE;
+        if (lockstep->stopped[side]) {
+            // The other engine went on past the instruction this one stopped at
+            lockstep->diverged = 1;
+            lockstep->diverged_at = lockstep->executed + done[side];
+            return 0;
+        }
+        uint32_t limit = ((done[0] == done[1]) ? cycles : done[!side]) - done[side];
+
+        Chip8 *chip8 = lockstep->instances[side];
+        lockstep->last_pc[side] = chip8->program_counter;
+        lockstep->last_instruction[side] = (uint16_t)(chip8->ram[chip8_ram_index(chip8, chip8->program_counter, 0)] << 8 |
+                                                      chip8->ram[chip8_ram_index(chip8, chip8->program_counter, 1)]);
+        lockstep->last_cycles[side] = lockstep->engines[side](chip8, limit, &lockstep->stopped[side]);
+        done[side] += lockstep->last_cycles[side];
+        chip8_state_hash_update(chip8);
+    }
+
+    lockstep->executed += done[LOCKSTEP_REFERENCE];
+    return 1;
+}
+
+// Prints the fields of both states that differ, returns how many did.
+static int lockstep_dump_fields(const Chip8 *reference, const Chip8 *candidate, FILE *out) {
+    struct {
+        const char *name;
+        uint32_t values[2];
+    } fields[] = {
+        { "pc", { reference->program_counter, candidate->program_counter } },
+        { "i", { reference->i_register, candidate->i_register } },
+        { "sp", { reference->stack_pointer, candidate->stack_pointer } },
+        { "delay", { reference->delay_timer, candidate->delay_timer } },
+        { "sound", { reference->sound_timer, candidate->sound_timer } },
+        { "timer", { (uint32_t)reference->timer, (uint32_t)candidate->timer } },
+        { "keys", { reference->keys, candidate->keys } },
+        { "key_wait", { reference->key_wait, candidate->key_wait } },
+        { "key_wait_held", { reference->key_wait_held, candidate->key_wait_held } },
+        { "key_wait_pressed", { reference->key_wait_pressed, candidate->key_wait_pressed } },
+        { "hires", { reference->hires, candidate->hires } },
+        { "planes", { reference->planes, candidate->planes } },
+        { "pitch", { reference->pitch, candidate->pitch } },
+        { "random", { reference->random_state, candidate->random_state } },
+        { "exited", { reference->exited, candidate->exited } },
+    };
+
+    int differing = 0;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (fields[i].values[0] != fields[i].values[1]) {
+            fprintf(out, "  %-16s %8" PRIX32 " %8" PRIX32 "\n", fields[i].name, fields[i].values[0], fields[i].values[1]);
+            differing++;
+        }
+    }
+    for (int i = 0; i < REGISTERS_SIZE; i++) {
+        if (reference->v[i] != candidate->v[i]) {
+            fprintf(out, "  v%-15X %8X %8X\n", i, reference->v[i], candidate->v[i]);
+            differing++;
+        }
+        if (reference->flags[i] != candidate->flags[i]) {
+            fprintf(out, "  flag%-12X %8X %8X\n", i, reference->flags[i], candidate->flags[i]);
+            differing++;
+        }
+        if (reference->audio_pattern[i] != candidate->audio_pattern[i]) {
+            fprintf(out, "  audio%-11X %8X %8X\n", i, reference->audio_pattern[i], candidate->audio_pattern[i]);
+            differing++;
+        }
+    }
+    for (int i = 0; i < STACK_SIZE; i++) {
+        if (reference->stack[i] != candidate->stack[i]) {
+            fprintf(out, "  stack%-11X %8X %8X\n", i, reference->stack[i], candidate->stack[i]);
+            differing++;
+        }
+    }
+
+    int printed = 0;
+    for (uint32_t address = 0; address <= reference->address_mask && address <= candidate->address_mask; address++) {
+        if (reference->ram[address] != candidate->ram[address]) {
+            if (printed++ < DUMP_LIMIT) {
+                fprintf(out, "  ram %04" PRIX32 "         %8X %8X\n", address, reference->ram[address], candidate->ram[address]);
+            }
+            differing++;
+        }
+    }
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        for (int y = 0; y < DISPLAY_HIRES_HEIGHT; y++) {
+            DisplayRow a = reference->display[plane][y];
+            DisplayRow b = candidate->display[plane][y];
+            if (a.hi != b.hi || a.lo != b.lo) {
+                if (printed++ < DUMP_LIMIT) {
+                    fprintf(out, "  plane %d row %-3d %016" PRIX64 "%016" PRIX64 "\n"
+                                 "                   %016" PRIX64 "%016" PRIX64 "\n", plane, y, a.hi, a.lo, b.hi, b.lo);
+                }
+                differing++;
+            }
+        }
+    }
+    if (printed > DUMP_LIMIT) {
+        fprintf(out, "  ... and %d more RAM bytes and display rows\n", printed - DUMP_LIMIT);
+    }
+    return differing;
+}
+
+// Prints where the engines differ and the fields of both states that differ.
+void chip8_lockstep_dump(Chip8Lockstep *lockstep, FILE *out) {
+    fprintf(out, "Engines differ after instruction %" PRIu64 ", equal after instruction %" PRIu64 "\n",
+            lockstep->diverged_at, lockstep->matched);
+    for (int side = 0; side < 2; side++) {
+        Chip8 *chip8 = lockstep->instances[side];
+        uint64_t rehashed = chip8_state_hash_compute(chip8);
+        fprintf(out, "  %s last ran %" PRIu32 " instruction%s from %03X (%04X)%s, hash %016" PRIx64 "%s\n",
+                engine_names[side], lockstep->last_cycles[side], lockstep->last_cycles[side] == 1 ? "" : "s",
+                lockstep->last_pc[side], lockstep->last_instruction[side],
+                lockstep->stopped[side] ? " and stopped" : "", lockstep->hashes[side].value,
+                (rehashed != lockstep->hashes[side].value) ? " (rehashes differently: a write escaped the hash)" : "");
+    }
+
+    fprintf(out, "  %-16s %8s %8s\n", "field", engine_names[LOCKSTEP_REFERENCE], engine_names[LOCKSTEP_CANDIDATE]);
+    if (lockstep_dump_fields(lockstep->instances[LOCKSTEP_REFERENCE], lockstep->instances[LOCKSTEP_CANDIDATE], out) == 0) {
+        fprintf(out, "  no field differs\n");
+    }
+}
+
+// Detaches the state hashes of both instances.
+void chip8_lockstep_stop(Chip8Lockstep *lockstep) {
+    for (int side = 0; side < 2; side++) {
+        if (lockstep->instances[side] != NULL && lockstep->instances[side]->state_hash == &lockstep->hashes[side]) {
+            chip8_state_hash_detach(lockstep->instances[side]);
+        }
+    }
+}
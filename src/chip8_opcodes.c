@@ -1,56 +1,29 @@
 #include "../include/chip8_opcodes.h"
 #include "../include/chip8.h"
-#include "../include/keyboard.h"
-
-/* The above code is defining an array called `opcode_table` of type `OpcodeEntry`. Each `OpcodeEntry`
-struct contains three elements: an opcode value, a mask value, and a function pointer to a specific
-opcode handler function. */
-const OpcodeEntry opcode_table[OPCODE_AMOUNT] = {
-    { 0x00E0, 0xFFFF, chip8_execute_opcode_cls },                   // 00E0
-    { 0x00EE, 0xFFFF, chip8_execute_opcode_ret },                   // 00EE
-    { 0x1000, 0xF000, chip8_execute_opcode_jp },                    // 1nnn
-    { 0x2000, 0xF000, chip8_execute_opcode_call },                  // 2nnn
-    { 0x3000, 0xF000, chip8_execute_opcode_skip_equal_byte },       // 3xkk
-    { 0x4000, 0xF000, chip8_execute_opcode_skip_not_equal_byte },   // 4xkk
-    { 0x5000, 0xF00F, chip8_execute_opcode_skip_equal },            // 5xy0
-    { 0x6000, 0xF000, chip8_execute_opcode_load_byte },             // 6xkk
-    { 0x7000, 0xF000, chip8_execute_opcode_add_byte },              // 7xkk
-    { 0x8000, 0xF00F, chip8_execute_opcode_load },                  // 8xy0
-    { 0x8001, 0xF00F, chip8_execute_opcode_or },                    // 8xy1
-    { 0x8002, 0xF00F, chip8_execute_opcode_and },                   // 8xy2
-    { 0x8003, 0xF00F, chip8_execute_opcode_xor },                   // 8xy3
-    { 0x8004, 0xF00F, chip8_execute_opcode_add },                   // 8xy4
-    { 0x8005, 0xF00F, chip8_execute_opcode_subtract_x },            // 8xy5
-    { 0x8006, 0xF00F, chip8_execute_opcode_divide },                // 8xy6
-    { 0x8007, 0xF00F, chip8_execute_opcode_subtract_y },            // 8xy7
-    { 0x800E, 0xF00F, chip8_execute_opcode_multiply },              // 8xyE
-    { 0x9000, 0xF00F, chip8_execute_opcode_skip_not_equal },        // 9xy0
-    { 0xA000, 0xF000, chip8_execute_opcode_set_i },                 // Annn
-    { 0xB000, 0xF000, chip8_execute_opcode_jump },                  // Bnnn
-    { 0xC000, 0xF000, chip8_execute_opcode_random },                // Cxkk
-    { 0xD000, 0xF000, chip8_execute_opcode_draw },                  // Dxyn
-    { 0xE09E, 0xF0FF, chip8_execute_opcode_skip_key },              // Ex9E
-    { 0xE0A1, 0xF0FF, chip8_execute_opcode_skip_not_key },          // ExA1
-    { 0xF007, 0xF0FF, chip8_execute_opcode_load_delay_timer },      // Fx07
-    { 0xF00A, 0xF0FF, chip8_execute_opcode_wait_key },              // Fx0A
-    { 0xF015, 0xF0FF, chip8_execute_opcode_set_delay_timer },       // Fx15
-    { 0xF018, 0xF0FF, chip8_execute_opcode_set_sound_timer },       // Fx18
-    { 0xF01E, 0xF0FF, chip8_execute_opcode_add_i },                 // Fx1E
-    { 0xF029, 0xF0FF, chip8_execute_opcode_load_font},              // Fx29
-    { 0xF033, 0xF0FF, chip8_execute_opcode_load_bcd },              // Fx33
-    { 0xF055, 0xF0FF, chip8_execute_opcode_load_registers},         // Fx55
-    { 0xF065, 0xF0FF, chip8_execute_opcode_load_memory },           // Fx65
-};
+
+/* Bytes to advance the program counter by to skip the next instruction. With long_skip
+   the four-byte XO-CHIP F000 nnnn instruction is skipped as a whole. */
+static inline uint16_t chip8_skip_length(Chip8 *chip8, const int long_skip)
+{
+    uint16_t pc = chip8->program_counter;
+    if (long_skip &&
+        chip8->ram[chip8_ram_index(chip8, pc, 2)] == 0xF0 &&
+        chip8->ram[chip8_ram_index(chip8, pc, 3)] == 0x00) {
+        return 6;
+    }
+    return 4;
+}
 
 /* clear the display */
 void chip8_execute_opcode_cls(Chip8 *chip8, Opcode *opcode)
 {
-    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
-        for (int x = 0; x < DISPLAY_WIDTH; x++) {
-            chip8_set_display_state(chip8, x, y, 0);
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (chip8->planes & (1 << plane)) {
+            memset(chip8->display[plane], 0, sizeof(chip8->display[plane]));
         }
     }
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->display_changed = 1;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* return from a subroutine */
@@ -58,7 +31,7 @@ void chip8_execute_opcode_ret(Chip8 *chip8, Opcode *opcode)
 {
     chip8->stack_pointer = (chip8->stack_pointer - 1) & 0xF;
     chip8->program_counter = chip8->stack[chip8->stack_pointer];
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
     
 }
 
@@ -77,66 +50,69 @@ void chip8_execute_opcode_call(Chip8 *chip8, Opcode *opcode)
 }
 
 /* Skip next instruction if Vx = kk */
-void chip8_execute_opcode_skip_equal_byte(Chip8 *chip8, Opcode *opcode)
+static inline void opcode_skip_equal_byte(Chip8 *chip8, Opcode *opcode, const int long_skip)
 {
-    chip8->program_counter += (chip8->v[opcode->x] == opcode->kk) ? 4 : 2;
-    chip8->program_counter = chip8->program_counter & 0x0FFF;
+    chip8->program_counter += (chip8->v[opcode->x] == opcode->kk) ? chip8_skip_length(chip8, long_skip) : 2;
+    chip8->program_counter = chip8->program_counter & chip8->address_mask;
 }
 
 /* Skip next instruction if Vx != kk */
-void chip8_execute_opcode_skip_not_equal_byte(Chip8 *chip8, Opcode *opcode)
+static inline void opcode_skip_not_equal_byte(Chip8 *chip8, Opcode *opcode, const int long_skip)
 {
-    chip8->program_counter += (chip8->v[opcode->x] != opcode->kk) ? 4 : 2;
-    chip8->program_counter = chip8->program_counter & 0x0FFF;
+    chip8->program_counter += (chip8->v[opcode->x] != opcode->kk) ? chip8_skip_length(chip8, long_skip) : 2;
+    chip8->program_counter = chip8->program_counter & chip8->address_mask;
 }
 
 /* Skip next instruction if Vx = Vy */
-void chip8_execute_opcode_skip_equal(Chip8 *chip8, Opcode *opcode)
+static inline void opcode_skip_equal(Chip8 *chip8, Opcode *opcode, const int long_skip)
 {
-    chip8->program_counter += (chip8->v[opcode->x] == chip8->v[opcode->y]) ? 4 : 2;
-    chip8->program_counter = chip8->program_counter & 0x0FFF;
+    chip8->program_counter += (chip8->v[opcode->x] == chip8->v[opcode->y]) ? chip8_skip_length(chip8, long_skip) : 2;
+    chip8->program_counter = chip8->program_counter & chip8->address_mask;
 }
 
 /* Set Vx = kk */
 void chip8_execute_opcode_load_byte(Chip8 *chip8, Opcode *opcode)
 {
     chip8->v[opcode->x] = opcode->kk;
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Set Vx = Vx + kk */
 void chip8_execute_opcode_add_byte(Chip8 *chip8, Opcode *opcode)
 {
     chip8->v[opcode->x] = chip8->v[opcode->x] + opcode->kk;
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Set Vx = Vy */
 void chip8_execute_opcode_load(Chip8 *chip8, Opcode *opcode)
 {
     chip8->v[opcode->x] = chip8->v[opcode->y];
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Set Vx = Vx OR Vy. */
-void chip8_execute_opcode_or(Chip8 *chip8, Opcode *opcode)
+static inline void opcode_or(Chip8 *chip8, Opcode *opcode, const int vf_reset)
 {
     chip8->v[opcode->x] = (chip8->v[opcode->x] | chip8->v[opcode->y]);
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    if (vf_reset) chip8->v[0x0F] = 0;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Set Vx = Vx AND Vy. */
-void chip8_execute_opcode_and(Chip8 *chip8, Opcode *opcode)
+static inline void opcode_and(Chip8 *chip8, Opcode *opcode, const int vf_reset)
 {
     chip8->v[opcode->x] = (chip8->v[opcode->x] & chip8->v[opcode->y]);
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    if (vf_reset) chip8->v[0x0F] = 0;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Set Vx = Vx XOR Vy. */
-void chip8_execute_opcode_xor(Chip8 *chip8, Opcode *opcode)
+static inline void opcode_xor(Chip8 *chip8, Opcode *opcode, const int vf_reset)
 {
     chip8->v[opcode->x] = (chip8->v[opcode->x] ^ chip8->v[opcode->y]);
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    if (vf_reset) chip8->v[0x0F] = 0;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Set Vx = Vx + Vy, set VF = carry. */
@@ -144,7 +120,7 @@ void chip8_execute_opcode_add(Chip8 *chip8, Opcode *opcode)
 {   
     chip8->v[0x0F] = ((uint16_t)chip8->v[opcode->x] + (uint16_t)chip8->v[opcode->y] > 255) ? 1 : 0;
     chip8->v[opcode->x] += chip8->v[opcode->y];
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Set Vx = Vx - Vy, set VF = NOT borrow. */
@@ -152,15 +128,16 @@ void chip8_execute_opcode_subtract_x(Chip8 *chip8, Opcode *opcode)
 {   
     chip8->v[0x0F] = (chip8->v[opcode->x] > chip8->v[opcode->y]) ? 1 : 0;
     chip8->v[opcode->x] -= chip8->v[opcode->y];
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
-/* Set Vx = Vx SHR 1. */
-void chip8_execute_opcode_divide(Chip8 *chip8, Opcode *opcode)
+/* Set Vx = Vx SHR 1, or Vx = Vy SHR 1 with shift_vy. */
+static inline void opcode_divide(Chip8 *chip8, Opcode *opcode, const int shift_vy)
 {   
-    chip8->v[0x0F] = (chip8->v[opcode->x] & 0x01);
-    chip8->v[opcode->x] >>= 1;
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    uint8_t source = chip8->v[shift_vy ? opcode->y : opcode->x];
+    chip8->v[0x0F] = (source & 0x01);
+    chip8->v[opcode->x] = source >> 1;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Set Vx = Vy - Vx, set VF = NOT borrow. */
@@ -168,142 +145,180 @@ void chip8_execute_opcode_subtract_y(Chip8 *chip8, Opcode *opcode)
 {   
     chip8->v[0x0F] = (chip8->v[opcode->y] > chip8->v[opcode->x]) ? 1 : 0;
     chip8->v[opcode->x] = chip8->v[opcode->y] - chip8->v[opcode->x];
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
-/* Set Vx = Vx SHR 1. */
-void chip8_execute_opcode_multiply(Chip8 *chip8, Opcode *opcode)
+/* Set Vx = Vx SHL 1, or Vx = Vy SHL 1 with shift_vy. */
+static inline void opcode_multiply(Chip8 *chip8, Opcode *opcode, const int shift_vy)
 {   
-    chip8->v[0x0F] = (chip8->v[opcode->x] & 0x80) >> 7;
-    uint8_t shl = chip8->v[opcode->x] << 1;
+    uint8_t source = chip8->v[shift_vy ? opcode->y : opcode->x];
+    chip8->v[0x0F] = (source & 0x80) >> 7;
+    uint8_t shl = source << 1;
     chip8->v[opcode->x] = shl & 0xFF;
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Skip next instruction if Vx != Vy. */
-void chip8_execute_opcode_skip_not_equal(Chip8 *chip8, Opcode *opcode)
+static inline void opcode_skip_not_equal(Chip8 *chip8, Opcode *opcode, const int long_skip)
 {   
-    chip8->program_counter += (chip8->v[opcode->x] != chip8->v[opcode->y]) ? 4 : 2;
-    chip8->program_counter = chip8->program_counter & 0x0FFF;
+    chip8->program_counter += (chip8->v[opcode->x] != chip8->v[opcode->y]) ? chip8_skip_length(chip8, long_skip) : 2;
+    chip8->program_counter = chip8->program_counter & chip8->address_mask;
 }
 
 /* Set I = nnn. */
 void chip8_execute_opcode_set_i(Chip8 *chip8, Opcode *opcode)
 {   
     chip8->i_register = opcode->nnn;
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
-/* Jump to location nnn + V0. */
-void chip8_execute_opcode_jump(Chip8 *chip8, Opcode *opcode)
+/* Jump to location nnn + V0, or xnn + Vx with jump_vx. */
+static inline void opcode_jump(Chip8 *chip8, Opcode *opcode, const int jump_vx)
 {   
-    chip8->program_counter = opcode->nnn + chip8->v[0];
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = opcode->nnn + chip8->v[jump_vx ? opcode->x : 0];
+    chip8->program_counter = chip8->program_counter & chip8->address_mask;
 }
 
 /* Set Vx = random byte AND kk. */
 void chip8_execute_opcode_random(Chip8 *chip8, Opcode *opcode)
 {   
-    uint8_t random_value = rand() % 256;
-    chip8->v[opcode->x] = random_value & opcode->kk;
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
-}
-
-/* Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision. */
-void chip8_execute_opcode_draw(Chip8 *chip8, Opcode *opcode)
+    // xorshift32 on the state of the instance
+    uint32_t state = chip8->random_state;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    chip8->random_state = state;
+
+    chip8->v[opcode->x] = (uint8_t)(state >> 24) & opcode->kk;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
+   On SUPER-CHIP and XO-CHIP, n = 0 draws a 16x16 sprite. Each selected bitplane consumes
+   its own sprite data, one whole row is combined per step. With clip_sprites, pixels past
+   the right and bottom edges are dropped instead of wrapping around. */
+static inline void opcode_draw(Chip8 *chip8, Opcode *opcode, const int clip_sprites)
 {   
-    uint8_t pos_x = chip8->v[opcode->x];
-    uint8_t pos_y = chip8->v[opcode->y];
+    uint8_t width = chip8_display_width(chip8);
+    uint8_t height = chip8_display_height(chip8);
+    uint8_t pos_x = chip8->v[opcode->x] & (width - 1);
+    uint8_t pos_y = chip8->v[opcode->y] & (height - 1);
     uint8_t amount = opcode->n;
+    uint8_t sprite_width = 8;
+
+    if (amount == 0 && chip8->platform != PLATFORM_CHIP8) {
+        amount = 16;
+        sprite_width = 16;
+    }
 
     chip8->display_changed = 1;
 
     uint8_t collision = 0;
-    for(int n = 0; n < amount; n++)
+    uint32_t offset = 0; // Sprite bytes read so far, the planes take consecutive sprites
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
     {
-        uint8_t value = chip8->ram[chip8->i_register + n];
-        for (int i = 7; i >= 0; i--) 
+        if (!(chip8->planes & (1 << plane))) continue;
+
+        for (int n = 0; n < amount; n++)
         {
-            uint8_t px_pos_x = (pos_x + 7 - i) % 64;
-            uint8_t px_pos_y = (pos_y + n) % 32;
+            if (clip_sprites && pos_y + n >= height) {
+                offset += (amount - n) * (sprite_width / 8);
+                break;
+            }
+
+            uint16_t value = chip8->ram[chip8_ram_index(chip8, chip8->i_register, offset)];
+            if (sprite_width == 16) {
+                value = (value << 8) | chip8->ram[chip8_ram_index(chip8, chip8->i_register, offset + 1)];
+            }
+            offset += sprite_width / 8;
+
+            DisplayRow sprite = clip_sprites
+                ? display_row_place_sprite_clipped(value, sprite_width, pos_x, width)
+                : display_row_place_sprite(value, sprite_width, pos_x, width);
+            DisplayRow *row = &chip8->display[plane][(pos_y + n) & (height - 1)];
 
-            uint8_t is_on = (value >> i) & 1;
-            uint8_t current_state = chip8_get_display_state(chip8, px_pos_x, px_pos_y);
-            
-            if (current_state & is_on) collision = 1;
+            if (!display_row_is_zero(display_row_and(*row, sprite))) collision = 1;
 
-            chip8_set_display_state(chip8, px_pos_x, px_pos_y, current_state ^ is_on);         
+            *row = display_row_xor(*row, sprite);
         }
     }
 
     chip8->v[0x0F] = collision;
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Skip next instruction if key with the value of Vx is pressed. */
-void chip8_execute_opcode_skip_key(Chip8 *chip8, Opcode *opcode)
+static inline void opcode_skip_key(Chip8 *chip8, Opcode *opcode, const int long_skip)
 {   
-    chip8->program_counter += (chip8_get_keyboard_state(chip8, chip8->v[opcode->x])) ? 4 : 2;
-    chip8->program_counter = chip8->program_counter & 0x0FFF;
+    chip8->program_counter += (chip8_get_keyboard_state(chip8, chip8->v[opcode->x])) ? chip8_skip_length(chip8, long_skip) : 2;
+    chip8->program_counter = chip8->program_counter & chip8->address_mask;
 }
 
 /* Skip next instruction if key with the value of Vx is not pressed. */
-void chip8_execute_opcode_skip_not_key(Chip8 *chip8, Opcode *opcode)
+static inline void opcode_skip_not_key(Chip8 *chip8, Opcode *opcode, const int long_skip)
 {   
-    chip8->program_counter += (chip8_get_keyboard_state(chip8, chip8->v[opcode->x])) ? 2 : 4;
-    chip8->program_counter = chip8->program_counter & 0x0FFF;
+    chip8->program_counter += (chip8_get_keyboard_state(chip8, chip8->v[opcode->x])) ? 2 : chip8_skip_length(chip8, long_skip);
+    chip8->program_counter = chip8->program_counter & chip8->address_mask;
 }
 
 /* Set Vx = delay timer value. */
 void chip8_execute_opcode_load_delay_timer(Chip8 *chip8, Opcode *opcode)
 {   
     chip8->v[opcode->x] = chip8->delay_timer;
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
-/* Wait for a key press, store the value of the key in Vx. */
+/* Wait for a key press and release, store the value of the key in Vx. */
 void chip8_execute_opcode_wait_key(Chip8 *chip8, Opcode *opcode)
-{   
+{
+    if (!chip8->key_wait) {
+        // Keys already held only count once they are pressed again
+        chip8->key_wait = 1;
+        chip8->key_wait_held = chip8->keys;
+        chip8->key_wait_pressed = 0;
+        return;
+    }
 
-    for (uint8_t i = 0; i < 16; i++) {
-        uint8_t current_state = chip8_get_keyboard_state(chip8, i);
-        if (current_state) 
-        {
+    chip8->key_wait_pressed |= chip8->keys & ~chip8->key_wait_held;
+    chip8->key_wait_held = chip8->keys;
+
+    uint16_t released = chip8->key_wait_pressed & ~chip8->keys;
+    for (uint8_t i = 0; i < KEYBOARD_SIZE; i++) {
+        if (released & (1 << i)) {
             chip8->v[opcode->x] = i;
-            chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
-            break;
+            chip8->key_wait = 0;
+            chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
             return;
         }
     }
-
 }
 
 /* Set delay timer = Vx. */
 void chip8_execute_opcode_set_delay_timer(Chip8 *chip8, Opcode *opcode)
 {   
     chip8->delay_timer = chip8->v[opcode->x];
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Set sound timer = Vx. */
 void chip8_execute_opcode_set_sound_timer(Chip8 *chip8, Opcode *opcode)
 {   
     chip8->sound_timer = chip8->v[opcode->x];
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Set I = I + Vx. */
 void chip8_execute_opcode_add_i(Chip8 *chip8, Opcode *opcode)
 {   
     chip8->i_register += chip8->v[opcode->x];
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Set I = location of sprite for digit Vx. */
 void chip8_execute_opcode_load_font(Chip8 *chip8, Opcode *opcode)
 {   
     chip8->i_register = chip8->v[opcode->x] * 5;
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
 /* Store BCD representation of Vx in memory locations I, I+1, and I+2. */
@@ -315,29 +330,389 @@ void chip8_execute_opcode_load_bcd(Chip8 *chip8, Opcode *opcode)
     uint8_t ones = Vx % 10;          // Ones place
 
     // Store the digits in memory
-    chip8->ram[chip8->i_register] = hundreds;
-    chip8->ram[(chip8->i_register + 1)] = tens;
-    chip8->ram[(chip8->i_register + 2)] = ones;
+    chip8->ram[chip8_ram_index(chip8, chip8->i_register, 0)] = hundreds;
+    chip8->ram[chip8_ram_index(chip8, chip8->i_register, 1)] = tens;
+    chip8->ram[chip8_ram_index(chip8, chip8->i_register, 2)] = ones;
 
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
-/* Store registers V0 through Vx in memory starting at location I. */
-void chip8_execute_opcode_load_registers(Chip8 *chip8, Opcode *opcode)
+/* Store registers V0 through Vx in memory starting at location I.
+   With memory_increment_i, I is left pointing past the last stored register. */
+static inline void opcode_load_registers(Chip8 *chip8, Opcode *opcode, const int memory_increment_i)
 {   
     for(int i = 0; i <= opcode->x; i++)
     {
-        chip8->ram[chip8->i_register + i] = chip8->v[i];
+        chip8->ram[chip8_ram_index(chip8, chip8->i_register, i)] = chip8->v[i];
     }
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
+    if (memory_increment_i) chip8->i_register += opcode->x + 1;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
 }
 
-/* Read registers V0 through Vx from memory starting at location I. */
-void chip8_execute_opcode_load_memory(Chip8 *chip8, Opcode *opcode)
+/* Read registers V0 through Vx from memory starting at location I.
+   With memory_increment_i, I is left pointing past the last loaded register. */
+static inline void opcode_load_memory(Chip8 *chip8, Opcode *opcode, const int memory_increment_i)
 {   
     for(int i = 0; i <= opcode->x; i++)
     {
-        chip8->v[i] = chip8->ram[chip8->i_register + i];
+        chip8->v[i] = chip8->ram[chip8_ram_index(chip8, chip8->i_register, i)];
+    }
+    if (memory_increment_i) chip8->i_register += opcode->x + 1;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Scroll the display down by n pixels. */
+void chip8_execute_opcode_scroll_down(Chip8 *chip8, Opcode *opcode)
+{
+    uint8_t height = chip8_display_height(chip8);
+    uint8_t amount = (opcode->n < height) ? opcode->n : height;
+
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(chip8->planes & (1 << plane))) continue;
+
+        DisplayRow *rows = chip8->display[plane];
+        memmove(rows + amount, rows, (height - amount) * sizeof(DisplayRow));
+        memset(rows, 0, amount * sizeof(DisplayRow));
+    }
+    chip8->display_changed = 1;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Scroll the display up by n pixels. */
+void chip8_execute_opcode_scroll_up(Chip8 *chip8, Opcode *opcode)
+{
+    uint8_t height = chip8_display_height(chip8);
+    uint8_t amount = (opcode->n < height) ? opcode->n : height;
+
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(chip8->planes & (1 << plane))) continue;
+
+        DisplayRow *rows = chip8->display[plane];
+        memmove(rows, rows + amount, (height - amount) * sizeof(DisplayRow));
+        memset(rows + height - amount, 0, amount * sizeof(DisplayRow));
+    }
+    chip8->display_changed = 1;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Scroll the display right by 4 pixels. */
+void chip8_execute_opcode_scroll_right(Chip8 *chip8, Opcode *opcode)
+{
+    uint8_t height = chip8_display_height(chip8);
+    DisplayRow mask = display_row_mask(chip8_display_width(chip8));
+
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(chip8->planes & (1 << plane))) continue;
+
+        for (int y = 0; y < height; y++) {
+            DisplayRow *row = &chip8->display[plane][y];
+            *row = display_row_and(display_row_shift_right(*row, 4), mask);
+        }
+    }
+    chip8->display_changed = 1;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Scroll the display left by 4 pixels. */
+void chip8_execute_opcode_scroll_left(Chip8 *chip8, Opcode *opcode)
+{
+    uint8_t height = chip8_display_height(chip8);
+    DisplayRow mask = display_row_mask(chip8_display_width(chip8));
+
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(chip8->planes & (1 << plane))) continue;
+
+        for (int y = 0; y < height; y++) {
+            DisplayRow *row = &chip8->display[plane][y];
+            *row = display_row_and(display_row_shift_left(*row, 4), mask);
+        }
+    }
+    chip8->display_changed = 1;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Exit the interpreter. */
+void chip8_execute_opcode_exit(Chip8 *chip8, Opcode *opcode)
+{
+    chip8->exited = 1;
+}
+
+/* Switch to 64x32 low resolution mode. */
+void chip8_execute_opcode_lores(Chip8 *chip8, Opcode *opcode)
+{
+    chip8->hires = 0;
+    memset(chip8->display, 0, sizeof(chip8->display));
+    chip8->display_changed = 1;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Switch to 128x64 high resolution mode. */
+void chip8_execute_opcode_hires(Chip8 *chip8, Opcode *opcode)
+{
+    chip8->hires = 1;
+    memset(chip8->display, 0, sizeof(chip8->display));
+    chip8->display_changed = 1;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Store registers Vx through Vy in memory starting at location I, I is left unchanged. */
+void chip8_execute_opcode_save_range(Chip8 *chip8, Opcode *opcode)
+{
+    int step = (opcode->x <= opcode->y) ? 1 : -1;
+    uint32_t offset = 0;
+    for (int i = opcode->x; ; i += step)
+    {
+        chip8->ram[chip8_ram_index(chip8, chip8->i_register, offset++)] = chip8->v[i];
+        if (i == opcode->y) break;
+    }
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Read registers Vx through Vy from memory starting at location I, I is left unchanged. */
+void chip8_execute_opcode_load_range(Chip8 *chip8, Opcode *opcode)
+{
+    int step = (opcode->x <= opcode->y) ? 1 : -1;
+    uint32_t offset = 0;
+    for (int i = opcode->x; ; i += step)
+    {
+        chip8->v[i] = chip8->ram[chip8_ram_index(chip8, chip8->i_register, offset++)];
+        if (i == opcode->y) break;
+    }
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Set I = nnnn, the 16-bit address stored in the next two bytes. */
+void chip8_execute_opcode_load_long_i(Chip8 *chip8, Opcode *opcode)
+{
+    uint16_t pc = chip8->program_counter;
+    chip8->i_register = (chip8->ram[chip8_ram_index(chip8, pc, 2)] << 8) | chip8->ram[chip8_ram_index(chip8, pc, 3)];
+    chip8->program_counter = (chip8->program_counter + 4) & chip8->address_mask;
+}
+
+/* Select the bitplanes n used by drawing, clearing and scrolling. */
+void chip8_execute_opcode_select_planes(Chip8 *chip8, Opcode *opcode)
+{
+    chip8->planes = opcode->x & ((1 << DISPLAY_PLANES) - 1);
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Load the 16-byte audio pattern starting at memory location I. */
+void chip8_execute_opcode_load_audio(Chip8 *chip8, Opcode *opcode)
+{
+    for (int i = 0; i < AUDIO_PATTERN_SIZE; i++)
+    {
+        chip8->audio_pattern[i] = chip8->ram[chip8_ram_index(chip8, chip8->i_register, i)];
     }
-    chip8->program_counter = (chip8->program_counter + 2) & 0x0FFF;
-}
\ No newline at end of file
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Set I = location of the large sprite for digit Vx. */
+void chip8_execute_opcode_load_big_font(Chip8 *chip8, Opcode *opcode)
+{
+    chip8->i_register = BIG_FONT_SET_START + (chip8->v[opcode->x] & 0x0F) * 10;
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Set audio pitch = Vx. */
+void chip8_execute_opcode_set_pitch(Chip8 *chip8, Opcode *opcode)
+{
+    chip8->pitch = chip8->v[opcode->x];
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Store registers V0 through Vx in the flag registers. */
+void chip8_execute_opcode_save_flags(Chip8 *chip8, Opcode *opcode)
+{
+    memcpy(chip8->flags, chip8->v, opcode->x + 1);
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Read registers V0 through Vx from the flag registers. */
+void chip8_execute_opcode_load_flags(Chip8 *chip8, Opcode *opcode)
+{
+    memcpy(chip8->v, chip8->flags, opcode->x + 1);
+    chip8->program_counter = (chip8->program_counter + 2) & chip8->address_mask;
+}
+
+/* Instantiate the quirk-dependent handlers of one profile. The quirks are passed as
+   constants, so the compiler folds every quirk test away inside each copy. */
+#define DEFINE_QUIRK_HANDLERS(ID, name, shift_vy, memory_increment_i, jump_vx, vf_reset, clip_sprites, long_skip) \
+    static void chip8_execute_opcode_skip_equal_byte_##name(Chip8 *chip8, Opcode *opcode) { opcode_skip_equal_byte(chip8, opcode, long_skip); } \
+    static void chip8_execute_opcode_skip_not_equal_byte_##name(Chip8 *chip8, Opcode *opcode) { opcode_skip_not_equal_byte(chip8, opcode, long_skip); } \
+    static void chip8_execute_opcode_skip_equal_##name(Chip8 *chip8, Opcode *opcode) { opcode_skip_equal(chip8, opcode, long_skip); } \
+    static void chip8_execute_opcode_skip_not_equal_##name(Chip8 *chip8, Opcode *opcode) { opcode_skip_not_equal(chip8, opcode, long_skip); } \
+    static void chip8_execute_opcode_skip_key_##name(Chip8 *chip8, Opcode *opcode) { opcode_skip_key(chip8, opcode, long_skip); } \
+    static void chip8_execute_opcode_skip_not_key_##name(Chip8 *chip8, Opcode *opcode) { opcode_skip_not_key(chip8, opcode, long_skip); } \
+    static void chip8_execute_opcode_or_##name(Chip8 *chip8, Opcode *opcode) { opcode_or(chip8, opcode, vf_reset); } \
+    static void chip8_execute_opcode_and_##name(Chip8 *chip8, Opcode *opcode) { opcode_and(chip8, opcode, vf_reset); } \
+    static void chip8_execute_opcode_xor_##name(Chip8 *chip8, Opcode *opcode) { opcode_xor(chip8, opcode, vf_reset); } \
+    static void chip8_execute_opcode_divide_##name(Chip8 *chip8, Opcode *opcode) { opcode_divide(chip8, opcode, shift_vy); } \
+    static void chip8_execute_opcode_multiply_##name(Chip8 *chip8, Opcode *opcode) { opcode_multiply(chip8, opcode, shift_vy); } \
+    static void chip8_execute_opcode_jump_##name(Chip8 *chip8, Opcode *opcode) { opcode_jump(chip8, opcode, jump_vx); } \
+    static void chip8_execute_opcode_draw_##name(Chip8 *chip8, Opcode *opcode) { opcode_draw(chip8, opcode, clip_sprites); } \
+    static void chip8_execute_opcode_load_registers_##name(Chip8 *chip8, Opcode *opcode) { opcode_load_registers(chip8, opcode, memory_increment_i); } \
+    static void chip8_execute_opcode_load_memory_##name(Chip8 *chip8, Opcode *opcode) { opcode_load_memory(chip8, opcode, memory_increment_i); }
+
+CHIP8_QUIRK_PROFILES(DEFINE_QUIRK_HANDLERS)
+
+/* The opcode table of one quirk profile. Each `OpcodeEntry` struct contains four elements:
+   an opcode value, a mask value, a function pointer to a specific opcode handler function
+   and the platforms the opcode exists on. Entries are indexed by Chip8OpcodeId. */
+#define OPCODE_TABLE(name) { \
+    [OPCODE_SCROLL_DOWN]         = { 0x00C0, 0xFFF0, chip8_execute_opcode_scroll_down, PLATFORM_SUPER }, \
+    [OPCODE_SCROLL_UP]           = { 0x00D0, 0xFFF0, chip8_execute_opcode_scroll_up, PLATFORM_XOCHIP }, \
+    [OPCODE_CLS]                 = { 0x00E0, 0xFFFF, chip8_execute_opcode_cls, PLATFORM_ALL }, \
+    [OPCODE_RET]                 = { 0x00EE, 0xFFFF, chip8_execute_opcode_ret, PLATFORM_ALL }, \
+    [OPCODE_SCROLL_RIGHT]        = { 0x00FB, 0xFFFF, chip8_execute_opcode_scroll_right, PLATFORM_SUPER }, \
+    [OPCODE_SCROLL_LEFT]         = { 0x00FC, 0xFFFF, chip8_execute_opcode_scroll_left, PLATFORM_SUPER }, \
+    [OPCODE_EXIT]                = { 0x00FD, 0xFFFF, chip8_execute_opcode_exit, PLATFORM_SUPER }, \
+    [OPCODE_LORES]               = { 0x00FE, 0xFFFF, chip8_execute_opcode_lores, PLATFORM_SUPER }, \
+    [OPCODE_HIRES]               = { 0x00FF, 0xFFFF, chip8_execute_opcode_hires, PLATFORM_SUPER }, \
+    [OPCODE_JP]                  = { 0x1000, 0xF000, chip8_execute_opcode_jp, PLATFORM_ALL }, \
+    [OPCODE_CALL]                = { 0x2000, 0xF000, chip8_execute_opcode_call, PLATFORM_ALL }, \
+    [OPCODE_SKIP_EQUAL_BYTE]     = { 0x3000, 0xF000, chip8_execute_opcode_skip_equal_byte_##name, PLATFORM_ALL }, \
+    [OPCODE_SKIP_NOT_EQUAL_BYTE] = { 0x4000, 0xF000, chip8_execute_opcode_skip_not_equal_byte_##name, PLATFORM_ALL }, \
+    [OPCODE_SKIP_EQUAL]          = { 0x5000, 0xF00F, chip8_execute_opcode_skip_equal_##name, PLATFORM_ALL }, \
+    [OPCODE_SAVE_RANGE]          = { 0x5002, 0xF00F, chip8_execute_opcode_save_range, PLATFORM_XOCHIP }, \
+    [OPCODE_LOAD_RANGE]          = { 0x5003, 0xF00F, chip8_execute_opcode_load_range, PLATFORM_XOCHIP }, \
+    [OPCODE_LOAD_BYTE]           = { 0x6000, 0xF000, chip8_execute_opcode_load_byte, PLATFORM_ALL }, \
+    [OPCODE_ADD_BYTE]            = { 0x7000, 0xF000, chip8_execute_opcode_add_byte, PLATFORM_ALL }, \
+    [OPCODE_LOAD]                = { 0x8000, 0xF00F, chip8_execute_opcode_load, PLATFORM_ALL }, \
+    [OPCODE_OR]                  = { 0x8001, 0xF00F, chip8_execute_opcode_or_##name, PLATFORM_ALL }, \
+    [OPCODE_AND]                 = { 0x8002, 0xF00F, chip8_execute_opcode_and_##name, PLATFORM_ALL }, \
+    [OPCODE_XOR]                 = { 0x8003, 0xF00F, chip8_execute_opcode_xor_##name, PLATFORM_ALL }, \
+    [OPCODE_ADD]                 = { 0x8004, 0xF00F, chip8_execute_opcode_add, PLATFORM_ALL }, \
+    [OPCODE_SUBTRACT_X]          = { 0x8005, 0xF00F, chip8_execute_opcode_subtract_x, PLATFORM_ALL }, \
+    [OPCODE_DIVIDE]              = { 0x8006, 0xF00F, chip8_execute_opcode_divide_##name, PLATFORM_ALL }, \
+    [OPCODE_SUBTRACT_Y]          = { 0x8007, 0xF00F, chip8_execute_opcode_subtract_y, PLATFORM_ALL }, \
+    [OPCODE_MULTIPLY]            = { 0x800E, 0xF00F, chip8_execute_opcode_multiply_##name, PLATFORM_ALL }, \
+    [OPCODE_SKIP_NOT_EQUAL]      = { 0x9000, 0xF00F, chip8_execute_opcode_skip_not_equal_##name, PLATFORM_ALL }, \
+    [OPCODE_SET_I]               = { 0xA000, 0xF000, chip8_execute_opcode_set_i, PLATFORM_ALL }, \
+    [OPCODE_JUMP]                = { 0xB000, 0xF000, chip8_execute_opcode_jump_##name, PLATFORM_ALL }, \
+    [OPCODE_RANDOM]              = { 0xC000, 0xF000, chip8_execute_opcode_random, PLATFORM_ALL }, \
+    [OPCODE_DRAW]                = { 0xD000, 0xF000, chip8_execute_opcode_draw_##name, PLATFORM_ALL }, \
+    [OPCODE_SKIP_KEY]            = { 0xE09E, 0xF0FF, chip8_execute_opcode_skip_key_##name, PLATFORM_ALL }, \
+    [OPCODE_SKIP_NOT_KEY]        = { 0xE0A1, 0xF0FF, chip8_execute_opcode_skip_not_key_##name, PLATFORM_ALL }, \
+    [OPCODE_LOAD_LONG_I]         = { 0xF000, 0xFFFF, chip8_execute_opcode_load_long_i, PLATFORM_XOCHIP }, \
+    [OPCODE_SELECT_PLANES]       = { 0xF001, 0xF0FF, chip8_execute_opcode_select_planes, PLATFORM_XOCHIP }, \
+    [OPCODE_LOAD_AUDIO]          = { 0xF002, 0xFFFF, chip8_execute_opcode_load_audio, PLATFORM_XOCHIP }, \
+    [OPCODE_LOAD_DELAY_TIMER]    = { 0xF007, 0xF0FF, chip8_execute_opcode_load_delay_timer, PLATFORM_ALL }, \
+    [OPCODE_WAIT_KEY]            = { 0xF00A, 0xF0FF, chip8_execute_opcode_wait_key, PLATFORM_ALL }, \
+    [OPCODE_SET_DELAY_TIMER]     = { 0xF015, 0xF0FF, chip8_execute_opcode_set_delay_timer, PLATFORM_ALL }, \
+    [OPCODE_SET_SOUND_TIMER]     = { 0xF018, 0xF0FF, chip8_execute_opcode_set_sound_timer, PLATFORM_ALL }, \
+    [OPCODE_ADD_I]               = { 0xF01E, 0xF0FF, chip8_execute_opcode_add_i, PLATFORM_ALL }, \
+    [OPCODE_LOAD_FONT]           = { 0xF029, 0xF0FF, chip8_execute_opcode_load_font, PLATFORM_ALL }, \
+    [OPCODE_LOAD_BIG_FONT]       = { 0xF030, 0xF0FF, chip8_execute_opcode_load_big_font, PLATFORM_SUPER }, \
+    [OPCODE_LOAD_BCD]            = { 0xF033, 0xF0FF, chip8_execute_opcode_load_bcd, PLATFORM_ALL }, \
+    [OPCODE_SET_PITCH]           = { 0xF03A, 0xF0FF, chip8_execute_opcode_set_pitch, PLATFORM_XOCHIP }, \
+    [OPCODE_LOAD_REGISTERS]      = { 0xF055, 0xF0FF, chip8_execute_opcode_load_registers_##name, PLATFORM_ALL }, \
+    [OPCODE_LOAD_MEMORY]         = { 0xF065, 0xF0FF, chip8_execute_opcode_load_memory_##name, PLATFORM_ALL }, \
+    [OPCODE_SAVE_FLAGS]          = { 0xF075, 0xF0FF, chip8_execute_opcode_save_flags, PLATFORM_SUPER }, \
+    [OPCODE_LOAD_FLAGS]          = { 0xF085, 0xF0FF, chip8_execute_opcode_load_flags, PLATFORM_SUPER }, \
+}
+
+#define DEFINE_QUIRK_TABLE(ID, name, ...) \
+    static const OpcodeEntry opcode_table_##name[OPCODE_AMOUNT] = OPCODE_TABLE(name);
+
+CHIP8_QUIRK_PROFILES(DEFINE_QUIRK_TABLE)
+
+/* Opcode table for CHIP-8, used wherever no quirk profile is involved */
+const OpcodeEntry opcode_table[OPCODE_AMOUNT] = OPCODE_TABLE(chip8);
+
+/* Opcode tables of all quirk profiles, indexed by Chip8QuirkProfile */
+const OpcodeEntry *const quirk_profile_tables[QUIRK_PROFILE_AMOUNT] = {
+#define QUIRK_TABLE_POINTER(ID, name, ...) [QUIRKS_##ID] = opcode_table_##name,
+    CHIP8_QUIRK_PROFILES(QUIRK_TABLE_POINTER)
+#undef QUIRK_TABLE_POINTER
+};
+
+/* Names of the quirk profiles as accepted on the command line */
+const char *const quirk_profile_names[QUIRK_PROFILE_AMOUNT] = {
+#define QUIRK_PROFILE_NAME(ID, name, ...) [QUIRKS_##ID] = #name,
+    CHIP8_QUIRK_PROFILES(QUIRK_PROFILE_NAME)
+#undef QUIRK_PROFILE_NAME
+};
+
+/* Decode an instruction to its opcode id without scanning the opcode table. */
+uint8_t chip8_decode_opcode(uint16_t instruction)
+{
+    uint8_t x = (instruction >> 8) & 0x0F;
+    uint8_t n = instruction & 0x000F;
+    uint8_t kk = instruction & 0x00FF;
+
+    switch (instruction >> 12) {
+        case 0x0:
+            if (x != 0) return OPCODE_UNKNOWN;
+            switch (kk & 0xF0) {
+                case 0xC0: return OPCODE_SCROLL_DOWN;
+                case 0xD0: return OPCODE_SCROLL_UP;
+            }
+            switch (kk) {
+                case 0xE0: return OPCODE_CLS;
+                case 0xEE: return OPCODE_RET;
+                case 0xFB: return OPCODE_SCROLL_RIGHT;
+                case 0xFC: return OPCODE_SCROLL_LEFT;
+                case 0xFD: return OPCODE_EXIT;
+                case 0xFE: return OPCODE_LORES;
+                case 0xFF: return OPCODE_HIRES;
+            }
+            return OPCODE_UNKNOWN;
+        case 0x1: return OPCODE_JP;
+        case 0x2: return OPCODE_CALL;
+        case 0x3: return OPCODE_SKIP_EQUAL_BYTE;
+        case 0x4: return OPCODE_SKIP_NOT_EQUAL_BYTE;
+        case 0x5:
+            switch (n) {
+                case 0x0: return OPCODE_SKIP_EQUAL;
+                case 0x2: return OPCODE_SAVE_RANGE;
+                case 0x3: return OPCODE_LOAD_RANGE;
+            }
+            return OPCODE_UNKNOWN;
+        case 0x6: return OPCODE_LOAD_BYTE;
+        case 0x7: return OPCODE_ADD_BYTE;
+        case 0x8:
+            switch (n) {
+                case 0x0: return OPCODE_LOAD;
+                case 0x1: return OPCODE_OR;
+                case 0x2: return OPCODE_AND;
+                case 0x3: return OPCODE_XOR;
+                case 0x4: return OPCODE_ADD;
+                case 0x5: return OPCODE_SUBTRACT_X;
+                case 0x6: return OPCODE_DIVIDE;
+                case 0x7: return OPCODE_SUBTRACT_Y;
+                case 0xE: return OPCODE_MULTIPLY;
+            }
+            return OPCODE_UNKNOWN;
+        case 0x9: return (n == 0) ? OPCODE_SKIP_NOT_EQUAL : OPCODE_UNKNOWN;
+        case 0xA: return OPCODE_SET_I;
+        case 0xB: return OPCODE_JUMP;
+        case 0xC: return OPCODE_RANDOM;
+        case 0xD: return OPCODE_DRAW;
+        case 0xE:
+            switch (kk) {
+                case 0x9E: return OPCODE_SKIP_KEY;
+                case 0xA1: return OPCODE_SKIP_NOT_KEY;
+            }
+            return OPCODE_UNKNOWN;
+        default:
+            switch (kk) {
+                case 0x00: return (x == 0) ? OPCODE_LOAD_LONG_I : OPCODE_UNKNOWN;
+                case 0x01: return OPCODE_SELECT_PLANES;
+                case 0x02: return (x == 0) ? OPCODE_LOAD_AUDIO : OPCODE_UNKNOWN;
+                case 0x07: return OPCODE_LOAD_DELAY_TIMER;
+                case 0x0A: return OPCODE_WAIT_KEY;
+                case 0x15: return OPCODE_SET_DELAY_TIMER;
+                case 0x18: return OPCODE_SET_SOUND_TIMER;
+                case 0x1E: return OPCODE_ADD_I;
+                case 0x29: return OPCODE_LOAD_FONT;
+                case 0x30: return OPCODE_LOAD_BIG_FONT;
+                case 0x33: return OPCODE_LOAD_BCD;
+                case 0x3A: return OPCODE_SET_PITCH;
+                case 0x55: return OPCODE_LOAD_REGISTERS;
+                case 0x65: return OPCODE_LOAD_MEMORY;
+                case 0x75: return OPCODE_SAVE_FLAGS;
+                case 0x85: return OPCODE_LOAD_FLAGS;
+            }
+            return OPCODE_UNKNOWN;
+    }
+}
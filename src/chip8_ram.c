@@ -0,0 +1,85 @@
+#ifdef __linux__
+#define _GNU_SOURCE  // memfd_create
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <stdlib.h>
+#include "../include/chip8_ram.h"
+
+#ifdef __linux__
+// Maps the RAM memfd twice back to back, so that an access starting in the RAM wraps into the mirror.
+static int chip8_ram_map_mirrors(Chip8Ram *ram) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (ram->size % page != 0 || ram->size < CHIP8_RAM_OVERRUN) {
+        errno = EINVAL; // Mirrors must start on page boundaries and cover the overrun
+        return 0;
+    }
+
+    size_t length = 2 * (size_t)ram->size;
+    int fd = memfd_create("chip8-ram", MFD_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    if (ftruncate(fd, ram->size) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return 0;
+    }
+
+    // Reserve both copies and the guard page behind them in one go
+    uint8_t *base = mmap(NULL, length + page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return 0;
+    }
+
+    for (size_t i = 0; i < 2; i++) {
+        if (mmap(base + i * ram->size, ram->size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            int error = errno;
+            munmap(base, length + page);
+            close(fd);
+            errno = error;
+            return 0;
+        }
+    }
+
+    close(fd); // The mappings keep the memory alive
+    ram->data = base;
+    ram->reserved = length + page;
+    return 1;
+}
+#endif
+
+// Allocates zeroed guest RAM, mirrored where the host allows it.
+int chip8_ram_alloc(Chip8Ram *ram, uint32_t size) {
+    ram->size = size;
+    ram->reserved = 0;
+    ram->data = NULL;
+
+#ifdef __linux__
+    if (chip8_ram_map_mirrors(ram)) {
+        return 1;
+    }
+#endif
+    ram->data = calloc(size, 1);
+    return ram->data != NULL;
+}
+
+// Releases guest RAM allocated by chip8_ram_alloc().
+void chip8_ram_free(Chip8Ram *ram) {
+#ifdef __linux__
+    if (ram->reserved) {
+        munmap(ram->data, ram->reserved);
+        ram->data = NULL;
+        return;
+    }
+#endif
+    free(ram->data);
+    ram->data = NULL;
+}
@@ -0,0 +1,115 @@
+#include "../include/chip8_snapshot.h"
+#include "../include/chip8_fork.h"
+#include "../include/chip8_lockstep.h"
+#include "../include/chip8_opcodes.h"
+
+// Opcodes whose handlers write RAM, in the order of Chip8Snapshot.originals.
+static const uint8_t written_opcodes[3] = { OPCODE_LOAD_BCD, OPCODE_LOAD_REGISTERS, OPCODE_SAVE_RANGE };
+
+// Records a RAM write made outside of the opcode handlers.
+void chip8_snapshot_touch(Chip8Snapshot *snapshot, uint32_t address, uint32_t length) {
+    if (length == 0) {
+        return;
+    }
+    uint32_t mask = snapshot->state.address_mask;
+    uint32_t first = address & mask;
+    uint32_t last = first + (length - 1 < mask ? length - 1 : mask);
+
+    // Pages past the end of RAM are its first ones again
+    for (uint32_t at = first & ~(uint32_t)(SNAPSHOT_PAGE_SIZE - 1); at <= last; at += SNAPSHOT_PAGE_SIZE) {
+        uint32_t page = (at & mask) / SNAPSHOT_PAGE_SIZE;
+        if (!snapshot->dirty[page]) {
+            snapshot->dirty[page] = 1;
+            snapshot->dirty_pages[snapshot->dirty_count++] = (uint16_t)page;
+        }
+    }
+}
+
+/* Fx33 with dirty page recording. */
+static void chip8_snapshot_load_bcd(Chip8 *chip8, Opcode *opcode)
+{
+    chip8_snapshot_touch(chip8->snapshot, chip8->i_register, 3);
+    chip8->snapshot->originals[0](chip8, opcode);
+}
+
+/* Fx55 with dirty page recording. */
+static void chip8_snapshot_load_registers(Chip8 *chip8, Opcode *opcode)
+{
+    chip8_snapshot_touch(chip8->snapshot, chip8->i_register, opcode->x + 1);
+    chip8->snapshot->originals[1](chip8, opcode);
+}
+
+/* 5xy2 with dirty page recording. */
+static void chip8_snapshot_save_range(Chip8 *chip8, Opcode *opcode)
+{
+    uint8_t length = (opcode->x <= opcode->y) ? opcode->y - opcode->x + 1 : opcode->x - opcode->y + 1;
+    chip8_snapshot_touch(chip8->snapshot, chip8->i_register, length);
+    chip8->snapshot->originals[2](chip8, opcode);
+}
+
+static const Chip8Handler snapshot_handlers[3] = {
+    chip8_snapshot_load_bcd, chip8_snapshot_load_registers, chip8_snapshot_save_range
+};
+
+// Captures an instance and starts recording the RAM pages it writes.
+void chip8_snapshot_capture(Chip8 *chip8, Chip8Snapshot *snapshot) {
+    memset(snapshot->dirty, 0, sizeof(snapshot->dirty));
+    snapshot->dirty_count = 0;
+
+    for (int i = 0; i < 3; i++) {
+        snapshot->originals[i] = chip8->handlers[written_opcodes[i]];
+        if (snapshot->originals[i] != NULL) {
+            chip8->handlers[written_opcodes[i]] = snapshot_handlers[i];
+        }
+    }
+    chip8->snapshot = snapshot;
+
+    snapshot->state = *chip8;
+    memcpy(snapshot->ram, chip8->ram, (size_t)chip8->address_mask + 1);
+}
+
+// Brings an instance back to the captured state.
+void chip8_snapshot_restore(Chip8 *chip8, Chip8Snapshot *snapshot) {
+    for (int i = 0; i < snapshot->dirty_count; i++) {
+        uint32_t offset = (uint32_t)snapshot->dirty_pages[i] * SNAPSHOT_PAGE_SIZE;
+        memcpy(chip8->ram + offset, snapshot->ram + offset, SNAPSHOT_PAGE_SIZE);
+        if (chip8->fork_tracker != NULL) {
+            chip8_fork_touch(chip8, offset, SNAPSHOT_PAGE_SIZE);
+        }
+        snapshot->dirty[snapshot->dirty_pages[i]] = 0;
+    }
+    snapshot->dirty_count = 0;
+
+    // Everything but the RAM mapping and the attachments of this instance comes from the snapshot
+    uint8_t *ram = chip8->ram;
+    Chip8Ram memory = chip8->memory;
+    Chip8Watch *watch = chip8->watch;
+    Chip8ForkTracker *fork_tracker = chip8->fork_tracker;
+    Chip8StateHash *state_hash = chip8->state_hash;
+    Chip8Handler handlers[OPCODE_AMOUNT + 1];
+    memcpy(handlers, chip8->handlers, sizeof(handlers));
+
+    *chip8 = snapshot->state;
+    chip8->ram = ram;
+    chip8->memory = memory;
+    chip8->watch = watch;
+    chip8->snapshot = snapshot;
+    chip8->fork_tracker = fork_tracker;
+    chip8->state_hash = state_hash;
+    memcpy(chip8->handlers, handlers, sizeof(handlers));
+
+    // The hash described the state before the restore
+    if (state_hash != NULL) {
+        chip8_state_hash_reset(chip8);
+    }
+}
+
+// Stops recording and puts the original handlers back.
+void chip8_snapshot_release(Chip8 *chip8, Chip8Snapshot *snapshot) {
+    for (int i = 0; i < 3; i++) {
+        if (snapshot->originals[i] != NULL) {
+            chip8_unwrap_handler(chip8, written_opcodes[i], snapshot_handlers[i], snapshot->originals[i]);
+        }
+    }
+    chip8->snapshot = NULL;
+}
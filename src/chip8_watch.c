@@ -0,0 +1,138 @@
+#include "../include/chip8_watch.h"
+#include "../include/chip8_opcodes.h"
+
+// Opcodes whose handlers write RAM, in the order of Chip8Watch.originals.
+static const uint8_t watched_opcodes[3] = { OPCODE_LOAD_BCD, OPCODE_LOAD_REGISTERS, OPCODE_SAVE_RANGE };
+
+// Checks whether an address lies in one of the watchpoints.
+static int chip8_watch_contains(const Chip8 *chip8, uint16_t address) {
+    const Chip8Watch *watch = chip8->watch;
+    for (int i = 0; i < watch->count; i++) {
+        if (((address - watch->points[i].start) & chip8->address_mask) < watch->points[i].length) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Runs a RAM-writing handler, reporting the watched bytes it wrote.
+static void chip8_watch_write(Chip8 *chip8, Opcode *opcode, int slot, uint8_t length) {
+    Chip8Watch *watch = chip8->watch;
+    uint16_t start = chip8->i_register;
+    uint16_t pc = chip8->program_counter;
+
+    // A write spans at most 16 bytes, so at most two pages
+    uint8_t flagged = watch->pages[(start & chip8->address_mask) / WATCH_PAGE_SIZE] |
+                      watch->pages[((start + length - 1) & chip8->address_mask) / WATCH_PAGE_SIZE];
+    if (!flagged) {
+        watch->originals[slot](chip8, opcode);
+        return;
+    }
+
+    uint8_t before[REGISTERS_SIZE];
+    for (uint8_t i = 0; i < length; i++) {
+        before[i] = chip8->ram[chip8_ram_index(chip8, start, i)];
+    }
+
+    watch->originals[slot](chip8, opcode);
+
+    for (uint8_t i = 0; i < length; i++) {
+        uint16_t address = (start + i) & chip8->address_mask;
+        if (chip8_watch_contains(chip8, address)) {
+            watch->callback(chip8, pc, address, before[i], chip8->ram[chip8_ram_index(chip8, start, i)], watch->user);
+        }
+    }
+}
+
+/* Fx33 with write watching. */
+static void chip8_watch_load_bcd(Chip8 *chip8, Opcode *opcode)
+{
+    chip8_watch_write(chip8, opcode, 0, 3);
+}
+
+/* Fx55 with write watching. */
+static void chip8_watch_load_registers(Chip8 *chip8, Opcode *opcode)
+{
+    chip8_watch_write(chip8, opcode, 1, opcode->x + 1);
+}
+
+/* 5xy2 with write watching. */
+static void chip8_watch_save_range(Chip8 *chip8, Opcode *opcode)
+{
+    uint8_t length = (opcode->x <= opcode->y) ? opcode->y - opcode->x + 1 : opcode->x - opcode->y + 1;
+    chip8_watch_write(chip8, opcode, 2, length);
+}
+
+static const Chip8Handler watch_handlers[3] = {
+    chip8_watch_load_bcd, chip8_watch_load_registers, chip8_watch_save_range
+};
+
+// Adds delta to the counters of the pages a range overlaps.
+static void chip8_watch_flag_pages(Chip8 *chip8, const Chip8Watchpoint *point, int delta) {
+    uint16_t first = point->start / WATCH_PAGE_SIZE;
+    uint16_t pages = (uint16_t)(((point->start % WATCH_PAGE_SIZE) + point->length - 1) / WATCH_PAGE_SIZE + 1);
+    uint16_t page_count = (chip8->address_mask + 1) / WATCH_PAGE_SIZE;
+
+    if (pages > page_count) {
+        pages = page_count;
+    }
+    for (uint16_t i = 0; i < pages; i++) {
+        chip8->watch->pages[(first + i) % page_count] += delta;
+    }
+}
+
+// Attaches an empty watchpoint set to an instance.
+void chip8_watch_init(Chip8 *chip8, Chip8Watch *watch, Chip8WatchCallback callback, void *user) {
+    memset(watch, 0, sizeof(*watch));
+    watch->callback = callback;
+    watch->user = user;
+    chip8->watch = watch;
+}
+
+// Watches writes to an address range.
+int chip8_watch_add(Chip8 *chip8, uint16_t start, uint16_t length) {
+    Chip8Watch *watch = chip8->watch;
+    if (watch->count == WATCH_MAX_POINTS || length == 0) {
+        return 0;
+    }
+
+    Chip8Watchpoint *point = &watch->points[watch->count++];
+    point->start = start & chip8->address_mask;
+    point->length = length;
+    chip8_watch_flag_pages(chip8, point, 1);
+
+    if (watch->count == 1) {
+        // First watchpoint: route the writing opcodes through the wrappers
+        for (int i = 0; i < 3; i++) {
+            watch->originals[i] = chip8->handlers[watched_opcodes[i]];
+            if (watch->originals[i] != NULL) {
+                chip8->handlers[watched_opcodes[i]] = watch_handlers[i];
+            }
+        }
+    }
+    return 1;
+}
+
+// Removes a watchpoint set with the same range.
+int chip8_watch_remove(Chip8 *chip8, uint16_t start, uint16_t length) {
+    Chip8Watch *watch = chip8->watch;
+    start &= chip8->address_mask;
+
+    for (int i = 0; i < watch->count; i++) {
+        if (watch->points[i].start == start && watch->points[i].length == length) {
+            chip8_watch_flag_pages(chip8, &watch->points[i], -1);
+            watch->points[i] = watch->points[--watch->count];
+
+            if (watch->count == 0) {
+                // Last watchpoint: unwatched runs use the original handlers again
+                for (int slot = 0; slot < 3; slot++) {
+                    if (watch->originals[slot] != NULL) {
+                        chip8_unwrap_handler(chip8, watched_opcodes[slot], watch_handlers[slot], watch->originals[slot]);
+                    }
+                }
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
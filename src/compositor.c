@@ -0,0 +1,211 @@
+#include "../include/compositor.h"
+#include "../include/display_row.h"
+#include "../include/simd.h"
+
+#include <string.h>
+
+// Words of a row of bits as wide as the image.
+#define COMPOSITOR_ROW_WORDS (COMPOSITOR_WIDTH / 64)
+
+const char *const compositor_filter_names[COMPOSITOR_FILTER_AMOUNT] = { "nearest", "scale2x" };
+
+// Converts a filter name to its CompositorFilter value.
+int parse_filter(const char *name) {
+    for (int i = 0; i < COMPOSITOR_FILTER_AMOUNT; i++) {
+        if (strcmp(name, compositor_filter_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Initializes a compositor.
+void compositor_init(Compositor *compositor, const uint8_t colors[1 << DISPLAY_PLANES][3], CompositorFilter filter,
+                     uint8_t phosphor) {
+    memset(compositor, 0, sizeof(*compositor));
+    for (int i = 0; i < (1 << DISPLAY_PLANES); i++) {
+        compositor->palette[i] = 0xFF000000u | (uint32_t)colors[i][0] << 16 | (uint32_t)colors[i][1] << 8 | colors[i][2];
+    }
+    compositor->filter = (uint8_t)filter;
+    compositor->phosphor = phosphor;
+}
+
+// Spreads 32 bits over the even bits of a 64-bit word, bit i moving to bit 2i.
+static uint64_t compositor_spread(uint64_t bits) {
+    bits = (bits | bits << 16) & 0x0000FFFF0000FFFFull;
+    bits = (bits | bits << 8) & 0x00FF00FF00FF00FFull;
+    bits = (bits | bits << 4) & 0x0F0F0F0F0F0F0F0Full;
+    bits = (bits | bits << 2) & 0x3333333333333333ull;
+    bits = (bits | bits << 1) & 0x5555555555555555ull;
+    return bits;
+}
+
+// Interleaves the pixels of two rows `width` pixels wide into a row twice as wide:
+// pixel x of `even` becomes pixel 2x and pixel x of `odd` pixel 2x + 1.
+static void compositor_interleave(uint64_t *out, DisplayRow even, DisplayRow odd, int width) {
+    for (int i = 0; i < width / 32; i++) {
+        uint64_t even_word = (i < 2) ? even.hi : even.lo;
+        uint64_t odd_word = (i < 2) ? odd.hi : odd.lo;
+        int shift = (i & 1) ? 0 : 32;
+        out[i] = compositor_spread((even_word >> shift) & 0xFFFFFFFFu) << 1 |
+                 compositor_spread((odd_word >> shift) & 0xFFFFFFFFu);
+    }
+}
+
+// Pixels of row a equal to those of row b in every plane.
+static DisplayRow compositor_equal(const DisplayRow *a, const DisplayRow *b, DisplayRow mask) {
+    DisplayRow differ = display_row_or(display_row_xor(a[0], b[0]), display_row_xor(a[1], b[1]));
+    DisplayRow r = { ~differ.hi & mask.hi, ~differ.lo & mask.lo };
+    return r;
+}
+
+// Takes, in every plane, the pixels of `other` where `condition` is set and those of `self` elsewhere.
+static void compositor_select(DisplayRow *out, DisplayRow condition, const DisplayRow *other, const DisplayRow *self) {
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        out[plane].hi = (other[plane].hi & condition.hi) | (self[plane].hi & ~condition.hi);
+        out[plane].lo = (other[plane].lo & condition.lo) | (self[plane].lo & ~condition.lo);
+    }
+}
+
+// Applies scale2x to display row y, all pixels of a row at once, giving the two image rows it becomes.
+static void compositor_scale2x(const Compositor *compositor, int y, int width, int height,
+                               uint64_t out[2][DISPLAY_PLANES][COMPOSITOR_ROW_WORDS]) {
+    DisplayRow mask = display_row_mask((uint8_t)width);
+    DisplayRow first = { (uint64_t)1 << 63, 0 };
+    DisplayRow last = { (width > 64) ? 0 : 1, (width > 64) ? 1 : 0 };
+    DisplayRow p[DISPLAY_PLANES], a[DISPLAY_PLANES], b[DISPLAY_PLANES], c[DISPLAY_PLANES], d[DISPLAY_PLANES];
+
+    // Neighbors above, right, left and below, edges repeating the pixel itself
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        p[plane] = display_row_and(compositor->source[plane][y], mask);
+        a[plane] = (y > 0) ? display_row_and(compositor->source[plane][y - 1], mask) : p[plane];
+        d[plane] = (y < height - 1) ? display_row_and(compositor->source[plane][y + 1], mask) : p[plane];
+        b[plane] = display_row_and(display_row_or(display_row_shift_left(p[plane], 1), display_row_and(p[plane], last)), mask);
+        c[plane] = display_row_and(display_row_or(display_row_shift_right(p[plane], 1), display_row_and(p[plane], first)), mask);
+    }
+
+    DisplayRow ca = compositor_equal(c, a, mask);
+    DisplayRow cd = compositor_equal(c, d, mask);
+    DisplayRow ab = compositor_equal(a, b, mask);
+    DisplayRow bd = compositor_equal(b, d, mask);
+
+    // E0 = A if C == A, C != D and A != B; E1 = B if A == B, A != C and B != D;
+    // E2 = C if D == C, D != B and C != A; E3 = D if B == D, B != A and D != C
+    DisplayRow e[4][DISPLAY_PLANES];
+    DisplayRow e0 = { ca.hi & ~cd.hi & ~ab.hi, ca.lo & ~cd.lo & ~ab.lo };
+    DisplayRow e1 = { ab.hi & ~ca.hi & ~bd.hi, ab.lo & ~ca.lo & ~bd.lo };
+    DisplayRow e2 = { cd.hi & ~bd.hi & ~ca.hi, cd.lo & ~bd.lo & ~ca.lo };
+    DisplayRow e3 = { bd.hi & ~ab.hi & ~cd.hi, bd.lo & ~ab.lo & ~cd.lo };
+    compositor_select(e[0], e0, a, p);
+    compositor_select(e[1], e1, b, p);
+    compositor_select(e[2], e2, c, p);
+    compositor_select(e[3], e3, d, p);
+
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        compositor_interleave(out[0][plane], e[0][plane], e[1][plane], width);
+        compositor_interleave(out[1][plane], e[2][plane], e[3][plane], width);
+    }
+}
+
+// Brightness out of 256 that fading pixels keep over a number of frames.
+static uint32_t compositor_keep(uint32_t frames) {
+    uint32_t keep = 256;
+    if (frames >= COMPOSITOR_PHOSPHOR_FRAMES) {
+        return 0;
+    }
+    while (frames-- > 0) {
+        keep = keep * COMPOSITOR_PHOSPHOR_DECAY >> 8;
+    }
+    return keep;
+}
+
+// Composites the rows of the display that changed or are still fading.
+int compositor_update(Compositor *compositor, const Chip8 *chip8, uint32_t frames) {
+    int width = chip8->hires ? DISPLAY_HIRES_WIDTH : DISPLAY_WIDTH;
+    int height = chip8->hires ? DISPLAY_HIRES_HEIGHT : DISPLAY_HEIGHT;
+    int full = !compositor->valid || chip8->hires != compositor->hires;
+    int scale2x = compositor->filter == COMPOSITOR_SCALE2X;
+    uint32_t keep = compositor_keep(frames);
+    uint8_t dirty[DISPLAY_HIRES_HEIGHT] = { 0 };
+
+    // Rows that changed, and with scale2x the rows next to them
+    uint64_t changed = full ? UINT64_MAX : 0;
+    for (int plane = 0; plane < DISPLAY_PLANES && !full; plane++) {
+        changed |= simd_rows_differ(chip8->display[plane], compositor->source[plane], height);
+    }
+    for (int y = 0; y < height; y++) {
+        if (changed >> y & 1) {
+            dirty[y] = 1;
+            if (scale2x && y > 0) {
+                dirty[y - 1] = 1;
+            }
+            if (scale2x && y < height - 1) {
+                dirty[y + 1] = 1;
+            }
+        }
+        dirty[y] |= compositor->fading[y] && keep < 256;
+    }
+    memcpy(compositor->source, chip8->display, sizeof(compositor->source));
+    if (full) {
+        memset(compositor->fading, 0, sizeof(compositor->fading));
+    }
+    compositor->hires = chip8->hires;
+    compositor->valid = 1;
+
+    // Each display row becomes `lines` distinct image rows, each repeated `span` times
+    int lines = scale2x ? 2 : 1;
+    int rows = COMPOSITOR_HEIGHT / height;
+    int span = rows / lines;
+    int factor = COMPOSITOR_WIDTH / width / lines;
+
+    compositor->dirty_top = COMPOSITOR_HEIGHT;
+    compositor->dirty_bottom = 0;
+    for (int y = 0; y < height; y++) {
+        if (!dirty[y]) {
+            continue;
+        }
+
+        uint64_t bits[2][DISPLAY_PLANES][COMPOSITOR_ROW_WORDS];
+        if (scale2x) {
+            compositor_scale2x(compositor, y, width, height, bits);
+        } else {
+            for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+                bits[0][plane][0] = chip8->display[plane][y].hi;
+                bits[0][plane][1] = chip8->display[plane][y].lo;
+            }
+        }
+
+        uint8_t fading = 0;
+        for (int line = 0; line < lines; line++) {
+            uint32_t target[COMPOSITOR_WIDTH];
+            uint32_t *row = compositor->pixels[y * rows + line * span];
+            simd_expand(target, bits[line][0], bits[line][1], width * lines, factor, compositor->palette);
+
+            if (compositor->phosphor && !full) {
+                fading |= (uint8_t)simd_fade(row, target, COMPOSITOR_WIDTH, keep);
+            } else {
+                memcpy(row, target, sizeof(target));
+            }
+            for (int copy = 1; copy < span; copy++) {
+                memcpy(row + copy * COMPOSITOR_WIDTH, row, sizeof(target));
+            }
+        }
+        compositor->fading[y] = fading;
+
+        if (y * rows < compositor->dirty_top) {
+            compositor->dirty_top = y * rows;
+        }
+        compositor->dirty_bottom = (y + 1) * rows;
+    }
+    return compositor->dirty_bottom > compositor->dirty_top;
+}
+
+// Tells whether pixels are still fading, so that later frames change the image.
+int compositor_is_fading(const Compositor *compositor) {
+    for (int y = 0; y < DISPLAY_HIRES_HEIGHT; y++) {
+        if (compositor->fading[y]) {
+            return 1;
+        }
+    }
+    return 0;
+}
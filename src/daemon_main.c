@@ -0,0 +1,829 @@
+#define _GNU_SOURCE  // pthread_setaffinity_np, accept4
+
+#include "../include/chip8.h"
+#include "../include/net.h"
+#include "../include/params.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#define DAEMON_MAX_EVENTS 64
+#define DAEMON_LINE_MAX (2 * PROGRAM_MEMORY_SIZE + 64)  // A whole XO-CHIP program in hex plus the command
+#define DAEMON_DEFAULT_BUDGET (8 * CYCLES_PER_FRAME)    // Enough for 8x speed
+#define DAEMON_MAX_SPEED 1000                           // Emulated frames per tick, if the budget allows
+#define DAEMON_MAX_CATCH_UP 4                           // Late ticks a worker makes up for, older ones are dropped
+
+/**
+ * One emulated machine.
+ */
+typedef struct {
+    Chip8 chip8;
+    uint32_t speed;       // Emulated frames per 60 Hz tick
+    uint64_t cycles;      // Instructions run or skipped
+    uint8_t stopped;      // Program exited, halted or hit an unknown opcode
+} Session;
+
+/**
+ * Client connection, owned by exactly one worker at a time.
+ */
+typedef struct Connection {
+    int fd;
+    char *input;                  // Received bytes not executed yet
+    size_t input_length;
+    size_t input_capacity;
+    char *output;                 // Replies the socket did not take yet
+    size_t output_start;
+    size_t output_length;
+    size_t output_capacity;
+    uint8_t pinned;               // Execute the next line here, it was handed over for it
+    uint8_t closing;              // Client sent everything, close once the replies are out
+    struct Connection *prev;      // In the owning worker's list, or the next in an inbox
+    struct Connection *next;
+} Connection;
+
+/**
+ * Shard of sessions run by one thread pinned to a core.
+ *
+ * Session n lives on worker n % shardCount, in slot n / shardCount, and is only
+ * ever touched by that worker's thread. A connection sending a command for a
+ * session of another shard is handed over to that shard's worker through its
+ * inbox, together with the unexecuted input.
+ */
+typedef struct {
+    int index;
+    pthread_t thread;
+    int epoll_fd;
+    int timer_fd;                 // 60 Hz ticks
+    int inbox_fd;                 // eventfd signalled when connections are handed over
+    pthread_mutex_t inbox_lock;
+    Connection *inbox;
+    Connection *connections;
+    Session **sessions;           // Slots, NULL when free
+    uint32_t capacity;
+    int session_count;            // Read by other workers to place new sessions
+} Worker;
+
+static Worker *workers;
+static int shardCount;
+static uint32_t budget = DAEMON_DEFAULT_BUDGET;
+static int listenFd = -1;
+static int stopping;
+
+// Tags telling the worker's own descriptors apart from connections in epoll events
+static char listenTag, timerTag, inboxTag;
+
+static void printUsage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [--shards <count>] [--budget <instructions>] <port>/<host:port>/<socket path>\n",
+            program_name);
+}
+
+/**
+ * @brief Runs one tick of a session: its speed in frames, which the instruction budget covers.
+ *
+ * Idle loops are fast-forwarded.
+ *
+ * @param session Session to run.
+ */
+static void runSession(Session *session) {
+    Chip8 *chip8 = &session->chip8;
+    uint32_t limit = session->speed * CYCLES_PER_FRAME;
+    uint32_t cycles = 0;
+
+    while (cycles < limit) {
+        if (chip8_idle_state(chip8) == CHIP8_IDLE_HALTED) {
+            session->stopped = 1;
+            break;
+        }
+        uint32_t skipped = chip8_fast_forward(chip8, limit - cycles);
+        if (skipped) {
+            cycles += skipped;
+            continue;
+        }
+        if (chip8_step(chip8) || chip8->exited) {
+            session->stopped = 1;
+            break;
+        }
+        cycles++;
+    }
+    session->cycles += cycles;
+}
+
+/**
+ * @brief Returns the shard holding the fewest sessions, preferring the given one on ties.
+ */
+static int leastLoadedShard(int preferred) {
+    int best = preferred;
+    int fewest = __atomic_load_n(&workers[preferred].session_count, __ATOMIC_RELAXED);
+    for (int i = 0; i < shardCount; i++) {
+        int count = __atomic_load_n(&workers[i].session_count, __ATOMIC_RELAXED);
+        if (count < fewest) {
+            best = i;
+            fewest = count;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Returns the session a command names, NULL if it does not live on this worker.
+ */
+static Session *findSession(Worker *worker, const char *line) {
+    unsigned long id;
+    if (sscanf(line, "%*s %lu", &id) != 1 || (int)(id % (unsigned long)shardCount) != worker->index) {
+        return NULL;
+    }
+    unsigned long slot = id / (unsigned long)shardCount;
+    return (slot < worker->capacity) ? worker->sessions[slot] : NULL;
+}
+
+/**
+ * @brief Returns the shard that has to execute a command line.
+ */
+static int commandShard(const Worker *worker, Connection *connection, const char *line) {
+    char command[16];
+    unsigned long id;
+
+    if (connection->pinned || sscanf(line, "%15s", command) != 1 || strcmp(command, "stats") == 0) {
+        return worker->index;
+    }
+    if (strcmp(command, "new") == 0) {
+        return leastLoadedShard(worker->index);
+    }
+    if (sscanf(line, "%*s %lu", &id) == 1) {
+        return (int)(id % (unsigned long)shardCount);
+    }
+    return worker->index;
+}
+
+/**
+ * @brief Appends a reply to the output of a connection.
+ *
+ * @return 1 on success, 0 if out of memory.
+ */
+static int reply(Connection *connection, const char *format, ...) {
+    for (;;) {
+        size_t room = connection->output_capacity - connection->output_length;
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(connection->output + connection->output_length, room, format, args);
+        va_end(args);
+        if (length < 0) {
+            return 0;
+        }
+        if ((size_t)length < room) {
+            connection->output_length += (size_t)length;
+            return 1;
+        }
+
+        size_t capacity = connection->output_capacity * 2 + (size_t)length + 1;
+        char *output = realloc(connection->output, capacity);
+        if (output == NULL) {
+            return 0;
+        }
+        connection->output = output;
+        connection->output_capacity = capacity;
+    }
+}
+
+/**
+ * @brief Creates a session: `new <platform> <program in hex>`.
+ */
+static void commandNew(Worker *worker, Connection *connection, const char *line) {
+    uint8_t program[PROGRAM_MEMORY_SIZE];
+    char platform[16];
+    int offset = 0;
+
+    if (sscanf(line, "%*s %15s %n", platform, &offset) != 1 || offset == 0 || parse_platform(platform) == 0) {
+        reply(connection, "err usage: new <chip8|schip|xochip> <program in hex>\n");
+        return;
+    }
+
+    const char *hex = line + offset;
+    long size = hex_decode(hex, strcspn(hex, " "), program, chip8_program_capacity(parse_platform(platform)));
+    if (size < 0) {
+        reply(connection, "err program is not hex or too large\n");
+        return;
+    }
+    if (size == 0) {
+        reply(connection, "err empty program\n");
+        return;
+    }
+
+    // Take the first free slot, growing the table when there is none
+    uint32_t slot = 0;
+    while (slot < worker->capacity && worker->sessions[slot] != NULL) {
+        slot++;
+    }
+    if (slot == worker->capacity) {
+        uint32_t capacity = worker->capacity ? worker->capacity * 2 : 64;
+        Session **sessions = realloc(worker->sessions, capacity * sizeof(Session *));
+        if (sessions == NULL) {
+            reply(connection, "err out of memory\n");
+            return;
+        }
+        memset(sessions + worker->capacity, 0, (capacity - worker->capacity) * sizeof(Session *));
+        worker->sessions = sessions;
+        worker->capacity = capacity;
+    }
+
+    Session *session = calloc(1, sizeof(Session));
+    if (session == NULL) {
+        reply(connection, "err out of memory\n");
+        return;
+    }
+    unsigned long id = (unsigned long)slot * (unsigned long)shardCount + (unsigned long)worker->index;
+    if (!chip8_init_platform(&session->chip8, (uint8_t)parse_platform(platform))) {
+        reply(connection, "err cannot allocate RAM: %s\n", strerror(errno));
+        free(session);
+        return;
+    }
+    chip8_set_quirks(&session->chip8, (uint8_t)parse_quirks(platform));
+    chip8_seed_random(&session->chip8, session->chip8.random_state ^ (uint32_t)id); // Sessions started together differ
+    chip8_load_ram(&session->chip8, program, (size_t)size);
+    session->speed = 1;
+
+    worker->sessions[slot] = session;
+    __atomic_add_fetch(&worker->session_count, 1, __ATOMIC_RELAXED);
+    reply(connection, "ok %lu\n", id);
+}
+
+/**
+ * @brief Sets the pressed keys of a session: `keys <id> <bitfield in hex>`.
+ */
+static void commandKeys(Session *session, Connection *connection, const char *line) {
+    unsigned int keys;
+    if (sscanf(line, "%*s %*u %x", &keys) != 1 || keys > 0xFFFF) {
+        reply(connection, "err usage: keys <id> <bitfield in hex>\n");
+        return;
+    }
+    for (uint8_t key = 0; key < KEYBOARD_SIZE; key++) {
+        chip8_set_keyboard_state(&session->chip8, key, (keys >> key) & 1);
+    }
+    reply(connection, "ok\n");
+}
+
+/**
+ * @brief Returns the most frames per tick the instruction budget covers.
+ */
+static uint32_t maxSpeed(void) {
+    uint32_t frames = budget / CYCLES_PER_FRAME;
+    return (frames < DAEMON_MAX_SPEED) ? frames : DAEMON_MAX_SPEED;
+}
+
+/**
+ * @brief Sets the emulated frames a session runs per tick: `speed <id> <frames>`.
+ *
+ * Speeds whose frames would take more instructions than the budget are refused,
+ * so a session always runs at the speed it was given.
+ */
+static void commandSpeed(Session *session, Connection *connection, const char *line) {
+    unsigned int speed;
+    if (sscanf(line, "%*s %*u %u", &speed) != 1 || speed == 0 || speed > maxSpeed()) {
+        reply(connection, "err usage: speed <id> <frames per tick, 1 to %u>\n", maxSpeed());
+        return;
+    }
+    session->speed = speed;
+    reply(connection, "ok\n");
+}
+
+/**
+ * @brief Sends the display of a session: `display <id>`.
+ *
+ * Replies with the resolution and then each bitplane as hex rows, leftmost
+ * pixel in the top bit of the first byte.
+ */
+static void commandDisplay(Session *session, Connection *connection) {
+    Chip8 *chip8 = &session->chip8;
+    int width = chip8_display_width(chip8);
+    int height = chip8_display_height(chip8);
+
+    reply(connection, "ok %dx%d", width, height);
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        reply(connection, " ");
+        for (int y = 0; y < height; y++) {
+            DisplayRow row = chip8->display[plane][y];
+            reply(connection, (width == DISPLAY_HIRES_WIDTH) ? "%016llx%016llx" : "%016llx",
+                  (unsigned long long)row.hi, (unsigned long long)row.lo);
+        }
+    }
+    reply(connection, "\n");
+}
+
+/**
+ * @brief Sends the state of a session: `state <id>`.
+ */
+static void commandState(Session *session, Connection *connection) {
+    Chip8 *chip8 = &session->chip8;
+    reply(connection, "ok pc=%04x i=%04x frames=%llu stopped=%u buzz=%u\n",
+          chip8->program_counter, chip8->i_register, (unsigned long long)(session->cycles / CYCLES_PER_FRAME),
+          session->stopped, chip8_should_buzz(chip8));
+}
+
+/**
+ * @brief Ends a session: `free <id>`.
+ */
+static void commandFree(Worker *worker, Session *session, Connection *connection, const char *line) {
+    unsigned long id;
+    sscanf(line, "%*s %lu", &id);
+    worker->sessions[id / (unsigned long)shardCount] = NULL;
+    __atomic_sub_fetch(&worker->session_count, 1, __ATOMIC_RELAXED);
+    chip8_destroy(&session->chip8);
+    free(session);
+    reply(connection, "ok\n");
+}
+
+/**
+ * @brief Sends the number of sessions on every shard: `stats`.
+ */
+static void commandStats(Connection *connection) {
+    reply(connection, "ok shards=%d budget=%u sessions=", shardCount, budget);
+    for (int i = 0; i < shardCount; i++) {
+        reply(connection, (i == 0) ? "%d" : ",%d", __atomic_load_n(&workers[i].session_count, __ATOMIC_RELAXED));
+    }
+    reply(connection, "\n");
+}
+
+/**
+ * @brief Executes one command line on the worker owning its session.
+ */
+static void executeCommand(Worker *worker, Connection *connection, const char *line) {
+    char command[16];
+    if (sscanf(line, "%15s", command) != 1) {
+        return; // Empty line
+    }
+
+    if (strcmp(command, "new") == 0) {
+        commandNew(worker, connection, line);
+        return;
+    }
+    if (strcmp(command, "stats") == 0) {
+        commandStats(connection);
+        return;
+    }
+
+    Session *session = findSession(worker, line);
+    int known = strcmp(command, "keys") == 0 || strcmp(command, "speed") == 0 || strcmp(command, "display") == 0 ||
+                strcmp(command, "state") == 0 || strcmp(command, "free") == 0;
+    if (!known) {
+        reply(connection, "err unknown command %s\n", command);
+    } else if (session == NULL) {
+        reply(connection, "err no such session\n");
+    } else if (strcmp(command, "keys") == 0) {
+        commandKeys(session, connection, line);
+    } else if (strcmp(command, "speed") == 0) {
+        commandSpeed(session, connection, line);
+    } else if (strcmp(command, "display") == 0) {
+        commandDisplay(session, connection);
+    } else if (strcmp(command, "state") == 0) {
+        commandState(session, connection);
+    } else {
+        commandFree(worker, session, connection, line);
+    }
+}
+
+/**
+ * @brief Registers a connection with a worker and its epoll loop.
+ *
+ * @return 1 on success, 0 if epoll refused it.
+ */
+static int adoptConnection(Worker *worker, Connection *connection) {
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = connection };
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, connection->fd, &event) < 0) {
+        return 0;
+    }
+    connection->prev = NULL;
+    connection->next = worker->connections;
+    if (worker->connections != NULL) {
+        worker->connections->prev = connection;
+    }
+    worker->connections = connection;
+    return 1;
+}
+
+/**
+ * @brief Removes a connection from a worker and its epoll loop.
+ */
+static void releaseConnection(Worker *worker, Connection *connection) {
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    if (connection->prev != NULL) {
+        connection->prev->next = connection->next;
+    } else {
+        worker->connections = connection->next;
+    }
+    if (connection->next != NULL) {
+        connection->next->prev = connection->prev;
+    }
+}
+
+static void closeConnection(Worker *worker, Connection *connection) {
+    releaseConnection(worker, connection);
+    close(connection->fd);
+    free(connection->input);
+    free(connection->output);
+    free(connection);
+}
+
+/**
+ * @brief Hands a connection over to the worker of another shard.
+ */
+static void handOver(Worker *worker, Connection *connection, int shard) {
+    Worker *target = &workers[shard];
+    uint64_t one = 1;
+
+    releaseConnection(worker, connection);
+    connection->pinned = 1;
+    pthread_mutex_lock(&target->inbox_lock);
+    connection->next = target->inbox;
+    target->inbox = connection;
+    pthread_mutex_unlock(&target->inbox_lock);
+    if (write(target->inbox_fd, &one, sizeof(one)) < 0) {
+        perror("Failed to wake a worker");
+    }
+}
+
+/**
+ * @brief Sends as much pending output as the socket takes.
+ *
+ * @return 1 if everything was sent, 0 if some is left, -1 if the client is gone.
+ */
+static int flushConnection(Connection *connection) {
+    while (connection->output_start < connection->output_length) {
+        ssize_t sent = send(connection->fd, connection->output + connection->output_start,
+                            connection->output_length - connection->output_start, MSG_NOSIGNAL);
+        if (sent < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        }
+        connection->output_start += (size_t)sent;
+    }
+    connection->output_start = 0;
+    connection->output_length = 0;
+    return 1;
+}
+
+/**
+ * @brief Executes the complete lines received on a connection and sends the replies.
+ *
+ * A client that does not read its replies is not read from until it does.
+ */
+static void serveConnection(Worker *worker, Connection *connection) {
+    size_t start = 0;
+    int target = worker->index;
+
+    while (connection->output_length == 0) {
+        char *newline = memchr(connection->input + start, '\n', connection->input_length - start);
+        if (newline == NULL) {
+            break;
+        }
+        *newline = '\0';
+        if (newline > connection->input + start && newline[-1] == '\r') {
+            newline[-1] = '\0';
+        }
+
+        const char *line = connection->input + start;
+        target = commandShard(worker, connection, line);
+        if (target != worker->index) {
+            *newline = '\n'; // Executed by the new owner
+            break;
+        }
+        connection->pinned = 0;
+        executeCommand(worker, connection, line);
+        start = (size_t)(newline - connection->input) + 1;
+
+        if (flushConnection(connection) < 0) {
+            closeConnection(worker, connection);
+            return;
+        }
+    }
+
+    memmove(connection->input, connection->input + start, connection->input_length - start);
+    connection->input_length -= start;
+    if (target != worker->index) {
+        handOver(worker, connection, target);
+        return;
+    }
+    if (connection->input_length >= DAEMON_LINE_MAX || (connection->closing && connection->output_length == 0)) {
+        closeConnection(worker, connection); // No command is that long, or nothing left to do
+        return;
+    }
+
+    // Stop reading while replies are backed up
+    struct epoll_event event = { .events = connection->output_length ? EPOLLOUT : EPOLLIN, .data.ptr = connection };
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+}
+
+/**
+ * @brief Reads what a client sent, then serves its complete lines.
+ */
+static void readConnection(Worker *worker, Connection *connection) {
+    for (;;) {
+        if (connection->input_capacity - connection->input_length < 4096 &&
+            connection->input_capacity < DAEMON_LINE_MAX + 4096) {
+            size_t capacity = connection->input_capacity * 2;
+            char *input = realloc(connection->input, capacity);
+            if (input == NULL) {
+                closeConnection(worker, connection);
+                return;
+            }
+            connection->input = input;
+            connection->input_capacity = capacity;
+        }
+        if (connection->input_length == connection->input_capacity) {
+            break; // Longest possible line, serveConnection() rejects it
+        }
+
+        ssize_t received = read(connection->fd, connection->input + connection->input_length,
+                                connection->input_capacity - connection->input_length);
+        if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            closeConnection(worker, connection);
+            return;
+        }
+        if (received <= 0) {
+            connection->closing = (received == 0);
+            break;
+        }
+        connection->input_length += (size_t)received;
+    }
+    serveConnection(worker, connection);
+}
+
+/**
+ * @brief Accepts the clients waiting to connect.
+ */
+static void acceptConnections(Worker *worker) {
+    for (;;) {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+
+        Connection *connection = calloc(1, sizeof(Connection));
+        if (connection != NULL) {
+            connection->fd = fd;
+            connection->input_capacity = 4096;
+            connection->output_capacity = 4096;
+            connection->input = malloc(connection->input_capacity);
+            connection->output = malloc(connection->output_capacity);
+        }
+        if (connection == NULL || connection->input == NULL || connection->output == NULL ||
+            !adoptConnection(worker, connection)) {
+            if (connection != NULL) {
+                free(connection->input);
+                free(connection->output);
+                free(connection);
+            }
+            close(fd);
+        }
+    }
+}
+
+/**
+ * @brief Takes over the connections other workers handed to this one.
+ */
+static void adoptInbox(Worker *worker) {
+    uint64_t count;
+    if (read(worker->inbox_fd, &count, sizeof(count)) < 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&worker->inbox_lock);
+    Connection *connection = worker->inbox;
+    worker->inbox = NULL;
+    pthread_mutex_unlock(&worker->inbox_lock);
+
+    while (connection != NULL) {
+        Connection *next = connection->next;
+        if (adoptConnection(worker, connection)) {
+            serveConnection(worker, connection);
+        } else {
+            close(connection->fd);
+            free(connection->input);
+            free(connection->output);
+            free(connection);
+        }
+        connection = next;
+    }
+}
+
+/**
+ * @brief Runs every session of the shard for the ticks that elapsed.
+ */
+static void runTicks(Worker *worker) {
+    uint64_t ticks;
+    if (read(worker->timer_fd, &ticks, sizeof(ticks)) < 0) {
+        return;
+    }
+    if (ticks > DAEMON_MAX_CATCH_UP) {
+        ticks = DAEMON_MAX_CATCH_UP; // Overloaded: sessions slow down instead of piling up work
+    }
+
+    for (uint32_t slot = 0; slot < worker->capacity; slot++) {
+        Session *session = worker->sessions[slot];
+        for (uint64_t tick = 0; session != NULL && !session->stopped && tick < ticks; tick++) {
+            runSession(session);
+        }
+    }
+}
+
+/**
+ * @brief Event loop of one worker.
+ */
+static void *workerMain(void *arg) {
+    Worker *worker = arg;
+    struct epoll_event events[DAEMON_MAX_EVENTS];
+
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+        int count = epoll_wait(worker->epoll_fd, events, DAEMON_MAX_EVENTS, -1);
+        for (int i = 0; i < count; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &listenTag) {
+                acceptConnections(worker);
+            } else if (tag == &timerTag) {
+                runTicks(worker);
+            } else if (tag == &inboxTag) {
+                adoptInbox(worker);
+            } else if (events[i].events & EPOLLOUT) {
+                Connection *connection = tag;
+                int flushed = flushConnection(connection);
+                if (flushed < 0) {
+                    closeConnection(worker, connection);
+                } else if (flushed) {
+                    serveConnection(worker, connection); // Lines received meanwhile, then reading again
+                }
+            } else {
+                readConnection(worker, tag);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Creates the event loop of a worker.
+ *
+ * Every worker is created before any starts, since workers hand connections to each other.
+ *
+ * @return 1 on success, 0 on failure (reported on stderr).
+ */
+static int createWorker(Worker *worker, int index) {
+    memset(worker, 0, sizeof(*worker));
+    worker->index = index;
+    pthread_mutex_init(&worker->inbox_lock, NULL);
+
+    struct itimerspec tick = { { 0, 1000000000L / TIMER_FREQUENCY }, { 0, 1000000000L / TIMER_FREQUENCY } };
+    worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    worker->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    worker->inbox_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (worker->epoll_fd < 0 || worker->timer_fd < 0 || worker->inbox_fd < 0 ||
+        timerfd_settime(worker->timer_fd, 0, &tick, NULL) < 0) {
+        perror("Failed to create a worker");
+        return 0;
+    }
+
+    // Every worker accepts, EPOLLEXCLUSIVE wakes only one of them per client
+    struct epoll_event listen_event = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = &listenTag };
+    struct epoll_event timer_event = { .events = EPOLLIN, .data.ptr = &timerTag };
+    struct epoll_event inbox_event = { .events = EPOLLIN, .data.ptr = &inboxTag };
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, listenFd, &listen_event) < 0 ||
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->timer_fd, &timer_event) < 0 ||
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->inbox_fd, &inbox_event) < 0) {
+        perror("Failed to set up a worker");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Starts the thread of a worker on its own core.
+ *
+ * @return 1 on success, 0 on failure (reported on stderr).
+ */
+static int startWorker(Worker *worker) {
+    if (pthread_create(&worker->thread, NULL, workerMain, worker) != 0) {
+        fprintf(stderr, "Failed to start worker %d\n", worker->index);
+        return 0;
+    }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(worker->index % sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+    pthread_setaffinity_np(worker->thread, sizeof(cpus), &cpus); // Best effort, e.g. in a restricted cpuset
+    return 1;
+}
+
+/**
+ * @brief Stops a worker and releases its sessions and connections.
+ */
+static void stopWorker(Worker *worker) {
+    uint64_t one = 1;
+    if (write(worker->inbox_fd, &one, sizeof(one)) < 0) {
+        perror("Failed to wake a worker");
+    }
+    pthread_join(worker->thread, NULL);
+
+    while (worker->connections != NULL) {
+        closeConnection(worker, worker->connections);
+    }
+    while (worker->inbox != NULL) {
+        Connection *connection = worker->inbox;
+        worker->inbox = connection->next;
+        close(connection->fd);
+        free(connection->input);
+        free(connection->output);
+        free(connection);
+    }
+    for (uint32_t slot = 0; slot < worker->capacity; slot++) {
+        if (worker->sessions[slot] != NULL) {
+            chip8_destroy(&worker->sessions[slot]->chip8);
+            free(worker->sessions[slot]);
+        }
+    }
+    free(worker->sessions);
+    close(worker->epoll_fd);
+    close(worker->timer_fd);
+    close(worker->inbox_fd);
+    pthread_mutex_destroy(&worker->inbox_lock);
+}
+
+int main(int argc, char *argv[]) {
+    shardCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    static struct option long_options[] = {
+        {"shards", required_argument, 0, 's'},
+        {"budget", required_argument, 0, 'b'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:b:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 's':
+                shardCount = atoi(optarg);
+                break;
+            case 'b':
+                budget = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc - 1 || shardCount <= 0 || budget < CYCLES_PER_FRAME) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    listenFd = net_listen(argv[optind], SOMAXCONN);
+    if (listenFd < 0) {
+        return 1;
+    }
+    fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+
+    // Workers inherit the blocked signals, only the main thread waits for them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    workers = calloc((size_t)shardCount, sizeof(Worker));
+    if (workers == NULL) {
+        perror("Failed to allocate the workers");
+        return 1;
+    }
+    for (int i = 0; i < shardCount; i++) {
+        if (!createWorker(&workers[i], i)) {
+            return 1;
+        }
+    }
+    int started = 0;
+    while (started < shardCount && startWorker(&workers[started])) {
+        started++;
+    }
+
+    int sig = 0;
+    if (started == shardCount) {
+        printf("Serving on %s with %d shards, %u instructions per session and tick\n", argv[optind], shardCount, budget);
+        fflush(stdout);
+        sigwait(&signals, &sig);
+    }
+
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < started; i++) {
+        stopWorker(&workers[i]);
+    }
+    free(workers);
+    close(listenFd);
+    return (started == shardCount) ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+#include "../include/chip8_disasm.h"
+#include "../include/params.h"
+
+static void printUsage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [--platform <chip8>/<schip>/<xochip>] [--format <text>/<dot>/<table>] <rom>\n", program_name);
+}
+
+int main(int argc, char *argv[]) {
+    const char *platform = "chip8";
+    const char *format = "text";
+
+    static struct option long_options[] = {
+        {"platform", required_argument, 0, 'p'},
+        {"format", required_argument, 0, 'f'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:f:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'p':
+                platform = optarg;
+                break;
+            case 'f':
+                format = optarg;
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc - 1 || parse_platform(platform) == 0 ||
+        (strcmp(format, "text") != 0 && strcmp(format, "dot") != 0 && strcmp(format, "table") != 0)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    static uint8_t program[PROGRAM_MEMORY_SIZE];
+    size_t program_size;
+    read_file_to_program(argv[optind], program, &program_size);
+    if (program_size == 0) {
+        fprintf(stderr, "No program to disassemble in %s\n", argv[optind]);
+        return 1;
+    }
+
+    Chip8Disasm *disasm = malloc(sizeof(Chip8Disasm));
+    if (disasm == NULL || !chip8_disasm_analyze(disasm, program, program_size, parse_platform(platform))) {
+        fprintf(stderr, "Out of memory\n");
+        free(disasm);
+        return 1;
+    }
+
+    if (strcmp(format, "dot") == 0) {
+        chip8_disasm_print_dot(disasm, stdout);
+    } else if (strcmp(format, "table") == 0) {
+        chip8_disasm_print_table(disasm, stdout);
+    } else {
+        chip8_disasm_print_text(disasm, stdout);
+    }
+
+    chip8_disasm_free(disasm);
+    free(disasm);
+    return 0;
+}
@@ -1,17 +1,11 @@
 #include "../include/display.h"
+#include "../include/trace.h"
 
 #ifdef _WIN32
 #include <windows.h>
 #define sleep_ms(ms) Sleep(ms)  // Sleep function on Windows
-void sound_buzzer() {
-    Beep(1000, 100);  // Frequency 1000 Hz, Duration 100 ms
-}
 #else
 #define sleep_ms(ms) usleep((ms) * 1000)  // usleep takes microseconds on Unix-like systems
-void sound_buzzer() {
-    printf("\a");  // Fallback to ASCII Bell character
-    fflush(stdout); 
-}
 #endif
 
 // Clears the terminal screen based on the operating system.
@@ -23,46 +17,155 @@ void clear_terminal() {
     #endif
 }
 
+// Terminal characters for each bitplane combination, indexed by pixel state.
+static const char terminal_pixels[1 << DISPLAY_PLANES] = { '.', '#', 'o', '@' };
+
+// RGB colors for each bitplane combination, indexed by pixel state.
+static const uint8_t sdl_pixel_colors[1 << DISPLAY_PLANES][3] = {
+    { ZERO_R, ZERO_G, ZERO_B },
+    { ONE_R, ONE_G, ONE_B },
+    { TWO_R, TWO_G, TWO_B },
+    { THREE_R, THREE_G, THREE_B },
+};
+
 // Renders the display to the terminal if it has changed.
 void show_terminal_display(Chip8 *chip8) {
     if (chip8->display_changed) {
+        trace_begin("render");
         clear_terminal();
 
-        for (int y = 0; y < DISPLAY_HEIGHT; y++) {
-            for (int x = 0; x < DISPLAY_WIDTH; x++) {
-                // Display '#' for pixels that are on and '.' for pixels that are off.
-                printf("%c", (chip8_get_display_state(chip8, x, y) ? '#' : '.'));
+        for (int y = 0; y < chip8_display_height(chip8); y++) {
+            for (int x = 0; x < chip8_display_width(chip8); x++) {
+                // Display '.' for pixels that are off and one character per bitplane combination otherwise.
+                printf("%c", terminal_pixels[chip8_get_display_state(chip8, x, y)]);
             }
             printf("\n");
         }
 
         chip8->display_changed = 0;
+        trace_end();
     }
 }
 
-// Renders the display using SDL if it has changed.
-void show_sdl_display(Display *display, Chip8 *chip8) {
-    if (chip8->display_changed) {
-        for (int y = 0; y < DISPLAY_HEIGHT; y++) {
-            for (int x = 0; x < DISPLAY_WIDTH; x++) {
-                // Set draw color based on pixel state.
-                SDL_SetRenderDrawColor(display->renderer,
-                                       chip8_get_display_state(chip8, x, y) ? ONE_R : ZERO_R,
-                                       chip8_get_display_state(chip8, x, y) ? ONE_G : ZERO_G,
-                                       chip8_get_display_state(chip8, x, y) ? ONE_B : ZERO_B,
-                                       SDL_ALPHA_OPAQUE);
-
-                // Render each pixel.
-                SDL_Rect rect = { x * PIXEL_SIZE, y * PIXEL_SIZE, PIXEL_SIZE, PIXEL_SIZE };
-                SDL_RenderFillRect(display->renderer, &rect);
-            }
-        }
+// Counts the whole frames since the last composition and moves on to the current one.
+static uint32_t elapsed_sdl_frames(Display *display) {
+    uint64_t period = SDL_GetPerformanceFrequency() / 60;
+    uint64_t frames = (SDL_GetPerformanceCounter() - display->composed) / period;
+    display->composed += frames * period;
+    return (frames > UINT32_MAX) ? UINT32_MAX : (uint32_t)frames;
+}
+
+// Composites the rows of the display that changed and draws the image over the whole window, without presenting it.
+static void render_sdl_pixels(Display *display, Chip8 *chip8, uint32_t frames) {
+    Compositor *compositor = display->compositor;
 
+    // Only the rows that changed are uploaded
+    if (compositor_update(compositor, chip8, frames)) {
+        SDL_Rect rows = { 0, compositor->dirty_top, COMPOSITOR_WIDTH, compositor->dirty_bottom - compositor->dirty_top };
+        SDL_UpdateTexture(display->texture, &rows, compositor->pixels[compositor->dirty_top],
+                          COMPOSITOR_WIDTH * (int)sizeof(uint32_t));
+    }
+    SDL_RenderCopy(display->renderer, display->texture, NULL, NULL);
+}
+
+// Renders the display using SDL if it has changed or is still fading.
+void show_sdl_display(Display *display, Chip8 *chip8) {
+    uint32_t frames = elapsed_sdl_frames(display);
+    if (chip8->display_changed || (frames > 0 && compositor_is_fading(display->compositor))) {
+        trace_begin("render");
+        render_sdl_pixels(display, chip8, frames);
+        trace_end();
+        trace_begin("present");
         SDL_RenderPresent(display->renderer); // Update the display
+        trace_end();
         chip8->display_changed = 0;
     }
 }
 
+// Returns the 3x5 overlay glyph of a character: one octal digit per row, top row first, leftmost pixel in the top bit.
+static uint16_t overlay_glyph(char c) {
+    static const uint16_t digits[10] = {
+        075557, 026227, 071747, 071717, 055711, 074717, 074757, 071111, 075757, 075717
+    };
+    static const uint16_t letters[26] = {
+        025755, 065656, 034443, 065556, 074647, 074644, 034553, 055755, 072227, 011152, 055655, 044447, 057755,
+        065555, 025552, 065644, 025563, 065655, 034216, 072222, 055557, 055552, 055775, 055255, 055222, 071247
+    };
+
+    if (c >= '0' && c <= '9') {
+        return digits[c - '0'];
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return letters[c - 'A'];
+    }
+    if (c >= 'a' && c <= 'z') {
+        return letters[c - 'a'];
+    }
+    switch (c) {
+        case '.': return 000002;
+        case ':': return 002020;
+        case '/': return 011244;
+        case '%': return 051245;
+        case '-': return 000700;
+        default: return 0;
+    }
+}
+
+// Draws lines of text at the top left corner of the window over a translucent backdrop.
+static void render_sdl_text(Display *display, const char *text) {
+    const int scale = 3;
+    const int advance = 4 * scale;
+    const int line_height = 7 * scale;
+
+    // Size of the backdrop
+    int columns = 0;
+    int lines = 1;
+    for (int column = 0, i = 0; text[i] != '\0'; i++) {
+        column = (text[i] == '\n') ? 0 : column + 1;
+        lines += (text[i] == '\n');
+        columns = (column > columns) ? column : columns;
+    }
+
+    SDL_Rect backdrop = { 0, 0, columns * advance + 2 * scale, lines * line_height + scale };
+    SDL_SetRenderDrawBlendMode(display->renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(display->renderer, 0, 0, 0, 192);
+    SDL_RenderFillRect(display->renderer, &backdrop);
+    SDL_SetRenderDrawBlendMode(display->renderer, SDL_BLENDMODE_NONE);
+
+    SDL_SetRenderDrawColor(display->renderer, THREE_R, THREE_G, THREE_B, SDL_ALPHA_OPAQUE);
+    int x = 2 * scale;
+    int y = 2 * scale;
+    for (const char *c = text; *c != '\0'; c++) {
+        if (*c == '\n') {
+            x = 2 * scale;
+            y += line_height;
+            continue;
+        }
+        uint16_t glyph = overlay_glyph(*c);
+        for (int row = 0; row < 5; row++) {
+            for (int column = 0; column < 3; column++) {
+                if (glyph & (1 << ((4 - row) * 3 + 2 - column))) {
+                    SDL_Rect rect = { x + column * scale, y + row * scale, scale, scale };
+                    SDL_RenderFillRect(display->renderer, &rect);
+                }
+            }
+        }
+        x += advance;
+    }
+}
+
+// Renders the display using SDL with lines of text over it.
+void show_sdl_display_overlay(Display *display, Chip8 *chip8, const char *text) {
+    trace_begin("render");
+    render_sdl_pixels(display, chip8, elapsed_sdl_frames(display));
+    render_sdl_text(display, text);
+    trace_end();
+    trace_begin("present");
+    SDL_RenderPresent(display->renderer); // Update the display
+    trace_end();
+    chip8->display_changed = 0;
+}
+
 // Initializes SDL library.
 void initSDL() {
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
@@ -97,11 +200,33 @@ Display createDisplay() {
         exit(EXIT_FAILURE);
     }
 
+    // Create the texture receiving the composited image, stretched without smoothing
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+    display.texture = SDL_CreateTexture(display.renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                        COMPOSITOR_WIDTH, COMPOSITOR_HEIGHT);
+    display.compositor = (Compositor *)malloc(sizeof(Compositor));
+    if (display.texture == NULL || display.compositor == NULL) {
+        fprintf(stderr, "Texture could not be created! SDL_Error: %s\n", SDL_GetError());
+        SDL_DestroyRenderer(display.renderer);
+        SDL_DestroyWindow(display.window);
+        SDL_Quit();
+        exit(EXIT_FAILURE);
+    }
+    compositor_init(display.compositor, sdl_pixel_colors, COMPOSITOR_NEAREST, 0);
+    display.composed = SDL_GetPerformanceCounter();
+
     return display;
 }
 
+// Selects how the display is scaled to the window.
+void setDisplayFilter(Display *display, CompositorFilter filter, uint8_t phosphor) {
+    compositor_init(display->compositor, sdl_pixel_colors, filter, phosphor);
+}
+
 // Cleans up SDL resources.
 void removeDisplay(Display *display) {
+    free(display->compositor);
+    SDL_DestroyTexture(display->texture);
     SDL_DestroyRenderer(display->renderer);
     SDL_DestroyWindow(display->window);
     SDL_Quit();
@@ -0,0 +1,179 @@
+#include "../include/chip8_snapshot.h"
+#include "../include/params.h"
+
+// Frames every input runs for unless CHIP8_FUZZ_FRAMES says otherwise.
+#define FUZZ_DEFAULT_FRAMES 60
+
+static Chip8 chip8;
+static Chip8Snapshot *golden;         // Instance every input starts from
+static int fixedRom;                  // 1 if inputs are key sequences for CHIP8_FUZZ_ROM, 0 if they are ROMs
+static unsigned long frameBudget = FUZZ_DEFAULT_FRAMES;
+
+/**
+ * @brief Builds the golden instance from the CHIP8_FUZZ_* environment variables.
+ *
+ * CHIP8_FUZZ_PLATFORM selects the platform and quirk profile (chip8 by default),
+ * CHIP8_FUZZ_FRAMES the number of 60 Hz frames each input runs for, and
+ * CHIP8_FUZZ_ROM a ROM to load, turning the inputs into key sequences for it.
+ */
+static void fuzzSetup(void)
+{
+    const char *platform = getenv("CHIP8_FUZZ_PLATFORM");
+    const char *frames = getenv("CHIP8_FUZZ_FRAMES");
+    const char *rom = getenv("CHIP8_FUZZ_ROM");
+
+    if (platform == NULL) {
+        platform = "chip8";
+    }
+    if (parse_platform(platform) == 0) {
+        fprintf(stderr, "Invalid CHIP8_FUZZ_PLATFORM, expected chip8, schip or xochip\n");
+        exit(1);
+    }
+    if (frames != NULL) {
+        frameBudget = strtoul(frames, NULL, 10);
+    }
+
+    if (!chip8_init_platform(&chip8, parse_platform(platform))) {
+        perror("Failed to allocate CHIP-8 RAM");
+        exit(1);
+    }
+    chip8_set_quirks(&chip8, (uint8_t)parse_quirks(platform));
+    chip8_seed_random(&chip8, 0); // Restored with the snapshot: Cxkk draws the same numbers for the same input
+
+    if (rom != NULL) {
+        static uint8_t program[PROGRAM_MEMORY_SIZE];
+        size_t program_size;
+        read_file_to_program(rom, program, &program_size);
+        if (program_size == 0) {
+            fprintf(stderr, "No program in CHIP8_FUZZ_ROM %s\n", rom);
+            exit(1);
+        }
+        chip8_load_ram(&chip8, program, program_size);
+        fixedRom = 1;
+    }
+
+    golden = malloc(sizeof(Chip8Snapshot));
+    if (golden == NULL) {
+        perror("Failed to allocate the fuzzing snapshot");
+        exit(1);
+    }
+    chip8_snapshot_capture(&chip8, golden);
+}
+
+/**
+ * @brief Aborts, so that the fuzzer records the input, if the instance is in a state no program can reach.
+ *
+ * RAM accesses need no check: the handlers wrap them around RAM, and one that
+ * did not would hit the guard page behind the mirror or the sanitizer.
+ */
+static void checkState(void)
+{
+    if (chip8.stack_pointer >= STACK_SIZE || chip8.program_counter > chip8.address_mask ||
+        chip8.planes > 3 || chip8.hires > 1) {
+        fprintf(stderr, "Invalid state after the instruction before PC=0x%04X: SP=%u planes=%u hires=%u\n",
+                chip8.program_counter, chip8.stack_pointer, chip8.planes, chip8.hires);
+        abort();
+    }
+}
+
+/**
+ * @brief Runs one input from the golden instance.
+ *
+ * Only the RAM pages the previous input wrote are copied back, the rest of the
+ * instance is a single struct copy.
+ *
+ * @param data ROM bytes, or with CHIP8_FUZZ_ROM one big-endian key bitfield per frame.
+ * @param size Number of bytes in data.
+ */
+static void fuzzRun(const uint8_t *data, size_t size)
+{
+    const uint8_t *keys = NULL;
+    size_t keyFrames = 0;
+
+    chip8_snapshot_restore(&chip8, golden);
+
+    if (fixedRom) {
+        keys = data;
+        keyFrames = size / 2;
+    } else {
+        size_t capacity = (size_t)chip8.address_mask + 1 - MEMORY_READ_START;
+        if (size > capacity) {
+            size = capacity;
+        }
+        memcpy(chip8.ram + MEMORY_READ_START, data, size);
+        chip8_snapshot_touch(golden, MEMORY_READ_START, (uint32_t)size);
+    }
+
+    for (unsigned long frame = 0; frame < frameBudget; frame++) {
+        if (frame < keyFrames) {
+            chip8.keys = (uint16_t)((keys[2 * frame] << 8) | keys[2 * frame + 1]);
+        }
+
+        uint32_t cycles = 0;
+        while (cycles < CYCLES_PER_FRAME) {
+            uint8_t state = chip8_idle_state(&chip8);
+            if (state == CHIP8_IDLE_HALTED || (state == CHIP8_IDLE_KEY && frame >= keyFrames)) {
+                return; // Nothing left in the input can change the machine state
+            }
+
+            uint32_t skipped = chip8_fast_forward(&chip8, CYCLES_PER_FRAME - cycles);
+            if (skipped) {
+                cycles += skipped;
+                continue;
+            }
+
+            if (chip8_step(&chip8) || chip8.exited) {
+                return;
+            }
+            checkState();
+            cycles++;
+        }
+    }
+}
+
+// libFuzzer entry points; AFL and the replay mode below call the same functions.
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    (void)argc;
+    (void)argv;
+    fuzzSetup();
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    fuzzRun(data, size);
+    return 0;
+}
+
+#ifndef CHIP8_LIBFUZZER
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+__AFL_FUZZ_INIT();
+#endif
+
+int main(int argc, char *argv[])
+{
+    fuzzSetup();
+
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+    // AFL persistent mode: inputs arrive in shared memory, no fork per input
+    (void)argc;
+    (void)argv;
+    __AFL_INIT();
+    const uint8_t *buffer = __AFL_FUZZ_TESTCASE_BUF;
+    while (__AFL_LOOP(100000)) {
+        fuzzRun(buffer, __AFL_FUZZ_TESTCASE_LEN);
+    }
+#else
+    // Without a fuzzer: replays the given inputs, e.g. ones a fuzzer saved as crashes
+    static uint8_t input[PROGRAM_MEMORY_SIZE];
+    for (int i = 1; i < argc; i++) {
+        size_t size;
+        read_file_to_program(argv[i], input, &size);
+        fuzzRun(input, size);
+        printf("%s: PC=0x%04X I=0x%04X SP=%u\n", argv[i], chip8.program_counter, chip8.i_register, chip8.stack_pointer);
+    }
+#endif
+    return 0;
+}
+#endif
@@ -0,0 +1,565 @@
+#include "../include/gdb_stub.h"
+#include "../include/chip8_watch.h"
+#include "../include/net.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+
+// Register numbers in the order of the 'g' packet and target.xml.
+#define GDB_REG_V0 0
+#define GDB_REG_I 16
+#define GDB_REG_PC 17
+#define GDB_REG_SP 18
+#define GDB_REG_STACK0 19
+#define GDB_REG_AMOUNT (GDB_REG_STACK0 + STACK_SIZE)
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Value of a hexadecimal digit, -1 if the character is not one.
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses a hexadecimal number, leaving *text on the first character after it.
+static unsigned long parse_hex(const char **text) {
+    unsigned long value = 0;
+    int digit;
+    while ((digit = hex_value(**text)) >= 0) {
+        value = (value << 4) | (unsigned long)digit;
+        (*text)++;
+    }
+    return value;
+}
+
+// Parses `count` bytes of hexadecimal data, returns 0 if the data is too short.
+static int parse_hex_bytes(const char *text, uint8_t *bytes, int count) {
+    for (int i = 0; i < count; i++) {
+        int high = hex_value(text[2 * i]);
+        int low = (high < 0) ? -1 : hex_value(text[2 * i + 1]);
+        if (low < 0) {
+            return 0;
+        }
+        bytes[i] = (uint8_t)((high << 4) | low);
+    }
+    return 1;
+}
+
+// Appends a value as little-endian hexadecimal bytes.
+static char *put_hex(char *out, unsigned value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        *out++ = hex_digits[(value >> 4) & 0xF];
+        *out++ = hex_digits[value & 0xF];
+        value >>= 8;
+    }
+    return out;
+}
+
+// Reads one byte from GDB, blocking until it arrives. Returns -1 once GDB is gone.
+static int gdb_stub_getc(GdbStub *stub) {
+    if (stub->input_start == stub->input_end) {
+        ssize_t received = recv(stub->fd, stub->input, sizeof(stub->input), 0);
+        if (received <= 0) {
+            return -1;
+        }
+        stub->input_start = 0;
+        stub->input_end = (int)received;
+    }
+    return (unsigned char)stub->input[stub->input_start++];
+}
+
+// Sends a packet and waits for GDB to acknowledge it.
+static void gdb_stub_send(GdbStub *stub, const char *payload) {
+    char header = '$';
+    char trailer[3];
+    uint8_t checksum = 0;
+    size_t length = strlen(payload);
+
+    for (size_t i = 0; i < length; i++) {
+        checksum += (uint8_t)payload[i];
+    }
+    trailer[0] = '#';
+    trailer[1] = hex_digits[checksum >> 4];
+    trailer[2] = hex_digits[checksum & 0xF];
+
+    for (int attempt = 0; attempt < 3; attempt++) {
+        send(stub->fd, &header, 1, 0);
+        send(stub->fd, payload, length, 0);
+        send(stub->fd, trailer, sizeof(trailer), 0);
+        if (gdb_stub_getc(stub) != '-') {
+            return; // Acknowledged, or GDB is gone
+        }
+    }
+}
+
+// Receives the next packet into stub->packet. Returns 1 for a packet,
+// 0x03 for an interrupt request and -1 once GDB is gone.
+static int gdb_stub_receive(GdbStub *stub) {
+    int c;
+    for (;;) {
+        do {
+            c = gdb_stub_getc(stub);
+            if (c < 0 || c == 0x03) {
+                return c;
+            }
+        } while (c != '$');
+
+        int length = 0;
+        uint8_t checksum = 0;
+        while ((c = gdb_stub_getc(stub)) >= 0 && c != '#') {
+            if (length < GDB_PACKET_SIZE - 1) {
+                stub->packet[length++] = (char)c;
+            }
+            checksum += (uint8_t)c;
+        }
+        int high = gdb_stub_getc(stub);
+        int low = gdb_stub_getc(stub);
+        if (c < 0 || low < 0) {
+            return -1;
+        }
+        stub->packet[length] = '\0';
+
+        int valid = (hex_value((char)high) << 4 | hex_value((char)low)) == checksum;
+        send(stub->fd, valid ? "+" : "-", 1, 0);
+        if (valid) {
+            return 1;
+        }
+    }
+}
+
+// Sets or clears the breakpoint at an address.
+static void gdb_stub_set_breakpoint(GdbStub *stub, uint16_t address, int set) {
+    if (gdb_stub_breakpoint_at(stub, address) == set) {
+        return;
+    }
+    stub->breakpoints[address >> 3] ^= (uint8_t)(1 << (address & 7));
+    stub->breakpoint_count += set ? 1 : -1;
+}
+
+// Removes every breakpoint.
+static void gdb_stub_clear_breakpoints(GdbStub *stub) {
+    memset(stub->breakpoints, 0, sizeof(stub->breakpoints));
+    stub->breakpoint_count = 0;
+}
+
+// Executes the instruction at the program counter, whether a breakpoint is set on it or not.
+static uint8_t gdb_stub_step(GdbStub *stub, Chip8 *chip8) {
+    int unknown = chip8_step(chip8); // The program counter stays on an unknown opcode
+    chip8->trapped = 0;
+    return (unknown && !stub->watch_hit) ? GDB_SIGILL : GDB_SIGTRAP;
+}
+
+// Reads a register in its 'g' packet encoding.
+static char *gdb_stub_put_register(Chip8 *chip8, int reg, char *out) {
+    if (reg < GDB_REG_I) {
+        return put_hex(out, chip8->v[reg - GDB_REG_V0], 1);
+    }
+    switch (reg) {
+        case GDB_REG_I: return put_hex(out, chip8->i_register, 2);
+        case GDB_REG_PC: return put_hex(out, chip8->program_counter, 2);
+        case GDB_REG_SP: return put_hex(out, chip8->stack_pointer, 1);
+        default: return put_hex(out, chip8->stack[reg - GDB_REG_STACK0], 2);
+    }
+}
+
+// Writes a register from its 'g' packet encoding, returns the number of characters used.
+static int gdb_stub_set_register(Chip8 *chip8, int reg, const char *text) {
+    uint8_t bytes[2];
+    int size = (reg < GDB_REG_I || reg == GDB_REG_SP) ? 1 : 2;
+    if (!parse_hex_bytes(text, bytes, size)) {
+        return 0;
+    }
+
+    uint16_t value = (size == 1) ? bytes[0] : (uint16_t)(bytes[0] | (bytes[1] << 8));
+    if (reg < GDB_REG_I) {
+        chip8->v[reg - GDB_REG_V0] = (uint8_t)value;
+    } else if (reg == GDB_REG_I) {
+        chip8->i_register = value;
+    } else if (reg == GDB_REG_PC) {
+        chip8->program_counter = value & chip8->address_mask;
+    } else if (reg == GDB_REG_SP) {
+        chip8->stack_pointer = (uint8_t)(value % STACK_SIZE);
+    } else {
+        chip8->stack[reg - GDB_REG_STACK0] = value & chip8->address_mask;
+    }
+    return 2 * size;
+}
+
+// Answers a qXfer:features:read request for the register description.
+static void gdb_stub_send_target_xml(GdbStub *stub, const char *request) {
+    static char xml[4096];
+    char *out = xml;
+    char *end = xml + sizeof(xml);
+
+    out += snprintf(out, end - out,
+        "<?xml version=\"1.0\"?><!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+        "<target version=\"1.0\"><feature name=\"org.chip8.core\">");
+    for (int i = 0; i < REGISTERS_SIZE; i++) {
+        out += snprintf(out, end - out, "<reg name=\"v%x\" bitsize=\"8\" type=\"uint8\"/>", i);
+    }
+    out += snprintf(out, end - out,
+        "<reg name=\"i\" bitsize=\"16\" type=\"data_ptr\"/>"
+        "<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>"
+        "<reg name=\"sp\" bitsize=\"8\" type=\"uint8\"/>");
+    for (int i = 0; i < STACK_SIZE; i++) {
+        out += snprintf(out, end - out, "<reg name=\"stack%d\" bitsize=\"16\" type=\"code_ptr\"/>", i);
+    }
+    snprintf(out, end - out, "</feature></target>");
+
+    const char *text = request;
+    unsigned long offset = parse_hex(&text);
+    text++; // ','
+    unsigned long length = parse_hex(&text);
+    unsigned long size = strlen(xml);
+    char *reply = stub->packet; // The request was parsed, reuse its buffer
+
+    if (offset >= size) {
+        gdb_stub_send(stub, "l");
+        return;
+    }
+    if (length > GDB_PACKET_SIZE - 2) {
+        length = GDB_PACKET_SIZE - 2;
+    }
+    if (length > size - offset) {
+        length = size - offset;
+    }
+    reply[0] = (offset + length < size) ? 'm' : 'l';
+    memcpy(reply + 1, xml + offset, length);
+    reply[length + 1] = '\0';
+    gdb_stub_send(stub, reply);
+}
+
+// Handles a query packet.
+static void gdb_stub_query(GdbStub *stub) {
+    const char *packet = stub->packet;
+    char reply[64];
+
+    if (strncmp(packet, "qSupported", 10) == 0) {
+        snprintf(reply, sizeof(reply), "PacketSize=%x;qXfer:features:read+", GDB_PACKET_SIZE);
+        gdb_stub_send(stub, reply);
+    } else if (strncmp(packet, "qXfer:features:read:target.xml:", 31) == 0) {
+        gdb_stub_send_target_xml(stub, packet + 31);
+    } else if (strcmp(packet, "qAttached") == 0) {
+        gdb_stub_send(stub, "1");
+    } else if (strcmp(packet, "qC") == 0) {
+        gdb_stub_send(stub, "QC1");
+    } else if (strcmp(packet, "qfThreadInfo") == 0) {
+        gdb_stub_send(stub, "m1");
+    } else if (strcmp(packet, "qsThreadInfo") == 0) {
+        gdb_stub_send(stub, "l");
+    } else {
+        gdb_stub_send(stub, "");
+    }
+}
+
+// Handles m, M, Z and z packets.
+static void gdb_stub_memory_command(GdbStub *stub, Chip8 *chip8) {
+    const char *text = stub->packet + 1;
+    char command = stub->packet[0];
+
+    if (command == 'Z' || command == 'z') {
+        unsigned long type = parse_hex(&text);
+        text++; // ','
+        uint16_t address = (uint16_t)parse_hex(&text) & chip8->address_mask;
+
+        if (type == 2 && chip8->watch != NULL) {
+            text++; // ','
+            uint16_t length = (uint16_t)parse_hex(&text);
+            int done = (command == 'Z') ? chip8_watch_add(chip8, address, length)
+                                        : chip8_watch_remove(chip8, address, length);
+            gdb_stub_send(stub, done ? "OK" : "E01");
+        } else if (type > 1) {
+            gdb_stub_send(stub, ""); // Only write watchpoints are supported
+        } else {
+            gdb_stub_set_breakpoint(stub, address, command == 'Z');
+            gdb_stub_send(stub, "OK");
+        }
+        return;
+    }
+
+    unsigned long address = parse_hex(&text);
+    text++; // ','
+    unsigned long length = parse_hex(&text);
+
+    if (command == 'm') {
+        char reply[GDB_PACKET_SIZE];
+        char *out = reply;
+        if (length > (GDB_PACKET_SIZE - 1) / 2) {
+            length = (GDB_PACKET_SIZE - 1) / 2;
+        }
+        for (unsigned long i = 0; i < length; i++) {
+            out = put_hex(out, chip8->ram[(address + i) & chip8->address_mask], 1);
+        }
+        *out = '\0';
+        gdb_stub_send(stub, reply);
+        return;
+    }
+
+    text++; // ':'
+    for (unsigned long i = 0; i < length; i++) {
+        uint8_t value;
+        if (!parse_hex_bytes(text + 2 * i, &value, 1)) {
+            gdb_stub_send(stub, "E01");
+            return;
+        }
+        chip8->ram[(address + i) & chip8->address_mask] = value;
+    }
+    gdb_stub_send(stub, "OK");
+}
+
+// Closes the connection to GDB, leaving the program running without breakpoints.
+static void gdb_stub_detach(GdbStub *stub) {
+    gdb_stub_clear_breakpoints(stub);
+    if (stub->fd >= 0) {
+        close(stub->fd);
+        stub->fd = -1;
+    }
+}
+
+// Formats the stop reply for a signal, naming the written address after a watchpoint hit.
+static void gdb_stub_stop_reply(GdbStub *stub, uint8_t signal, char *stop, size_t size) {
+    if (stub->watch_hit) {
+        snprintf(stop, size, "T%02xwatch:%x;", GDB_SIGTRAP, stub->watch_address);
+        stub->watch_hit = 0;
+    } else {
+        snprintf(stop, size, "S%02x", signal);
+    }
+}
+
+// Reports a stop and serves GDB until it resumes the program. Returns 1 if it killed it.
+static int gdb_stub_serve(GdbStub *stub, Chip8 *chip8, uint8_t signal) {
+    char reply[GDB_REG_AMOUNT * 4 + 1];
+    char stop[32];
+
+    gdb_stub_stop_reply(stub, signal, stop, sizeof(stop));
+    gdb_stub_send(stub, stop);
+
+    for (;;) {
+        int received = gdb_stub_receive(stub);
+        if (received < 0) {
+            gdb_stub_detach(stub); // GDB went away, keep running
+            return 0;
+        }
+        if (received == 0x03) {
+            continue; // Already stopped
+        }
+
+        const char *text = stub->packet + 1;
+        switch (stub->packet[0]) {
+            case '?':
+                gdb_stub_send(stub, stop);
+                break;
+            case 'g': {
+                char *out = reply;
+                for (int reg = 0; reg < GDB_REG_AMOUNT; reg++) {
+                    out = gdb_stub_put_register(chip8, reg, out);
+                }
+                *out = '\0';
+                gdb_stub_send(stub, reply);
+                break;
+            }
+            case 'G':
+                for (int reg = 0; reg < GDB_REG_AMOUNT; reg++) {
+                    int used = gdb_stub_set_register(chip8, reg, text);
+                    if (used == 0) break;
+                    text += used;
+                }
+                gdb_stub_send(stub, "OK");
+                break;
+            case 'p': {
+                unsigned long reg = parse_hex(&text);
+                if (reg >= GDB_REG_AMOUNT) {
+                    gdb_stub_send(stub, "E01");
+                    break;
+                }
+                *gdb_stub_put_register(chip8, (int)reg, reply) = '\0';
+                gdb_stub_send(stub, reply);
+                break;
+            }
+            case 'P': {
+                unsigned long reg = parse_hex(&text);
+                if (reg >= GDB_REG_AMOUNT || *text != '=' || !gdb_stub_set_register(chip8, (int)reg, text + 1)) {
+                    gdb_stub_send(stub, "E01");
+                    break;
+                }
+                gdb_stub_send(stub, "OK");
+                break;
+            }
+            case 'm':
+            case 'M':
+            case 'Z':
+            case 'z':
+                gdb_stub_memory_command(stub, chip8);
+                break;
+            case 's':
+            case 'c':
+                if (*text) {
+                    chip8->program_counter = (uint16_t)parse_hex(&text) & chip8->address_mask;
+                }
+                if (stub->packet[0] == 's') {
+                    gdb_stub_stop_reply(stub, gdb_stub_step(stub, chip8), stop, sizeof(stop));
+                    gdb_stub_send(stub, stop);
+                    break;
+                }
+                // Leave a breakpoint under the program counter before running into it again
+                if (gdb_stub_breakpoint_at(stub, chip8->program_counter)) {
+                    signal = gdb_stub_step(stub, chip8);
+                    if (signal == GDB_SIGILL || stub->watch_hit) {
+                        gdb_stub_stop_reply(stub, signal, stop, sizeof(stop));
+                        gdb_stub_send(stub, stop);
+                        break;
+                    }
+                }
+                return 0;
+            case 'D':
+                gdb_stub_send(stub, "OK");
+                gdb_stub_detach(stub);
+                return 0;
+            case 'k':
+                gdb_stub_detach(stub);
+                return 1;
+            case 'H':
+            case 'T':
+                gdb_stub_send(stub, "OK");
+                break;
+            case 'q':
+                gdb_stub_query(stub);
+                break;
+            default:
+                gdb_stub_send(stub, ""); // Unsupported
+                break;
+        }
+    }
+}
+
+// Listens on the given address and waits for GDB to connect.
+int gdb_stub_open(GdbStub *stub, const char *address) {
+    memset(stub, 0, sizeof(*stub));
+    stub->fd = -1;
+
+    stub->listen_fd = net_listen(address, 1);
+    if (stub->listen_fd < 0) {
+        return 0;
+    }
+
+    printf("Waiting for GDB on %s\n", address);
+    stub->fd = accept(stub->listen_fd, NULL, NULL);
+    if (stub->fd < 0) {
+        perror("Failed to accept GDB");
+        return 0;
+    }
+
+    int nodelay = 1;
+    setsockopt(stub->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)); // Fails harmlessly on Unix sockets
+    return 1;
+}
+
+// Lets GDB inspect the program before it starts.
+int gdb_stub_attach(GdbStub *stub, Chip8 *chip8) {
+    chip8->trapped = 0;
+    return gdb_stub_serve(stub, chip8, GDB_SIGTRAP);
+}
+
+// Reports a stop and serves GDB until it continues.
+int gdb_stub_trap(GdbStub *stub, Chip8 *chip8) {
+    chip8->trapped = 0;
+    if (stub->fd < 0) {
+        return 1; // Unknown opcode and nobody to report it to
+    }
+
+    uint8_t signal = GDB_SIGTRAP;
+    if (!stub->watch_hit && !gdb_stub_breakpoint_at(stub, chip8->program_counter)) {
+        signal = GDB_SIGILL;
+    }
+    return gdb_stub_serve(stub, chip8, signal);
+}
+
+// Stops the program if GDB sent an interrupt request.
+int gdb_stub_poll(GdbStub *stub, Chip8 *chip8) {
+    struct pollfd fd = { stub->fd, POLLIN, 0 };
+    if (stub->fd < 0 || stub->input_start != stub->input_end || poll(&fd, 1, 0) <= 0) {
+        return 0;
+    }
+
+    int c = gdb_stub_getc(stub);
+    if (c < 0) {
+        gdb_stub_detach(stub);
+        return 0;
+    }
+    if (c != 0x03) {
+        return 0; // Nothing else is expected while running
+    }
+    return gdb_stub_serve(stub, chip8, GDB_SIGINT);
+}
+
+// Stops the program after the instruction that wrote a watched address.
+void gdb_stub_watch_hit(GdbStub *stub, Chip8 *chip8, uint16_t address) {
+    if (stub->fd < 0) {
+        return;
+    }
+    stub->watch_hit = 1;
+    stub->watch_address = address;
+    chip8->trapped = 1;
+}
+
+// Tells GDB the program ended and closes the sockets.
+void gdb_stub_close(GdbStub *stub, Chip8 *chip8) {
+    (void)chip8;
+    if (stub->fd >= 0) {
+        gdb_stub_send(stub, "W00");
+    }
+    gdb_stub_detach(stub);
+    if (stub->listen_fd >= 0) {
+        close(stub->listen_fd);
+        stub->listen_fd = -1;
+    }
+}
+
+#else
+
+// The stub is built on POSIX sockets.
+int gdb_stub_open(GdbStub *stub, const char *address) {
+    (void)address;
+    memset(stub, 0, sizeof(*stub));
+    stub->listen_fd = -1;
+    stub->fd = -1;
+    fprintf(stderr, "The GDB stub is not available on Windows\n");
+    return 0;
+}
+
+int gdb_stub_attach(GdbStub *stub, Chip8 *chip8) {
+    (void)stub;
+    (void)chip8;
+    return 0;
+}
+
+int gdb_stub_trap(GdbStub *stub, Chip8 *chip8) {
+    (void)stub;
+    chip8->trapped = 0;
+    return 1;
+}
+
+int gdb_stub_poll(GdbStub *stub, Chip8 *chip8) {
+    (void)stub;
+    (void)chip8;
+    return 0;
+}
+
+void gdb_stub_watch_hit(GdbStub *stub, Chip8 *chip8, uint16_t address) {
+    (void)stub;
+    (void)chip8;
+    (void)address;
+}
+
+void gdb_stub_close(GdbStub *stub, Chip8 *chip8) {
+    (void)stub;
+    (void)chip8;
+}
+
+#endif
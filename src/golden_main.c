@@ -0,0 +1,494 @@
+#include "../include/chip8.h"
+#include "../include/chip8_lockstep.h"
+#include "../include/chip8_snapshot.h"
+#include "../include/params.h"
+#include "../include/rom.h"
+#include "../include/simd.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define GOLDEN_DEFAULT_FRAMES 3600
+#define GOLDEN_INTERVAL 60          // Frames between checkpoints
+#define GOLDEN_MAX_CHECKPOINTS 1024
+#define GOLDEN_SEED 0xC8C8C8C8u     // Seed of the Cxkk random numbers
+
+// FNV-1a 64-bit parameters.
+#define FNV_OFFSET 0xCBF29CE484222325ull
+#define FNV_PRIME 0x100000001B3ull
+
+/**
+ * Platforms and quirk profiles every ROM runs on, named in the golden file.
+ */
+static const struct {
+    const char *name;
+    const char *platform;
+    const char *quirks;
+} golden_targets[] = {
+    { "chip8", "chip8", "chip8" },
+    { "vip", "chip8", "vip" },
+    { "schip", "schip", "schip" },
+    { "xochip", "xochip", "xochip" },
+};
+
+/**
+ * Hashes taken at the end of one checkpoint frame.
+ */
+typedef struct {
+    uint32_t frame;     // Frames run before the checkpoint
+    uint64_t display;   // Hash of the resolution and the bitplanes
+    uint64_t state;     // Hash of the whole machine state, RAM included
+} GoldenCheckpoint;
+
+/**
+ * One ROM run on one platform.
+ */
+typedef struct {
+    const char *name;                 // File name of the ROM, identifies it in the golden file
+    const char *platform;             // Platform and quirk profile name
+    uint32_t frames;                  // Frames to run
+    int count;                        // Checkpoints taken
+    GoldenCheckpoint *checkpoints;    // One per GOLDEN_INTERVAL frames
+    char *divergence;                 // Where the engines differ under --lockstep, NULL if they agree
+} GoldenJob;
+
+/**
+ * ROMs shared by the worker threads, each taking the next ROM and running it on every platform.
+ */
+typedef struct {
+    RomQueue queue;
+    GoldenJob *jobs;                  // Platform jobs of each ROM, in the order of the queue
+    int platform_count;
+    uint32_t lockstep;                // Instructions between engine comparisons, 0 to run the fast engine alone
+} GoldenBatch;
+
+/**
+ * Checkpoint read from the golden file.
+ */
+typedef struct {
+    char name[256];
+    char platform[16];
+    GoldenCheckpoint checkpoint;
+} GoldenEntry;
+
+static void printUsage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [--update] [--frames <count>] [--lockstep <instructions>] [--force-isa <scalar|sse2|avx2|avx512|neon>] <golden file> <rom or directory>...\n", program_name);
+}
+
+// Adds bytes to an FNV-1a hash.
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// Adds a value to an FNV-1a hash, independently of its type and the byte order of the host.
+static uint64_t hashValue(uint64_t hash, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        hash = (hash ^ (uint8_t)(value >> (8 * i))) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// Hashes the resolution and the bitplanes.
+static uint64_t hashDisplay(const Chip8 *chip8) {
+    uint64_t hash = hashValue(FNV_OFFSET, chip8->hires);
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        for (int y = 0; y < DISPLAY_HIRES_HEIGHT; y++) {
+            hash = hashValue(hash, chip8->display[plane][y].hi);
+            hash = hashValue(hash, chip8->display[plane][y].lo);
+        }
+    }
+    return hash;
+}
+
+// Hashes everything the program can observe or change, field by field so that padding and pointers stay out.
+static uint64_t hashState(const Chip8 *chip8) {
+    uint64_t hash = hashDisplay(chip8);
+    hash = hashValue(hash, chip8->program_counter);
+    hash = hashValue(hash, chip8->i_register);
+    hash = hashValue(hash, chip8->stack_pointer);
+    hash = hashValue(hash, chip8->delay_timer);
+    hash = hashValue(hash, chip8->sound_timer);
+    hash = hashValue(hash, (uint64_t)chip8->timer);
+    hash = hashValue(hash, chip8->key_wait);
+    hash = hashValue(hash, chip8->key_wait_held);
+    hash = hashValue(hash, chip8->key_wait_pressed);
+    hash = hashValue(hash, chip8->planes);
+    hash = hashValue(hash, chip8->pitch);
+    hash = hashValue(hash, chip8->exited);
+    hash = hashValue(hash, chip8->random_state);
+    for (int i = 0; i < STACK_SIZE; i++) {
+        hash = hashValue(hash, chip8->stack[i]);
+    }
+    hash = hashBytes(hash, chip8->v, sizeof(chip8->v));
+    hash = hashBytes(hash, chip8->flags, sizeof(chip8->flags));
+    hash = hashBytes(hash, chip8->audio_pattern, sizeof(chip8->audio_pattern));
+    return hashBytes(hash, chip8->ram, (size_t)chip8->address_mask + 1);
+}
+
+// Keys held during a frame: every key in turn, held for 10 frames and released for 10.
+static uint16_t goldenKeys(uint32_t frame) {
+    if (frame % 20 >= 10) {
+        return 0;
+    }
+    return (uint16_t)(1 << ((frame / 20) * 7 % KEYBOARD_SIZE));
+}
+
+// Brings an instance back to its fresh state and loads a ROM.
+static void goldenReset(Chip8 *chip8, const Rom *rom) {
+    chip8_snapshot_restore(chip8, chip8->snapshot);
+    rom_load(chip8, rom);
+}
+
+/**
+ * @brief Runs one ROM from a fixed seed with the scripted keys, hashing the state at every checkpoint.
+ *
+ * A program that exits or hits an unknown opcode stops, later checkpoints
+ * hash the state it stopped in. With a reference instance, the ROM also runs
+ * on it one instruction at a time without idle skipping, and both are
+ * compared every `interval` instructions. Once they differ, the run is
+ * repeated comparing after every advance, and the first difference is
+ * recorded in the job.
+ *
+ * @param job Pointer to the GoldenJob.
+ * @param chip8 Instance of the platform of the job, with the snapshot of its fresh state attached.
+ * @param reference Second instance of the platform with its own snapshot, NULL to run without lockstep.
+ * @param rom Mapped ROM, loaded straight into the RAM of the instance.
+ * @param interval Instructions between comparisons with the reference.
+ */
+static void goldenRun(GoldenJob *job, Chip8 *chip8, Chip8 *reference, const Rom *rom, uint32_t interval) {
+    goldenReset(chip8, rom);
+    job->count = 0;
+
+    Chip8Lockstep lockstep;
+    if (reference != NULL) {
+        goldenReset(reference, rom);
+        chip8_lockstep_start(&lockstep, reference, chip8_engine_step, chip8, chip8_engine_fast_forward, interval);
+    }
+
+    uint8_t stopped = 0;
+    for (uint32_t frame = 0; frame < job->frames; frame++) {
+        chip8->keys = goldenKeys(frame);
+
+        if (reference != NULL) {
+            reference->keys = chip8->keys;
+            if (!chip8_lockstep_run(&lockstep, CYCLES_PER_FRAME)) {
+                if (interval > 1) {
+                    chip8_lockstep_stop(&lockstep);
+                    goldenRun(job, chip8, reference, rom, 1);
+                    return;
+                }
+                size_t size;
+                FILE *report = open_memstream(&job->divergence, &size);
+                if (report != NULL) {
+                    fprintf(report, "frame %" PRIu32 "\n", frame);
+                    chip8_lockstep_dump(&lockstep, report);
+                    fclose(report);
+                }
+                break;
+            }
+        } else {
+            uint32_t cycles = 0;
+            while (!stopped && cycles < CYCLES_PER_FRAME) {
+                cycles += chip8_engine_fast_forward(chip8, CYCLES_PER_FRAME - cycles, &stopped);
+            }
+        }
+
+        if ((frame + 1) % GOLDEN_INTERVAL == 0 && job->count < GOLDEN_MAX_CHECKPOINTS) {
+            GoldenCheckpoint *checkpoint = &job->checkpoints[job->count++];
+            checkpoint->frame = frame + 1;
+            checkpoint->display = hashDisplay(chip8);
+            checkpoint->state = hashState(chip8);
+        }
+    }
+
+    if (reference != NULL) {
+        chip8_lockstep_stop(&lockstep);
+    }
+}
+
+/**
+ * @brief Takes ROMs from the queue until it is empty, mapping each once for all of its platforms.
+ *
+ * The worker creates one instance per platform, two under --lockstep, and
+ * restores it from a snapshot of its fresh state before every ROM, which only
+ * copies back the RAM pages the previous ROM wrote.
+ *
+ * @param data Pointer to the GoldenBatch.
+ * @return NULL.
+ */
+static void *goldenWorker(void *data) {
+    GoldenBatch *batch = data;
+
+    // Reference instances follow the instances of the fast engine
+    int instance_count = batch->platform_count * (batch->lockstep ? 2 : 1);
+    Chip8 *instances = calloc((size_t)instance_count, sizeof(Chip8));
+    Chip8Snapshot *snapshots = malloc((size_t)instance_count * sizeof(Chip8Snapshot));
+    if (instances == NULL || snapshots == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < instance_count; i++) {
+        int target = i % batch->platform_count;
+        Chip8 *chip8 = &instances[i];
+        if (!chip8_init_platform(chip8, parse_platform(golden_targets[target].platform))) {
+            perror("Failed to allocate CHIP-8 RAM");
+            exit(1);
+        }
+        chip8_set_quirks(chip8, (uint8_t)parse_quirks(golden_targets[target].quirks));
+        chip8_seed_random(chip8, GOLDEN_SEED);
+        chip8_snapshot_capture(chip8, &snapshots[i]);
+    }
+
+    Rom rom;
+    int index;
+    while ((index = rom_queue_next(&batch->queue, &rom)) >= 0) {
+        for (int platform = 0; platform < batch->platform_count; platform++) {
+            Chip8 *reference = batch->lockstep ? &instances[batch->platform_count + platform] : NULL;
+            goldenRun(&batch->jobs[index * batch->platform_count + platform], &instances[platform], reference, &rom,
+                      batch->lockstep);
+        }
+        rom_unmap(&rom);
+    }
+
+    for (int i = 0; i < instance_count; i++) {
+        chip8_snapshot_release(&instances[i], &snapshots[i]);
+        chip8_destroy(&instances[i]);
+    }
+    free(snapshots);
+    free(instances);
+    return NULL;
+}
+
+/**
+ * @brief Reads the checkpoints of a golden file.
+ *
+ * @param path Golden file.
+ * @param count Receives the number of checkpoints.
+ * @return The checkpoints, NULL if the file cannot be read.
+ */
+static GoldenEntry *readGolden(const char *path, int *count) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    GoldenEntry *entries = NULL;
+    int capacity = 0;
+    char line[512];
+    *count = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        GoldenEntry entry;
+        if (line[0] == '#' || sscanf(line, "%255s %15s %" SCNu32 " %" SCNx64 " %" SCNx64, entry.name, entry.platform,
+                                     &entry.checkpoint.frame, &entry.checkpoint.display, &entry.checkpoint.state) != 5) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            GoldenEntry *grown = realloc(entries, capacity * sizeof(GoldenEntry));
+            if (grown == NULL) {
+                break;
+            }
+            entries = grown;
+        }
+        entries[(*count)++] = entry;
+    }
+    fclose(file);
+    return entries ? entries : calloc(1, sizeof(GoldenEntry));
+}
+
+// Finds the golden checkpoint of a job at a frame.
+static const GoldenEntry *findGolden(const GoldenEntry *entries, int count, const GoldenJob *job, uint32_t frame) {
+    for (int i = 0; i < count; i++) {
+        if (entries[i].checkpoint.frame == frame && strcmp(entries[i].name, job->name) == 0 &&
+            strcmp(entries[i].platform, job->platform) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Reports where the engines of a job differ under --lockstep, returns 1 if they agree.
+static int checkDivergence(const GoldenJob *job) {
+    if (job->divergence == NULL) {
+        return 1;
+    }
+    printf("DIVERGE %s %s: %s", job->name, job->platform, job->divergence);
+    return 0;
+}
+
+// Compares the checkpoints of a job with the golden ones, reporting the first difference.
+static int checkJob(const GoldenJob *job, const GoldenEntry *entries, int count) {
+    if (!checkDivergence(job)) {
+        return 0;
+    }
+    for (int i = 0; i < job->count; i++) {
+        const GoldenCheckpoint *actual = &job->checkpoints[i];
+        const GoldenEntry *expected = findGolden(entries, count, job, actual->frame);
+        if (expected == NULL) {
+            printf("MISSING %s %s: no golden checkpoint at frame %" PRIu32 "\n", job->name, job->platform, actual->frame);
+            return 0;
+        }
+        if (actual->display != expected->checkpoint.display || actual->state != expected->checkpoint.state) {
+            printf("FAIL    %s %s: frame %" PRIu32 " display %016" PRIx64 " (expected %016" PRIx64 "), state %016" PRIx64
+                   " (expected %016" PRIx64 ")\n", job->name, job->platform, actual->frame, actual->display,
+                   expected->checkpoint.display, actual->state, expected->checkpoint.state);
+            return 0;
+        }
+    }
+    printf("ok      %s %s\n", job->name, job->platform);
+    return 1;
+}
+
+// Writes the checkpoints of every job as the new golden file.
+static int writeGolden(const char *path, const GoldenJob *jobs, int count) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror("Failed to write the golden file");
+        return 0;
+    }
+    fprintf(file, "# chip8-golden checkpoints: <rom> <platform> <frame> <display hash> <state hash>\n");
+    for (int i = 0; i < count; i++) {
+        for (int c = 0; c < jobs[i].count; c++) {
+            const GoldenCheckpoint *checkpoint = &jobs[i].checkpoints[c];
+            fprintf(file, "%s %s %" PRIu32 " %016" PRIx64 " %016" PRIx64 "\n", jobs[i].name, jobs[i].platform,
+                    checkpoint->frame, checkpoint->display, checkpoint->state);
+        }
+    }
+    fclose(file);
+    printf("Wrote %d runs to %s\n", count, path);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    int update = 0;
+    unsigned long frames = GOLDEN_DEFAULT_FRAMES;
+    unsigned long lockstep = 0;
+
+    static struct option long_options[] = {
+        {"update", no_argument, 0, 'u'},
+        {"frames", required_argument, 0, 'f'},
+        {"lockstep", required_argument, 0, 'l'},
+        {"force-isa", required_argument, 0, 'I'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "uf:l:I:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'u':
+                update = 1;
+                break;
+            case 'f':
+                frames = strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                lockstep = strtoul(optarg, NULL, 10);
+                break;
+            case 'I':
+                if (parse_isa(optarg) < 0 || !simd_force((SimdIsa)parse_isa(optarg))) {
+                    fprintf(stderr, "Unknown instruction set, or one this build or host cannot run: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (argc - optind < 2 || frames == 0 || frames > (unsigned long)GOLDEN_INTERVAL * GOLDEN_MAX_CHECKPOINTS ||
+        lockstep > UINT32_MAX) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // Every ROM on every platform, spread over one worker thread per processor
+    const char *golden_path = argv[optind];
+    static GoldenBatch batch;
+    if (!rom_queue_init(&batch.queue, argv + optind + 1, argc - optind - 1)) {
+        return 1;
+    }
+    if (batch.queue.count == 0) {
+        fprintf(stderr, "No ROMs to run\n");
+        return 1;
+    }
+    batch.platform_count = (int)(sizeof(golden_targets) / sizeof(golden_targets[0]));
+    batch.lockstep = (uint32_t)lockstep;
+    int job_count = batch.queue.count * batch.platform_count;
+    size_t checkpoint_count = (frames + GOLDEN_INTERVAL - 1) / GOLDEN_INTERVAL;
+    GoldenJob *jobs = calloc(job_count, sizeof(GoldenJob));
+    GoldenCheckpoint *checkpoints = calloc((size_t)job_count * checkpoint_count, sizeof(GoldenCheckpoint));
+    if (jobs == NULL || checkpoints == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    batch.jobs = jobs;
+
+    for (int i = 0; i < job_count; i++) {
+        GoldenJob *job = &jobs[i];
+        const char *path = batch.queue.paths[i / batch.platform_count];
+        job->name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+        job->platform = golden_targets[i % batch.platform_count].name;
+        job->frames = (uint32_t)frames;
+        job->checkpoints = checkpoints + (size_t)i * checkpoint_count;
+    }
+
+    long worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (worker_count < 1) {
+        worker_count = 1;
+    }
+    if (worker_count > batch.queue.count) {
+        worker_count = batch.queue.count;
+    }
+    pthread_t *workers = calloc((size_t)worker_count, sizeof(pthread_t));
+    if (workers == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (long i = 0; i < worker_count; i++) {
+        if (pthread_create(&workers[i], NULL, goldenWorker, &batch) != 0) {
+            fprintf(stderr, "Failed to start a worker thread\n");
+            return 1;
+        }
+    }
+    for (long i = 0; i < worker_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    int passed = 1;
+    if (update) {
+        // Checkpoints of a run whose engines differ are not trusted
+        for (int i = 0; i < job_count; i++) {
+            passed &= checkDivergence(&jobs[i]);
+        }
+        passed = passed && writeGolden(golden_path, jobs, job_count);
+    } else {
+        int entry_count;
+        GoldenEntry *entries = readGolden(golden_path, &entry_count);
+        if (entries == NULL) {
+            fprintf(stderr, "Cannot read %s, create it with --update\n", golden_path);
+            free(checkpoints);
+            free(jobs);
+            rom_queue_free(&batch.queue);
+            return 1;
+        }
+        for (int i = 0; i < job_count; i++) {
+            passed &= checkJob(&jobs[i], entries, entry_count);
+        }
+        free(entries);
+    }
+
+    for (int i = 0; i < job_count; i++) {
+        free(jobs[i].divergence);
+    }
+    free(checkpoints);
+    free(jobs);
+    rom_queue_free(&batch.queue);
+    return passed ? 0 : 1;
+}
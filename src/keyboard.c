@@ -1,41 +1,65 @@
 #include "keyboard.h"
 
+#include <ctype.h>
+
+/** Host key bound to each CHIP-8 key: the 4x4 block under 1234 unless a ROM pack sets another. */
+static char keymap[KEYBOARD_SIZE] = { 'x', '1', '2', '3', 'q', 'w', 'e', 'a', 's', 'd', 'z', 'c', '4', 'r', 'f', 'v' };
+
+/**
+ * Binds host keys to the CHIP-8 keys.
+ * 
+ * @param keys Digit or lowercase letter bound to each CHIP-8 key, in key order.
+ * @return 1 if the keys were bound, 0 if one is not a digit or letter or appears twice.
+ */
+int set_keymap(const char keys[KEYBOARD_SIZE]) {
+    for (int i = 0; i < KEYBOARD_SIZE; i++) {
+        if (!(isdigit((unsigned char)keys[i]) || islower((unsigned char)keys[i])) ||
+            memchr(keys, keys[i], (size_t)i) != NULL) {
+            return 0;
+        }
+    }
+    memcpy(keymap, keys, KEYBOARD_SIZE);
+    return 1;
+}
+
 /**
- * Maps SDL keycodes to CHIP-8 key indices.
+ * Maps a host key to the scancode of its position on a US layout.
  * 
- * @param key SDL keycode.
+ * @param key Digit or lowercase letter.
+ * @return The SDL scancode.
+ */
+static SDL_Scancode key_to_scancode(char key) {
+    if (key >= 'a' && key <= 'z') {
+        return (SDL_Scancode)(SDL_SCANCODE_A + (key - 'a'));
+    }
+    return (key == '0') ? SDL_SCANCODE_0 : (SDL_Scancode)(SDL_SCANCODE_1 + (key - '1'));
+}
+
+/**
+ * Maps SDL scancodes to CHIP-8 key indices, like read_keyboard_sdl() reads them.
+ * 
+ * @param scancode SDL scancode.
  * @return Corresponding CHIP-8 key index or 0xFF if invalid.
  */
-static uint8_t sdl_key_to_chip8_key(SDL_Keycode key) {
-    switch (key) {
-        case SDLK_1: return 0x1;
-        case SDLK_2: return 0x2;
-        case SDLK_3: return 0x3;
-        case SDLK_4: return 0xC;
-        case SDLK_q: return 0x4;
-        case SDLK_w: return 0x5;
-        case SDLK_e: return 0x6;
-        case SDLK_r: return 0xD;
-        case SDLK_a: return 0x7;
-        case SDLK_s: return 0x8;
-        case SDLK_d: return 0x9;
-        case SDLK_f: return 0xE;
-        case SDLK_z: return 0xA;
-        case SDLK_x: return 0x0;
-        case SDLK_c: return 0xB;
-        case SDLK_v: return 0xF;
-        default: return 0xFF; // Invalid key
+static uint8_t sdl_scancode_to_chip8_key(SDL_Scancode scancode) {
+    for (uint8_t i = 0; i < KEYBOARD_SIZE; i++) {
+        if (scancode == key_to_scancode(keymap[i])) {
+            return i;
+        }
     }
+    return 0xFF; // Invalid key
 }
 
 /**
  * Reads the keyboard state using SDL and updates the CHIP-8 keyboard state.
  * 
  * @param chip8 Pointer to the Chip8 structure.
+ * @param latency Pointer to the Latency timing key presses, NULL to not time them.
  * @return 1 if the ESC key was pressed, 0 otherwise.
  */
-int read_keyboard_sdl(Chip8 *chip8) {
+int read_keyboard_sdl(Chip8 *chip8, Latency *latency) {
     const Uint8 *state = SDL_GetKeyboardState(NULL);
+    uint16_t keys = chip8->keys;
 
     // Check ESC key for exiting
     if (state[SDL_GetScancodeFromKey(SDLK_ESCAPE)]) {
@@ -44,37 +68,44 @@ int read_keyboard_sdl(Chip8 *chip8) {
 
     // Iterate over all CHIP-8 keys and update their state
     for (int i = 0; i < KEYBOARD_SIZE; ++i) {
-        SDL_Scancode scancode = SDL_SCANCODE_UNKNOWN;
-
-        // Map CHIP-8 key index to SDL scancode
-        switch (i) {
-            case 0x1: scancode = SDL_SCANCODE_1; break;
-            case 0x2: scancode = SDL_SCANCODE_2; break;
-            case 0x3: scancode = SDL_SCANCODE_3; break;
-            case 0xC: scancode = SDL_SCANCODE_4; break;
-            case 0x4: scancode = SDL_SCANCODE_Q; break;
-            case 0x5: scancode = SDL_SCANCODE_W; break;
-            case 0x6: scancode = SDL_SCANCODE_E; break;
-            case 0xD: scancode = SDL_SCANCODE_R; break;
-            case 0x7: scancode = SDL_SCANCODE_A; break;
-            case 0x8: scancode = SDL_SCANCODE_S; break;
-            case 0x9: scancode = SDL_SCANCODE_D; break;
-            case 0xE: scancode = SDL_SCANCODE_F; break;
-            case 0xA: scancode = SDL_SCANCODE_Z; break;
-            case 0x0: scancode = SDL_SCANCODE_X; break;
-            case 0xB: scancode = SDL_SCANCODE_C; break;
-            case 0xF: scancode = SDL_SCANCODE_V; break;
-            default: continue; // Skip invalid key indices
-        }
-
-        // Update the state of the key
-        uint8_t new_state = state[scancode] ? 1 : 0;
+        uint8_t new_state = state[key_to_scancode(keymap[i])] ? 1 : 0;
         chip8_set_keyboard_state(chip8, i, new_state);
     }
 
+    if (chip8->keys & ~keys) {
+        latency_keys_changed(latency, SDL_GetPerformanceCounter()); // A key went down
+    }
     return 0; // Return 0 to indicate normal operation
 }
 
+/**
+ * Notes when a CHIP-8 key was pressed according to an SDL event.
+ * 
+ * @param e SDL event, ignored unless it presses a CHIP-8 key.
+ * @param latency Pointer to the Latency timing key presses.
+ */
+void time_key_event_sdl(const SDL_Event *e, Latency *latency) {
+    if (e->type != SDL_KEYDOWN || e->key.repeat || sdl_scancode_to_chip8_key(e->key.keysym.scancode) == 0xFF) {
+        return;
+    }
+
+    // Event timestamps are in milliseconds of SDL_GetTicks(), move them to the performance counter
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint32 age_ms = SDL_GetTicks() - e->key.timestamp;
+    Uint64 age = (Uint64)age_ms * SDL_GetPerformanceFrequency() / 1000;
+    latency_key_event(latency, (age < now) ? now - age : now);
+}
+
+/**
+ * Blocks until an SDL event arrives or the timeout expires.
+ * The event stays queued for the next SDL_PollEvent().
+ * 
+ * @param timeout_ms Maximum time to wait in milliseconds, -1 to wait forever.
+ */
+void wait_for_input_sdl(int timeout_ms) {
+    SDL_WaitEventTimeout(NULL, timeout_ms);
+}
+
 /**
  * Maps a character to a CHIP-8 key index.
  * 
@@ -82,25 +113,12 @@ int read_keyboard_sdl(Chip8 *chip8) {
  * @return Corresponding CHIP-8 key index or 16 if invalid.
  */
 uint8_t map_key_to_index(char key) {
-    switch (key) {
-        case '1': return 1;
-        case '2': return 2;
-        case '3': return 3;
-        case '4': return 12;
-        case 'q': return 4;
-        case 'w': return 5;
-        case 'e': return 6;
-        case 'r': return 13;
-        case 'a': return 7;
-        case 's': return 8;
-        case 'd': return 9;
-        case 'f': return 14;
-        case 'z': return 10;
-        case 'x': return 0;
-        case 'c': return 11;
-        case 'v': return 15;
-        default: return 16; // Invalid key index
+    for (uint8_t i = 0; i < KEYBOARD_SIZE; i++) {
+        if (key == keymap[i]) {
+            return i;
+        }
     }
+    return 16; // Invalid key index
 }
 
 #ifdef _WIN32
@@ -125,13 +143,28 @@ uint8_t map_key_to_index(char key) {
         }
     }
 
+    /**
+     * Blocks until a key is available or the timeout expires (Windows version).
+     * 
+     * @param timeout_ms Maximum time to wait in milliseconds, -1 to wait forever.
+     */
+    void wait_for_input(int timeout_ms) {
+        while (!_kbhit() && timeout_ms != 0) {
+            Sleep(1);
+            if (timeout_ms > 0) {
+                timeout_ms--;
+            }
+        }
+    }
+
     /**
      * Reads the keyboard state and updates the CHIP-8 keyboard state (Windows version).
      * 
      * @param chip8 Pointer to the Chip8 structure.
+     * @param latency Pointer to the Latency timing key presses, NULL to not time them.
      * @return 1 if the ESC key was pressed, 0 otherwise.
      */
-    int read_keyboard(Chip8 *chip8) {
+    int read_keyboard(Chip8 *chip8, Latency *latency) {
         for (int i = 0; i < 16; i++) {
             chip8_set_keyboard_state(chip8, i, 0); // Assume all keys are up
         }
@@ -142,7 +175,9 @@ uint8_t map_key_to_index(char key) {
             }
             uint8_t key_index = map_key_to_index(key);
             if (key_index < 16) {
+                // The terminal has no event times: the key is timed as it is read
                 chip8_set_keyboard_state(chip8, key_index, 1); // Key down
+                latency_keys_changed(latency, SDL_GetPerformanceCounter());
             }
         }
         return 0;
@@ -152,6 +187,7 @@ uint8_t map_key_to_index(char key) {
     #include <termios.h>
     #include <unistd.h>
     #include <fcntl.h>
+    #include <poll.h>
 
     /**
      * Checks if a key has been pressed (Unix-like systems).
@@ -183,13 +219,34 @@ uint8_t map_key_to_index(char key) {
         return 0;
     }
 
+    /**
+     * Blocks until a key is available or the timeout expires (Unix-like systems).
+     * 
+     * @param timeout_ms Maximum time to wait in milliseconds, -1 to wait forever.
+     */
+    void wait_for_input(int timeout_ms) {
+        struct termios oldt, newt;
+        struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+
+        // Without canonical mode a single key press makes stdin readable
+        tcgetattr(STDIN_FILENO, &oldt);
+        newt = oldt;
+        newt.c_lflag &= ~(ICANON | ECHO);
+        tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+
+        poll(&fd, 1, timeout_ms);
+
+        tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+    }
+
     /**
      * Reads the keyboard state and updates the CHIP-8 keyboard state (Unix-like systems).
      * 
      * @param chip8 Pointer to the Chip8 structure.
+     * @param latency Pointer to the Latency timing key presses, NULL to not time them.
      * @return 1 if the ESC key was pressed, 0 otherwise.
      */
-    int read_keyboard(Chip8 *chip8) {
+    int read_keyboard(Chip8 *chip8, Latency *latency) {
         for (int i = 0; i < 16; i++) {
             chip8_set_keyboard_state(chip8, i, 0); // Assume all keys are up
         }
@@ -200,7 +257,9 @@ uint8_t map_key_to_index(char key) {
             }
             uint8_t key_index = map_key_to_index(key);
             if (key_index < 16) {
+                // The terminal has no event times: the key is timed as it is read
                 chip8_set_keyboard_state(chip8, key_index, 1); // Key down
+                latency_keys_changed(latency, SDL_GetPerformanceCounter());
             }
         }
         return 0;
@@ -0,0 +1,195 @@
+#include "../include/latency.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Stages a measured press goes through.
+enum {
+    LATENCY_IDLE,                       // No press in flight
+    LATENCY_KEYS,                       // Chip8.keys changed, waiting for a Dxyn
+    LATENCY_DRAWN                       // Drawn, waiting for the frame to be presented
+};
+
+static const char *const segment_names[LATENCY_SEGMENTS] = { "input", "emulation", "render", "total" };
+static const double report_quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+#define REPORT_QUANTILES (int)(sizeof(report_quantiles) / sizeof(report_quantiles[0]))
+
+// Number of low bits of a value that its bucket does not tell apart.
+static int latency_bucket_shift(uint64_t value) {
+    int shift = 0;
+    while ((value >> shift) >= (2u << LATENCY_SUB_BUCKET_BITS)) {
+        shift++;
+    }
+    return shift;
+}
+
+// Index of the bucket holding a value.
+static int latency_bucket(uint64_t value) {
+    int shift = latency_bucket_shift(value);
+    return (shift << LATENCY_SUB_BUCKET_BITS) + (int)(value >> shift);
+}
+
+// Largest value a bucket holds.
+static uint64_t latency_bucket_max(int bucket) {
+    if (bucket < (2 << LATENCY_SUB_BUCKET_BITS)) {
+        return (uint64_t)bucket;
+    }
+    int shift = (bucket >> LATENCY_SUB_BUCKET_BITS) - 1;
+    uint64_t first = (uint64_t)(bucket - (shift << LATENCY_SUB_BUCKET_BITS)) << shift;
+    return first + ((uint64_t)1 << shift) - 1;
+}
+
+// Adds a duration in performance counter ticks to a histogram.
+static void latency_record(LatencyHistogram *histogram, uint64_t ticks, uint64_t frequency) {
+    uint64_t value = ticks * 1000000 / frequency;
+    if (value >= (uint64_t)1 << LATENCY_MAX_BITS) {
+        value = ((uint64_t)1 << LATENCY_MAX_BITS) - 1;
+    }
+
+    histogram->counts[latency_bucket(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+// Resets the histograms.
+void latency_init(Latency *latency, uint64_t frequency) {
+    memset(latency, 0, sizeof(*latency));
+    latency->frequency = frequency;
+}
+
+// Notes a key event, before the key reaches Chip8.keys.
+void latency_key_event(Latency *latency, uint64_t time) {
+    if (latency != NULL && latency->event_time == 0) {
+        latency->event_time = time;
+    }
+}
+
+// Notes that a key was pressed in Chip8.keys, starting a measurement if none is in flight.
+void latency_keys_changed(Latency *latency, uint64_t time) {
+    if (latency == NULL) {
+        return;
+    }
+
+    // The event behind this change, unless it is stale, e.g. a key that only the host handles
+    uint64_t event_time = latency->event_time;
+    latency->event_time = 0;
+    if (event_time == 0 || event_time > time || time - event_time > latency->frequency) {
+        event_time = time;
+    }
+
+    if (latency->stage != LATENCY_IDLE) {
+        if (time - latency->keys_time <= latency->frequency) {
+            return; // Still following an earlier press
+        }
+        latency->abandoned++;
+    }
+    latency->start_time = event_time;
+    latency->keys_time = time;
+    latency->stage = LATENCY_KEYS;
+}
+
+// Notes that a Dxyn instruction was executed.
+void latency_draw(Latency *latency, uint64_t time) {
+    if (latency->stage != LATENCY_KEYS) {
+        return;
+    }
+    if (time - latency->keys_time > latency->frequency) {
+        latency->abandoned++; // Too late to be the effect of the press
+        latency->stage = LATENCY_IDLE;
+        return;
+    }
+    latency->draw_time = time;
+    latency->stage = LATENCY_DRAWN;
+}
+
+// Notes that a frame was presented, completing the measurement in flight if it drew.
+void latency_present(Latency *latency, uint64_t time) {
+    if (latency->stage != LATENCY_DRAWN) {
+        return;
+    }
+    latency_record(&latency->segments[LATENCY_INPUT], latency->keys_time - latency->start_time, latency->frequency);
+    latency_record(&latency->segments[LATENCY_EMULATION], latency->draw_time - latency->keys_time, latency->frequency);
+    latency_record(&latency->segments[LATENCY_RENDER], time - latency->draw_time, latency->frequency);
+    latency_record(&latency->segments[LATENCY_TOTAL], time - latency->start_time, latency->frequency);
+    latency->stage = LATENCY_IDLE;
+}
+
+// Returns the value below which a fraction of the recorded values fall.
+uint64_t latency_quantile(const LatencyHistogram *histogram, double quantile) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    // Rank of the value, counting from 1
+    double exact = quantile * (double)histogram->count;
+    uint64_t rank = (uint64_t)exact;
+    if ((double)rank < exact || rank == 0) {
+        rank++;
+    }
+
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += histogram->counts[bucket];
+        if (seen >= rank) {
+            uint64_t value = latency_bucket_max(bucket);
+            return (value < histogram->max) ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+// Writes the histograms as Prometheus summaries.
+size_t latency_format(const Latency *latency, char *buffer, size_t size) {
+    size_t length = 0;
+
+    length += (size_t)snprintf(buffer, size,
+        "# HELP chip8_key_latency_seconds Time from a key press to the display showing its first Dxyn, per segment.\n"
+        "# TYPE chip8_key_latency_seconds summary\n");
+    for (int segment = 0; segment < LATENCY_SEGMENTS && length < size; segment++) {
+        const LatencyHistogram *histogram = &latency->segments[segment];
+        for (int i = 0; i < REPORT_QUANTILES && length < size; i++) {
+            length += (size_t)snprintf(buffer + length, size - length,
+                                       "chip8_key_latency_seconds{segment=\"%s\",quantile=\"%g\"} %.6f\n",
+                                       segment_names[segment], report_quantiles[i],
+                                       (double)latency_quantile(histogram, report_quantiles[i]) / 1e6);
+        }
+        if (length < size) {
+            length += (size_t)snprintf(buffer + length, size - length,
+                                       "chip8_key_latency_seconds_sum{segment=\"%s\"} %.6f\n"
+                                       "chip8_key_latency_seconds_count{segment=\"%s\"} %llu\n",
+                                       segment_names[segment], (double)histogram->sum / 1e6,
+                                       segment_names[segment], (unsigned long long)histogram->count);
+        }
+    }
+    if (length < size) {
+        length += (size_t)snprintf(buffer + length, size - length,
+            "# HELP chip8_key_presses_abandoned_total Key presses not followed by a Dxyn within a second.\n"
+            "# TYPE chip8_key_presses_abandoned_total counter\n"
+            "chip8_key_presses_abandoned_total %llu\n",
+            (unsigned long long)latency->abandoned);
+    }
+    return (length < size) ? length : size - 1;
+}
+
+// Prints the percentiles of every segment, if any press was measured.
+void latency_report(const Latency *latency) {
+    if (latency->segments[LATENCY_TOTAL].count == 0) {
+        return;
+    }
+
+    printf("Key latency over %llu presses (%llu drew nothing), in ms:\n",
+           (unsigned long long)latency->segments[LATENCY_TOTAL].count, (unsigned long long)latency->abandoned);
+    printf("  %-10s %8s %8s %8s %8s %8s %8s\n", "segment", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for (int segment = 0; segment < LATENCY_SEGMENTS; segment++) {
+        const LatencyHistogram *histogram = &latency->segments[segment];
+        printf("  %-10s %8.2f", segment_names[segment], (double)histogram->sum / (double)histogram->count / 1000.0);
+        for (int i = 0; i < REPORT_QUANTILES; i++) {
+            printf(" %8.2f", (double)latency_quantile(histogram, report_quantiles[i]) / 1000.0);
+        }
+        printf(" %8.2f\n", (double)histogram->max / 1000.0);
+    }
+}
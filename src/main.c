@@ -2,13 +2,21 @@
 #include "../include/chip8_opcodes.h"
 #include "../include/keyboard.h"
 #include "../include/display.h"
+#include "../include/audio.h"
+#include "../include/recorder.h"
+#include "../include/stream.h"
+#include "../include/telemetry.h"
+#include "../include/trace.h"
+#include "../include/gdb_stub.h"
+#include "../include/chip8_watch.h"
 #include "../include/params.h"
 #include "../include/utils.h"
 
 /**
  * @brief Initializes the UI based on user arguments.
  *
- * Sets up the SDL window and creates a display if the UI type is "window".
+ * Sets up the SDL window and creates a display scaled with the chosen filter
+ * if the UI type is "window".
  *
  * @param args The command-line arguments specifying UI options.
  * @param display Pointer to a Display structure that will be initialized.
@@ -18,9 +26,99 @@ static void initializeUI(const Arguments *args, Display *display)
     if (strstr(args->ui, "window") != NULL) {
         initSDL();
         *display = createDisplay();
+        setDisplayFilter(display, (CompositorFilter)parse_filter(args->filter), (uint8_t)args->phosphor);
     }
 }
 
+/**
+ * @brief Reports a write to a watched RAM address.
+ *
+ * Prints the writing instruction and the byte before and after the write,
+ * and stops the program in GDB when a debugger is attached.
+ *
+ * @param chip8 Pointer to the Chip8 emulator instance.
+ * @param pc Address of the writing instruction.
+ * @param address Address of the written byte.
+ * @param old_value Byte before the write.
+ * @param new_value Byte after the write.
+ * @param user Pointer to the attached GdbStub, NULL without a debugger.
+ */
+static void onWatchHit(Chip8 *chip8, uint16_t pc, uint16_t address, uint8_t old_value, uint8_t new_value, void *user)
+{
+    printf("Watch 0x%03X: PC=0x%03X 0x%02X -> 0x%02X\n", address, pc, old_value, new_value);
+    if (user != NULL) {
+        gdb_stub_watch_hit((GdbStub *)user, chip8, address);
+    }
+}
+
+/**
+ * @brief Sleeps through an idle loop instead of executing it.
+ *
+ * While the program spins in a loop that only the timers can end, or waits for
+ * a key in Fx0A, the loop is fast-forwarded to just before the next timer
+ * update and the host waits for input for the time the skipped instructions
+ * would have taken. A program halted on a jump to itself waits for input
+ * without a timeout, unless a server is open: GDB, the stream and the stats
+ * socket are served at the end of each frame, so the jump then keeps running
+ * in real time.
+ *
+ * @param chip8 Pointer to the Chip8 emulator instance.
+ * @param args The command-line arguments specifying UI options.
+ * @param serving Whether a GDB, stream or stats server is open.
+ * @return 1 if the wait replaced the next instruction, 0 otherwise.
+ */
+static int waitWhileIdle(Chip8 *chip8, const Arguments *args, int serving)
+{
+    int timeout_ms;
+
+    switch (chip8_idle_state(chip8)) {
+        case CHIP8_IDLE_HALTED:
+            if (serving) {
+                return 0; // Waits one instruction at a time, frames keep ending
+            }
+            timeout_ms = -1;
+            break;
+        case CHIP8_IDLE_TIMER:
+        case CHIP8_IDLE_KEY: {
+            uint32_t skipped = chip8_fast_forward(chip8, CYCLES_PER_FRAME - chip8->timer - 1);
+            if (skipped == 0) {
+                return 0;
+            }
+            timeout_ms = skipped * TIME_PER_TICK_MS;
+            break;
+        }
+        default:
+            return 0;
+    }
+
+    trace_begin("sleep");
+    if (strstr(args->ui, "window") != NULL) {
+        wait_for_input_sdl(timeout_ms); // A quit event is handled by the next poll
+    } else {
+        wait_for_input(timeout_ms);
+    }
+    trace_end();
+    return 1;
+}
+
+/**
+ * @brief Shows or hides the telemetry overlay when F1 is pressed.
+ *
+ * @param chip8 Pointer to the Chip8 emulator instance, redrawn after a toggle.
+ * @param telemetry Pointer to the Telemetry whose overlay is toggled.
+ */
+static void toggleOverlay(Chip8 *chip8, Telemetry *telemetry)
+{
+    static uint8_t was_pressed = 0;
+    uint8_t pressed = SDL_GetKeyboardState(NULL)[SDL_SCANCODE_F1] ? 1 : 0;
+
+    if (pressed && !was_pressed) {
+        telemetry->overlay = !telemetry->overlay;
+        chip8->display_changed = 1; // Redraw with or without it
+    }
+    was_pressed = pressed;
+}
+
 /**
  * @brief Handles user input and updates the display.
  *
@@ -29,53 +127,225 @@ static void initializeUI(const Arguments *args, Display *display)
  * @param chip8 Pointer to the Chip8 emulator instance.
  * @param args The command-line arguments specifying UI options.
  * @param display Pointer to a Display structure used for rendering.
+ * @param audio Pointer to the Audio backend receiving the buzzer state.
+ * @param recorder Pointer to the Recorder receiving finished frames, NULL when not recording.
+ * @param stream Pointer to the StreamServer sending finished frames, NULL when not streaming.
+ * @param gdb Pointer to the attached GDB stub, NULL when debugging is off.
+ * @param telemetry Pointer to the Telemetry timing the emulation, rendering, input and key presses.
  * @param result Pointer to a uint8_t that will be set to indicate the exit status.
  */
-static void handleInputAndDisplay(Chip8 *chip8, const Arguments *args, Display *display, uint8_t *result)
+static void handleInputAndDisplay(Chip8 *chip8, const Arguments *args, Display *display, Audio *audio,
+                                  Recorder *recorder, StreamServer *stream, GdbStub *gdb, Telemetry *telemetry,
+                                  uint8_t *result)
 {
+    static uint32_t frame = 0;
     SDL_Event e;
 
     // Poll for SDL events
+    trace_begin("poll");
+    uint64_t start = telemetry_now();
     while (SDL_PollEvent(&e) != 0) {
         if (e.type == SDL_QUIT) {
+            trace_end();
             *result = 1; // Set result to indicate exit
             return;
         }
+        time_key_event_sdl(&e, &telemetry->latency);
     }
+    telemetry->input_ticks += telemetry_now() - start;
+    trace_end();
 
-    // Fetch and execute the next opcode
+    // Fetch and execute the next opcode, unless it has a breakpoint or the program is idling.
+    // Idle loops run in full while breakpoints are set, one of them could be inside.
     Opcode opcode = chip8_fetch_opcode(chip8);
-    *result = chip8_execute_opcode(chip8, &opcode);
+    int breakpoints = gdb != NULL && gdb->breakpoint_count > 0;
+    if (breakpoints && gdb_stub_breakpoint_at(gdb, chip8->program_counter)) {
+        *result = gdb_stub_trap(gdb, chip8); // GDB steps over it when it continues
+    } else if (breakpoints || !waitWhileIdle(chip8, args, gdb != NULL || stream != NULL || telemetry->listen_fd >= 0)) {
+        // Wait for the time slot of the instruction outside the measured emulation time
+        trace_begin("sleep");
+        chip8_wait_for_next_tick();
+        trace_end();
+        trace_begin("execute");
+        start = telemetry_now();
+        *result = chip8_step(chip8);
+        uint64_t end = telemetry_now();
+        trace_end();
+        telemetry->emulation_ticks += end - start;
+        telemetry->instructions++;
+        if ((opcode.instruction & 0xF000) == 0xD000) {
+            latency_draw(&telemetry->latency, end);
+        }
+        if (gdb != NULL && (*result || chip8->trapped)) {
+            *result = gdb_stub_trap(gdb, chip8); // Unknown opcode or watchpoint hit under GDB
+        }
+        if (chip8->exited) {
+            *result = 1; // Program executed 00FD
+        }
 
-    // Check if a sound should be played
-    if (chip8_should_buzz(chip8)) {
-        sound_buzzer();
+        // Hand the buzzer state to the audio thread once per timer frame
+        if (chip8->timer == 0) {
+            trace_instant("frame");
+            trace_begin("timers");
+            audio_push_frame(audio, chip8_should_buzz(chip8));
+            frame++;
+            if (recorder != NULL) {
+                recorder_push_frame(recorder, chip8, frame);
+            }
+            if (stream != NULL) {
+                stream_push_frame(stream, chip8, frame);
+            }
+            if (gdb != NULL && gdb_stub_poll(gdb, chip8)) {
+                *result = 1; // GDB killed the program
+            }
+            telemetry_end_frames(telemetry, 1, 1);
+            trace_end();
+        }
     }
 
     // Update the display based on the UI type
     if (strstr(args->ui, "terminal") != NULL) {
-        if (read_keyboard(chip8)) {
+        trace_begin("input");
+        start = telemetry_now();
+        if (read_keyboard(chip8, &telemetry->latency)) {
             *result = 1; // Set result to indicate exit
         }
+        uint64_t rendering = telemetry_now();
+        trace_end();
+        uint8_t presenting = chip8->display_changed;
         show_terminal_display(chip8);
+        uint64_t end = telemetry_now();
+        telemetry->input_ticks += rendering - start;
+        telemetry->render_ticks += end - rendering;
+        if (presenting) {
+            latency_present(&telemetry->latency, end);
+        }
     } else if (strstr(args->ui, "window") != NULL) {
-        if (read_keyboard_sdl(chip8)) {
+        trace_begin("input");
+        start = telemetry_now();
+        if (read_keyboard_sdl(chip8, &telemetry->latency)) {
             *result = 1; // Set result to indicate exit
         }
-        show_sdl_display(display, chip8);
+        toggleOverlay(chip8, telemetry);
+        uint64_t rendering = telemetry_now();
+        trace_end();
+        uint8_t presenting = chip8->display_changed;
+        if (!telemetry->overlay) {
+            show_sdl_display(display, chip8);
+        } else if (chip8->display_changed || chip8->timer == 0) {
+            // Redrawn every frame so that the figures stay current
+            char text[TELEMETRY_OVERLAY_SIZE];
+            telemetry_format_overlay(telemetry, text);
+            show_sdl_display_overlay(display, chip8, text);
+        }
+        uint64_t end = telemetry_now();
+        telemetry->input_ticks += rendering - start;
+        telemetry->render_ticks += end - rendering;
+        if (presenting) {
+            latency_present(&telemetry->latency, end);
+        }
+        trace_begin("print");
         print_opcode(&opcode);
+        trace_end();
     }
 }
 
+/**
+ * @brief Runs the program without a UI as fast as possible.
+ *
+ * Idle loops are fast-forwarded instead of executed. The run ends when the
+ * program halts, waits for a key, exits, hits an unknown opcode or reaches
+ * the frame limit.
+ *
+ * @param chip8 Pointer to the Chip8 emulator instance.
+ * @param args The command-line arguments holding the frame limit.
+ * @param recorder Pointer to the Recorder receiving finished frames, NULL when not recording.
+ * @param stream Pointer to the StreamServer sending finished frames, NULL when not streaming.
+ * @param gdb Pointer to the attached GDB stub, NULL when debugging is off.
+ * @param telemetry Pointer to the Telemetry counting instructions and frames.
+ */
+static void runHeadless(Chip8 *chip8, const Arguments *args, Recorder *recorder, StreamServer *stream, GdbStub *gdb,
+                        Telemetry *telemetry)
+{
+    uint64_t limit = (uint64_t)args->frames * CYCLES_PER_FRAME;
+    uint64_t executed = 0;
+    uint64_t skipped = 0;
+    uint64_t recorded = 0;
+
+    while (limit == 0 || executed + skipped < limit) {
+        // Hand the display to the recorder and the stream once per finished frame, however many were skipped
+        uint64_t frame = (executed + skipped) / CYCLES_PER_FRAME;
+        if (frame != recorded) {
+            if (recorder != NULL) {
+                recorder_push_frame(recorder, chip8, (uint32_t)frame);
+            }
+            if (stream != NULL) {
+                stream_push_frame(stream, chip8, (uint32_t)frame);
+            }
+            telemetry->instructions = executed;
+            telemetry_end_frames(telemetry, (uint32_t)(frame - recorded), 0);
+            recorded = frame;
+        }
+
+        int breakpoints = gdb != NULL && gdb->breakpoint_count > 0;
+        if (breakpoints && gdb_stub_breakpoint_at(gdb, chip8->program_counter)) {
+            if (gdb_stub_trap(gdb, chip8)) {
+                break;
+            }
+            continue; // GDB stepped over it
+        }
+
+        uint8_t state = chip8_idle_state(chip8);
+        if (state == CHIP8_IDLE_HALTED || state == CHIP8_IDLE_KEY) {
+            break; // Nothing but input could change the machine state
+        }
+
+        // Idle loops run in full while breakpoints are set, one of them could be inside
+        uint64_t budget = limit ? limit - executed - skipped : UINT32_MAX;
+        uint32_t cycles = breakpoints ? 0 : chip8_fast_forward(chip8, (budget > UINT32_MAX) ? UINT32_MAX : (uint32_t)budget);
+        if (cycles) {
+            skipped += cycles;
+            continue;
+        }
+
+        executed++;
+        int unknown = chip8_step(chip8);
+        if ((unknown || chip8->trapped) && (gdb == NULL || gdb_stub_trap(gdb, chip8))) {
+            break; // Unknown opcode, or GDB killed the program after a stop
+        }
+        if (chip8->exited) {
+            break;
+        }
+        if (gdb != NULL && chip8->timer == 0 && gdb_stub_poll(gdb, chip8)) {
+            break;
+        }
+    }
+
+    // The display at the end of the run, counting an unfinished last frame as a whole one
+    uint64_t last_frame = (executed + skipped + CYCLES_PER_FRAME - 1) / CYCLES_PER_FRAME;
+    if (recorder != NULL && last_frame != recorded) {
+        recorder_push_frame(recorder, chip8, (uint32_t)last_frame);
+    }
+    if (stream != NULL && last_frame != recorded) {
+        stream_push_frame(stream, chip8, (uint32_t)last_frame);
+    }
+
+    printf("Ran %llu frames: %llu instructions executed, %llu skipped\n",
+           (unsigned long long)((executed + skipped) / CYCLES_PER_FRAME),
+           (unsigned long long)executed, (unsigned long long)skipped);
+}
+
 /**
  * @brief Cleans up resources used by the application.
  *
  * Removes the display and performs any other necessary cleanup.
  *
  * @param display Pointer to a Display structure to be cleaned up.
+ * @param audio Pointer to the Audio backend to be closed.
  */
-static void cleanup(Display *display)
+static void cleanup(Display *display, Audio *audio)
 {
+    audio_close(audio);
     if (display) {
         removeDisplay(display);
     }
@@ -95,35 +365,141 @@ static void cleanup(Display *display)
 int run_app(int argc, char *argv[])
 {
     Data data = {0};
-    Arguments args = {NULL, NULL, NULL, 0};
+    Arguments args = {NULL, NULL, NULL, NULL, NULL, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, NULL, 0};
     
     // Parse and handle command-line arguments
     get_args(&args, argc, argv);
     handle_args(&args, &data);
     print_launch_options(&args);
+
+    // Threads started from here on record into the trace as well
+    if (args.trace != NULL && !trace_open(args.trace)) {
+        return 1;
+    }
+    int status = 1;
     
     // Initialize CHIP-8 emulator and load program
     Chip8 chip8;
-    chip8_init(&chip8);
+    if (!chip8_init_platform(&chip8, parse_platform(args.platform))) {
+        perror("Failed to allocate CHIP-8 RAM");
+        free_program_data(&data);
+        trace_close();
+        return status;
+    }
+    chip8_set_quirks(&chip8, parse_quirks(args.quirks));
     chip8_load_ram(&chip8, data.program, data.program_size);
 
+    // Keys and speed a ROM pack stores with the program
+    if (data.entry.keymap[0] != '\0' && !set_keymap(data.entry.keymap)) {
+        fprintf(stderr, "Ignoring the invalid key map of the program\n");
+    }
+    if (data.entry.cycles_per_frame != 0 && data.entry.cycles_per_frame != CYCLES_PER_FRAME) {
+        fprintf(stderr, "The program expects %u instructions per frame, this build runs %d\n",
+                (unsigned)data.entry.cycles_per_frame, CYCLES_PER_FRAME);
+    }
+    free_program_data(&data);
+
+    // Whatever was opened is closed at done, in reverse order
+    GdbStub gdb;
+    GdbStub *debugger = NULL;
+    static Recorder recorder;
+    Recorder *recording = NULL;
+    static StreamServer server;
+    StreamServer *streaming = NULL;
+    Telemetry telemetry;
+    Telemetry *measuring = NULL;
+
+    // Hand the program to GDB before it starts
+    if (args.gdb != NULL) {
+        debugger = &gdb;
+        if (!gdb_stub_open(debugger, args.gdb)) {
+            goto done;
+        }
+    }
+
+    // Watchpoints from the command line, GDB can add more
+    Chip8Watch watch;
+    if (args.watch != NULL || debugger != NULL) {
+        uint16_t starts[WATCH_MAX_POINTS];
+        uint16_t lengths[WATCH_MAX_POINTS];
+        int count = (args.watch != NULL) ? parse_watchpoints(args.watch, starts, lengths, WATCH_MAX_POINTS) : 0;
+
+        chip8_watch_init(&chip8, &watch, onWatchHit, debugger);
+        for (int i = 0; i < count; i++) {
+            chip8_watch_add(&chip8, starts[i], lengths[i]);
+        }
+    }
+
+    if (debugger != NULL && gdb_stub_attach(debugger, &chip8)) {
+        status = 0; // GDB killed the program before it started
+        goto done;
+    }
+
+    // Frames are encoded on a background thread, the Recorder has to stay put until closed
+    if (args.record != NULL) {
+        if (!recorder_open(&recorder, args.record)) {
+            goto done;
+        }
+        recording = &recorder;
+    }
+
+    // Spectators connect at any time, frames are sent without ever waiting for them
+    if (args.stream != NULL) {
+        if (!stream_open(&server, args.stream)) {
+            goto done;
+        }
+        streaming = &server;
+    }
+
+    telemetry_init(&telemetry);
+    measuring = &telemetry;
+    if (args.stats != NULL && !telemetry_listen(&telemetry, args.stats)) {
+        goto done;
+    }
+
+    if (strstr(args.ui, "headless") != NULL) {
+        trace_begin("headless");
+        runHeadless(&chip8, &args, recording, streaming, debugger, &telemetry);
+        trace_end();
+        status = 0;
+        goto done;
+    }
+
     Display display;
-    SDL_Event e;
+    Audio audio;
     uint8_t result = 0;
 
     // Initialize UI components
     initializeUI(&args, &display);
+    audio_init(&audio);
 
     // Main application loop
     while (!result) {
-        handleInputAndDisplay(&chip8, &args, &display, &result);
+        handleInputAndDisplay(&chip8, &args, &display, &audio, recording, streaming, debugger, &telemetry, &result);
     }
 
     // Perform cleanup before exiting
-    cleanup(&display);
-
+    latency_report(&telemetry.latency);
+    cleanup(&display, &audio);
     SDL_Quit();
-    return 0;
+    status = 0;
+
+done:
+    if (measuring) {
+        telemetry_close(measuring);
+    }
+    if (streaming) {
+        stream_close(streaming);
+    }
+    if (recording) {
+        recorder_close(recording);
+    }
+    if (debugger) {
+        gdb_stub_close(debugger, &chip8);
+    }
+    chip8_destroy(&chip8);
+    trace_close();
+    return status;
 }
 
 /**
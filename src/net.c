@@ -0,0 +1,114 @@
+#include "../include/net.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+// Fills a Unix or TCP socket address. Returns its size, 0 if the address is malformed.
+static socklen_t net_parse_address(const char *address, struct sockaddr_storage *storage) {
+    memset(storage, 0, sizeof(*storage));
+
+    if (strchr(address, '/') != NULL) {
+        struct sockaddr_un *local = (struct sockaddr_un *)storage;
+        local->sun_family = AF_UNIX;
+        strncpy(local->sun_path, address, sizeof(local->sun_path) - 1);
+        return sizeof(*local);
+    }
+
+    struct sockaddr_in *inet = (struct sockaddr_in *)storage;
+    const char *colon = strrchr(address, ':');
+    char host[64] = "127.0.0.1";
+    if (colon != NULL) {
+        size_t length = (size_t)(colon - address);
+        if (length == 0 || length >= sizeof(host)) {
+            return 0;
+        }
+        memcpy(host, address, length);
+        host[length] = '\0';
+        address = colon + 1;
+    }
+
+    char *end;
+    unsigned long port = strtoul(address, &end, 10);
+    inet->sin_family = AF_INET;
+    inet->sin_port = htons((uint16_t)port);
+    if (*address == '\0' || *end != '\0' || port > 65535 || inet_pton(AF_INET, host, &inet->sin_addr) != 1) {
+        return 0;
+    }
+    return sizeof(*inet);
+}
+
+// Creates a socket listening on an address.
+int net_listen(const char *address, int backlog) {
+    struct sockaddr_storage storage;
+    socklen_t size = net_parse_address(address, &storage);
+    if (size == 0) {
+        fprintf(stderr, "Invalid socket address %s\n", address);
+        return -1;
+    }
+
+    int fd = socket(storage.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Failed to create socket");
+        return -1;
+    }
+    if (storage.ss_family == AF_UNIX) {
+        unlink(((struct sockaddr_un *)&storage)->sun_path);
+    } else {
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+
+    if (bind(fd, (struct sockaddr *)&storage, size) < 0 || listen(fd, backlog) < 0) {
+        fprintf(stderr, "Failed to listen on %s: ", address);
+        perror(NULL);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Connects to a listening socket.
+int net_connect(const char *address) {
+    struct sockaddr_storage storage;
+    socklen_t size = net_parse_address(address, &storage);
+    if (size == 0) {
+        fprintf(stderr, "Invalid socket address %s\n", address);
+        return -1;
+    }
+
+    int fd = socket(storage.ss_family, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&storage, size) < 0) {
+        fprintf(stderr, "Failed to connect to %s: ", address);
+        perror(NULL);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+#else
+
+// Sockets are only available on POSIX systems.
+int net_listen(const char *address, int backlog) {
+    (void)backlog;
+    fprintf(stderr, "Cannot listen on %s: sockets are not available on Windows\n", address);
+    return -1;
+}
+
+int net_connect(const char *address) {
+    fprintf(stderr, "Cannot connect to %s: sockets are not available on Windows\n", address);
+    return -1;
+}
+
+#endif
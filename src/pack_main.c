@@ -0,0 +1,475 @@
+#include "../include/params.h"
+#include "../include/rom.h"
+#include "../include/rom_pack.h"
+
+#include <errno.h>
+#include <inttypes.h>
+
+#define PACK_LINE_MAX 4096
+
+/**
+ * ROM to store, with the metadata of its entry.
+ */
+typedef struct {
+    char *path;                 // ROM file
+    const char *name;           // File name of the ROM, names the entry
+    RomPackEntry entry;         // Metadata, name and blob filled in when the archive is laid out
+} PackItem;
+
+/**
+ * Distinct program, its bytes in the data buffer of the archive being built.
+ */
+typedef struct {
+    uint64_t hash;
+    size_t offset;              // Offset in the data buffer
+    uint32_t size;
+    uint32_t entry;             // First entry naming the program, UINT32_MAX until the entries are sorted
+    uint32_t index;             // Index in the sorted blob table
+} PackBlob;
+
+/**
+ * Archive being built.
+ */
+typedef struct {
+    PackItem *items;
+    int item_count;
+    int item_capacity;
+    PackBlob *blobs;
+    uint32_t blob_count;
+    uint32_t *slots;            // Open addressing table of blob indices + 1 by hash, 0 for empty
+    uint32_t slot_count;        // Power of two
+    uint8_t *data;              // Programs, each aligned to ROM_PACK_ALIGNMENT
+    size_t data_size;
+    size_t data_capacity;
+} Pack;
+
+static void printUsage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [--platform <chip8>/<schip>/<xochip>] [--quirks <chip8>/<vip>/<schip>/<xochip>] "
+                    "[--cycles <per frame>] [--keys <16 keys>] [--manifest <file>] <archive> [<rom or directory>...]\n"
+                    "       %s --list <archive>\n", program_name, program_name);
+}
+
+// Checks a key map: 16 distinct digits or lowercase letters, the host key of each CHIP-8 key.
+static int validKeymap(const char *keys) {
+    if (strlen(keys) != KEYBOARD_SIZE) {
+        return 0;
+    }
+    for (int i = 0; i < KEYBOARD_SIZE; i++) {
+        if (!(isdigit((unsigned char)keys[i]) || islower((unsigned char)keys[i])) ||
+            memchr(keys, keys[i], (size_t)i) != NULL) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Applies a "key=value" setting, or a command line option, to the metadata of an entry. Returns 0 if invalid.
+static int applySetting(RomPackEntry *entry, const char *key, const char *value) {
+    if (strcmp(key, "platform") == 0 && parse_platform(value) != 0) {
+        strncpy(entry->platform, value, ROM_PACK_NAME_MAX - 1);
+        strncpy(entry->quirks, value, ROM_PACK_NAME_MAX - 1); // Every platform has a quirk profile of the same name
+    } else if (strcmp(key, "quirks") == 0 && parse_quirks(value) >= 0) {
+        strncpy(entry->quirks, value, ROM_PACK_NAME_MAX - 1);
+    } else if (strcmp(key, "cycles") == 0 && strtoul(value, NULL, 10) > 0 && strtoul(value, NULL, 10) <= UINT16_MAX) {
+        entry->cycles_per_frame = (uint16_t)strtoul(value, NULL, 10);
+    } else if (strcmp(key, "keys") == 0 && validKeymap(value)) {
+        memcpy(entry->keymap, value, KEYBOARD_SIZE);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Adds a ROM with its metadata. Returns 0 if out of memory.
+static int addItem(Pack *pack, const char *path, const RomPackEntry *entry) {
+    if (pack->item_count == pack->item_capacity) {
+        int capacity = pack->item_capacity ? pack->item_capacity * 2 : 1024;
+        PackItem *items = realloc(pack->items, (size_t)capacity * sizeof(PackItem));
+        if (items == NULL) {
+            return 0;
+        }
+        pack->items = items;
+        pack->item_capacity = capacity;
+    }
+
+    PackItem *item = &pack->items[pack->item_count];
+    item->path = strdup(path);
+    if (item->path == NULL) {
+        return 0;
+    }
+    item->name = strrchr(item->path, '/') ? strrchr(item->path, '/') + 1 : item->path;
+    item->entry = *entry;
+    pack->item_count++;
+    return 1;
+}
+
+/**
+ * @brief Adds the ROMs of a manifest, one per line: <path> [platform=...] [quirks=...] [cycles=...] [keys=...].
+ *
+ * Settings a line leaves out come from the command line.
+ *
+ * @return 1 on success, 0 on a malformed line or failure (reported on stderr).
+ */
+static int readManifest(Pack *pack, const char *path, const RomPackEntry *defaults) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open the manifest %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    char line[PACK_LINE_MAX];
+    int number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        number++;
+        char *rom = strtok(line, " \t\r\n");
+        if (rom == NULL || rom[0] == '#') {
+            continue;
+        }
+
+        RomPackEntry entry = *defaults;
+        char *setting;
+        while ((setting = strtok(NULL, " \t\r\n")) != NULL) {
+            char *equals = strchr(setting, '=');
+            if (equals != NULL) {
+                *equals = '\0';
+            }
+            if (equals == NULL || !applySetting(&entry, setting, equals + 1)) {
+                fprintf(stderr, "%s:%d: invalid setting %s\n", path, number, setting);
+                fclose(file);
+                return 0;
+            }
+        }
+        if (!addItem(pack, rom, &entry)) {
+            fprintf(stderr, "Out of memory\n");
+            fclose(file);
+            return 0;
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+// Stores a program once, returning the index of its blob, -1 if out of memory.
+static long storeProgram(Pack *pack, const Rom *rom) {
+    uint64_t hash = rom_pack_hash(rom->data, rom->size);
+    uint32_t mask = pack->slot_count - 1;
+    uint32_t slot = (uint32_t)hash & mask;
+    while (pack->slots[slot] != 0) {
+        const PackBlob *blob = &pack->blobs[pack->slots[slot] - 1];
+        if (blob->hash == hash && blob->size == rom->size &&
+            (rom->size == 0 || memcmp(pack->data + blob->offset, rom->data, rom->size) == 0)) {
+            return (long)(pack->slots[slot] - 1);
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    size_t offset = (pack->data_size + ROM_PACK_ALIGNMENT - 1) & ~(size_t)(ROM_PACK_ALIGNMENT - 1);
+    if (offset + rom->size > pack->data_capacity) {
+        size_t capacity = pack->data_capacity ? pack->data_capacity : 1 << 20;
+        while (capacity < offset + rom->size) {
+            capacity *= 2;
+        }
+        uint8_t *data = realloc(pack->data, capacity);
+        if (data == NULL) {
+            return -1;
+        }
+        pack->data = data;
+        pack->data_capacity = capacity;
+    }
+    if (offset > pack->data_size) {
+        memset(pack->data + pack->data_size, 0, offset - pack->data_size);
+    }
+    if (rom->size) {
+        memcpy(pack->data + offset, rom->data, rom->size);
+    }
+    pack->data_size = offset + rom->size;
+
+    PackBlob *blob = &pack->blobs[pack->blob_count];
+    blob->hash = hash;
+    blob->offset = offset;
+    blob->size = (uint32_t)rom->size;
+    blob->entry = UINT32_MAX;
+    pack->slots[slot] = ++pack->blob_count;
+    return (long)(pack->blob_count - 1);
+}
+
+// Orders items by the hash of their name, then by name.
+static int compareItems(const void *a, const void *b) {
+    const PackItem *left = a;
+    const PackItem *right = b;
+    if (left->entry.name_hash != right->entry.name_hash) {
+        return (left->entry.name_hash < right->entry.name_hash) ? -1 : 1;
+    }
+    return strcmp(left->name, right->name);
+}
+
+// Orders blob pointers by hash.
+static int compareBlobs(const void *a, const void *b) {
+    const PackBlob *left = *(const PackBlob *const *)a;
+    const PackBlob *right = *(const PackBlob *const *)b;
+    if (left->hash != right->hash) {
+        return (left->hash < right->hash) ? -1 : 1;
+    }
+    return (left->offset < right->offset) ? -1 : (left->offset > right->offset);
+}
+
+// Writes zero bytes until the file reaches an offset.
+static void padTo(FILE *file, uint64_t *position, uint64_t offset) {
+    static const uint8_t zeros[ROM_PACK_ALIGNMENT];
+    while (*position < offset) {
+        size_t count = (offset - *position < sizeof(zeros)) ? (size_t)(offset - *position) : sizeof(zeros);
+        fwrite(zeros, 1, count, file);
+        *position += count;
+    }
+}
+
+/**
+ * @brief Lays out the archive and writes it next to its path, then renames it into place.
+ *
+ * @return 1 on success, 0 on failure (reported on stderr).
+ */
+static int writePack(Pack *pack, const char *path) {
+    // Entry and blob tables, sorted for binary search
+    for (int i = 0; i < pack->item_count; i++) {
+        pack->items[i].entry.name_hash = rom_pack_hash(pack->items[i].name, strlen(pack->items[i].name));
+    }
+    qsort(pack->items, (size_t)pack->item_count, sizeof(PackItem), compareItems);
+    for (int i = 1; i < pack->item_count; i++) {
+        if (strcmp(pack->items[i - 1].name, pack->items[i].name) == 0) {
+            fprintf(stderr, "Two ROMs are named %s: %s and %s\n", pack->items[i].name, pack->items[i - 1].path,
+                    pack->items[i].path);
+            return 0;
+        }
+    }
+
+    PackBlob **sorted = malloc((pack->blob_count ? pack->blob_count : 1) * sizeof(PackBlob *));
+    if (sorted == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 0;
+    }
+    for (uint32_t i = 0; i < pack->blob_count; i++) {
+        sorted[i] = &pack->blobs[i];
+    }
+    qsort(sorted, pack->blob_count, sizeof(PackBlob *), compareBlobs);
+    for (uint32_t i = 0; i < pack->blob_count; i++) {
+        sorted[i]->index = i;
+    }
+    for (int i = 0; i < pack->item_count; i++) {
+        PackBlob *blob = &pack->blobs[pack->items[i].entry.blob];
+        pack->items[i].entry.blob = blob->index;
+        if (blob->entry == UINT32_MAX) {
+            blob->entry = (uint32_t)i;
+        }
+    }
+
+    // Header, tables, names, then the programs
+    uint64_t entries = sizeof(RomPackHeader);
+    uint64_t blobs = entries + (uint64_t)pack->item_count * sizeof(RomPackEntry);
+    uint64_t names = blobs + (uint64_t)pack->blob_count * sizeof(RomPackBlob);
+    uint64_t names_size = 0;
+    for (int i = 0; i < pack->item_count; i++) {
+        pack->items[i].entry.name = (uint32_t)(names + names_size);
+        names_size += strlen(pack->items[i].name) + 1;
+    }
+    uint64_t programs = (names + names_size + ROM_PACK_ALIGNMENT - 1) & ~(uint64_t)(ROM_PACK_ALIGNMENT - 1);
+    uint64_t size = programs + pack->data_size;
+    if (size > UINT32_MAX) {
+        fprintf(stderr, "The archive would exceed 4 GB\n");
+        free(sorted);
+        return 0;
+    }
+
+    // Readers that have the previous archive mapped keep it until they close it
+    size_t temporary_length = strlen(path) + 5;
+    char *temporary = malloc(temporary_length);
+    FILE *file = NULL;
+    if (temporary != NULL) {
+        snprintf(temporary, temporary_length, "%s.tmp", path);
+        file = fopen(temporary, "wb");
+    }
+    if (file == NULL) {
+        fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+        free(temporary);
+        free(sorted);
+        return 0;
+    }
+
+    RomPackHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ROM_PACK_MAGIC, sizeof(header.magic));
+    header.version = ROM_PACK_VERSION;
+    header.byte_order = ROM_PACK_BYTE_ORDER;
+    header.entry_count = (uint32_t)pack->item_count;
+    header.blob_count = pack->blob_count;
+    header.entries = (uint32_t)entries;
+    header.blobs = (uint32_t)blobs;
+    header.size = (uint32_t)size;
+    fwrite(&header, sizeof(header), 1, file);
+
+    for (int i = 0; i < pack->item_count; i++) {
+        fwrite(&pack->items[i].entry, sizeof(RomPackEntry), 1, file);
+    }
+    for (uint32_t i = 0; i < pack->blob_count; i++) {
+        RomPackBlob blob;
+        memset(&blob, 0, sizeof(blob));
+        blob.hash = sorted[i]->hash;
+        blob.offset = (uint32_t)(programs + sorted[i]->offset);
+        blob.size = sorted[i]->size;
+        blob.entry = sorted[i]->entry;
+        fwrite(&blob, sizeof(blob), 1, file);
+    }
+    for (int i = 0; i < pack->item_count; i++) {
+        fwrite(pack->items[i].name, 1, strlen(pack->items[i].name) + 1, file);
+    }
+    uint64_t position = names + names_size;
+    padTo(file, &position, programs);
+    fwrite(pack->data, 1, pack->data_size, file);
+    free(sorted);
+
+    int ok = !ferror(file);
+    ok &= fclose(file) == 0;
+    if (!ok || rename(temporary, path) != 0) {
+        fprintf(stderr, "Failed to write %s: %s\n", path, strerror(errno));
+        remove(temporary);
+        free(temporary);
+        return 0;
+    }
+    free(temporary);
+
+    printf("Packed %d ROMs, %" PRIu32 " distinct, into %s (%" PRIu64 " bytes)\n", pack->item_count, pack->blob_count,
+           path, size);
+    return 1;
+}
+
+// Prints the entries of an archive in index order.
+static int listPack(const char *path) {
+    RomPack pack;
+    if (!rom_pack_open(&pack, path)) {
+        return 0;
+    }
+
+    printf("%-16s %6s %-8s %-8s %6s %-16s %s\n", "hash", "size", "platform", "quirks", "cycles", "keys", "name");
+    for (uint32_t i = 0; i < pack.header->entry_count; i++) {
+        const RomPackEntry *entry = &pack.entries[i];
+        const RomPackBlob *blob = rom_pack_blob(&pack, entry);
+        const char *name = rom_pack_name(&pack, entry);
+        if (blob == NULL || name == NULL) {
+            fprintf(stderr, "Entry %" PRIu32 " of %s is corrupt\n", i, path);
+            rom_pack_close(&pack);
+            return 0;
+        }
+        printf("%016" PRIx64 " %6" PRIu32 " %-8.8s %-8.8s %6u %-16.16s %s\n", blob->hash, blob->size, entry->platform,
+               entry->quirks, entry->cycles_per_frame, entry->keymap[0] ? entry->keymap : "default", name);
+    }
+    printf("%" PRIu32 " ROMs, %" PRIu32 " distinct\n", pack.header->entry_count, pack.header->blob_count);
+    rom_pack_close(&pack);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    RomPackEntry defaults;
+    memset(&defaults, 0, sizeof(defaults));
+    applySetting(&defaults, "platform", "chip8");
+    const char *manifest = NULL;
+    int list = 0;
+
+    static struct option long_options[] = {
+        {"platform", required_argument, 0, 'p'},
+        {"quirks", required_argument, 0, 'q'},
+        {"cycles", required_argument, 0, 'c'},
+        {"keys", required_argument, 0, 'k'},
+        {"manifest", required_argument, 0, 'm'},
+        {"list", no_argument, 0, 'l'},
+        {0, 0, 0, 0}
+    };
+
+    // Settings apply in order, so --quirks goes after the --platform it overrides
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:q:c:k:m:l", long_options, NULL)) != -1) {
+        const char *key = NULL;
+        switch (opt) {
+            case 'p':
+                key = "platform";
+                break;
+            case 'q':
+                key = "quirks";
+                break;
+            case 'c':
+                key = "cycles";
+                break;
+            case 'k':
+                key = "keys";
+                break;
+            case 'm':
+                manifest = optarg;
+                break;
+            case 'l':
+                list = 1;
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+        if (key != NULL && !applySetting(&defaults, key, optarg)) {
+            fprintf(stderr, "Invalid --%s %s\n", key, optarg);
+            return 1;
+        }
+    }
+
+    if (list) {
+        if (optind != argc - 1) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return listPack(argv[optind]) ? 0 : 1;
+    }
+    if (optind >= argc || (optind == argc - 1 && manifest == NULL)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    static Pack pack;
+    RomQueue queue;
+    if (!rom_queue_init(&queue, argv + optind + 1, argc - optind - 1)) {
+        return 1;
+    }
+    for (int i = 0; i < queue.count; i++) {
+        if (!addItem(&pack, queue.paths[i], &defaults)) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+    }
+    rom_queue_free(&queue);
+    if (manifest != NULL && !readManifest(&pack, manifest, &defaults)) {
+        return 1;
+    }
+
+    // Twice as many slots as programs keeps the probes short
+    pack.slot_count = 1;
+    while (pack.slot_count < 2 * (uint32_t)pack.item_count) {
+        pack.slot_count *= 2;
+    }
+    pack.slots = calloc(pack.slot_count, sizeof(uint32_t));
+    pack.blobs = calloc((size_t)pack.item_count + 1, sizeof(PackBlob));
+    if (pack.slots == NULL || pack.blobs == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    for (int i = 0; i < pack.item_count; i++) {
+        Rom rom;
+        if (!rom_map(&rom, pack.items[i].path)) {
+            fprintf(stderr, "Failed to open %s: %s\n", pack.items[i].path, strerror(errno));
+            return 1;
+        }
+        long blob = storeProgram(&pack, &rom);
+        rom_unmap(&rom);
+        if (blob < 0) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        pack.items[i].entry.blob = (uint32_t)blob;
+    }
+
+    return writePack(&pack, argv[optind]) ? 0 : 1;
+}
@@ -1,71 +1,71 @@
 #include "../include/params.h"
+#include "../include/compositor.h"
+#include "../include/simd.h"
 
-/**
- * Convert raw hexadecimal string to program byte array.
- * 
- * @param hex_string Raw hexadecimal data as a string.
- * @param byte_array Pointer to the buffer where bytes will be stored.
- * @param program_size Pointer to a variable that will receive the program size.
- */
-void raw_data_to_program(const char *hex_string, uint8_t *byte_array, size_t *program_size) {
-    size_t length = strlen(hex_string);
-    size_t byte_array_size = 0;
-    const char *pos = hex_string;
-
-    for (size_t i = 0; i < length / 3 + 1 && byte_array_size < PROGRAM_MEMORY_SIZE; i++) {
-        if (sscanf(pos, "%2hhx", &byte_array[byte_array_size]) == 1) {
-            byte_array_size++;
-        }
-        pos += 3; // Move to the next byte
-    }
-    *program_size = byte_array_size;
-}
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-/**
- * Check if a file exists and is readable.
- * 
- * @param path Path to the file.
- * @return 1 if the file exists and is readable, 0 otherwise.
- */
-int file_exists_and_readable(const char *path) {
-    FILE *file = fopen(path, "r");
-    if (file) {
-        fclose(file);
-        return 1;
-    } else {
-        return 0;
-    }
-}
+// Class of each character: a hex digit is HEX_DIGIT | value, whitespace is HEX_SPACE, anything else 0.
+#define HEX_DIGIT 0x40
+#define HEX_SPACE 0x80
+
+static const uint8_t hex_classes[256] = {
+    ['0'] = HEX_DIGIT | 0x0, ['1'] = HEX_DIGIT | 0x1, ['2'] = HEX_DIGIT | 0x2, ['3'] = HEX_DIGIT | 0x3,
+    ['4'] = HEX_DIGIT | 0x4, ['5'] = HEX_DIGIT | 0x5, ['6'] = HEX_DIGIT | 0x6, ['7'] = HEX_DIGIT | 0x7,
+    ['8'] = HEX_DIGIT | 0x8, ['9'] = HEX_DIGIT | 0x9,
+    ['a'] = HEX_DIGIT | 0xA, ['b'] = HEX_DIGIT | 0xB, ['c'] = HEX_DIGIT | 0xC,
+    ['d'] = HEX_DIGIT | 0xD, ['e'] = HEX_DIGIT | 0xE, ['f'] = HEX_DIGIT | 0xF,
+    ['A'] = HEX_DIGIT | 0xA, ['B'] = HEX_DIGIT | 0xB, ['C'] = HEX_DIGIT | 0xC,
+    ['D'] = HEX_DIGIT | 0xD, ['E'] = HEX_DIGIT | 0xE, ['F'] = HEX_DIGIT | 0xF,
+    [' '] = HEX_SPACE, ['\t'] = HEX_SPACE, ['\n'] = HEX_SPACE, ['\v'] = HEX_SPACE, ['\f'] = HEX_SPACE, ['\r'] = HEX_SPACE,
+};
 
 /**
- * Validate the format of raw data.
+ * Validate and decode hexadecimal text in a single pass.
  * 
- * @param str Raw data string to validate.
- * @return 1 if the raw data is valid, 0 otherwise.
+ * @param text Hexadecimal text, not necessarily NUL terminated.
+ * @param length Length of the text.
+ * @param bytes Buffer receiving the bytes, NULL to only validate.
+ * @param capacity Number of bytes the program may have.
+ * @return Number of bytes, HEX_INVALID if the text is malformed, HEX_TOO_LARGE if it exceeds the capacity.
  */
-int is_raw_data_valid(const char *str) {
-    if (str == NULL || *str == '\0') {
-        return 0;
-    }
+long hex_decode(const char *text, size_t length, uint8_t *bytes, size_t capacity) {
+    const unsigned char *input = (const unsigned char *)text;
+    size_t size = 0;
+    size_t i = 0;
 
-    int len = strlen(str);
-    if (len % 3 != 2) {
-        return 0;
-    }
+    while (i < length) {
+        if (hex_classes[input[i]] & HEX_SPACE) {
+            i++;
+            continue;
+        }
 
-    for (int i = 0; i < len; i++) {
-        if (i % 3 == 2) {
-            if (str[i] != ' ') {
-                return 0;
+        // A word of digit pairs, optionally prefixed with 0x
+        if (input[i] == '0' && i + 1 < length && (input[i + 1] | 0x20) == 'x') {
+            i += 2;
+        }
+        size_t word = size;
+        while (i + 1 < length) {
+            uint8_t high = hex_classes[input[i]];
+            uint8_t low = hex_classes[input[i + 1]];
+            if (!(high & low & HEX_DIGIT)) {
+                break;
             }
-        } else {
-            if (!isxdigit(str[i])) {
-                return 0;
+            if (size == capacity) {
+                return HEX_TOO_LARGE;
             }
+            if (bytes != NULL) {
+                bytes[size] = (uint8_t)((high & 0x0F) << 4 | (low & 0x0F));
+            }
+            size++;
+            i += 2;
+        }
+        if (size == word || (i < length && !(hex_classes[input[i]] & HEX_SPACE))) {
+            return HEX_INVALID; // Empty word, odd number of digits or a stray character
         }
     }
-
-    return str[len - 1] != ' ';
+    return (long)size;
 }
 
 /**
@@ -99,6 +99,71 @@ void read_file_to_program(const char* file_path, uint8_t *program, size_t *progr
     }
 }
 
+/**
+ * Convert a platform name to its Chip8Platform value.
+ * 
+ * @param name Platform name (chip8, schip or xochip).
+ * @return The Chip8Platform value, 0 if the name is unknown.
+ */
+uint8_t parse_platform(const char *name) {
+    if (strcmp(name, "chip8") == 0) {
+        return PLATFORM_CHIP8;
+    } else if (strcmp(name, "schip") == 0) {
+        return PLATFORM_SCHIP;
+    } else if (strcmp(name, "xochip") == 0) {
+        return PLATFORM_XOCHIP;
+    }
+    return 0;
+}
+
+/**
+ * Convert a quirk profile name to its Chip8QuirkProfile value.
+ * 
+ * @param name Quirk profile name (chip8, vip, schip or xochip).
+ * @return The Chip8QuirkProfile value, -1 if the name is unknown.
+ */
+int parse_quirks(const char *name) {
+    for (int i = 0; i < QUIRK_PROFILE_AMOUNT; i++) {
+        if (strcmp(name, quirk_profile_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Parse a comma separated list of hexadecimal watch ranges, each <start>[:<length>].
+ * 
+ * @param text Watch range list.
+ * @param starts Receives the first address of each range.
+ * @param lengths Receives the length of each range, 1 if omitted.
+ * @param max Capacity of starts and lengths.
+ * @return Number of ranges, -1 if the list is malformed or too long.
+ */
+int parse_watchpoints(const char *text, uint16_t *starts, uint16_t *lengths, int max) {
+    int count = 0;
+    char *end;
+
+    while (*text) {
+        if (count == max || !isxdigit((unsigned char)*text)) {
+            return -1;
+        }
+        unsigned long start = strtoul(text, &end, 16);
+        unsigned long length = 1;
+        if (*end == ':') {
+            length = strtoul(end + 1, &end, 16);
+        }
+        if (start >= RAM_SIZE || length == 0 || length > RAM_SIZE || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        starts[count] = (uint16_t)start;
+        lengths[count] = (uint16_t)length;
+        count++;
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
 /**
  * Parse command-line arguments.
  * 
@@ -108,17 +173,29 @@ void read_file_to_program(const char* file_path, uint8_t *program, size_t *progr
  */
 void get_args(Arguments *args, int argc, char *argv[]) {
     int opt;
-    char *usage = ERROR_MSG "\nUsage: %s --ui <terminal>/<window> --type <file>/<raw> --data <path to file>/<bytes>\n";
+    char *usage = ERROR_MSG "\nUsage: %s --ui <terminal>/<window>/<headless> --type <file>/<raw>/<pack> --data <path to file>/<bytes>/<->/<archive:name> [--platform <chip8>/<schip>/<xochip>] [--quirks <chip8>/<vip>/<schip>/<xochip>] [--frames <count>] [--gdb <port>/<socket path>] [--watch <start>[:<length>],...] [--record <file.y4m>/<file.gif>/<file.c8r>] [--stream <port>/<host:port>/<socket path>] [--stats <port>/<host:port>/<socket path>] [--trace <file.json>] [--filter <nearest>/<scale2x>] [--phosphor] [--force-isa <scalar>/<sse2>/<avx2>/<avx512>/<neon>]\n";
 
     static struct option long_options[] = {
         {"ui", required_argument, 0, 'u'},
         {"type", required_argument, 0, 't'},
         {"data", required_argument, 0, 'd'},
+        {"platform", required_argument, 0, 'p'},
+        {"quirks", required_argument, 0, 'q'},
+        {"frames", required_argument, 0, 'f'},
+        {"gdb", required_argument, 0, 'g'},
+        {"watch", required_argument, 0, 'w'},
+        {"record", required_argument, 0, 'r'},
+        {"stream", required_argument, 0, 's'},
+        {"stats", required_argument, 0, 'S'},
+        {"trace", required_argument, 0, 'T'},
+        {"filter", required_argument, 0, 'F'},
+        {"phosphor", no_argument, 0, 'P'},
+        {"force-isa", required_argument, 0, 'I'},
         {0, 0, 0, 0}
     };
 
     int option_index = 0;
-    while ((opt = getopt_long(argc, argv, "u:t:d:", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "u:t:d:p:q:f:g:w:r:s:S:T:F:PI:", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'u':
                 args->ui = optarg;
@@ -129,6 +206,42 @@ void get_args(Arguments *args, int argc, char *argv[]) {
             case 'd':
                 args->data = optarg;
                 break;
+            case 'p':
+                args->platform = optarg;
+                break;
+            case 'q':
+                args->quirks = optarg;
+                break;
+            case 'f':
+                args->frames = strtoul(optarg, NULL, 10);
+                break;
+            case 'g':
+                args->gdb = optarg;
+                break;
+            case 'w':
+                args->watch = optarg;
+                break;
+            case 'r':
+                args->record = optarg;
+                break;
+            case 's':
+                args->stream = optarg;
+                break;
+            case 'S':
+                args->stats = optarg;
+                break;
+            case 'T':
+                args->trace = optarg;
+                break;
+            case 'F':
+                args->filter = optarg;
+                break;
+            case 'P':
+                args->phosphor = 1;
+                break;
+            case 'I':
+                args->isa = optarg;
+                break;
             default:
                 fprintf(stderr, usage, argv[0]);
                 exit(1);
@@ -140,58 +253,228 @@ void get_args(Arguments *args, int argc, char *argv[]) {
         exit(1);
     }
 
+    if (args->filter == NULL) {
+        args->filter = "nearest";
+    }
+
     args->result = 0;
 }
 
 /**
  * Handle command-line arguments and load program data accordingly.
  * 
+ * The platform and quirk profile default to those of the program.
+ * 
  * @param args Pointer to the Arguments structure containing parsed arguments.
  * @param program_data Pointer to the Data structure to store the loaded program.
  */
-void handle_args(const Arguments *args, Data *program_data) {
+void handle_args(Arguments *args, Data *program_data) {
     if (args->result == 1) {
         exit(1);
     }
+    if (parse_filter(args->filter) < 0) {
+        fprintf(stderr, ERROR_MSG);
+        fprintf(stderr, "Invalid filter option. Usage: --filter <nearest>/<scale2x>\n");
+        exit(1);
+    }
+    if (args->isa != NULL && (parse_isa(args->isa) < 0 || !simd_force((SimdIsa)parse_isa(args->isa)))) {
+        fprintf(stderr, ERROR_MSG);
+        fprintf(stderr, "Invalid force-isa option, or one this build or host cannot run. Usage: --force-isa <scalar>/<sse2>/<avx2>/<avx512>/<neon>\n");
+        exit(1);
+    }
+    if (args->watch != NULL) {
+        uint16_t starts[WATCH_MAX_POINTS];
+        uint16_t lengths[WATCH_MAX_POINTS];
+        if (parse_watchpoints(args->watch, starts, lengths, WATCH_MAX_POINTS) < 0) {
+            fprintf(stderr, ERROR_MSG);
+            fprintf(stderr, "Invalid watch option. Usage: --watch <start>[:<length>],... (hexadecimal, at most %d ranges)\n", WATCH_MAX_POINTS);
+            exit(1);
+        }
+    }
+    memset(&program_data->pack, 0, sizeof(program_data->pack));
+    memset(&program_data->entry, 0, sizeof(program_data->entry));
     if (strstr(args->type, "raw") != NULL) {
         handle_raw_program_data(args->data, program_data);
     } else if (strstr(args->type, "file") != NULL) {
         handle_file_program_data(args->data, program_data);
+    } else if (strstr(args->type, "pack") != NULL) {
+        handle_pack_program_data(args->data, program_data);
     } else {
         fprintf(stderr, ERROR_MSG);
-        fprintf(stderr, "Invalid type option. Usage: --type <file>/<raw>\n");
+        fprintf(stderr, "Invalid type option. Usage: --type <file>/<raw>/<pack>\n");
+        exit(1);
+    }
+
+    // Options given on the command line win over the ones stored with the program
+    if (args->platform == NULL) {
+        args->platform = program_data->entry.platform[0] ? program_data->entry.platform : "chip8";
+    }
+    if (args->quirks == NULL) {
+        // Every platform has a quirk profile of the same name
+        args->quirks = program_data->entry.quirks[0] ? program_data->entry.quirks : args->platform;
+    }
+    if (parse_platform(args->platform) == 0) {
+        fprintf(stderr, ERROR_MSG);
+        fprintf(stderr, "Invalid platform option. Usage: --platform <chip8>/<schip>/<xochip>\n");
+        exit(1);
+    }
+    if (parse_quirks(args->quirks) < 0) {
+        fprintf(stderr, ERROR_MSG);
+        fprintf(stderr, "Invalid quirks option. Usage: --quirks <chip8>/<vip>/<schip>/<xochip>\n");
+        exit(1);
+    }
+
+    // Loading would cut the program short instead
+    size_t capacity = chip8_program_capacity(parse_platform(args->platform));
+    if (program_data->program_size > capacity) {
+        fprintf(stderr, ERROR_MSG);
+        fprintf(stderr, "The program has %zu bytes, the %s platform has room for %zu\n",
+                program_data->program_size, args->platform, capacity);
         exit(1);
     }
 }
 
+/**
+ * Read a whole stream of text, such as a pipe, into memory.
+ * 
+ * @param stream Stream to read until its end.
+ * @param length Pointer to a variable that will receive the length of the text.
+ * @return The NUL terminated text, to be freed by the caller, NULL on failure or if it exceeds RAW_TEXT_MAX.
+ */
+char *read_text_stream(FILE *stream, size_t *length) {
+    size_t capacity = 4096;
+    size_t size = 0;
+    char *text = malloc(capacity);
+
+    while (text != NULL) {
+        size += fread(text + size, 1, capacity - size - 1, stream);
+        if (size < capacity - 1) {
+            break; // End of the stream or an error
+        }
+        char *grown = (capacity < RAW_TEXT_MAX) ? realloc(text, capacity * 2) : NULL;
+        if (grown == NULL) {
+            free(text);
+            return NULL;
+        }
+        text = grown;
+        capacity *= 2;
+    }
+    if (text == NULL || ferror(stream)) {
+        free(text);
+        return NULL;
+    }
+    text[size] = '\0';
+    *length = size;
+    return text;
+}
+
 /**
  * Handle raw program data and load it into the program buffer.
  * 
- * @param data Raw hexadecimal data as a string.
+ * @param data Raw hexadecimal data as a string, "-" to read it from stdin.
  * @param program_data Pointer to the Data structure to store the loaded program.
  */
 void handle_raw_program_data(const char *data, Data *program_data) {
-    if (is_raw_data_valid(data)) {
-        raw_data_to_program(data, program_data->program, &program_data->program_size);
+    char *text = NULL;
+    size_t length = 0;
+
+    if (strcmp(data, "-") == 0) {
+        text = read_text_stream(stdin, &length);
+        if (text == NULL) {
+            fprintf(stderr, ERROR_MSG);
+            fprintf(stderr, "Failed to read raw data from stdin\n");
+            exit(1);
+        }
+        // Keys of the terminal display are read from stdin, which the program used up
+        int tty = isatty(STDIN_FILENO) ? -1 : open("/dev/tty", O_RDONLY);
+        if (tty >= 0) {
+            dup2(tty, STDIN_FILENO);
+            close(tty);
+            clearerr(stdin);
+        }
+        data = text;
     } else {
+        length = strlen(data);
+    }
+
+    long size = hex_decode(data, length, program_data->buffer, PROGRAM_MEMORY_SIZE);
+    free(text);
+    if (size <= 0) {
         fprintf(stderr, ERROR_MSG);
-        fprintf(stderr, "Invalid raw data\n");
+        if (size == HEX_TOO_LARGE) {
+            fprintf(stderr, "Raw data exceeds the %d bytes of program memory\n", PROGRAM_MEMORY_SIZE);
+        } else {
+            fprintf(stderr, "Invalid raw data\n");
+        }
         exit(1);
     }
+    program_data->program = program_data->buffer;
+    program_data->program_size = (size_t)size;
 }
 
 /**
- * Handle file-based program data and load it into the program buffer.
+ * Handle file-based program data by mapping the file.
  * 
  * @param data Path to the program file.
  * @param program_data Pointer to the Data structure to store the loaded program.
  */
 void handle_file_program_data(const char *data, Data *program_data) {
-    if (file_exists_and_readable(data)) {
-        read_file_to_program(data, program_data->program, &program_data->program_size);
+    if (rom_map(&program_data->rom, data)) {
+        program_data->program = program_data->rom.data ? program_data->rom.data : program_data->buffer;
+        program_data->program_size = program_data->rom.size;
     } else {
         fprintf(stderr, ERROR_MSG);
-        fprintf(stderr, "Invalid file path\n");
+        fprintf(stderr, "Invalid file path %s: %s\n", data, strerror(errno));
+        exit(1);
+    }
+}
+
+/**
+ * Handle program data from a ROM pack by mapping the archive.
+ * 
+ * @param data Path to the archive and name or content hash of the program, <archive>:<name>.
+ * @param program_data Pointer to the Data structure to store the loaded program.
+ */
+void handle_pack_program_data(const char *data, Data *program_data) {
+    // Archive paths may hold colons, names may not
+    const char *separator = strrchr(data, ':');
+    if (separator == NULL || separator == data || separator[1] == '\0') {
+        fprintf(stderr, ERROR_MSG);
+        fprintf(stderr, "Invalid pack data %s. Usage: --data <archive>:<name or content hash>\n", data);
+        exit(1);
+    }
+    char *path = strndup(data, (size_t)(separator - data));
+    if (path == NULL || !rom_pack_open(&program_data->pack, path)) {
+        free(path);
+        fprintf(stderr, ERROR_MSG);
         exit(1);
     }
+    free(path);
+
+    const RomPackEntry *entry = rom_pack_lookup(&program_data->pack, separator + 1);
+    if (entry == NULL || !rom_pack_rom(&program_data->pack, entry, &program_data->rom)) {
+        fprintf(stderr, ERROR_MSG);
+        fprintf(stderr, "%s\n", (entry == NULL) ? "No such program in the ROM pack" : "Corrupt ROM pack");
+        rom_pack_close(&program_data->pack);
+        exit(1);
+    }
+
+    // Names are NUL padded, a full field from a damaged archive must not run past it
+    program_data->entry = *entry;
+    program_data->entry.platform[ROM_PACK_NAME_MAX - 1] = '\0';
+    program_data->entry.quirks[ROM_PACK_NAME_MAX - 1] = '\0';
+    program_data->program = program_data->rom.data ? program_data->rom.data : program_data->buffer;
+    program_data->program_size = program_data->rom.size;
+}
+
+/**
+ * Release the memory of a program once it is loaded into RAM.
+ * 
+ * @param program_data Pointer to the Data structure holding the program.
+ */
+void free_program_data(Data *program_data) {
+    rom_unmap(&program_data->rom);
+    rom_pack_close(&program_data->pack);
+    program_data->program = NULL;
+    program_data->program_size = 0;
 }
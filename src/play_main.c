@@ -0,0 +1,160 @@
+#include "../include/recorder.h"
+#include "../include/display.h"
+#include "../include/display_row.h"
+
+#include <getopt.h>
+
+static void printUsage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [--ui <terminal>/<window>] <recording.c8r>\n", program_name);
+}
+
+/**
+ * @brief Reads one LEB128 varint.
+ *
+ * @param file Recording to read from.
+ * @param value Receives the value.
+ * @return 1 on success, 0 at the end of the file or on a malformed varint.
+ */
+static int readVarint(FILE *file, uint32_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int byte = fgetc(file);
+        if (byte == EOF) {
+            return 0;
+        }
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Applies the next record of a recording to the display of an instance.
+ *
+ * @param file Recording to read from, positioned at a record.
+ * @param chip8 Instance whose first bitplane holds the previous image.
+ * @param duration Receives the number of frames the image stays on screen.
+ * @return 1 on success, 0 at the end of the recording, -1 if it is malformed.
+ */
+static int readRecord(FILE *file, Chip8 *chip8, uint32_t *duration) {
+    if (!readVarint(file, duration)) {
+        return 0;
+    }
+    int hires = fgetc(file);
+    if (hires != 0 && hires != 1) {
+        return -1;
+    }
+    if (hires != chip8->hires) {
+        memset(chip8->display, 0, sizeof(chip8->display));
+        chip8->hires = (uint8_t)hires;
+    }
+
+    int width = chip8_display_width(chip8);
+    uint32_t total = (uint32_t)width * chip8_display_height(chip8);
+    uint32_t position = 0;
+    uint8_t toggling = 0;
+    while (position < total) {
+        uint32_t run;
+        if (!readVarint(file, &run) || run > total - position) {
+            return -1;
+        }
+        if (toggling) {
+            for (uint32_t pixel = position; pixel < position + run; pixel++) {
+                DisplayRow *row = &chip8->display[0][pixel / width];
+                uint8_t x = (uint8_t)(pixel % width);
+                display_row_set(row, x, !display_row_get(*row, x));
+            }
+        }
+        position += run;
+        toggling = !toggling;
+    }
+
+    chip8->display_changed = 1;
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *ui = "terminal";
+
+    static struct option long_options[] = {
+        {"ui", required_argument, 0, 'u'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "u:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'u':
+                ui = optarg;
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc - 1 || (strcmp(ui, "terminal") != 0 && strcmp(ui, "window") != 0)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[optind], "rb");
+    if (file == NULL) {
+        perror("Failed to open the recording");
+        return 1;
+    }
+
+    char magic[4];
+    int rate;
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, RECORDER_RLE_MAGIC, sizeof(magic)) != 0 ||
+        fgetc(file) != RECORDER_RLE_VERSION || (rate = fgetc(file)) <= 0) {
+        fprintf(stderr, "%s is not a .c8r recording\n", argv[optind]);
+        fclose(file);
+        return 1;
+    }
+
+    // Only the display of the instance is used
+    static Chip8 chip8;
+    Display display;
+    int window = strcmp(ui, "window") == 0;
+    if (window) {
+        initSDL();
+        display = createDisplay();
+    }
+
+    uint32_t duration;
+    int status = 0;
+    uint8_t quit = 0;
+    while (!quit && (status = readRecord(file, &chip8, &duration)) > 0) {
+        if (window) {
+            show_sdl_display(&display, &chip8);
+        } else {
+            show_terminal_display(&chip8);
+        }
+
+        // Keep the image on screen for its frames, still reacting to the window closing
+        Uint32 end = SDL_GetTicks() + (Uint32)((uint64_t)duration * 1000 / (unsigned)rate);
+        while (!quit && (Sint32)(end - SDL_GetTicks()) > 0) {
+            SDL_Event e;
+            while (window && SDL_PollEvent(&e) != 0) {
+                if (e.type == SDL_QUIT) {
+                    quit = 1;
+                }
+            }
+            SDL_Delay(1);
+        }
+    }
+
+    if (window) {
+        removeDisplay(&display);
+    }
+    fclose(file);
+
+    if (!quit && status < 0) {
+        fprintf(stderr, "Malformed record in %s\n", argv[optind]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,396 @@
+#include "../include/recorder.h"
+#include "../include/display.h"
+#include "../include/display_row.h"
+#include "../include/trace.h"
+
+// GIF LZW parameters for a 4-color image.
+#define GIF_MIN_CODE_SIZE 2
+#define GIF_CLEAR_CODE (1 << GIF_MIN_CODE_SIZE)
+#define GIF_MAX_CODES 4096
+
+// Display colors, indexed by pixel state.
+static const uint8_t recorder_colors[1 << DISPLAY_PLANES][3] = {
+    { ZERO_R, ZERO_G, ZERO_B },
+    { ONE_R, ONE_G, ONE_B },
+    { TWO_R, TWO_G, TWO_B },
+    { THREE_R, THREE_G, THREE_B },
+};
+
+// Bytes of an LZW code stream, written as GIF sub-blocks of up to 255 bytes.
+typedef struct {
+    FILE *file;
+    uint8_t block[255];
+    int block_size;
+    uint32_t bits;
+    int bit_count;
+} GifStream;
+
+// Writes one LEB128 varint.
+static void recorder_put_varint(FILE *file, uint32_t value) {
+    while (value >= 0x80) {
+        fputc((int)((value & 0x7F) | 0x80), file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+// Writes a little-endian 16-bit value.
+static void recorder_put_u16(FILE *file, uint16_t value) {
+    fputc(value & 0xFF, file);
+    fputc(value >> 8, file);
+}
+
+// Converts a frame into pixel states at the recorded size, doubling low resolution pixels.
+static void recorder_canvas(const RecorderFrame *frame, uint8_t canvas[RECORDER_HEIGHT][RECORDER_WIDTH]) {
+    int scale = frame->hires ? 1 : 2;
+
+    for (int y = 0; y < RECORDER_HEIGHT; y++) {
+        for (int x = 0; x < RECORDER_WIDTH; x++) {
+            uint8_t state = 0;
+            for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+                state |= display_row_get(frame->display[plane][y / scale], (uint8_t)(x / scale)) << plane;
+            }
+            canvas[y][x] = state;
+        }
+    }
+}
+
+// Writes the Y4M stream header.
+static void recorder_y4m_header(FILE *file) {
+    fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", RECORDER_WIDTH, RECORDER_HEIGHT, TIMER_FREQUENCY);
+}
+
+// Writes a frame once per emulated frame it stays on screen, keeping the frame rate constant.
+static void recorder_y4m_frame(FILE *file, uint8_t canvas[RECORDER_HEIGHT][RECORDER_WIDTH], uint32_t duration) {
+    static uint8_t planes[RECORDER_WIDTH * RECORDER_HEIGHT * 3 / 2];
+    uint8_t *luma = planes;
+    uint8_t *cb = planes + RECORDER_WIDTH * RECORDER_HEIGHT;
+    uint8_t *cr = cb + RECORDER_WIDTH * RECORDER_HEIGHT / 4;
+
+    // Full range BT.601, chroma averaged over 2x2 pixels
+    for (int y = 0; y < RECORDER_HEIGHT; y++) {
+        for (int x = 0; x < RECORDER_WIDTH; x++) {
+            const uint8_t *rgb = recorder_colors[canvas[y][x]];
+            luma[y * RECORDER_WIDTH + x] = (uint8_t)((299 * rgb[0] + 587 * rgb[1] + 114 * rgb[2] + 500) / 1000);
+        }
+    }
+    for (int y = 0; y < RECORDER_HEIGHT; y += 2) {
+        for (int x = 0; x < RECORDER_WIDTH; x += 2) {
+            int r = 0, g = 0, b = 0;
+            for (int i = 0; i < 4; i++) {
+                const uint8_t *rgb = recorder_colors[canvas[y + i / 2][x + i % 2]];
+                r += rgb[0];
+                g += rgb[1];
+                b += rgb[2];
+            }
+            int index = (y / 2) * (RECORDER_WIDTH / 2) + x / 2;
+            cb[index] = (uint8_t)(128 + (-168736 * r - 331264 * g + 500000 * b) / 4000000);
+            cr[index] = (uint8_t)(128 + (500000 * r - 418688 * g - 81312 * b) / 4000000);
+        }
+    }
+
+    for (uint32_t i = 0; i < duration; i++) {
+        fputs("FRAME\n", file);
+        fwrite(planes, 1, sizeof(planes), file);
+    }
+}
+
+// Writes the GIF header, the display colors and the looping extension.
+static void recorder_gif_header(FILE *file) {
+    fputs("GIF89a", file);
+    recorder_put_u16(file, RECORDER_WIDTH);
+    recorder_put_u16(file, RECORDER_HEIGHT);
+    fputc(0x91, file); // Global color table of 4 entries, 2 bits per primary
+    fputc(0, file);    // Background color
+    fputc(0, file);    // Square pixels
+    fwrite(recorder_colors, 1, sizeof(recorder_colors), file);
+
+    // NETSCAPE2.0 application extension: loop forever
+    fputs("\x21\xFF\x0BNETSCAPE2.0\x03\x01", file);
+    recorder_put_u16(file, 0);
+    fputc(0, file);
+}
+
+// Writes the filled part of a sub-block.
+static void gif_flush_block(GifStream *stream) {
+    if (stream->block_size > 0) {
+        fputc(stream->block_size, stream->file);
+        fwrite(stream->block, 1, (size_t)stream->block_size, stream->file);
+        stream->block_size = 0;
+    }
+}
+
+// Appends a code of the given width, least significant bit first.
+static void gif_put_code(GifStream *stream, uint16_t code, int size) {
+    stream->bits |= (uint32_t)code << stream->bit_count;
+    stream->bit_count += size;
+    while (stream->bit_count >= 8) {
+        stream->block[stream->block_size++] = (uint8_t)(stream->bits & 0xFF);
+        stream->bits >>= 8;
+        stream->bit_count -= 8;
+        if (stream->block_size == (int)sizeof(stream->block)) {
+            gif_flush_block(stream);
+        }
+    }
+}
+
+// Writes one image with its display time in 1/100 s.
+static void recorder_gif_image(FILE *file, uint8_t canvas[RECORDER_HEIGHT][RECORDER_WIDTH], uint16_t delay) {
+    static uint16_t children[GIF_MAX_CODES][1 << DISPLAY_PLANES]; // Code of each prefix + pixel, 0 if unassigned
+    GifStream stream = { file, { 0 }, 0, 0, 0 };
+
+    // Graphic control extension holding the delay, then the image descriptor
+    fputs("\x21\xF9\x04", file);
+    fputc(0x04, file); // Leave the image in place for the next one
+    recorder_put_u16(file, delay);
+    fputc(0, file);
+    fputc(0, file);
+    fputc(0x2C, file);
+    recorder_put_u16(file, 0);
+    recorder_put_u16(file, 0);
+    recorder_put_u16(file, RECORDER_WIDTH);
+    recorder_put_u16(file, RECORDER_HEIGHT);
+    fputc(0, file);
+    fputc(GIF_MIN_CODE_SIZE, file);
+
+    const uint8_t *pixels = &canvas[0][0];
+    int size = GIF_MIN_CODE_SIZE + 1;
+    uint16_t last_code = GIF_CLEAR_CODE + 1;
+    uint16_t prefix = pixels[0];
+
+    memset(children, 0, sizeof(children));
+    gif_put_code(&stream, GIF_CLEAR_CODE, size);
+
+    for (int i = 1; i < RECORDER_WIDTH * RECORDER_HEIGHT; i++) {
+        uint8_t pixel = pixels[i];
+        if (children[prefix][pixel] != 0) {
+            prefix = children[prefix][pixel];
+            continue;
+        }
+
+        gif_put_code(&stream, prefix, size);
+        children[prefix][pixel] = ++last_code;
+        if (last_code >= (1 << size)) {
+            size++;
+        }
+        if (last_code == GIF_MAX_CODES - 1) {
+            // Table full: start over
+            gif_put_code(&stream, GIF_CLEAR_CODE, size);
+            memset(children, 0, sizeof(children));
+            size = GIF_MIN_CODE_SIZE + 1;
+            last_code = GIF_CLEAR_CODE + 1;
+        }
+        prefix = pixel;
+    }
+
+    // The decoder adds a table entry for the last code too, which can widen the end code
+    gif_put_code(&stream, prefix, size);
+    if (last_code + 1 >= (1 << size) && size < 12) {
+        size++;
+    }
+    gif_put_code(&stream, GIF_CLEAR_CODE + 1, size);
+    if (stream.bit_count > 0) {
+        gif_put_code(&stream, 0, 8 - stream.bit_count);
+    }
+    gif_flush_block(&stream);
+    fputc(0, file); // Block terminator
+}
+
+// Converts a frame number into 1/100 s since the start, rounded.
+static uint32_t recorder_centiseconds(uint32_t frame) {
+    return (uint32_t)(((uint64_t)frame * 100 + TIMER_FREQUENCY / 2) / TIMER_FREQUENCY);
+}
+
+// Writes a GIF image unless it is shown too briefly, in which case the next image takes its time.
+static void recorder_gif_frame(Recorder *recorder, uint8_t canvas[RECORDER_HEIGHT][RECORDER_WIDTH],
+                               uint32_t end, uint8_t last) {
+    uint32_t delay = recorder_centiseconds(end) - recorder_centiseconds(recorder->gif_start);
+    if (delay < RECORDER_GIF_MIN_DELAY && !last) {
+        return;
+    }
+
+    while (delay > UINT16_MAX) {
+        recorder_gif_image(recorder->file, canvas, UINT16_MAX);
+        delay -= UINT16_MAX;
+    }
+    recorder_gif_image(recorder->file, canvas, (uint16_t)delay);
+    recorder->gif_start = end;
+}
+
+// Writes a run-length encoded record of the pixels that toggled since the previous one.
+static void recorder_rle_frame(Recorder *recorder, const RecorderFrame *frame, uint32_t duration) {
+    int width = frame->hires ? DISPLAY_HIRES_WIDTH : DISPLAY_WIDTH;
+    int height = frame->hires ? DISPLAY_HIRES_HEIGHT : DISPLAY_HEIGHT;
+
+    if (frame->hires != recorder->previous_hires) {
+        memset(recorder->previous, 0, sizeof(recorder->previous));
+        recorder->previous_hires = frame->hires;
+    }
+
+    recorder_put_varint(recorder->file, duration);
+    fputc(frame->hires, recorder->file);
+
+    uint8_t toggling = 0;
+    uint32_t run = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t lit = 0;
+            for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+                lit |= display_row_get(frame->display[plane][y], (uint8_t)x);
+            }
+            if ((lit != recorder->previous[y][x]) != toggling) {
+                recorder_put_varint(recorder->file, run);
+                toggling = !toggling;
+                run = 0;
+            }
+            recorder->previous[y][x] = lit;
+            run++;
+        }
+    }
+    recorder_put_varint(recorder->file, run);
+}
+
+// Encodes a frame that stays on screen from its frame number until the end frame.
+static void recorder_encode(Recorder *recorder, const RecorderFrame *frame, uint32_t end, uint8_t last) {
+    static uint8_t canvas[RECORDER_HEIGHT][RECORDER_WIDTH];
+    uint32_t duration = (end > frame->frame) ? end - frame->frame : 1;
+
+    switch (recorder->format) {
+        case RECORDER_Y4M:
+            recorder_canvas(frame, canvas);
+            recorder_y4m_frame(recorder->file, canvas, duration);
+            break;
+        case RECORDER_GIF:
+            recorder_canvas(frame, canvas);
+            recorder_gif_frame(recorder, canvas, frame->frame + duration, last);
+            break;
+        case RECORDER_RLE:
+            recorder_rle_frame(recorder, frame, duration);
+            break;
+    }
+}
+
+// Encoder thread: a frame is written once the next one tells how long it stayed on screen.
+static int recorder_thread(void *data) {
+    Recorder *recorder = (Recorder *)data;
+    RecorderFrame current;
+    uint8_t has_current = 0;
+
+    trace_thread_name("recorder");
+    for (;;) {
+        int tail = SDL_AtomicGet(&recorder->ring.tail);
+        if (tail == SDL_AtomicGet(&recorder->ring.head)) {
+            if (SDL_AtomicGet(&recorder->stopping)) {
+                break;
+            }
+            SDL_SemWaitTimeout(recorder->wake, 100);
+            continue;
+        }
+
+        const RecorderFrame *next = &recorder->ring.frames[tail & (RECORDER_RING_SIZE - 1)];
+        if (has_current) {
+            trace_begin("encode");
+            recorder_encode(recorder, &current, next->frame, 0);
+            trace_end();
+        } else {
+            recorder->gif_start = next->frame;
+        }
+        current = *next;
+        has_current = 1;
+        SDL_AtomicSet(&recorder->ring.tail, tail + 1);
+    }
+
+    if (has_current) {
+        recorder_encode(recorder, &current, recorder->end_frame, 1);
+    }
+    if (recorder->format == RECORDER_GIF) {
+        fputc(0x3B, recorder->file); // Trailer
+    }
+    return 0;
+}
+
+// Creates the output file and starts the encoder thread.
+int recorder_open(Recorder *recorder, const char *path) {
+    const char *extension = strrchr(path, '.');
+
+    memset(recorder, 0, sizeof(*recorder));
+    if (extension != NULL && strcmp(extension, ".y4m") == 0) {
+        recorder->format = RECORDER_Y4M;
+    } else if (extension != NULL && strcmp(extension, ".gif") == 0) {
+        recorder->format = RECORDER_GIF;
+    } else if (extension != NULL && strcmp(extension, ".c8r") == 0) {
+        recorder->format = RECORDER_RLE;
+    } else {
+        fprintf(stderr, "Unknown recording format of %s, expected .y4m, .gif or .c8r\n", path);
+        return 0;
+    }
+
+    recorder->file = fopen(path, "wb");
+    if (recorder->file == NULL) {
+        perror("Failed to create the recording");
+        return 0;
+    }
+
+    switch (recorder->format) {
+        case RECORDER_Y4M:
+            recorder_y4m_header(recorder->file);
+            break;
+        case RECORDER_GIF:
+            recorder_gif_header(recorder->file);
+            break;
+        case RECORDER_RLE:
+            fputs(RECORDER_RLE_MAGIC, recorder->file);
+            fputc(RECORDER_RLE_VERSION, recorder->file);
+            fputc(TIMER_FREQUENCY, recorder->file);
+            break;
+    }
+
+    recorder->wake = SDL_CreateSemaphore(0);
+    recorder->thread = (recorder->wake != NULL) ? SDL_CreateThread(recorder_thread, "recorder", recorder) : NULL;
+    if (recorder->thread == NULL) {
+        fprintf(stderr, "Recorder thread could not start! SDL_Error: %s\n", SDL_GetError());
+        if (recorder->wake != NULL) {
+            SDL_DestroySemaphore(recorder->wake);
+        }
+        fclose(recorder->file);
+        return 0;
+    }
+    return 1;
+}
+
+// Queues the display at the end of an emulated frame, skipping unchanged frames.
+void recorder_push_frame(Recorder *recorder, const Chip8 *chip8, uint32_t frame) {
+    recorder->end_frame = frame + 1;
+    if (recorder->has_last && recorder->last.hires == chip8->hires &&
+        memcmp(recorder->last.display, chip8->display, sizeof(chip8->display)) == 0) {
+        return;
+    }
+
+    int head = SDL_AtomicGet(&recorder->ring.head);
+    if (head - SDL_AtomicGet(&recorder->ring.tail) >= RECORDER_RING_SIZE) {
+        recorder->dropped++; // The encoder is behind, the previous frame stays on screen longer
+        return;
+    }
+
+    RecorderFrame *slot = &recorder->ring.frames[head & (RECORDER_RING_SIZE - 1)];
+    slot->frame = frame;
+    slot->hires = chip8->hires;
+    memcpy(slot->display, chip8->display, sizeof(slot->display));
+    recorder->last = *slot;
+    recorder->has_last = 1;
+    recorder->pushed++;
+
+    SDL_AtomicSet(&recorder->ring.head, head + 1);
+    SDL_SemPost(recorder->wake);
+}
+
+// Encodes the queued frames, finishes the file and stops the encoder thread.
+void recorder_close(Recorder *recorder) {
+    SDL_AtomicSet(&recorder->stopping, 1);
+    SDL_SemPost(recorder->wake);
+    SDL_WaitThread(recorder->thread, NULL);
+    SDL_DestroySemaphore(recorder->wake);
+    fclose(recorder->file);
+
+    printf("Recorded %u frames, %u dropped\n", recorder->pushed, recorder->dropped);
+}
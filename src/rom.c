@@ -0,0 +1,276 @@
+#include "../include/rom.h"
+#include "../include/chip8_snapshot.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Adds a path the queue takes ownership of. Returns 0 if out of memory, freeing the path.
+static int rom_queue_add(RomQueue *queue, int *capacity, char *path) {
+    if (path == NULL) {
+        return 0;
+    }
+    if (queue->count == *capacity) {
+        int grown_capacity = *capacity ? *capacity * 2 : 64;
+        char **grown = realloc(queue->paths, (size_t)grown_capacity * sizeof(char *));
+        if (grown == NULL) {
+            free(path);
+            return 0;
+        }
+        queue->paths = grown;
+        *capacity = grown_capacity;
+    }
+    queue->paths[queue->count++] = path;
+    return 1;
+}
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Reads a file that cannot be mapped, such as a pipe, into a heap buffer. Returns 0 on failure.
+static int rom_read(Rom *rom, int fd) {
+    uint8_t *data = malloc(PROGRAM_MEMORY_SIZE);
+    if (data == NULL) {
+        return 0;
+    }
+    size_t size = 0;
+    while (size < PROGRAM_MEMORY_SIZE) {
+        ssize_t count = read(fd, data + size, PROGRAM_MEMORY_SIZE - size);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            free(data);
+            return 0;
+        }
+        if (count == 0) {
+            break;
+        }
+        size += (size_t)count;
+    }
+    rom->data = data;
+    rom->size = size;
+    rom->owned = 1;
+    return 1;
+}
+
+// Maps a program file, opening it once.
+int rom_map(Rom *rom, const char *path) {
+    memset(rom, 0, sizeof(*rom));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat status;
+    int error = (fstat(fd, &status) != 0) ? errno : S_ISDIR(status.st_mode) ? EISDIR : 0;
+    if (error == 0 && !S_ISREG(status.st_mode)) {
+        error = rom_read(rom, fd) ? 0 : errno;
+        close(fd);
+        errno = error;
+        return error == 0;
+    }
+    if (error != 0) {
+        close(fd);
+        errno = error;
+        return 0;
+    }
+
+    size_t size = (status.st_size > PROGRAM_MEMORY_SIZE) ? PROGRAM_MEMORY_SIZE : (size_t)status.st_size;
+    if (size == 0) {
+        close(fd);
+        return 1;
+    }
+
+    // The mapping keeps the file alive after the descriptor is closed
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    error = errno;
+    close(fd);
+    if (data == MAP_FAILED) {
+        errno = error;
+        return 0;
+    }
+    madvise(data, size, MADV_WILLNEED);
+
+    rom->data = data;
+    rom->size = size;
+    rom->mapped = size;
+    return 1;
+}
+
+// Releases the memory of a Rom.
+void rom_unmap(Rom *rom) {
+    if (rom->mapped) {
+        munmap((void *)rom->data, rom->mapped);
+    } else if (rom->owned) {
+        free((void *)rom->data);
+    }
+    memset(rom, 0, sizeof(*rom));
+}
+
+// Asks the kernel to start reading a file into the page cache without waiting for it.
+void rom_prefetch(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return; // Reported when the ROM is mapped
+    }
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, 0, PROGRAM_MEMORY_SIZE, POSIX_FADV_WILLNEED);
+#endif
+    close(fd);
+}
+
+// Orders paths by name.
+static int rom_compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Adds the regular files of a directory to the queue, sorted by name. Returns 0 on failure.
+static int rom_list_directory(RomQueue *queue, int *capacity, const char *directory) {
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    int first = queue->count;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        size_t length = strlen(directory) + strlen(entry->d_name) + 2;
+        char *path = malloc(length);
+        if (path != NULL) {
+            snprintf(path, length, "%s/%s", directory, entry->d_name);
+        }
+
+        struct stat status;
+        if (path != NULL && (stat(path, &status) != 0 || !S_ISREG(status.st_mode))) {
+            free(path);
+            continue;
+        }
+        if (!rom_queue_add(queue, capacity, path)) {
+            closedir(dir);
+            errno = ENOMEM;
+            return 0;
+        }
+    }
+    closedir(dir);
+
+    // readdir() returns the files in no particular order
+    qsort(queue->paths + first, (size_t)(queue->count - first), sizeof(char *), rom_compare_paths);
+    return 1;
+}
+
+#else
+
+// Windows has no mmap(), the program is read into a heap buffer instead.
+int rom_map(Rom *rom, const char *path) {
+    memset(rom, 0, sizeof(*rom));
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    uint8_t *data = malloc(PROGRAM_MEMORY_SIZE);
+    if (data == NULL) {
+        fclose(file);
+        return 0;
+    }
+    rom->size = fread(data, 1, PROGRAM_MEMORY_SIZE, file);
+    fclose(file);
+    rom->data = data;
+    rom->owned = 1;
+    return 1;
+}
+
+void rom_unmap(Rom *rom) {
+    if (rom->owned) {
+        free((void *)rom->data);
+    }
+    memset(rom, 0, sizeof(*rom));
+}
+
+void rom_prefetch(const char *path) {
+    (void)path;
+}
+
+static int rom_list_directory(RomQueue *queue, int *capacity, const char *directory) {
+    (void)queue;
+    (void)capacity;
+    (void)directory;
+    errno = ENOSYS; // Directories are not expanded on Windows
+    return 0;
+}
+
+#endif
+
+// Loads a mapped program into guest RAM with a single copy.
+void rom_load(Chip8 *chip8, const Rom *rom) {
+    static const uint8_t empty[1];
+    chip8_load_ram(chip8, rom->data ? rom->data : empty, rom->size);
+
+    // The next restore has to put back the RAM under the program
+    if (chip8->snapshot != NULL && rom->size > 0) {
+        size_t capacity = (size_t)chip8->address_mask + 1 - MEMORY_READ_START;
+        chip8_snapshot_touch(chip8->snapshot, MEMORY_READ_START, (uint32_t)(rom->size < capacity ? rom->size : capacity));
+    }
+}
+
+// Lists the ROM files of paths and directories and starts prefetching the first ones.
+int rom_queue_init(RomQueue *queue, char *const *paths, int count) {
+    memset(queue, 0, sizeof(*queue));
+    int capacity = 0;
+
+    for (int i = 0; i < count; i++) {
+        struct stat status;
+        if (stat(paths[i], &status) == 0 && S_ISDIR(status.st_mode)) {
+            if (!rom_list_directory(queue, &capacity, paths[i])) {
+                fprintf(stderr, "Failed to list the ROMs in %s: %s\n", paths[i], strerror(errno));
+                rom_queue_free(queue);
+                return 0;
+            }
+        } else if (!rom_queue_add(queue, &capacity, strdup(paths[i]))) {
+            // Files that cannot be read are reported when they are mapped
+            fprintf(stderr, "Out of memory\n");
+            rom_queue_free(queue);
+            return 0;
+        }
+    }
+
+    for (int i = 0; i < queue->count && i < ROM_PREFETCH_DISTANCE; i++) {
+        rom_prefetch(queue->paths[i]);
+    }
+    return 1;
+}
+
+// Claims and maps the next ROM. Safe to call from several threads.
+int rom_queue_next(RomQueue *queue, Rom *rom) {
+    int index = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+    if (index >= queue->count) {
+        return -1;
+    }
+
+    // Every index is claimed once, so every later ROM is prefetched once
+    if (index + ROM_PREFETCH_DISTANCE < queue->count) {
+        rom_prefetch(queue->paths[index + ROM_PREFETCH_DISTANCE]);
+    }
+    if (!rom_map(rom, queue->paths[index])) {
+        fprintf(stderr, "Failed to open %s: %s\n", queue->paths[index], strerror(errno));
+    }
+    return index;
+}
+
+// Releases the paths of a queue.
+void rom_queue_free(RomQueue *queue) {
+    for (int i = 0; i < queue->count; i++) {
+        free(queue->paths[i]);
+    }
+    free(queue->paths);
+    memset(queue, 0, sizeof(*queue));
+}
@@ -0,0 +1,226 @@
+#include "../include/rom_pack.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// FNV-1a 64-bit parameters.
+#define FNV_OFFSET 0xCBF29CE484222325ull
+#define FNV_PRIME 0x100000001B3ull
+
+// Hashes bytes with 64-bit FNV-1a.
+uint64_t rom_pack_hash(const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+#ifndef _WIN32
+
+// Maps a whole file read-only. Returns NULL on failure.
+static const uint8_t *rom_pack_map(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat status;
+    int error = (fstat(fd, &status) != 0) ? errno : (status.st_size < (off_t)sizeof(RomPackHeader)) ? EINVAL : 0;
+    if (error != 0) {
+        close(fd);
+        errno = error;
+        return NULL;
+    }
+
+    // Programs are read in place, the mapping keeps the file alive after the descriptor is closed
+    void *base = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    error = errno;
+    close(fd);
+    if (base == MAP_FAILED) {
+        errno = error;
+        return NULL;
+    }
+    *size = (size_t)status.st_size;
+    return base;
+}
+
+static void rom_pack_unmap(const uint8_t *base, size_t size) {
+    munmap((void *)base, size);
+}
+
+#else
+
+// Windows has no mmap(), the archive is read into a heap buffer instead.
+static const uint8_t *rom_pack_map(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *base = (length > 0) ? malloc((size_t)length) : NULL;
+    if (base == NULL || fread(base, 1, (size_t)length, file) != (size_t)length) {
+        free(base);
+        fclose(file);
+        errno = EINVAL;
+        return NULL;
+    }
+    fclose(file);
+    *size = (size_t)length;
+    return base;
+}
+
+static void rom_pack_unmap(const uint8_t *base, size_t size) {
+    (void)size;
+    free((void *)base);
+}
+
+#endif
+
+// Tells whether a table of count items of a given size at offset lies within the archive, aligned.
+static int rom_pack_table_fits(size_t archive_size, uint32_t offset, uint32_t count, size_t item_size) {
+    return offset % 8 == 0 && (uint64_t)offset + (uint64_t)count * item_size <= archive_size;
+}
+
+// Maps a ROM pack and checks its header and tables.
+int rom_pack_open(RomPack *pack, const char *path) {
+    memset(pack, 0, sizeof(*pack));
+
+    size_t size = 0;
+    const uint8_t *base = rom_pack_map(path, &size);
+    if (base == NULL) {
+        fprintf(stderr, "Failed to open the ROM pack %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    const RomPackHeader *header = (const RomPackHeader *)base;
+    const char *problem = NULL;
+    if (size < sizeof(RomPackHeader) || memcmp(header->magic, ROM_PACK_MAGIC, sizeof(header->magic)) != 0) {
+        problem = "not a ROM pack";
+    } else if (header->version != ROM_PACK_VERSION) {
+        problem = "unsupported version";
+    } else if (header->byte_order != ROM_PACK_BYTE_ORDER) {
+        problem = "written on a host of the other byte order";
+    } else if (header->size != size || !rom_pack_table_fits(size, header->entries, header->entry_count,
+                                                           sizeof(RomPackEntry)) ||
+               !rom_pack_table_fits(size, header->blobs, header->blob_count, sizeof(RomPackBlob))) {
+        problem = "truncated or corrupt";
+    }
+    if (problem != NULL) {
+        fprintf(stderr, "Failed to open the ROM pack %s: %s\n", path, problem);
+        rom_pack_unmap(base, size);
+        return 0;
+    }
+
+    pack->base = base;
+    pack->size = size;
+    pack->header = header;
+    pack->entries = (const RomPackEntry *)(base + header->entries);
+    pack->blobs = (const RomPackBlob *)(base + header->blobs);
+    return 1;
+}
+
+// Unmaps a ROM pack.
+void rom_pack_close(RomPack *pack) {
+    if (pack->base != NULL) {
+        rom_pack_unmap(pack->base, pack->size);
+    }
+    memset(pack, 0, sizeof(*pack));
+}
+
+// Finds an entry by name with a binary search of the sorted hashes.
+const RomPackEntry *rom_pack_find(const RomPack *pack, const char *name) {
+    uint64_t hash = rom_pack_hash(name, strlen(name));
+
+    // First entry whose hash is not below the one searched for
+    uint32_t low = 0;
+    uint32_t high = pack->header->entry_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (pack->entries[middle].name_hash < hash) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    for (uint32_t i = low; i < pack->header->entry_count && pack->entries[i].name_hash == hash; i++) {
+        const char *entry_name = rom_pack_name(pack, &pack->entries[i]);
+        if (entry_name != NULL && strcmp(entry_name, name) == 0) {
+            return &pack->entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Finds the first entry naming a program by the hash of its content.
+const RomPackEntry *rom_pack_find_hash(const RomPack *pack, uint64_t hash) {
+    uint32_t low = 0;
+    uint32_t high = pack->header->blob_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (pack->blobs[middle].hash < hash) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low == pack->header->blob_count || pack->blobs[low].hash != hash ||
+        pack->blobs[low].entry >= pack->header->entry_count) {
+        return NULL;
+    }
+    return &pack->entries[pack->blobs[low].entry];
+}
+
+// Finds an entry by name or, failing that, by a 16 digit hexadecimal content hash.
+const RomPackEntry *rom_pack_lookup(const RomPack *pack, const char *key) {
+    const RomPackEntry *entry = rom_pack_find(pack, key);
+    if (entry != NULL || strlen(key) != 16 || strspn(key, "0123456789abcdefABCDEF") != 16) {
+        return entry;
+    }
+    return rom_pack_find_hash(pack, strtoull(key, NULL, 16));
+}
+
+// Returns the name of an entry.
+const char *rom_pack_name(const RomPack *pack, const RomPackEntry *entry) {
+    if (entry->name >= pack->size || memchr(pack->base + entry->name, '\0', pack->size - entry->name) == NULL) {
+        return NULL;
+    }
+    return (const char *)(pack->base + entry->name);
+}
+
+// Returns the blob of an entry.
+const RomPackBlob *rom_pack_blob(const RomPack *pack, const RomPackEntry *entry) {
+    if (entry->blob >= pack->header->blob_count) {
+        return NULL;
+    }
+    const RomPackBlob *blob = &pack->blobs[entry->blob];
+    if (blob->size > PROGRAM_MEMORY_SIZE || (uint64_t)blob->offset + blob->size > pack->size) {
+        return NULL;
+    }
+    return blob;
+}
+
+// Points a Rom at the program of an entry, inside the mapping of the pack.
+int rom_pack_rom(const RomPack *pack, const RomPackEntry *entry, Rom *rom) {
+    memset(rom, 0, sizeof(*rom));
+    const RomPackBlob *blob = rom_pack_blob(pack, entry);
+    if (blob == NULL) {
+        return 0;
+    }
+    rom->data = blob->size ? pack->base + blob->offset : NULL;
+    rom->size = blob->size;
+    return 1;
+}
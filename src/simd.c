@@ -0,0 +1,535 @@
+#include "../include/simd.h"
+
+#include <string.h>
+
+// Every x86 kernel is compiled for its own instruction set through the target attribute,
+// whatever the flags of the build.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SIMD_X86
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#define SIMD_TARGET_AVX512 SIMD_TARGET("avx512f,avx512dq,avx512bw")
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+// NEON is part of the AArch64 baseline, nothing to detect
+#include <arm_neon.h>
+#define SIMD_NEON
+#endif
+
+// splitmix64 multipliers, as in simd_mix64().
+#define SIMD_MIX_FIRST 0xBF58476D1CE4E5B9ull
+#define SIMD_MIX_SECOND 0x94D049BB133111EBull
+
+const char *const simd_isa_names[SIMD_ISA_AMOUNT] = { "scalar", "sse2", "avx2", "avx512", "neon" };
+
+// Converts an instruction set name to its SimdIsa value.
+int parse_isa(const char *name) {
+    for (int i = 0; i < SIMD_ISA_AMOUNT; i++) {
+        if (strcmp(name, simd_isa_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Portable kernels, also the reference the others are tested against.
+
+static void simd_expand_scalar(uint32_t *out, const uint64_t *plane0, const uint64_t *plane1, int width, int factor,
+                               const uint32_t *palette) {
+    for (int x = 0; x < width; x++) {
+        int shift = 63 - (x & 63);
+        int state = (int)((plane0[x >> 6] >> shift) & 1) | (int)((plane1[x >> 6] >> shift) & 1) << 1;
+        for (int i = 0; i < factor; i++) {
+            *out++ = palette[state];
+        }
+    }
+}
+
+static int simd_fade_scalar(uint32_t *row, const uint32_t *target, int count, uint32_t keep) {
+    int fading = 0;
+    for (int x = 0; x < count; x++) {
+        uint32_t v = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            uint32_t old = ((row[x] >> shift) & 0xFF) * keep >> 8;
+            uint32_t next = (target[x] >> shift) & 0xFF;
+            v |= ((old > next) ? old : next) << shift;
+        }
+        fading |= v != target[x];
+        row[x] = v;
+    }
+    return fading;
+}
+
+static uint64_t simd_rows_differ_scalar(const DisplayRow *a, const DisplayRow *b, int count) {
+    uint64_t differ = 0;
+    for (int y = 0; y < count; y++) {
+        differ |= (uint64_t)(((a[y].hi ^ b[y].hi) | (a[y].lo ^ b[y].lo)) != 0) << y;
+    }
+    return differ;
+}
+
+// Hashes the bytes from an address on, for the tails the vector kernels leave.
+static uint64_t simd_hash_ram_from(const uint8_t *ram, uint32_t address, uint32_t size) {
+    uint64_t sum = 0;
+    for (; address < size; address++) {
+        sum += simd_mix64((uint64_t)address << 8 | ram[address]);
+    }
+    return sum;
+}
+
+static uint64_t simd_hash_ram_scalar(const uint8_t *ram, uint32_t size) {
+    return simd_hash_ram_from(ram, 0, size);
+}
+
+#ifdef SIMD_X86
+
+// SSE2: four pixels or one display row at a time. The RAM hash needs 64-bit multiplies
+// SSE2 lacks, and stays scalar.
+
+SIMD_TARGET("sse2")
+static void simd_expand_sse2(uint32_t *out, const uint64_t *plane0, const uint64_t *plane1, int width, int factor,
+                             const uint32_t *palette) {
+    // A mask per plane selects between the four colors
+    const __m128i select = _mm_set_epi32(1, 2, 4, 8);
+    const __m128i c0 = _mm_set1_epi32((int)palette[0]);
+    const __m128i c1 = _mm_set1_epi32((int)palette[1]);
+    const __m128i c2 = _mm_set1_epi32((int)palette[2]);
+    const __m128i c3 = _mm_set1_epi32((int)palette[3]);
+
+    for (int x = 0; x < width; x += 4) {
+        int shift = 60 - (x & 63);
+        __m128i n0 = _mm_set1_epi32((int)((plane0[x >> 6] >> shift) & 0xF));
+        __m128i n1 = _mm_set1_epi32((int)((plane1[x >> 6] >> shift) & 0xF));
+        __m128i m0 = _mm_cmpeq_epi32(_mm_and_si128(n0, select), select);
+        __m128i m1 = _mm_cmpeq_epi32(_mm_and_si128(n1, select), select);
+        __m128i low = _mm_or_si128(_mm_andnot_si128(m0, c0), _mm_and_si128(m0, c1));
+        __m128i high = _mm_or_si128(_mm_andnot_si128(m0, c2), _mm_and_si128(m0, c3));
+        __m128i v = _mm_or_si128(_mm_andnot_si128(m1, low), _mm_and_si128(m1, high));
+
+        if (factor == 1) {
+            _mm_storeu_si128((__m128i *)out, v);
+        } else if (factor == 2) {
+            _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi32(v, v));
+            _mm_storeu_si128((__m128i *)(out + 4), _mm_unpackhi_epi32(v, v));
+        } else {
+            _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi32(v, 0x00));
+            _mm_storeu_si128((__m128i *)(out + 4), _mm_shuffle_epi32(v, 0x55));
+            _mm_storeu_si128((__m128i *)(out + 8), _mm_shuffle_epi32(v, 0xAA));
+            _mm_storeu_si128((__m128i *)(out + 12), _mm_shuffle_epi32(v, 0xFF));
+        }
+        out += 4 * factor;
+    }
+}
+
+SIMD_TARGET("sse2")
+static int simd_fade_sse2(uint32_t *row, const uint32_t *target, int count, uint32_t keep) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i scale = _mm_set1_epi16((short)keep);
+    int fading = 0;
+
+    for (int x = 0; x < count; x += 4) {
+        __m128i old = _mm_loadu_si128((const __m128i *)(row + x));
+        __m128i next = _mm_loadu_si128((const __m128i *)(target + x));
+        __m128i low = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(old, zero), scale), 8);
+        __m128i high = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(old, zero), scale), 8);
+        __m128i v = _mm_max_epu8(next, _mm_packus_epi16(low, high));
+        _mm_storeu_si128((__m128i *)(row + x), v);
+        fading |= _mm_movemask_epi8(_mm_cmpeq_epi8(v, next)) != 0xFFFF;
+    }
+    return fading;
+}
+
+SIMD_TARGET("sse2")
+static uint64_t simd_rows_differ_sse2(const DisplayRow *a, const DisplayRow *b, int count) {
+    uint64_t differ = 0;
+    for (int y = 0; y < count; y++) {
+        __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&a[y]), _mm_loadu_si128((const __m128i *)&b[y]));
+        differ |= (uint64_t)(_mm_movemask_epi8(equal) != 0xFFFF) << y;
+    }
+    return differ;
+}
+
+// AVX2: eight pixels or two display rows at a time.
+
+SIMD_TARGET("avx2")
+static void simd_expand_avx2(uint32_t *out, const uint64_t *plane0, const uint64_t *plane1, int width, int factor,
+                             const uint32_t *palette) {
+    // Lanes from which each output lane takes its pixel when pixels are repeated
+    static const int32_t spread[3][8] = {
+        { 0, 0, 1, 1, 2, 2, 3, 3 },
+        { 0, 0, 0, 0, 1, 1, 1, 1 },
+        { 2, 2, 2, 2, 3, 3, 3, 3 },
+    };
+    const __m256i select = _mm256_set_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i c0 = _mm256_set1_epi32((int)palette[0]);
+    const __m256i c1 = _mm256_set1_epi32((int)palette[1]);
+    const __m256i c2 = _mm256_set1_epi32((int)palette[2]);
+    const __m256i c3 = _mm256_set1_epi32((int)palette[3]);
+    const __m256i pairs = _mm256_loadu_si256((const __m256i *)spread[0]);
+    const __m256i quads = _mm256_loadu_si256((const __m256i *)spread[1]);
+    const __m256i next_quads = _mm256_loadu_si256((const __m256i *)spread[2]);
+    const __m256i four = _mm256_set1_epi32(4);
+
+    for (int x = 0; x < width; x += 8) {
+        int shift = 56 - (x & 63);
+        __m256i n0 = _mm256_set1_epi32((int)((plane0[x >> 6] >> shift) & 0xFF));
+        __m256i n1 = _mm256_set1_epi32((int)((plane1[x >> 6] >> shift) & 0xFF));
+        __m256i m0 = _mm256_cmpeq_epi32(_mm256_and_si256(n0, select), select);
+        __m256i m1 = _mm256_cmpeq_epi32(_mm256_and_si256(n1, select), select);
+        __m256i low = _mm256_blendv_epi8(c0, c1, m0);
+        __m256i high = _mm256_blendv_epi8(c2, c3, m0);
+        __m256i v = _mm256_blendv_epi8(low, high, m1);
+
+        if (factor == 1) {
+            _mm256_storeu_si256((__m256i *)out, v);
+        } else if (factor == 2) {
+            _mm256_storeu_si256((__m256i *)out, _mm256_permutevar8x32_epi32(v, pairs));
+            _mm256_storeu_si256((__m256i *)(out + 8), _mm256_permutevar8x32_epi32(v, _mm256_add_epi32(pairs, four)));
+        } else {
+            _mm256_storeu_si256((__m256i *)out, _mm256_permutevar8x32_epi32(v, quads));
+            _mm256_storeu_si256((__m256i *)(out + 8), _mm256_permutevar8x32_epi32(v, next_quads));
+            _mm256_storeu_si256((__m256i *)(out + 16), _mm256_permutevar8x32_epi32(v, _mm256_add_epi32(quads, four)));
+            _mm256_storeu_si256((__m256i *)(out + 24),
+                                _mm256_permutevar8x32_epi32(v, _mm256_add_epi32(next_quads, four)));
+        }
+        out += 8 * factor;
+    }
+}
+
+SIMD_TARGET("avx2")
+static int simd_fade_avx2(uint32_t *row, const uint32_t *target, int count, uint32_t keep) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i scale = _mm256_set1_epi16((short)keep);
+    int fading = 0;
+
+    // Unpacking and packing both work within 128-bit lanes, so the pixels stay in place
+    for (int x = 0; x < count; x += 8) {
+        __m256i old = _mm256_loadu_si256((const __m256i *)(row + x));
+        __m256i next = _mm256_loadu_si256((const __m256i *)(target + x));
+        __m256i low = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(old, zero), scale), 8);
+        __m256i high = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(old, zero), scale), 8);
+        __m256i v = _mm256_max_epu8(next, _mm256_packus_epi16(low, high));
+        _mm256_storeu_si256((__m256i *)(row + x), v);
+        fading |= _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, next)) != -1;
+    }
+    return fading;
+}
+
+SIMD_TARGET("avx2")
+static uint64_t simd_rows_differ_avx2(const DisplayRow *a, const DisplayRow *b, int count) {
+    uint64_t differ = 0;
+    for (int y = 0; y < count; y += 2) {
+        __m256i equal = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)&a[y]),
+                                          _mm256_loadu_si256((const __m256i *)&b[y]));
+        uint32_t same = (uint32_t)_mm256_movemask_epi8(equal);
+        differ |= (uint64_t)((same & 0xFFFF) != 0xFFFF) << y | (uint64_t)((same >> 16) != 0xFFFF) << (y + 1);
+    }
+    return differ;
+}
+
+// Low 64 bits of the products of 64-bit lanes, from the 32-bit multiplies AVX2 has.
+SIMD_TARGET("avx2")
+static inline __m256i simd_mullo_epi64_avx2(__m256i a, __m256i b, __m256i b_high) {
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, b_high));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+SIMD_TARGET("avx2")
+static uint64_t simd_hash_ram_avx2(const uint8_t *ram, uint32_t size) {
+    const __m256i first = _mm256_set1_epi64x((long long)SIMD_MIX_FIRST);
+    const __m256i first_high = _mm256_set1_epi64x((long long)(SIMD_MIX_FIRST >> 32));
+    const __m256i second = _mm256_set1_epi64x((long long)SIMD_MIX_SECOND);
+    const __m256i second_high = _mm256_set1_epi64x((long long)(SIMD_MIX_SECOND >> 32));
+    const __m256i step = _mm256_set1_epi64x(4 << 8);
+    __m256i addresses = _mm256_set_epi64x(3 << 8, 2 << 8, 1 << 8, 0);
+    __m256i sums = _mm256_setzero_si256();
+
+    uint32_t address = 0;
+    for (; address + 4 <= size; address += 4) {
+        int32_t bytes;
+        memcpy(&bytes, ram + address, sizeof(bytes));
+        __m256i x = _mm256_or_si256(addresses, _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bytes)));
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 30));
+        x = simd_mullo_epi64_avx2(x, first, first_high);
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 27));
+        x = simd_mullo_epi64_avx2(x, second, second_high);
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 31));
+        sums = _mm256_add_epi64(sums, x);
+        addresses = _mm256_add_epi64(addresses, step);
+    }
+
+    __m128i pair = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, pair);
+    return lanes[0] + lanes[1] + simd_hash_ram_from(ram, address, size);
+}
+
+// AVX-512: sixteen pixels or four display rows at a time.
+
+SIMD_TARGET_AVX512
+static void simd_expand_avx512(uint32_t *out, const uint64_t *plane0, const uint64_t *plane1, int width, int factor,
+                               const uint32_t *palette) {
+    // Lanes from which each output lane takes its pixel when pixels are repeated
+    static const int32_t spread[2][16] = {
+        { 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7 },
+        { 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3 },
+    };
+    const __m512i select = _mm512_set_epi32(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384,
+                                            32768);
+    const __m512i c0 = _mm512_set1_epi32((int)palette[0]);
+    const __m512i c1 = _mm512_set1_epi32((int)palette[1]);
+    const __m512i c2 = _mm512_set1_epi32((int)palette[2]);
+    const __m512i c3 = _mm512_set1_epi32((int)palette[3]);
+    const __m512i pairs = _mm512_loadu_si512(spread[0]);
+    const __m512i quads = _mm512_loadu_si512(spread[1]);
+
+    for (int x = 0; x < width; x += 16) {
+        int shift = 48 - (x & 63);
+        __mmask16 m0 = _mm512_test_epi32_mask(_mm512_set1_epi32((int)((plane0[x >> 6] >> shift) & 0xFFFF)), select);
+        __mmask16 m1 = _mm512_test_epi32_mask(_mm512_set1_epi32((int)((plane1[x >> 6] >> shift) & 0xFFFF)), select);
+        __m512i low = _mm512_mask_blend_epi32(m0, c0, c1);
+        __m512i high = _mm512_mask_blend_epi32(m0, c2, c3);
+        __m512i v = _mm512_mask_blend_epi32(m1, low, high);
+
+        if (factor == 1) {
+            _mm512_storeu_si512(out, v);
+        } else if (factor == 2) {
+            _mm512_storeu_si512(out, _mm512_permutexvar_epi32(pairs, v));
+            _mm512_storeu_si512(out + 16, _mm512_permutexvar_epi32(_mm512_add_epi32(pairs, _mm512_set1_epi32(8)), v));
+        } else {
+            for (int part = 0; part < 4; part++) {
+                __m512i lanes = _mm512_add_epi32(quads, _mm512_set1_epi32(4 * part));
+                _mm512_storeu_si512(out + 16 * part, _mm512_permutexvar_epi32(lanes, v));
+            }
+        }
+        out += 16 * factor;
+    }
+}
+
+SIMD_TARGET_AVX512
+static int simd_fade_avx512(uint32_t *row, const uint32_t *target, int count, uint32_t keep) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i scale = _mm512_set1_epi16((short)keep);
+    int fading = 0;
+
+    for (int x = 0; x < count; x += 16) {
+        __m512i old = _mm512_loadu_si512(row + x);
+        __m512i next = _mm512_loadu_si512(target + x);
+        __m512i low = _mm512_srli_epi16(_mm512_mullo_epi16(_mm512_unpacklo_epi8(old, zero), scale), 8);
+        __m512i high = _mm512_srli_epi16(_mm512_mullo_epi16(_mm512_unpackhi_epi8(old, zero), scale), 8);
+        __m512i v = _mm512_max_epu8(next, _mm512_packus_epi16(low, high));
+        _mm512_storeu_si512(row + x, v);
+        fading |= _mm512_cmpneq_epu8_mask(v, next) != 0;
+    }
+    return fading;
+}
+
+SIMD_TARGET_AVX512
+static uint64_t simd_rows_differ_avx512(const DisplayRow *a, const DisplayRow *b, int count) {
+    uint64_t differ = 0;
+    for (int y = 0; y < count; y += 4) {
+        // Two words per row: fold each pair of mask bits into one bit per row
+        unsigned words = _mm512_cmpneq_epi64_mask(_mm512_loadu_si512(&a[y]), _mm512_loadu_si512(&b[y]));
+        unsigned rows = words | words >> 1;
+        rows = (rows & 1) | (rows >> 1 & 2) | (rows >> 2 & 4) | (rows >> 3 & 8);
+        differ |= (uint64_t)rows << y;
+    }
+    return differ;
+}
+
+SIMD_TARGET_AVX512
+static uint64_t simd_hash_ram_avx512(const uint8_t *ram, uint32_t size) {
+    const __m512i first = _mm512_set1_epi64((long long)SIMD_MIX_FIRST);
+    const __m512i second = _mm512_set1_epi64((long long)SIMD_MIX_SECOND);
+    const __m512i step = _mm512_set1_epi64(8 << 8);
+    __m512i addresses = _mm512_set_epi64(7 << 8, 6 << 8, 5 << 8, 4 << 8, 3 << 8, 2 << 8, 1 << 8, 0);
+    __m512i sums = _mm512_setzero_si512();
+
+    uint32_t address = 0;
+    for (; address + 8 <= size; address += 8) {
+        __m512i x = _mm512_or_si512(addresses, _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i *)(ram + address))));
+        x = _mm512_xor_si512(x, _mm512_srli_epi64(x, 30));
+        x = _mm512_mullo_epi64(x, first);
+        x = _mm512_xor_si512(x, _mm512_srli_epi64(x, 27));
+        x = _mm512_mullo_epi64(x, second);
+        x = _mm512_xor_si512(x, _mm512_srli_epi64(x, 31));
+        sums = _mm512_add_epi64(sums, x);
+        addresses = _mm512_add_epi64(addresses, step);
+    }
+
+    // Summed as unsigned: _mm512_reduce_add_epi64() adds signed lanes, whose overflow is undefined
+    uint64_t lanes[8];
+    _mm512_storeu_si512((__m512i *)lanes, sums);
+    uint64_t sum = simd_hash_ram_from(ram, address, size);
+    for (int i = 0; i < 8; i++) {
+        sum += lanes[i];
+    }
+    return sum;
+}
+
+// Tells whether the host runs an instruction set, the operating system saving its registers included.
+static int simd_host_has(SimdIsa isa) {
+    __builtin_cpu_init();
+    switch (isa) {
+        case SIMD_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case SIMD_AVX2:
+            return __builtin_cpu_supports("avx2");
+        case SIMD_AVX512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+                   __builtin_cpu_supports("avx512bw");
+        default:
+            return isa == SIMD_SCALAR;
+    }
+}
+
+#elif defined(SIMD_NEON)
+
+// NEON: four pixels or one display row at a time. Without 64-bit multiplies
+// to spare, the RAM hash stays scalar.
+
+static void simd_expand_neon(uint32_t *out, const uint64_t *plane0, const uint64_t *plane1, int width, int factor,
+                             const uint32_t *palette) {
+    static const uint32_t lanes[4] = { 8, 4, 2, 1 };
+    const uint32x4_t select = vld1q_u32(lanes);
+    const uint32x4_t c0 = vdupq_n_u32(palette[0]);
+    const uint32x4_t c1 = vdupq_n_u32(palette[1]);
+    const uint32x4_t c2 = vdupq_n_u32(palette[2]);
+    const uint32x4_t c3 = vdupq_n_u32(palette[3]);
+
+    for (int x = 0; x < width; x += 4) {
+        int shift = 60 - (x & 63);
+        uint32x4_t n0 = vdupq_n_u32((uint32_t)((plane0[x >> 6] >> shift) & 0xF));
+        uint32x4_t n1 = vdupq_n_u32((uint32_t)((plane1[x >> 6] >> shift) & 0xF));
+        uint32x4_t m0 = vceqq_u32(vandq_u32(n0, select), select);
+        uint32x4_t m1 = vceqq_u32(vandq_u32(n1, select), select);
+        uint32x4_t v = vbslq_u32(m1, vbslq_u32(m0, c3, c2), vbslq_u32(m0, c1, c0));
+
+        if (factor == 1) {
+            vst1q_u32(out, v);
+        } else if (factor == 2) {
+            uint32x4x2_t pairs = vzipq_u32(v, v);
+            vst1q_u32(out, pairs.val[0]);
+            vst1q_u32(out + 4, pairs.val[1]);
+        } else {
+            vst1q_u32(out, vdupq_n_u32(vgetq_lane_u32(v, 0)));
+            vst1q_u32(out + 4, vdupq_n_u32(vgetq_lane_u32(v, 1)));
+            vst1q_u32(out + 8, vdupq_n_u32(vgetq_lane_u32(v, 2)));
+            vst1q_u32(out + 12, vdupq_n_u32(vgetq_lane_u32(v, 3)));
+        }
+        out += 4 * factor;
+    }
+}
+
+static int simd_fade_neon(uint32_t *row, const uint32_t *target, int count, uint32_t keep) {
+    int fading = 0;
+    for (int x = 0; x < count; x += 4) {
+        uint8x16_t old = vreinterpretq_u8_u32(vld1q_u32(row + x));
+        uint8x16_t next = vreinterpretq_u8_u32(vld1q_u32(target + x));
+        uint16x8_t low = vmulq_n_u16(vmovl_u8(vget_low_u8(old)), (uint16_t)keep);
+        uint16x8_t high = vmulq_n_u16(vmovl_u8(vget_high_u8(old)), (uint16_t)keep);
+        uint8x16_t v = vmaxq_u8(next, vcombine_u8(vshrn_n_u16(low, 8), vshrn_n_u16(high, 8)));
+        vst1q_u32(row + x, vreinterpretq_u32_u8(v));
+        fading |= vmaxvq_u8(veorq_u8(v, next)) != 0;
+    }
+    return fading;
+}
+
+static uint64_t simd_rows_differ_neon(const DisplayRow *a, const DisplayRow *b, int count) {
+    uint64_t differ = 0;
+    for (int y = 0; y < count; y++) {
+        uint8x16_t equal = vceqq_u8(vld1q_u8((const uint8_t *)&a[y]), vld1q_u8((const uint8_t *)&b[y]));
+        differ |= (uint64_t)(vminvq_u8(equal) != 0xFF) << y;
+    }
+    return differ;
+}
+
+static int simd_host_has(SimdIsa isa) {
+    return isa == SIMD_SCALAR || isa == SIMD_NEON;
+}
+
+#else
+
+static int simd_host_has(SimdIsa isa) {
+    return isa == SIMD_SCALAR;
+}
+
+#endif
+
+/**
+ * The kernels built for one instruction set.
+ */
+typedef struct {
+    void (*expand)(uint32_t *out, const uint64_t *plane0, const uint64_t *plane1, int width, int factor,
+                   const uint32_t *palette);
+    int (*fade)(uint32_t *row, const uint32_t *target, int count, uint32_t keep);
+    uint64_t (*rows_differ)(const DisplayRow *a, const DisplayRow *b, int count);
+    uint64_t (*hash_ram)(const uint8_t *ram, uint32_t size);
+} SimdKernels;
+
+// Kernels of each instruction set, empty for those not built.
+static const SimdKernels simd_kernels[SIMD_ISA_AMOUNT] = {
+    [SIMD_SCALAR] = { simd_expand_scalar, simd_fade_scalar, simd_rows_differ_scalar, simd_hash_ram_scalar },
+#ifdef SIMD_X86
+    [SIMD_SSE2] = { simd_expand_sse2, simd_fade_sse2, simd_rows_differ_sse2, simd_hash_ram_scalar },
+    [SIMD_AVX2] = { simd_expand_avx2, simd_fade_avx2, simd_rows_differ_avx2, simd_hash_ram_avx2 },
+    [SIMD_AVX512] = { simd_expand_avx512, simd_fade_avx512, simd_rows_differ_avx512, simd_hash_ram_avx512 },
+#endif
+#ifdef SIMD_NEON
+    [SIMD_NEON] = { simd_expand_neon, simd_fade_neon, simd_rows_differ_neon, simd_hash_ram_scalar },
+#endif
+};
+
+// Instruction set whose kernels run, -1 until the first use.
+static int simd_active = -1;
+
+// Tells whether the kernels of an instruction set are built in and the host can run them.
+int simd_supported(SimdIsa isa) {
+    return (unsigned)isa < SIMD_ISA_AMOUNT && simd_kernels[isa].expand != NULL && simd_host_has(isa);
+}
+
+// Selects the kernels of an instruction set instead of the best one.
+int simd_force(SimdIsa isa) {
+    if (!simd_supported(isa)) {
+        return 0;
+    }
+    __atomic_store_n(&simd_active, (int)isa, __ATOMIC_RELAXED);
+    return 1;
+}
+
+// Returns the instruction set whose kernels run, selecting the widest supported one on first use.
+SimdIsa simd_isa(void) {
+    int isa = __atomic_load_n(&simd_active, __ATOMIC_RELAXED);
+    if (isa < 0) {
+        // Threads racing here all pick the same one
+        isa = SIMD_SCALAR;
+        for (int i = SIMD_ISA_AMOUNT - 1; i > SIMD_SCALAR; i--) {
+            if (simd_supported((SimdIsa)i)) {
+                isa = i;
+                break;
+            }
+        }
+        __atomic_store_n(&simd_active, isa, __ATOMIC_RELAXED);
+    }
+    return (SimdIsa)isa;
+}
+
+// Expands pixels of two bitplanes into ARGB pixels.
+void simd_expand(uint32_t *out, const uint64_t *plane0, const uint64_t *plane1, int width, int factor,
+                 const uint32_t *palette) {
+    simd_kernels[simd_isa()].expand(out, plane0, plane1, width, factor, palette);
+}
+
+// Blends ARGB pixels into the current ones with phosphor decay.
+int simd_fade(uint32_t *row, const uint32_t *target, int count, uint32_t keep) {
+    return simd_kernels[simd_isa()].fade(row, target, count, keep);
+}
+
+// Compares two snapshots of display rows.
+uint64_t simd_rows_differ(const DisplayRow *a, const DisplayRow *b, int count) {
+    return simd_kernels[simd_isa()].rows_differ(a, b, count);
+}
+
+// Sums the mixed address and value of every byte of a RAM image.
+uint64_t simd_hash_ram(const uint8_t *ram, uint32_t size) {
+    return simd_kernels[simd_isa()].hash_ram(ram, size);
+}
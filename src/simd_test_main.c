@@ -0,0 +1,166 @@
+#include "../include/simd.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Fails the current test with the condition that did not hold.
+#define CHECK(condition)                                                                  \
+    do {                                                                                  \
+        if (!(condition)) {                                                               \
+            fprintf(stderr, "%s:%d: %s\n", __func__, __LINE__, #condition);               \
+            return 0;                                                                     \
+        }                                                                                 \
+    } while (0)
+
+#define TEST_ROUNDS 64          // Random inputs per kernel and size
+#define TEST_MAX_WIDTH 128      // Widest display row the kernels are given
+#define TEST_MAX_FACTOR 4
+#define TEST_MAX_ROWS 64
+
+// Instruction set under test, compared with the scalar kernels.
+static SimdIsa testedIsa;
+
+// State of the random inputs, reseeded by every test so that each ISA sees the same ones.
+static uint64_t randomState;
+
+// Draws the next random input (xorshift64).
+static uint64_t nextRandom(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return randomState;
+}
+
+// Expanding bitplanes gives the same pixels at every width and factor.
+static int testExpand(void) {
+    static const uint32_t palette[4] = { 0xFF000000, 0xFFFF8000, 0xFF0080FF, 0xFFFFFFFF };
+    uint32_t expected[TEST_MAX_WIDTH * TEST_MAX_FACTOR];
+    uint32_t actual[TEST_MAX_WIDTH * TEST_MAX_FACTOR];
+    randomState = 1;
+
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+        uint64_t plane0[2] = { nextRandom(), nextRandom() };
+        uint64_t plane1[2] = { nextRandom(), nextRandom() };
+        for (int width = 16; width <= TEST_MAX_WIDTH; width += 16) {
+            for (int factor = 1; factor <= TEST_MAX_FACTOR; factor *= 2) {
+                size_t size = (size_t)width * factor * sizeof(uint32_t);
+                simd_force(SIMD_SCALAR);
+                simd_expand(expected, plane0, plane1, width, factor, palette);
+                simd_force(testedIsa);
+                simd_expand(actual, plane0, plane1, width, factor, palette);
+                CHECK(memcmp(actual, expected, size) == 0);
+            }
+        }
+    }
+    return 1;
+}
+
+// Fading gives the same pixels and the same answer to whether some pixel still fades.
+static int testFade(void) {
+    static const uint32_t keeps[] = { 0, 1, 128, 230, 255, 256 };
+    uint32_t pixels[TEST_MAX_WIDTH];
+    uint32_t target[TEST_MAX_WIDTH];
+    uint32_t expected[TEST_MAX_WIDTH];
+    uint32_t actual[TEST_MAX_WIDTH];
+    randomState = 2;
+
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+        for (int x = 0; x < TEST_MAX_WIDTH; x++) {
+            pixels[x] = (uint32_t)nextRandom();
+            // Some pixels already equal their new value, most are brighter or darker than it
+            uint64_t draw = nextRandom();
+            target[x] = (draw & 3) == 0 ? pixels[x] : (uint32_t)(draw >> 32) & ((draw & 4) ? 0xFFFFFFFF : 0x3F3F3F3F);
+        }
+        for (size_t k = 0; k < sizeof(keeps) / sizeof(keeps[0]); k++) {
+            for (int count = 16; count <= TEST_MAX_WIDTH; count += 16) {
+                memcpy(expected, pixels, sizeof(pixels));
+                memcpy(actual, pixels, sizeof(pixels));
+                simd_force(SIMD_SCALAR);
+                int expected_fading = simd_fade(expected, target, count, keeps[k]);
+                simd_force(testedIsa);
+                CHECK(simd_fade(actual, target, count, keeps[k]) == expected_fading);
+                CHECK(memcmp(actual, expected, sizeof(actual)) == 0);
+            }
+        }
+    }
+    return 1;
+}
+
+// Comparing display rows finds the same changed rows at every row count.
+static int testRowsDiffer(void) {
+    DisplayRow a[TEST_MAX_ROWS];
+    DisplayRow b[TEST_MAX_ROWS];
+    randomState = 3;
+
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+        for (int y = 0; y < TEST_MAX_ROWS; y++) {
+            a[y].hi = nextRandom();
+            a[y].lo = nextRandom();
+            b[y] = a[y];
+            // A quarter of the rows change, in either half
+            uint64_t draw = nextRandom();
+            if ((draw & 3) == 0) {
+                uint64_t bit = 1ull << ((draw >> 8) & 63);
+                if (draw & 4) {
+                    b[y].hi ^= bit;
+                } else {
+                    b[y].lo ^= bit;
+                }
+            }
+        }
+        for (int count = 4; count <= TEST_MAX_ROWS; count += 4) {
+            simd_force(SIMD_SCALAR);
+            uint64_t expected = simd_rows_differ(a, b, count);
+            simd_force(testedIsa);
+            CHECK(simd_rows_differ(a, b, count) == expected);
+        }
+    }
+    return 1;
+}
+
+// Hashing RAM gives the same sum for both address spaces and for sizes that leave a tail.
+static int testHashRam(void) {
+    static const uint32_t sizes[] = { 1, 7, 63, 65, 4095, 4096, 65535, 65536 };
+    static uint8_t ram[65536];
+    randomState = 4;
+
+    for (int round = 0; round < 4; round++) {
+        for (size_t i = 0; i < sizeof(ram); i++) {
+            ram[i] = (uint8_t)nextRandom();
+        }
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            simd_force(SIMD_SCALAR);
+            uint64_t expected = simd_hash_ram(ram, sizes[s]);
+            simd_force(testedIsa);
+            CHECK(simd_hash_ram(ram, sizes[s]) == expected);
+        }
+    }
+    return 1;
+}
+
+static const struct {
+    const char *name;
+    int (*run)(void);
+} tests[] = {
+    { "expand", testExpand },
+    { "fade", testFade },
+    { "rows differ", testRowsDiffer },
+    { "hash ram", testHashRam },
+};
+
+int main(void) {
+    int failed = 0;
+    for (int isa = SIMD_SCALAR + 1; isa < SIMD_ISA_AMOUNT; isa++) {
+        if (!simd_supported((SimdIsa)isa)) {
+            printf("skip %s\n", simd_isa_names[isa]);
+            continue;
+        }
+        testedIsa = (SimdIsa)isa;
+        for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+            int passed = tests[i].run();
+            printf("%s %s %s\n", passed ? "ok" : "FAIL", simd_isa_names[isa], tests[i].name);
+            failed += !passed;
+        }
+    }
+    return failed ? 1 : 0;
+}
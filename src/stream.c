@@ -0,0 +1,297 @@
+#include "../include/stream.h"
+#include "../include/net.h"
+#include "../include/simd.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Viewers that disconnected must not kill the emulator with SIGPIPE.
+#ifdef MSG_NOSIGNAL
+#define STREAM_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define STREAM_SEND_FLAGS 0
+#endif
+#endif
+
+// Bytes of one row in a resolution.
+static int stream_row_bytes(uint8_t hires) {
+    return hires ? DISPLAY_HIRES_WIDTH / 8 : DISPLAY_WIDTH / 8;
+}
+
+// Writes a little-endian 32-bit value.
+static void stream_put_u32(uint8_t *out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+// Reads a little-endian 32-bit value.
+static uint32_t stream_get_u32(const uint8_t *in) {
+    return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+// Starts a message, returning where its row entries go.
+static uint8_t *stream_begin(uint8_t *message, uint8_t type, uint8_t hires, uint32_t sequence, uint32_t frame) {
+    message[0] = type;
+    message[1] = hires;
+    message[2] = 0;
+    message[3] = 0;
+    stream_put_u32(message + 4, sequence);
+    stream_put_u32(message + 8, frame);
+    return message + STREAM_HEADER_SIZE;
+}
+
+// Appends the row entry of one row, big-endian so that the leftmost pixel comes first.
+static uint8_t *stream_put_row(uint8_t *message, uint8_t *out, int plane, int y, DisplayRow row, uint8_t hires) {
+    *out++ = (uint8_t)(plane * DISPLAY_HIRES_HEIGHT + y);
+    for (int i = 0; i < stream_row_bytes(hires); i++) {
+        uint64_t word = (i < 8) ? row.hi : row.lo;
+        *out++ = (uint8_t)(word >> (56 - 8 * (i & 7)));
+    }
+    message[2]++;
+    return out;
+}
+
+// Encodes every row of the display as the keyframe of this frame.
+static void stream_encode_keyframe(StreamServer *server, uint32_t frame) {
+    uint8_t *out = stream_begin(server->keyframe, STREAM_KEYFRAME, server->hires, server->sequence, frame);
+    int height = server->hires ? DISPLAY_HIRES_HEIGHT : DISPLAY_HEIGHT;
+
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        for (int y = 0; y < height; y++) {
+            out = stream_put_row(server->keyframe, out, plane, y, server->display[plane][y], server->hires);
+        }
+    }
+    server->keyframe_size = (int)(out - server->keyframe);
+}
+
+// Takes the display of the frame, encoding the rows that changed as the delta of this frame.
+// Returns 1 if the resolution changed, in which case the keyframe is encoded instead.
+static int stream_encode_delta(StreamServer *server, const Chip8 *chip8, uint32_t frame) {
+    int height = chip8->hires ? DISPLAY_HIRES_HEIGHT : DISPLAY_HEIGHT;
+    uint8_t *out = stream_begin(server->delta, STREAM_DELTA, chip8->hires, server->sequence + 1, frame);
+
+    server->delta_size = 0;
+    server->keyframe_size = 0;
+    if (chip8->hires != server->hires) {
+        // Rows of another size: every viewer needs a keyframe
+        memcpy(server->display, chip8->display, sizeof(server->display));
+        server->hires = chip8->hires;
+        server->sequence++;
+        stream_encode_keyframe(server, frame);
+        return 1;
+    }
+
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        uint64_t changed = simd_rows_differ(chip8->display[plane], server->display[plane], height);
+        for (int y = 0; y < height; y++) {
+            if (changed >> y & 1) {
+                out = stream_put_row(server->delta, out, plane, y, chip8->display[plane][y], chip8->hires);
+                server->display[plane][y] = chip8->display[plane][y];
+            }
+        }
+    }
+    if (server->delta[2] > 0) {
+        server->sequence++;
+        server->delta_size = (int)(out - server->delta);
+    }
+    return 0;
+}
+
+#ifndef _WIN32
+
+// Closes the connection to a viewer.
+static void stream_drop_viewer(StreamViewer *viewer) {
+    close(viewer->fd);
+    viewer->fd = -1;
+}
+
+// Sends as much of the pending message as the socket takes. Returns 0 if the viewer is gone.
+static int stream_flush(StreamViewer *viewer) {
+    while (viewer->pending_start < viewer->pending_end) {
+        ssize_t sent = send(viewer->fd, viewer->pending + viewer->pending_start,
+                            (size_t)(viewer->pending_end - viewer->pending_start), STREAM_SEND_FLAGS);
+        if (sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        viewer->pending_start += (int)sent;
+    }
+    return 1;
+}
+
+// Queues a message for a viewer whose previous message has been sent in full.
+static int stream_send(StreamViewer *viewer, const uint8_t *message, int size) {
+    memcpy(viewer->pending, message, (size_t)size);
+    viewer->pending_start = 0;
+    viewer->pending_end = size;
+    return stream_flush(viewer);
+}
+
+// Accepts the viewers waiting to connect.
+static void stream_accept(StreamServer *server) {
+    static const uint8_t hello[5] = { 'C', '8', 'S', 'P', STREAM_VERSION };
+
+    for (;;) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+
+        StreamViewer *viewer = NULL;
+        for (int i = 0; i < STREAM_MAX_VIEWERS && viewer == NULL; i++) {
+            if (server->viewers[i].fd < 0) {
+                viewer = &server->viewers[i];
+            }
+        }
+        if (viewer == NULL) {
+            close(fd); // Full
+            continue;
+        }
+
+        // A small send buffer keeps a slow viewer a few frames behind, not seconds
+        int one = 1;
+        int buffer = STREAM_SOCKET_BUFFER;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Fails harmlessly on Unix sockets
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+        viewer->fd = fd;
+        viewer->need_keyframe = 1;
+        if (!stream_send(viewer, hello, sizeof(hello))) {
+            stream_drop_viewer(viewer);
+        }
+    }
+}
+
+// Starts listening for viewers.
+int stream_open(StreamServer *server, const char *address) {
+    memset(server, 0, sizeof(*server));
+    for (int i = 0; i < STREAM_MAX_VIEWERS; i++) {
+        server->viewers[i].fd = -1;
+    }
+
+    server->listen_fd = net_listen(address, STREAM_MAX_VIEWERS);
+    if (server->listen_fd < 0) {
+        return 0;
+    }
+    fcntl(server->listen_fd, F_SETFL, fcntl(server->listen_fd, F_GETFL) | O_NONBLOCK);
+    printf("Streaming the display on %s\n", address);
+    return 1;
+}
+
+// Accepts new viewers and sends them the display at the end of a frame.
+void stream_push_frame(StreamServer *server, const Chip8 *chip8, uint32_t frame) {
+    stream_accept(server);
+    int resized = stream_encode_delta(server, chip8, frame);
+
+    for (int i = 0; i < STREAM_MAX_VIEWERS; i++) {
+        StreamViewer *viewer = &server->viewers[i];
+        if (viewer->fd < 0) {
+            continue;
+        }
+        if (!stream_flush(viewer)) {
+            stream_drop_viewer(viewer);
+            continue;
+        }
+        if (viewer->pending_start < viewer->pending_end) {
+            // Still sending an older message: skip this one, and catch up with a keyframe later
+            viewer->need_keyframe |= resized || server->delta_size > 0;
+            continue;
+        }
+
+        int sent = 1;
+        if (viewer->need_keyframe || resized) {
+            if (server->keyframe_size == 0) {
+                stream_encode_keyframe(server, frame);
+            }
+            sent = stream_send(viewer, server->keyframe, server->keyframe_size);
+            viewer->need_keyframe = 0;
+        } else if (server->delta_size > 0) {
+            sent = stream_send(viewer, server->delta, server->delta_size);
+        }
+        if (!sent) {
+            stream_drop_viewer(viewer);
+        }
+    }
+}
+
+// Disconnects every viewer and stops listening.
+void stream_close(StreamServer *server) {
+    for (int i = 0; i < STREAM_MAX_VIEWERS; i++) {
+        if (server->viewers[i].fd >= 0) {
+            stream_drop_viewer(&server->viewers[i]);
+        }
+    }
+    if (server->listen_fd >= 0) {
+        close(server->listen_fd);
+        server->listen_fd = -1;
+    }
+}
+
+#else
+
+// The server is built on POSIX sockets.
+int stream_open(StreamServer *server, const char *address) {
+    memset(server, 0, sizeof(*server));
+    server->listen_fd = -1;
+    return net_listen(address, STREAM_MAX_VIEWERS) >= 0;
+}
+
+void stream_push_frame(StreamServer *server, const Chip8 *chip8, uint32_t frame) {
+    (void)server;
+    (void)chip8;
+    (void)frame;
+}
+
+void stream_close(StreamServer *server) {
+    (void)server;
+}
+
+#endif
+
+// Reads a message header from its wire format.
+void stream_decode_header(const uint8_t *bytes, StreamHeader *header) {
+    header->type = bytes[0];
+    header->hires = bytes[1];
+    header->count = bytes[2];
+    header->reserved = bytes[3];
+    header->sequence = stream_get_u32(bytes + 4);
+    header->frame = stream_get_u32(bytes + 8);
+}
+
+// Returns the number of bytes of row entries following a header.
+int stream_rows_size(const StreamHeader *header) {
+    return header->count * (1 + stream_row_bytes(header->hires));
+}
+
+// Writes the row entries of a message into the display of an instance.
+int stream_apply_rows(Chip8 *chip8, const StreamHeader *header, const uint8_t *rows) {
+    int height = header->hires ? DISPLAY_HIRES_HEIGHT : DISPLAY_HEIGHT;
+
+    if (header->type == STREAM_KEYFRAME) {
+        memset(chip8->display, 0, sizeof(chip8->display));
+        chip8->hires = header->hires ? 1 : 0;
+    }
+
+    for (int entry = 0; entry < header->count; entry++) {
+        int plane = rows[0] / DISPLAY_HIRES_HEIGHT;
+        int y = rows[0] % DISPLAY_HIRES_HEIGHT;
+        if (plane >= DISPLAY_PLANES || y >= height) {
+            return 0;
+        }
+        rows++;
+
+        DisplayRow row = { 0, 0 };
+        for (int i = 0; i < stream_row_bytes(header->hires); i++) {
+            uint64_t *word = (i < 8) ? &row.hi : &row.lo;
+            *word |= (uint64_t)*rows++ << (56 - 8 * (i & 7));
+        }
+        chip8->display[plane][y] = row;
+    }
+    chip8->display_changed = 1;
+    return 1;
+}
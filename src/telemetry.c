@@ -0,0 +1,242 @@
+#include "../include/telemetry.h"
+#include "../include/net.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+#define TELEMETRY_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define TELEMETRY_SEND_FLAGS 0
+#endif
+#endif
+
+#define TELEMETRY_RESPONSE_SIZE 8192
+
+// Resets the counters and starts the first frame.
+void telemetry_init(Telemetry *telemetry) {
+    memset(telemetry, 0, sizeof(*telemetry));
+    telemetry->frequency = SDL_GetPerformanceFrequency();
+    telemetry->frame_start = telemetry_now();
+    telemetry->window_start = telemetry->frame_start;
+    telemetry->listen_fd = -1;
+    latency_init(&telemetry->latency, telemetry->frequency);
+    for (int i = 0; i < TELEMETRY_MAX_CLIENTS; i++) {
+        telemetry->clients[i].fd = -1;
+    }
+}
+
+// Milliseconds per frame of a number of ticks spread over frames.
+static double telemetry_ms_per_frame(const Telemetry *telemetry, uint64_t ticks, uint64_t frames) {
+    return frames ? (double)ticks * 1000.0 / (double)telemetry->frequency / (double)frames : 0.0;
+}
+
+// Computes the rates of the second that just ended and starts the next one.
+static void telemetry_roll_window(Telemetry *telemetry, uint64_t now) {
+    double seconds = (double)(now - telemetry->window_start) / (double)telemetry->frequency;
+    uint64_t frames = telemetry->frames - telemetry->window_frames;
+
+    telemetry->instructions_per_second = (double)(telemetry->instructions - telemetry->window_instructions) / seconds;
+    telemetry->frames_per_second = (double)frames / seconds;
+    telemetry->emulation_ms_per_frame =
+        telemetry_ms_per_frame(telemetry, telemetry->emulation_ticks - telemetry->window_emulation_ticks, frames);
+    telemetry->render_ms_per_frame =
+        telemetry_ms_per_frame(telemetry, telemetry->render_ticks - telemetry->window_render_ticks, frames);
+    telemetry->input_ms_per_frame =
+        telemetry_ms_per_frame(telemetry, telemetry->input_ticks - telemetry->window_input_ticks, frames);
+
+    telemetry->window_start = now;
+    telemetry->window_instructions = telemetry->instructions;
+    telemetry->window_frames = telemetry->frames;
+    telemetry->window_emulation_ticks = telemetry->emulation_ticks;
+    telemetry->window_render_ticks = telemetry->render_ticks;
+    telemetry->window_input_ticks = telemetry->input_ticks;
+}
+
+// Writes the counters in the Prometheus text exposition format.
+size_t telemetry_format(const Telemetry *telemetry, char *buffer, size_t size) {
+    double frequency = (double)telemetry->frequency;
+    int length = snprintf(buffer, size,
+        "# HELP chip8_instructions_total Instructions executed.\n"
+        "# TYPE chip8_instructions_total counter\n"
+        "chip8_instructions_total %llu\n"
+        "# HELP chip8_frames_total 60 Hz frames completed.\n"
+        "# TYPE chip8_frames_total counter\n"
+        "chip8_frames_total %llu\n"
+        "# HELP chip8_late_frames_total Frames that took over 1.5 frame periods.\n"
+        "# TYPE chip8_late_frames_total counter\n"
+        "chip8_late_frames_total %llu\n"
+        "# HELP chip8_dropped_frames_total Frame periods lost by late frames.\n"
+        "# TYPE chip8_dropped_frames_total counter\n"
+        "chip8_dropped_frames_total %llu\n"
+        "# HELP chip8_seconds_total Host time spent per activity.\n"
+        "# TYPE chip8_seconds_total counter\n"
+        "chip8_seconds_total{activity=\"emulation\"} %.6f\n"
+        "chip8_seconds_total{activity=\"render\"} %.6f\n"
+        "chip8_seconds_total{activity=\"input\"} %.6f\n"
+        "# HELP chip8_instructions_per_second Instructions executed in the last second.\n"
+        "# TYPE chip8_instructions_per_second gauge\n"
+        "chip8_instructions_per_second %.1f\n"
+        "# HELP chip8_frames_per_second Frames completed in the last second.\n"
+        "# TYPE chip8_frames_per_second gauge\n"
+        "chip8_frames_per_second %.2f\n"
+        "# HELP chip8_seconds_per_frame Host time per frame and activity in the last second.\n"
+        "# TYPE chip8_seconds_per_frame gauge\n"
+        "chip8_seconds_per_frame{activity=\"emulation\"} %.6f\n"
+        "chip8_seconds_per_frame{activity=\"render\"} %.6f\n"
+        "chip8_seconds_per_frame{activity=\"input\"} %.6f\n",
+        (unsigned long long)telemetry->instructions, (unsigned long long)telemetry->frames,
+        (unsigned long long)telemetry->late_frames, (unsigned long long)telemetry->dropped_frames,
+        (double)telemetry->emulation_ticks / frequency, (double)telemetry->render_ticks / frequency,
+        (double)telemetry->input_ticks / frequency,
+        telemetry->instructions_per_second, telemetry->frames_per_second,
+        telemetry->emulation_ms_per_frame / 1000.0, telemetry->render_ms_per_frame / 1000.0,
+        telemetry->input_ms_per_frame / 1000.0);
+
+    if (length < 0) {
+        return 0;
+    }
+    if ((size_t)length >= size) {
+        return size - 1;
+    }
+    return (size_t)length + latency_format(&telemetry->latency, buffer + length, size - (size_t)length);
+}
+
+// Writes the rates as short lines for the window overlay.
+void telemetry_format_overlay(const Telemetry *telemetry, char *buffer) {
+    snprintf(buffer, TELEMETRY_OVERLAY_SIZE,
+             "IPS %.0f\nFPS %.1f\nEMU %.2f MS\nREN %.2f MS\nINP %.2f MS\nLATE %llu DROP %llu",
+             telemetry->instructions_per_second, telemetry->frames_per_second,
+             telemetry->emulation_ms_per_frame, telemetry->render_ms_per_frame, telemetry->input_ms_per_frame,
+             (unsigned long long)telemetry->late_frames, (unsigned long long)telemetry->dropped_frames);
+}
+
+#ifndef _WIN32
+
+// Opens the stats socket.
+int telemetry_listen(Telemetry *telemetry, const char *address) {
+    telemetry->listen_fd = net_listen(address, TELEMETRY_MAX_CLIENTS);
+    if (telemetry->listen_fd < 0) {
+        return 0;
+    }
+    fcntl(telemetry->listen_fd, F_SETFL, fcntl(telemetry->listen_fd, F_GETFL) | O_NONBLOCK);
+    printf("Serving stats on %s\n", address);
+    return 1;
+}
+
+// Sends the counters to a client, as an HTTP response if it sent an HTTP request.
+static void telemetry_answer(const Telemetry *telemetry, int fd) {
+    static char response[TELEMETRY_RESPONSE_SIZE];
+    char request[1024];
+    size_t length = 0;
+
+    // Read the whole request: closing with unread data would reset the connection
+    ssize_t received = recv(fd, request, sizeof(request), MSG_DONTWAIT);
+    if (received >= 4 && memcmp(request, "GET ", 4) == 0) {
+        length = (size_t)snprintf(response, sizeof(response),
+                                  "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n");
+    }
+    length += telemetry_format(telemetry, response + length, sizeof(response) - length);
+
+    // A fresh socket takes a few kilobytes without blocking
+    if (send(fd, response, length, MSG_DONTWAIT | TELEMETRY_SEND_FLAGS) < 0) {
+        perror("Failed to send stats");
+    }
+    close(fd);
+}
+
+// Accepts stats clients and answers those whose request arrived or that waited long enough.
+static void telemetry_serve(Telemetry *telemetry, uint64_t now) {
+    int fd;
+    while ((fd = accept(telemetry->listen_fd, NULL, NULL)) >= 0) {
+        int slot = 0;
+        while (slot < TELEMETRY_MAX_CLIENTS && telemetry->clients[slot].fd >= 0) {
+            slot++;
+        }
+        if (slot == TELEMETRY_MAX_CLIENTS) {
+            close(fd); // Busy
+            continue;
+        }
+        telemetry->clients[slot].fd = fd;
+        telemetry->clients[slot].accepted = now;
+    }
+
+    for (int i = 0; i < TELEMETRY_MAX_CLIENTS; i++) {
+        TelemetryClient *client = &telemetry->clients[i];
+        if (client->fd < 0) {
+            continue;
+        }
+
+        // Clients that send nothing, e.g. socat or nc, are answered after two frames
+        char byte;
+        int waited = now - client->accepted >= 2 * telemetry->frequency / 60;
+        if (waited || recv(client->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) >= 0) {
+            telemetry_answer(telemetry, client->fd);
+            client->fd = -1;
+        }
+    }
+}
+
+// Disconnects pending clients and closes the stats socket.
+void telemetry_close(Telemetry *telemetry) {
+    for (int i = 0; i < TELEMETRY_MAX_CLIENTS; i++) {
+        if (telemetry->clients[i].fd >= 0) {
+            close(telemetry->clients[i].fd);
+            telemetry->clients[i].fd = -1;
+        }
+    }
+    if (telemetry->listen_fd >= 0) {
+        close(telemetry->listen_fd);
+        telemetry->listen_fd = -1;
+    }
+}
+
+#else
+
+// The stats socket is built on POSIX sockets.
+int telemetry_listen(Telemetry *telemetry, const char *address) {
+    (void)telemetry;
+    return net_listen(address, TELEMETRY_MAX_CLIENTS) >= 0;
+}
+
+static void telemetry_serve(Telemetry *telemetry, uint64_t now) {
+    (void)telemetry;
+    (void)now;
+}
+
+void telemetry_close(Telemetry *telemetry) {
+    (void)telemetry;
+}
+
+#endif
+
+// Ends frames, updating the frame timing and rates and answering stats clients.
+void telemetry_end_frames(Telemetry *telemetry, uint32_t frames, uint8_t paced) {
+    uint64_t now = telemetry_now();
+    uint64_t elapsed = now - telemetry->frame_start;
+    uint64_t period = telemetry->frequency / 60;
+
+    telemetry->frames += frames;
+    if (!paced) {
+        telemetry->emulation_ticks += elapsed;
+    } else if (frames == 1 && elapsed * 2 > period * 3) {
+        telemetry->late_frames++;
+        telemetry->dropped_frames += elapsed / period - 1;
+    }
+    telemetry->frame_start = now;
+
+    if (now - telemetry->window_start >= telemetry->frequency) {
+        telemetry_roll_window(telemetry, now);
+    }
+
+    // Unthrottled runs end frames far more often than clients need answers
+    if (telemetry->listen_fd >= 0 && now - telemetry->last_poll >= period) {
+        telemetry_serve(telemetry, now);
+        telemetry->last_poll = now;
+    }
+}
@@ -0,0 +1,181 @@
+#include "../include/trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint8_t trace_enabled = 0;
+
+static const char *trace_path;          // File written when the trace is closed
+static uint64_t trace_start;            // Performance counter when the trace was opened
+static SDL_TLSID trace_tls;             // TraceBuffer of each thread
+static void *trace_buffers;             // Every TraceBuffer, pushed with compare-and-swap
+
+// Starts recording a trace of the calling thread and every thread that records events.
+int trace_open(const char *path) {
+    trace_tls = SDL_TLSCreate();
+    if (trace_tls == 0) {
+        fprintf(stderr, "Failed to create the trace buffers: %s\n", SDL_GetError());
+        return 0;
+    }
+    trace_path = path;
+    trace_start = SDL_GetPerformanceCounter();
+    trace_enabled = 1;
+    trace_thread_name("main");
+    return 1;
+}
+
+// Returns the buffer of the calling thread, creating it on its first event.
+static TraceBuffer *trace_buffer(void) {
+    TraceBuffer *buffer = (TraceBuffer *)SDL_TLSGet(trace_tls);
+    if (buffer != NULL) {
+        return buffer;
+    }
+
+    buffer = (TraceBuffer *)calloc(1, sizeof(*buffer));
+    if (buffer == NULL) {
+        return NULL;
+    }
+    buffer->thread_id = SDL_ThreadID();
+    SDL_TLSSet(trace_tls, buffer, NULL);
+
+    // Other threads may register at the same time
+    do {
+        buffer->next = (TraceBuffer *)trace_buffers;
+    } while (!SDL_AtomicCASPtr(&trace_buffers, buffer->next, buffer));
+    return buffer;
+}
+
+// Appends an event, growing the buffer as needed. Returns its index, -1 if it was dropped.
+static int32_t trace_append(TraceBuffer *buffer, const char *name, uint8_t instant) {
+    if (buffer->count == buffer->capacity) {
+        uint32_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        TraceEvent *events = (buffer->capacity < TRACE_MAX_EVENTS)
+                                 ? (TraceEvent *)realloc(buffer->events, capacity * sizeof(TraceEvent))
+                                 : NULL;
+        if (events == NULL) {
+            buffer->dropped++;
+            return -1;
+        }
+        buffer->events = events;
+        buffer->capacity = capacity;
+    }
+
+    TraceEvent *event = &buffer->events[buffer->count];
+    event->name = name;
+    event->begin = SDL_GetPerformanceCounter();
+    event->end = instant ? event->begin : 0;
+    event->instant = instant;
+    return (int32_t)buffer->count++;
+}
+
+// Names the calling thread in the trace.
+void trace_thread_name(const char *name) {
+    TraceBuffer *buffer = trace_enabled ? trace_buffer() : NULL;
+    if (buffer != NULL) {
+        buffer->thread_name = name;
+    }
+}
+
+// Records the beginning of a span on the calling thread.
+void trace_record_begin(const char *name) {
+    TraceBuffer *buffer = trace_buffer();
+    if (buffer == NULL || buffer->depth == TRACE_MAX_DEPTH) {
+        return;
+    }
+    buffer->open[buffer->depth++] = trace_append(buffer, name, 0);
+}
+
+// Records the end of the innermost open span of the calling thread.
+void trace_record_end(void) {
+    TraceBuffer *buffer = trace_buffer();
+    if (buffer == NULL || buffer->depth == 0) {
+        return;
+    }
+    int32_t index = buffer->open[--buffer->depth];
+    if (index >= 0) {
+        buffer->events[index].end = SDL_GetPerformanceCounter();
+    }
+}
+
+// Records an instant on the calling thread.
+void trace_record_instant(const char *name) {
+    TraceBuffer *buffer = trace_buffer();
+    if (buffer != NULL) {
+        trace_append(buffer, name, 1);
+    }
+}
+
+// Converts a performance counter value to microseconds since the trace was opened.
+static double trace_microseconds(uint64_t time, uint64_t frequency) {
+    return (double)(time - trace_start) * 1e6 / (double)frequency;
+}
+
+// Writes the events of one thread, returning the number written.
+static uint64_t trace_write_buffer(FILE *file, const TraceBuffer *buffer, uint64_t now, uint64_t written) {
+    uint64_t frequency = SDL_GetPerformanceFrequency();
+
+    fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+            written ? ",\n" : "", buffer->thread_id, buffer->thread_name ? buffer->thread_name : "thread");
+    written++;
+
+    for (uint32_t i = 0; i < buffer->count; i++) {
+        const TraceEvent *event = &buffer->events[i];
+        double begin = trace_microseconds(event->begin, frequency);
+        if (event->instant) {
+            fprintf(file, ",\n{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f}",
+                    event->name, buffer->thread_id, begin);
+        } else {
+            // Spans still open when the trace closes end with it
+            double end = trace_microseconds(event->end ? event->end : now, frequency);
+            fprintf(file, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}",
+                    event->name, buffer->thread_id, begin, end - begin);
+        }
+        written++;
+    }
+    return written;
+}
+
+// Writes the trace and stops recording.
+int trace_close(void) {
+    if (!trace_enabled) {
+        return 1;
+    }
+    trace_enabled = 0;
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    FILE *file = fopen(trace_path, "w");
+    if (file == NULL) {
+        perror("Failed to write the trace");
+    }
+
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    if (file != NULL) {
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    }
+    TraceBuffer *buffer = (TraceBuffer *)trace_buffers;
+    while (buffer != NULL) {
+        TraceBuffer *next = buffer->next;
+        if (file != NULL) {
+            written = trace_write_buffer(file, buffer, now, written);
+        }
+        dropped += buffer->dropped;
+        free(buffer->events);
+        free(buffer);
+        buffer = next;
+    }
+    trace_buffers = NULL;
+
+    if (file == NULL) {
+        return 0;
+    }
+    fprintf(file, "\n]}\n");
+    int ok = fclose(file) == 0;
+    printf("Wrote %llu trace events to %s", (unsigned long long)written, trace_path);
+    if (dropped) {
+        printf(", %llu dropped", (unsigned long long)dropped);
+    }
+    printf("\n");
+    return ok;
+}
@@ -1,4 +1,5 @@
 #include "../include/utils.h"
+#include "../include/simd.h"
 #include <stdio.h>
 
 /**
@@ -11,6 +12,33 @@ void print_launch_options(const Arguments *args) {
     printf("User Interface: %s\n", args->ui);
     printf("Data Type: %s\n", args->type);
     printf("Data Path/Bytes: %s\n", args->data);
+    printf("Platform: %s\n", args->platform);
+    printf("Quirks: %s\n", args->quirks);
+    if (strstr(args->ui, "window") != NULL) {
+        printf("Filter: %s%s\n", args->filter, args->phosphor ? " with phosphor decay" : "");
+    }
+    printf("Vector Kernels: %s%s\n", simd_isa_names[simd_isa()], args->isa ? " (forced)" : "");
+    if (args->frames) {
+        printf("Frames: %lu\n", args->frames);
+    }
+    if (args->gdb) {
+        printf("GDB: %s\n", args->gdb);
+    }
+    if (args->watch) {
+        printf("Watch: %s\n", args->watch);
+    }
+    if (args->record) {
+        printf("Record: %s\n", args->record);
+    }
+    if (args->stream) {
+        printf("Stream: %s\n", args->stream);
+    }
+    if (args->stats) {
+        printf("Stats: %s\n", args->stats);
+    }
+    if (args->trace) {
+        printf("Trace: %s\n", args->trace);
+    }
 }
 
 /**
@@ -0,0 +1,148 @@
+#include "../include/stream.h"
+#include "../include/net.h"
+#include "../include/display.h"
+
+#include <getopt.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static void printUsage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [--ui <terminal>/<window>] <port>/<host:port>/<socket path>\n", program_name);
+}
+
+/**
+ * @brief Reads exactly a number of bytes from a socket.
+ *
+ * @param fd Socket to read from.
+ * @param buffer Receives the bytes.
+ * @param size Number of bytes to read.
+ * @return 1 on success, 0 if the server went away.
+ */
+static int readFully(int fd, uint8_t *buffer, int size) {
+    while (size > 0) {
+        ssize_t received = read(fd, buffer, (size_t)size);
+        if (received <= 0) {
+            return 0;
+        }
+        buffer += received;
+        size -= (int)received;
+    }
+    return 1;
+}
+
+/**
+ * @brief Waits until the server sent something, handling window events meanwhile.
+ *
+ * @param fd Socket connected to the server.
+ * @param window 1 when rendering to an SDL window.
+ * @return 1 once data is available, 0 if the window was closed.
+ */
+static int waitForMessage(int fd, int window) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    for (;;) {
+        SDL_Event e;
+        while (window && SDL_PollEvent(&e) != 0) {
+            if (e.type == SDL_QUIT) {
+                return 0;
+            }
+        }
+        if (poll(&pfd, 1, window ? 16 : -1) != 0) {
+            return 1; // Data, hang-up or error: the read tells them apart
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *ui = "terminal";
+
+    static struct option long_options[] = {
+        {"ui", required_argument, 0, 'u'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "u:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'u':
+                ui = optarg;
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc - 1 || (strcmp(ui, "terminal") != 0 && strcmp(ui, "window") != 0)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    int fd = net_connect(argv[optind]);
+    if (fd < 0) {
+        return 1;
+    }
+    int buffer = STREAM_SOCKET_BUFFER;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+
+    uint8_t hello[5];
+    if (!readFully(fd, hello, sizeof(hello)) || memcmp(hello, STREAM_MAGIC, 4) != 0 || hello[4] != STREAM_VERSION) {
+        fprintf(stderr, "%s is not a CHIP-8 display stream\n", argv[optind]);
+        close(fd);
+        return 1;
+    }
+
+    // Only the display of the instance is used
+    static Chip8 chip8;
+    static uint8_t rows[STREAM_MESSAGE_MAX];
+    Display display;
+    int window = strcmp(ui, "window") == 0;
+    if (window) {
+        initSDL();
+        display = createDisplay();
+    }
+
+    uint8_t bytes[STREAM_HEADER_SIZE];
+    StreamHeader header;
+    uint32_t sequence = 0;
+    uint8_t synced = 0;
+    int status = 0;
+    while (waitForMessage(fd, window) && readFully(fd, bytes, sizeof(bytes))) {
+        stream_decode_header(bytes, &header);
+        if (header.type != STREAM_KEYFRAME && header.type != STREAM_DELTA) {
+            status = 1;
+            break;
+        }
+        if (!readFully(fd, rows, stream_rows_size(&header))) {
+            break; // Server stopped in the middle of a message
+        }
+
+        // A delta only applies on top of the version before it, wait for a keyframe otherwise
+        if (header.type == STREAM_DELTA && (!synced || header.sequence != sequence + 1)) {
+            synced = 0;
+            continue;
+        }
+        if (!stream_apply_rows(&chip8, &header, rows)) {
+            status = 1;
+            break;
+        }
+        sequence = header.sequence;
+        synced = 1;
+
+        if (window) {
+            show_sdl_display(&display, &chip8);
+        } else {
+            show_terminal_display(&chip8);
+        }
+    }
+
+    if (window) {
+        removeDisplay(&display);
+    }
+    close(fd);
+
+    if (status) {
+        fprintf(stderr, "Malformed message from %s\n", argv[optind]);
+    }
+    return status;
+}